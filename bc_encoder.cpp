@@ -0,0 +1,770 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define BC_ENCODER_SSE
+#include <emmintrin.h>
+#endif
+
+#include "bc_encoder.h"
+#include "cpu_mips.h"
+#include "jobs.h"
+#include "memory.h"
+#include "texture_file.h"
+
+// ============================================================================
+// Block fitting
+// ============================================================================
+
+#define BC_POWER_ITERATIONS 8
+
+// 4x4 texels, one array per channel so 4 texels fit an SSE register
+struct BlockTexels {
+    f32 c[4][16];
+};
+
+// BC7 index weights, in 64ths
+static const u32 bc7Weights4[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64,
+};
+
+static void loadBlock(const u8* rgba, u32 width, u32 height, u32 bx, u32 by,
+                      BlockTexels* block)
+{
+    for (u32 y = 0; y < 4; y++) {
+        u32 sy = MIN(4 * by + y, height - 1);
+        for (u32 x = 0; x < 4; x++) {
+            u32 sx          = MIN(4 * bx + x, width - 1);
+            const u8* texel = rgba + 4 * ((u64)sy * width + sx);
+            for (u32 c = 0; c < 4; c++) block->c[c][4 * y + x] = texel[c];
+        }
+    }
+}
+
+/// @brief Endpoints at the ends of the block's principal axis
+static void fitAxis(const BlockTexels* block, u32 channels, f32* e0, f32* e1)
+{
+    f32 mean[4] = {};
+    for (u32 c = 0; c < channels; c++) {
+        for (u32 i = 0; i < 16; i++) mean[c] += block->c[c][i];
+        mean[c] /= 16.0f;
+    }
+
+    f32 cov[4][4] = {};
+    for (u32 i = 0; i < 16; i++) {
+        for (u32 a = 0; a < channels; a++) {
+            for (u32 b = a; b < channels; b++) {
+                cov[a][b] += (block->c[a][i] - mean[a])
+                             * (block->c[b][i] - mean[b]);
+            }
+        }
+    }
+    for (u32 a = 0; a < channels; a++)
+        for (u32 b = 0; b < a; b++) cov[a][b] = cov[b][a];
+
+    // power iteration, seeded with the covariance column of the channel
+    // that varies most. Not the bounding box diagonal: it has no negative
+    // components, so for anti-correlated channels (red against green
+    // halves) cov * diagonal is zero and the axis would stay perpendicular
+    // to the real one. Should an iteration collapse anyway, the next most
+    // varying channel seeds another try
+    f32 axis[4]  = {};
+    bool used[4] = {};
+    for (u32 attempt = 0; attempt < channels; attempt++) {
+        u32 seed = channels;
+        for (u32 c = 0; c < channels; c++) {
+            if (!used[c] && (seed == channels || cov[c][c] > cov[seed][seed]))
+                seed = c;
+        }
+        used[seed] = true;
+        if (cov[seed][seed] < 1e-6f) break; // flat block
+
+        for (u32 c = 0; c < channels; c++) axis[c] = cov[c][seed];
+        bool collapsed = false;
+        for (u32 iter = 0; iter < BC_POWER_ITERATIONS; iter++) {
+            f32 next[4] = {}, length = 0.0f;
+            for (u32 a = 0; a < channels; a++) {
+                for (u32 b = 0; b < channels; b++)
+                    next[a] += cov[a][b] * axis[b];
+                length = MAX(length, fabsf(next[a]));
+            }
+            if (length < 1e-6f) {
+                collapsed = true;
+                break;
+            }
+            for (u32 c = 0; c < channels; c++) axis[c] = next[c] / length;
+        }
+        if (!collapsed) break;
+        memset(axis, 0, sizeof(axis));
+    }
+
+    f32 length2 = 0.0f;
+    for (u32 c = 0; c < channels; c++) length2 += axis[c] * axis[c];
+    if (length2 < 1e-12f) {
+        for (u32 c = 0; c < channels; c++) e0[c] = e1[c] = mean[c];
+        return;
+    }
+
+    f32 tMin = 1e30f, tMax = -1e30f;
+    for (u32 i = 0; i < 16; i++) {
+        f32 t = 0.0f;
+        for (u32 c = 0; c < channels; c++)
+            t += (block->c[c][i] - mean[c]) * axis[c];
+        tMin = MIN(tMin, t);
+        tMax = MAX(tMax, t);
+    }
+    for (u32 c = 0; c < channels; c++) {
+        e0[c] = CLAMP(mean[c] + axis[c] * tMin / length2, 0.0f, 255.0f);
+        e1[c] = CLAMP(mean[c] + axis[c] * tMax / length2, 0.0f, 255.0f);
+    }
+}
+
+/// @brief Nearest of levels evenly spaced steps from e0 to e1, by projecting
+/// every texel onto the endpoint line
+static void selectLevels(const BlockTexels* block, u32 channels,
+                         const f32* e0, const f32* e1, u32 levels,
+                         u32 out[16])
+{
+    f32 dir[4] = {}, length2 = 0.0f;
+    for (u32 c = 0; c < channels; c++) {
+        dir[c] = e1[c] - e0[c];
+        length2 += dir[c] * dir[c];
+    }
+    if (length2 < 1e-6f) {
+        memset(out, 0, sizeof(u32) * 16);
+        return;
+    }
+    f32 scale = (levels - 1) / length2;
+    f32 last  = (f32)(levels - 1);
+
+#ifdef BC_ENCODER_SSE
+    for (u32 i = 0; i < 16; i += 4) {
+        __m128 t = _mm_setzero_ps();
+        for (u32 c = 0; c < channels; c++) {
+            __m128 d = _mm_sub_ps(_mm_loadu_ps(block->c[c] + i),
+                                  _mm_set1_ps(e0[c]));
+            d        = _mm_mul_ps(d, _mm_set1_ps(dir[c] * scale));
+            t        = _mm_add_ps(t, d);
+        }
+        t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(last));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_cvtps_epi32(t)); // rounds
+    }
+#else
+    for (u32 i = 0; i < 16; i++) {
+        f32 t = 0.0f;
+        for (u32 c = 0; c < channels; c++)
+            t += (block->c[c][i] - e0[c]) * dir[c] * scale;
+        out[i] = (u32)(CLAMP(t, 0.0f, last) + 0.5f);
+    }
+#endif
+}
+
+/// @brief Least squares endpoints for fixed weights (of e1, per texel).
+/// False if the weights don't pin down two endpoints
+static bool refitEndpoints(const BlockTexels* block, u32 channels,
+                           const f32 weights[16], f32* e0, f32* e1)
+{
+    f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    f32 ax[4] = {}, bx[4] = {};
+    for (u32 i = 0; i < 16; i++) {
+        f32 b = weights[i], a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (u32 c = 0; c < channels; c++) {
+            ax[c] += a * block->c[c][i];
+            bx[c] += b * block->c[c][i];
+        }
+    }
+    f32 det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return false;
+
+    for (u32 c = 0; c < channels; c++) {
+        e0[c] = CLAMP((bb * ax[c] - ab * bx[c]) / det, 0.0f, 255.0f);
+        e1[c] = CLAMP((aa * bx[c] - ab * ax[c]) / det, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+// ============================================================================
+// BC1
+// ============================================================================
+
+static u16 pack565(const f32* color)
+{
+    u32 r = (u32)(color[0] * 31.0f / 255.0f + 0.5f);
+    u32 g = (u32)(color[1] * 63.0f / 255.0f + 0.5f);
+    u32 b = (u32)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void unpack565(u16 packed, u32* color)
+{
+    u32 r    = (packed >> 11) & 31;
+    u32 g    = (packed >> 5) & 63;
+    u32 b    = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// 4 color palette as the decoder builds it, in level order (c0, 1/3, 2/3, c1)
+static void bc1Palette(u16 c0, u16 c1, u32 palette[4][3])
+{
+    u32 a[3], b[3];
+    unpack565(c0, a);
+    unpack565(c1, b);
+    for (u32 c = 0; c < 3; c++) {
+        palette[0][c] = a[c];
+        palette[1][c] = (2 * a[c] + b[c]) / 3;
+        palette[2][c] = (a[c] + 2 * b[c]) / 3;
+        palette[3][c] = b[c];
+    }
+}
+
+struct BC1Fit {
+    u16 c0, c1;
+    u32 levels[16];
+    f32 error;
+};
+
+static void bc1Evaluate(const BlockTexels* block, const f32* e0,
+                        const f32* e1, BC1Fit* fit)
+{
+    fit->c0 = pack565(e0);
+    fit->c1 = pack565(e1);
+
+    u32 palette[4][3];
+    bc1Palette(fit->c0, fit->c1, palette);
+    f32 q0[3], q1[3];
+    for (u32 c = 0; c < 3; c++) {
+        q0[c] = (f32)palette[0][c];
+        q1[c] = (f32)palette[3][c];
+    }
+    selectLevels(block, 3, q0, q1, 4, fit->levels);
+
+    fit->error = 0.0f;
+    for (u32 i = 0; i < 16; i++) {
+        for (u32 c = 0; c < 3; c++) {
+            f32 d = block->c[c][i] - palette[fit->levels[i]][c];
+            fit->error += d * d;
+        }
+    }
+}
+
+static void encodeBC1(const BlockTexels* block, u8* out)
+{
+    f32 e0[4], e1[4];
+    fitAxis(block, 3, e0, e1);
+
+    BC1Fit best = {};
+    bc1Evaluate(block, e0, e1, &best);
+    if (best.error > 0.0f) {
+        f32 weights[16];
+        for (u32 i = 0; i < 16; i++) weights[i] = best.levels[i] / 3.0f;
+        if (refitEndpoints(block, 3, weights, e0, e1)) {
+            BC1Fit refit = {};
+            bc1Evaluate(block, e0, e1, &refit);
+            if (refit.error < best.error) best = refit;
+        }
+    }
+
+    // c0 > c1 selects 4 color mode; equal endpoints decode index 0 as c0
+    // either way
+    u16 c0 = best.c0, c1 = best.c1;
+    bool swap = c0 < c1;
+    if (swap) {
+        c0 = best.c1;
+        c1 = best.c0;
+    }
+
+    static const u32 levelToIndex[4] = { 0, 2, 3, 1 };
+    u32 indices = 0;
+    for (u32 i = 0; i < 16; i++) {
+        u32 level = swap ? 3 - best.levels[i] : best.levels[i];
+        if (c0 == c1) level = 0;
+        indices |= levelToIndex[level] << (2 * i);
+    }
+
+    out[0] = (u8)(c0 & 0xFF);
+    out[1] = (u8)(c0 >> 8);
+    out[2] = (u8)(c1 & 0xFF);
+    out[3] = (u8)(c1 >> 8);
+    memcpy(out + 4, &indices, sizeof(indices));
+}
+
+static void decodeBC1(const u8* in, u8 texels[16][4])
+{
+    u16 c0 = (u16)(in[0] | (in[1] << 8));
+    u16 c1 = (u16)(in[2] | (in[3] << 8));
+    u32 indices;
+    memcpy(&indices, in + 4, sizeof(indices));
+
+    u32 a[3], b[3], palette[4][4];
+    unpack565(c0, a);
+    unpack565(c1, b);
+    for (u32 c = 0; c < 3; c++) {
+        palette[0][c] = a[c];
+        palette[1][c] = b[c];
+        if (c0 > c1) {
+            palette[2][c] = (2 * a[c] + b[c]) / 3;
+            palette[3][c] = (a[c] + 2 * b[c]) / 3;
+        } else {
+            palette[2][c] = (a[c] + b[c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = c0 > c1 ? 255 : 0;
+
+    for (u32 i = 0; i < 16; i++) {
+        u32 index = (indices >> (2 * i)) & 3;
+        for (u32 c = 0; c < 4; c++) texels[i][c] = (u8)palette[index][c];
+    }
+}
+
+// ============================================================================
+// BC4
+// ============================================================================
+
+static void encodeBC4(const BlockTexels* block, u32 channel, u8* out)
+{
+    const f32* values = block->c[channel];
+    f32 lo = values[0], hi = values[0];
+    for (u32 i = 1; i < 16; i++) {
+        lo = MIN(lo, values[i]);
+        hi = MAX(hi, values[i]);
+    }
+
+    // a0 > a1: 8 levels from a1 to a0. Equal endpoints decode index 0 as a0
+    u8 a0 = (u8)(hi + 0.5f), a1 = (u8)(lo + 0.5f);
+    u64 indices = 0;
+    if (a0 != a1) {
+        // select on one channel, endpoints as a 1 channel line
+        BlockTexels line = {};
+        memcpy(line.c[0], values, sizeof(line.c[0]));
+        f32 e0 = a1, e1 = a0;
+        u32 levels[16];
+        selectLevels(&line, 1, &e0, &e1, 8, levels);
+
+        // level 7 is a0 (index 0), 0 is a1 (index 1), between count down
+        for (u32 i = 0; i < 16; i++) {
+            u32 level = levels[i];
+            u64 index = level == 7 ? 0 : level == 0 ? 1 : 8 - level;
+            indices |= index << (3 * i);
+        }
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (u32 i = 0; i < 6; i++) out[2 + i] = (u8)(indices >> (8 * i));
+}
+
+static void decodeBC4(const u8* in, u32 channel, u8 texels[16][4])
+{
+    u32 a0 = in[0], a1 = in[1];
+    u32 palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (u32 i = 2; i < 8; i++)
+            palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+    } else {
+        for (u32 i = 2; i < 6; i++)
+            palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    u64 indices = 0;
+    for (u32 i = 0; i < 6; i++) indices |= (u64)in[2 + i] << (8 * i);
+    for (u32 i = 0; i < 16; i++)
+        texels[i][channel] = (u8)palette[(indices >> (3 * i)) & 7];
+}
+
+// ============================================================================
+// BC7 (mode 6)
+// ============================================================================
+
+struct BC7Fit {
+    u32 endpoints[2][4]; // 7 bit
+    u32 pbits[2];
+    u32 indices[16];
+    f32 error;
+};
+
+static u32 bc7Expand(u32 value7, u32 pbit)
+{
+    return (value7 << 1) | pbit;
+}
+
+/// @brief 7 bits per channel plus a shared p bit, whichever p is closer
+static void bc7Quantize(const f32* endpoint, u32* value7, u32* pbit)
+{
+    f32 bestError = 1e30f;
+    for (u32 p = 0; p < 2; p++) {
+        u32 q[4];
+        f32 error = 0.0f;
+        for (u32 c = 0; c < 4; c++) {
+            f32 v = (endpoint[c] - p) * 0.5f + 0.5f;
+            q[c]  = (u32)CLAMP(v, 0.0f, 127.0f);
+            f32 d = (f32)bc7Expand(q[c], p) - endpoint[c];
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            *pbit     = p;
+            memcpy(value7, q, sizeof(q));
+        }
+    }
+}
+
+static u32 bc7Interpolate(u32 e0, u32 e1, u32 weight)
+{
+    return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+// nearest 4 bit index for a position along the line in 64ths
+static const u8* bc7IndexTable()
+{
+    struct Table {
+        u8 index[65];
+        Table()
+        {
+            for (u32 t = 0; t <= 64; t++) {
+                u32 best = 0;
+                for (u32 i = 1; i < 16; i++) {
+                    u32 d     = t > bc7Weights4[i] ? t - bc7Weights4[i]
+                                                   : bc7Weights4[i] - t;
+                    u32 bestD = t > bc7Weights4[best] ? t - bc7Weights4[best]
+                                                      : bc7Weights4[best] - t;
+                    if (d < bestD) best = i;
+                }
+                index[t] = (u8)best;
+            }
+        }
+    };
+    static const Table table; // built once, thread safe
+    return table.index;
+}
+
+static void bc7Evaluate(const BlockTexels* block, const f32* e0,
+                        const f32* e1, BC7Fit* fit)
+{
+    bc7Quantize(e0, fit->endpoints[0], &fit->pbits[0]);
+    bc7Quantize(e1, fit->endpoints[1], &fit->pbits[1]);
+
+    u32 q0[4], q1[4];
+    f32 f0[4], f1[4];
+    for (u32 c = 0; c < 4; c++) {
+        q0[c] = bc7Expand(fit->endpoints[0][c], fit->pbits[0]);
+        q1[c] = bc7Expand(fit->endpoints[1][c], fit->pbits[1]);
+        f0[c] = (f32)q0[c];
+        f1[c] = (f32)q1[c];
+    }
+
+    u32 positions[16];
+    selectLevels(block, 4, f0, f1, 65, positions);
+    const u8* table = bc7IndexTable();
+
+    fit->error = 0.0f;
+    for (u32 i = 0; i < 16; i++) {
+        fit->indices[i] = table[positions[i]];
+        u32 weight      = bc7Weights4[fit->indices[i]];
+        for (u32 c = 0; c < 4; c++) {
+            f32 d = block->c[c][i] - bc7Interpolate(q0[c], q1[c], weight);
+            fit->error += d * d;
+        }
+    }
+}
+
+// little endian bit stream over a 16 byte block
+struct BitWriter {
+    u8* out;
+    u32 bit;
+
+    void write(u32 value, u32 bits)
+    {
+        for (u32 i = 0; i < bits; i++, bit++) {
+            if ((value >> i) & 1) out[bit >> 3] |= (u8)(1u << (bit & 7));
+        }
+    }
+};
+
+struct BitReader {
+    const u8* in;
+    u32 bit;
+
+    u32 read(u32 bits)
+    {
+        u32 value = 0;
+        for (u32 i = 0; i < bits; i++, bit++)
+            value |= (u32)((in[bit >> 3] >> (bit & 7)) & 1) << i;
+        return value;
+    }
+};
+
+static void encodeBC7(const BlockTexels* block, u8* out)
+{
+    f32 e0[4], e1[4];
+    fitAxis(block, 4, e0, e1);
+
+    BC7Fit best = {};
+    bc7Evaluate(block, e0, e1, &best);
+    if (best.error > 0.0f) {
+        f32 weights[16];
+        for (u32 i = 0; i < 16; i++)
+            weights[i] = bc7Weights4[best.indices[i]] / 64.0f;
+        if (refitEndpoints(block, 4, weights, e0, e1)) {
+            BC7Fit refit = {};
+            bc7Evaluate(block, e0, e1, &refit);
+            if (refit.error < best.error) best = refit;
+        }
+    }
+
+    // the first index is stored without its top bit, which must be 0
+    u32 first = 0, second = 1;
+    if (best.indices[0] & 8) {
+        first  = 1;
+        second = 0;
+        for (u32 i = 0; i < 16; i++) best.indices[i] = 15 - best.indices[i];
+    }
+
+    memset(out, 0, 16);
+    BitWriter writer = { out, 0 };
+    writer.write(1 << 6, 7); // mode 6
+    for (u32 c = 0; c < 4; c++) {
+        writer.write(best.endpoints[first][c], 7);
+        writer.write(best.endpoints[second][c], 7);
+    }
+    writer.write(best.pbits[first], 1);
+    writer.write(best.pbits[second], 1);
+    writer.write(best.indices[0], 3);
+    for (u32 i = 1; i < 16; i++) writer.write(best.indices[i], 4);
+}
+
+static void decodeBC7(const u8* in, u8 texels[16][4])
+{
+    BitReader reader = { in, 0 };
+    if (reader.read(7) != 1 << 6) {
+        // not mode 6, not something encodeBC7() wrote
+        for (u32 i = 0; i < 16; i++) {
+            texels[i][0] = texels[i][2] = texels[i][3] = 255;
+            texels[i][1]                                = 0;
+        }
+        return;
+    }
+
+    u32 endpoints[2][4];
+    for (u32 c = 0; c < 4; c++) {
+        endpoints[0][c] = reader.read(7);
+        endpoints[1][c] = reader.read(7);
+    }
+    u32 p0 = reader.read(1), p1 = reader.read(1);
+    for (u32 c = 0; c < 4; c++) {
+        endpoints[0][c] = bc7Expand(endpoints[0][c], p0);
+        endpoints[1][c] = bc7Expand(endpoints[1][c], p1);
+    }
+    for (u32 i = 0; i < 16; i++) {
+        u32 weight = bc7Weights4[reader.read(i == 0 ? 3 : 4)];
+        for (u32 c = 0; c < 4; c++) {
+            texels[i][c]
+              = (u8)bc7Interpolate(endpoints[0][c], endpoints[1][c], weight);
+        }
+    }
+}
+
+// ============================================================================
+// BC Encoder
+// ============================================================================
+
+struct BCEncodeJob {
+    const u8* rgba;
+    u8* blocks;
+    u32 width;
+    u32 height;
+    u32 blocksX;
+    u32 blocksY;
+    BCFormat format;
+};
+
+static void encodeBand(void* userData, u32 band)
+{
+    BCEncodeJob* job = (BCEncodeJob*)userData;
+    u32 blockBytes   = BCEncoder::blockBytes(job->format);
+    u32 y0           = band * BC_ENCODE_BAND_ROWS;
+    u32 y1           = MIN(y0 + BC_ENCODE_BAND_ROWS, job->blocksY);
+
+    BlockTexels block;
+    for (u32 by = y0; by < y1; by++) {
+        for (u32 bx = 0; bx < job->blocksX; bx++) {
+            u8* out = job->blocks
+                      + ((u64)by * job->blocksX + bx) * blockBytes;
+            loadBlock(job->rgba, job->width, job->height, bx, by, &block);
+            switch (job->format) {
+                case BC_FORMAT_BC1: encodeBC1(&block, out); break;
+                case BC_FORMAT_BC3:
+                    encodeBC4(&block, 3, out);
+                    encodeBC1(&block, out + 8);
+                    break;
+                case BC_FORMAT_BC4: encodeBC4(&block, 0, out); break;
+                case BC_FORMAT_BC5:
+                    encodeBC4(&block, 0, out);
+                    encodeBC4(&block, 1, out + 8);
+                    break;
+                case BC_FORMAT_BC7: encodeBC7(&block, out); break;
+            }
+        }
+    }
+}
+
+u32 BCEncoder::blockBytes(BCFormat format)
+{
+    return format == BC_FORMAT_BC1 || format == BC_FORMAT_BC4 ? 8 : 16;
+}
+
+u64 BCEncoder::encodedBytes(BCFormat format, u32 width, u32 height)
+{
+    u64 blocksX = (width + 3) / 4;
+    u64 blocksY = (height + 3) / 4;
+    return blocksX * blocksY * blockBytes(format);
+}
+
+WGPUTextureFormat BCEncoder::textureFormat(BCFormat format, bool srgb)
+{
+    switch (format) {
+        case BC_FORMAT_BC1:
+            return srgb ? WGPUTextureFormat_BC1RGBAUnormSrgb
+                        : WGPUTextureFormat_BC1RGBAUnorm;
+        case BC_FORMAT_BC3:
+            return srgb ? WGPUTextureFormat_BC3RGBAUnormSrgb
+                        : WGPUTextureFormat_BC3RGBAUnorm;
+        case BC_FORMAT_BC4: return WGPUTextureFormat_BC4RUnorm;
+        case BC_FORMAT_BC5: return WGPUTextureFormat_BC5RGUnorm;
+        case BC_FORMAT_BC7:
+            return srgb ? WGPUTextureFormat_BC7RGBAUnormSrgb
+                        : WGPUTextureFormat_BC7RGBAUnorm;
+    }
+    return WGPUTextureFormat_Undefined;
+}
+
+u32 BCEncoder::channelMask(BCFormat format)
+{
+    switch (format) {
+        case BC_FORMAT_BC1: return 0x7;
+        case BC_FORMAT_BC4: return 0x1;
+        case BC_FORMAT_BC5: return 0x3;
+        default: return 0xF;
+    }
+}
+
+void BCEncoder::encode(const u8* rgba, u32 width, u32 height, BCFormat format,
+                       u8* blocks)
+{
+    BCEncodeJob job = {};
+    job.rgba        = rgba;
+    job.blocks      = blocks;
+    job.width       = width;
+    job.height      = height;
+    job.blocksX     = (width + 3) / 4;
+    job.blocksY     = (height + 3) / 4;
+    job.format      = format;
+
+    u32 bands = (job.blocksY + BC_ENCODE_BAND_ROWS - 1) / BC_ENCODE_BAND_ROWS;
+    JobSystem::parallelFor(bands, encodeBand, &job);
+}
+
+void BCEncoder::decode(const u8* blocks, u32 width, u32 height,
+                       BCFormat format, u8* rgba)
+{
+    u32 blocksX    = (width + 3) / 4;
+    u32 blocksY    = (height + 3) / 4;
+    u32 blockBytes = BCEncoder::blockBytes(format);
+
+    for (u32 by = 0; by < blocksY; by++) {
+        for (u32 bx = 0; bx < blocksX; bx++) {
+            const u8* in = blocks + ((u64)by * blocksX + bx) * blockBytes;
+            u8 texels[16][4] = {};
+            for (u32 i = 0; i < 16; i++) texels[i][3] = 255;
+            switch (format) {
+                case BC_FORMAT_BC1: decodeBC1(in, texels); break;
+                case BC_FORMAT_BC3:
+                    decodeBC1(in + 8, texels);
+                    decodeBC4(in, 3, texels);
+                    break;
+                case BC_FORMAT_BC4: decodeBC4(in, 0, texels); break;
+                case BC_FORMAT_BC5:
+                    decodeBC4(in, 0, texels);
+                    decodeBC4(in + 8, 1, texels);
+                    break;
+                case BC_FORMAT_BC7: decodeBC7(in, texels); break;
+            }
+
+            // drop the texels past the edge
+            for (u32 y = 0; y < 4 && 4 * by + y < height; y++) {
+                for (u32 x = 0; x < 4 && 4 * bx + x < width; x++) {
+                    u8* texel = rgba
+                                + 4 * ((u64)(4 * by + y) * width + 4 * bx + x);
+                    memcpy(texel, texels[4 * y + x], 4);
+                }
+            }
+        }
+    }
+}
+
+f64 BCEncoder::psnr(const u8* a, const u8* b, u32 width, u32 height,
+                    u32 channelMask)
+{
+    u64 squared  = 0;
+    u64 channels = 0;
+    for (u64 i = 0; i < (u64)width * height; i++) {
+        for (u32 c = 0; c < 4; c++) {
+            if (!(channelMask & (1u << c))) continue;
+            i32 d = (i32)a[4 * i + c] - (i32)b[4 * i + c];
+            squared += (u64)(d * d);
+            channels++;
+        }
+    }
+    if (squared == 0 || channels == 0) return 99.0;
+    f64 mse = (f64)squared / channels;
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+bool BCEncoder::encodeMipChain(const CPUMipChain* chain, BCFormat format,
+                               TextureFile* file)
+{
+    ASSERT(chain->levelCount > 0);
+    ASSERT(chain->levelCount <= TEXTURE_FILE_MAX_LEVELS);
+    *file = {};
+
+    const CPUMipLevel* base = &chain->levels[0];
+    if (chain->format == CPU_MIP_RGBA32_FLOAT || base->width % 4 != 0
+        || base->height % 4 != 0) {
+        file->error = "BC encoding needs RGBA8 levels, a multiple of 4 texels";
+        return false;
+    }
+
+    file->format     = BCEncoder::textureFormat(format,
+                                                chain->format
+                                                  == CPU_MIP_RGBA8_SRGB);
+    file->width      = base->width;
+    file->height     = base->height;
+    file->layers     = 1;
+    file->faces      = 1;
+    file->levelCount = chain->levelCount;
+
+    // levels back to back, like KTX2
+    for (u32 level = 0; level < file->levelCount; level++) {
+        file->levelOffsets[level] = file->size;
+        file->layerStrides[level] = TextureFile::imageBytes(file, level);
+        file->size += file->layerStrides[level];
+    }
+    file->data = ALLOCATE_BYTES(u8, file->size);
+
+    for (u32 level = 0; level < file->levelCount; level++) {
+        const CPUMipLevel* src = &chain->levels[level];
+        BCEncoder::encode(src->pixels, src->width, src->height, format,
+                          file->data + file->levelOffsets[level]);
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+
+struct CPUMipChain;
+struct TextureFile;
+
+// ============================================================================
+// BC Encoder
+// ============================================================================
+
+// Fast CPU block compression for textures that only exist as PNG/JPG, at
+// load time or as a bake step:
+//
+// - BC1: RGB, 4 bpp (alpha is dropped, no 1 bit alpha mode). Albedo
+// - BC3: BC1 color + BC4 alpha, 8 bpp
+// - BC4: R, 4 bpp. Height, roughness, masks
+// - BC5: two BC4 channels (R, G), 8 bpp. Normal maps, z rebuilt in shader
+// - BC7: RGBA, 8 bpp, mode 6 only (one subset, 4 bit indices). A fast
+//   quality tier: better than BC1/BC3 on gradients and alpha, well below
+//   what an exhaustive BC7 search reaches
+//
+// Color endpoints come from the block's principal axis (power iteration on
+// the covariance), indices from projecting texels onto the endpoint line,
+// 4 texels at a time with SSE (scalar elsewhere), followed by one least
+// squares refit of the endpoints, kept if it lowers the error. BC4 channels
+// use the min/max range with 8 levels. Blocks past the image edge repeat
+// the edge texels. Rows of blocks are split across the job system.
+//
+// decode() handles everything encode() produces (for BC7 that is mode 6
+// only) and, with psnr(), reports quality against the source.
+
+#define BC_ENCODE_BAND_ROWS 4 // block rows per job
+
+enum BCFormat {
+    BC_FORMAT_BC1 = 0,
+    BC_FORMAT_BC3,
+    BC_FORMAT_BC4,
+    BC_FORMAT_BC5,
+    BC_FORMAT_BC7,
+};
+
+struct BCEncoder {
+    /// @brief 8 or 16
+    static u32 blockBytes(BCFormat format);
+    static u64 encodedBytes(BCFormat format, u32 width, u32 height);
+    /// @brief srgb applies to BC1, BC3 and BC7, the others are linear
+    static WGPUTextureFormat textureFormat(BCFormat format, bool srgb);
+    /// @brief RGBA bits (1 = R) of the channels the format stores
+    static u32 channelMask(BCFormat format);
+
+    /// @brief Tightly packed RGBA8 to blocks in row major order. Blocks
+    /// must hold encodedBytes(). Blocks, the caller helps the job system
+    static void encode(const u8* rgba, u32 width, u32 height, BCFormat format,
+                       u8* blocks);
+    /// @brief Back to RGBA8 (missing channels: 0, alpha 255)
+    static void decode(const u8* blocks, u32 width, u32 height,
+                       BCFormat format, u8* rgba);
+    /// @brief Over the channels in channelMask, in dB. Identical images
+    /// report 99
+    static f64 psnr(const u8* a, const u8* b, u32 width, u32 height,
+                    u32 channelMask);
+
+    /// @brief Encode every level of an RGBA8 chain into file, ready for
+    /// TextureFile::upload() or Texture::initFromTextureFile(). Level 0 must
+    /// be a multiple of 4 texels on both axes (a WebGPU requirement)
+    static bool encodeMipChain(const CPUMipChain* chain, BCFormat format,
+                               TextureFile* file);
+};
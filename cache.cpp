@@ -0,0 +1,992 @@
+#include <GLFW/glfw3.h>
+#include <string.h>
+
+#include "cache.h"
+#include "core/log.h"
+#include "deletion.h"
+#include "memory.h"
+
+// ============================================================================
+// Descriptor hashing
+// ============================================================================
+
+// Descriptors are hashed field by field, never with hashBytes() over the
+// struct: padding is uninitialized and pointers (labels, arrays) must be
+// followed rather than hashed by address.
+
+static u64 hashConstants(u64 hash, const WGPUConstantEntry* constants,
+                         size_t count)
+{
+    hash = hashCombine(hash, count);
+    for (size_t i = 0; i < count; i++) {
+        hash = hashString(constants[i].key, hash);
+        hash = hashBytes(&constants[i].value, sizeof(f64), hash);
+    }
+    return hash;
+}
+
+static u64 hashBlendComponent(u64 hash, const WGPUBlendComponent* c)
+{
+    hash = hashCombine(hash, c->operation);
+    hash = hashCombine(hash, c->srcFactor);
+    return hashCombine(hash, c->dstFactor);
+}
+
+static u64 hashStencilFace(u64 hash, const WGPUStencilFaceState* s)
+{
+    hash = hashCombine(hash, s->compare);
+    hash = hashCombine(hash, s->failOp);
+    hash = hashCombine(hash, s->depthFailOp);
+    return hashCombine(hash, s->passOp);
+}
+
+u64 PipelineCache::hash(const WGPUBindGroupLayoutDescriptor* desc)
+{
+    u64 hash = hashCombine(HASH_SEED, desc->entryCount);
+    for (size_t i = 0; i < desc->entryCount; i++) {
+        const WGPUBindGroupLayoutEntry* e = &desc->entries[i];
+
+        hash = hashCombine(hash, e->binding);
+        hash = hashCombine(hash, e->visibility);
+
+        hash = hashCombine(hash, e->buffer.type);
+        hash = hashCombine(hash, e->buffer.hasDynamicOffset);
+        hash = hashCombine(hash, e->buffer.minBindingSize);
+
+        hash = hashCombine(hash, e->sampler.type);
+
+        hash = hashCombine(hash, e->texture.sampleType);
+        hash = hashCombine(hash, e->texture.viewDimension);
+        hash = hashCombine(hash, e->texture.multisampled);
+
+        hash = hashCombine(hash, e->storageTexture.access);
+        hash = hashCombine(hash, e->storageTexture.format);
+        hash = hashCombine(hash, e->storageTexture.viewDimension);
+    }
+    return hash;
+}
+
+u64 PipelineCache::hash(const WGPUPipelineLayoutDescriptor* desc)
+{
+    u64 hash = hashCombine(HASH_SEED, desc->bindGroupLayoutCount);
+    for (size_t i = 0; i < desc->bindGroupLayoutCount; i++)
+        hash = hashCombine(hash, (u64)desc->bindGroupLayouts[i]);
+    return hash;
+}
+
+u64 PipelineCache::hash(const WGPURenderPipelineDescriptor* desc)
+{
+    u64 hash = hashCombine(HASH_SEED, (u64)desc->layout);
+
+    // vertex
+    const WGPUVertexState* vertex = &desc->vertex;
+
+    hash = hashCombine(hash, (u64)vertex->module);
+    hash = hashString(vertex->entryPoint, hash);
+    hash = hashConstants(hash, vertex->constants, vertex->constantCount);
+    hash = hashCombine(hash, vertex->bufferCount);
+    for (size_t i = 0; i < vertex->bufferCount; i++) {
+        const WGPUVertexBufferLayout* buffer = &vertex->buffers[i];
+
+        hash = hashCombine(hash, buffer->arrayStride);
+        hash = hashCombine(hash, buffer->stepMode);
+        hash = hashCombine(hash, buffer->attributeCount);
+        for (size_t j = 0; j < buffer->attributeCount; j++) {
+            hash = hashCombine(hash, buffer->attributes[j].format);
+            hash = hashCombine(hash, buffer->attributes[j].offset);
+            hash = hashCombine(hash, buffer->attributes[j].shaderLocation);
+        }
+    }
+
+    // primitive
+    hash = hashCombine(hash, desc->primitive.topology);
+    hash = hashCombine(hash, desc->primitive.stripIndexFormat);
+    hash = hashCombine(hash, desc->primitive.frontFace);
+    hash = hashCombine(hash, desc->primitive.cullMode);
+
+    // depth stencil
+    const WGPUDepthStencilState* depth = desc->depthStencil;
+
+    hash = hashCombine(hash, depth != NULL);
+    if (depth) {
+        hash = hashCombine(hash, depth->format);
+        hash = hashCombine(hash, depth->depthWriteEnabled);
+        hash = hashCombine(hash, depth->depthCompare);
+        hash = hashStencilFace(hash, &depth->stencilFront);
+        hash = hashStencilFace(hash, &depth->stencilBack);
+        hash = hashCombine(hash, depth->stencilReadMask);
+        hash = hashCombine(hash, depth->stencilWriteMask);
+        hash = hashCombine(hash, (u64)(i64)depth->depthBias);
+        hash = hashBytes(&depth->depthBiasSlopeScale, sizeof(f32), hash);
+        hash = hashBytes(&depth->depthBiasClamp, sizeof(f32), hash);
+    }
+
+    // multisample
+    hash = hashCombine(hash, desc->multisample.count);
+    hash = hashCombine(hash, desc->multisample.mask);
+    hash = hashCombine(hash, desc->multisample.alphaToCoverageEnabled);
+
+    // fragment
+    const WGPUFragmentState* fragment = desc->fragment;
+
+    hash = hashCombine(hash, fragment != NULL);
+    if (fragment) {
+        hash = hashCombine(hash, (u64)fragment->module);
+        hash = hashString(fragment->entryPoint, hash);
+        hash = hashConstants(hash, fragment->constants,
+                             fragment->constantCount);
+        hash = hashCombine(hash, fragment->targetCount);
+        for (size_t i = 0; i < fragment->targetCount; i++) {
+            const WGPUColorTargetState* target = &fragment->targets[i];
+
+            hash = hashCombine(hash, target->format);
+            hash = hashCombine(hash, target->writeMask);
+            hash = hashCombine(hash, target->blend != NULL);
+            if (target->blend) {
+                hash = hashBlendComponent(hash, &target->blend->color);
+                hash = hashBlendComponent(hash, &target->blend->alpha);
+            }
+        }
+    }
+
+    return hash;
+}
+
+u64 PipelineCache::hash(const WGPUComputePipelineDescriptor* desc)
+{
+    u64 hash = hashCombine(HASH_SEED, (u64)desc->layout);
+    hash     = hashCombine(hash, (u64)desc->compute.module);
+    hash     = hashString(desc->compute.entryPoint, hash);
+    hash     = hashConstants(hash, desc->compute.constants,
+                         desc->compute.constantCount);
+    return hash;
+}
+
+// ============================================================================
+// Pipeline Cache
+// ============================================================================
+
+WGPUShaderModule PipelineCache::getShaderModule(GraphicsContext* ctx,
+                                                const char* code,
+                                                const char* label)
+{
+    PipelineCache* cache = ctx->pipelineCache;
+    u64 key              = hashString(code);
+
+    WGPUShaderModule module
+      = (WGPUShaderModule)HashMap::get(&cache->shaderModules, key);
+    if (module) {
+        cache->shaderModuleStats.hits++;
+        wgpuShaderModuleReference(module);
+        return module;
+    }
+
+    f64 start = glfwGetTime();
+
+    ShaderModule shaderModule = {};
+    ShaderModule::init(ctx, &shaderModule, code, label);
+    module = shaderModule.module;
+    ASSERT(module != NULL);
+
+    cache->shaderModuleStats.misses++;
+    cache->shaderModuleStats.createSeconds += glfwGetTime() - start;
+
+    // one reference for the cache, one for the caller
+    HashMap::put(&cache->shaderModules, key, module);
+    wgpuShaderModuleReference(module);
+    return module;
+}
+
+WGPUBindGroupLayout
+PipelineCache::getBindGroupLayout(GraphicsContext* ctx,
+                                  const WGPUBindGroupLayoutDescriptor* desc)
+{
+    PipelineCache* cache = ctx->pipelineCache;
+    u64 key              = PipelineCache::hash(desc);
+
+    WGPUBindGroupLayout layout
+      = (WGPUBindGroupLayout)HashMap::get(&cache->bindGroupLayouts, key);
+    if (layout) {
+        cache->bindGroupLayoutStats.hits++;
+        wgpuBindGroupLayoutReference(layout);
+        return layout;
+    }
+
+    f64 start = glfwGetTime();
+    layout    = wgpuDeviceCreateBindGroupLayout(ctx->device, desc);
+    ASSERT(layout != NULL);
+
+    cache->bindGroupLayoutStats.misses++;
+    cache->bindGroupLayoutStats.createSeconds += glfwGetTime() - start;
+
+    HashMap::put(&cache->bindGroupLayouts, key, layout);
+    wgpuBindGroupLayoutReference(layout);
+    return layout;
+}
+
+WGPUPipelineLayout
+PipelineCache::getPipelineLayout(GraphicsContext* ctx,
+                                 const WGPUPipelineLayoutDescriptor* desc)
+{
+    PipelineCache* cache = ctx->pipelineCache;
+    u64 key              = PipelineCache::hash(desc);
+
+    WGPUPipelineLayout layout
+      = (WGPUPipelineLayout)HashMap::get(&cache->pipelineLayouts, key);
+    if (layout) {
+        cache->pipelineLayoutStats.hits++;
+        wgpuPipelineLayoutReference(layout);
+        return layout;
+    }
+
+    f64 start = glfwGetTime();
+    layout    = wgpuDeviceCreatePipelineLayout(ctx->device, desc);
+    ASSERT(layout != NULL);
+
+    cache->pipelineLayoutStats.misses++;
+    cache->pipelineLayoutStats.createSeconds += glfwGetTime() - start;
+
+    HashMap::put(&cache->pipelineLayouts, key, layout);
+    wgpuPipelineLayoutReference(layout);
+    return layout;
+}
+
+WGPURenderPipeline
+PipelineCache::getRenderPipeline(GraphicsContext* ctx,
+                                 const WGPURenderPipelineDescriptor* desc)
+{
+    PipelineCache* cache = ctx->pipelineCache;
+    u64 key              = PipelineCache::hash(desc);
+
+#ifndef __EMSCRIPTEN__
+    // already compiling in the background, finishing that is never slower
+    // than starting over
+    if (HashMap::get(&cache->pendingRenderPipelines, key)) {
+#ifdef WEBGPU_BACKEND_WGPU
+        // help with the compile jobs rather than spin
+        JobSystem::wait(&cache->compiling);
+#endif
+        while (HashMap::get(&cache->pendingRenderPipelines, key))
+            GraphicsContext::poll(ctx);
+    }
+#endif
+
+    WGPURenderPipeline pipeline
+      = (WGPURenderPipeline)HashMap::get(&cache->renderPipelines, key);
+    if (pipeline) {
+        cache->renderPipelineStats.hits++;
+        wgpuRenderPipelineReference(pipeline);
+        return pipeline;
+    }
+
+    f64 start = glfwGetTime();
+    pipeline  = wgpuDeviceCreateRenderPipeline(ctx->device, desc);
+    ASSERT(pipeline != NULL);
+
+    f64 seconds = glfwGetTime() - start;
+    cache->renderPipelineStats.misses++;
+    cache->renderPipelineStats.createSeconds += seconds;
+    log_debug("compiled render pipeline '%s' in %.2f ms",
+              desc->label ? desc->label : "", 1000.0 * seconds);
+
+    HashMap::put(&cache->renderPipelines, key, pipeline);
+    wgpuRenderPipelineReference(pipeline);
+    return pipeline;
+}
+
+#ifdef WEBGPU_BACKEND_WGPU
+
+// The compile job outlives the caller's descriptor, which usually sits on
+// its stack. Everything it points at is copied into one allocation, the
+// same fields PipelineCache::hash() reads (chained structs are dropped,
+// the repo uses none on pipeline descriptors).
+
+struct DescriptorArena {
+    u8* data;
+    u64 used;
+};
+
+static void* arenaCopy(DescriptorArena* arena, const void* src, u64 bytes)
+{
+    if (src == NULL || bytes == 0) return NULL;
+    u64 offset  = (arena->used + 7) & ~7ull; // pointers and f64s
+    arena->used = offset + bytes;
+    memcpy(arena->data + offset, src, bytes);
+    return arena->data + offset;
+}
+
+static const char* arenaString(DescriptorArena* arena, const char* string)
+{
+    if (string == NULL) return NULL;
+    return (const char*)arenaCopy(arena, string, strlen(string) + 1);
+}
+
+static u64 stringBytes(const char* string)
+{
+    return string ? strlen(string) + 1 + 8 : 0;
+}
+
+static u64 constantBytes(const WGPUConstantEntry* constants, size_t count)
+{
+    u64 bytes = count * sizeof(WGPUConstantEntry) + 8;
+    for (size_t i = 0; i < count; i++) bytes += stringBytes(constants[i].key);
+    return bytes;
+}
+
+static const WGPUConstantEntry*
+arenaConstants(DescriptorArena* arena, const WGPUConstantEntry* constants,
+               size_t count)
+{
+    WGPUConstantEntry* copy = (WGPUConstantEntry*)arenaCopy(
+      arena, constants, count * sizeof(WGPUConstantEntry));
+    for (size_t i = 0; i < count; i++) {
+        copy[i].nextInChain = NULL;
+        copy[i].key         = arenaString(arena, constants[i].key);
+    }
+    return copy;
+}
+
+static u64 descriptorBytes(const WGPURenderPipelineDescriptor* desc)
+{
+    const WGPUVertexState* vertex = &desc->vertex;
+
+    u64 bytes = stringBytes(desc->label) + stringBytes(vertex->entryPoint)
+                + constantBytes(vertex->constants, vertex->constantCount)
+                + vertex->bufferCount * sizeof(WGPUVertexBufferLayout) + 8;
+    for (size_t i = 0; i < vertex->bufferCount; i++)
+        bytes += vertex->buffers[i].attributeCount * sizeof(WGPUVertexAttribute)
+                 + 8;
+
+    if (desc->depthStencil) bytes += sizeof(WGPUDepthStencilState) + 8;
+
+    const WGPUFragmentState* fragment = desc->fragment;
+    if (fragment) {
+        bytes += sizeof(WGPUFragmentState) + 8
+                 + stringBytes(fragment->entryPoint)
+                 + constantBytes(fragment->constants, fragment->constantCount)
+                 + fragment->targetCount * sizeof(WGPUColorTargetState) + 8;
+        for (size_t i = 0; i < fragment->targetCount; i++)
+            if (fragment->targets[i].blend) bytes += sizeof(WGPUBlendState) + 8;
+    }
+    return bytes;
+}
+
+/// @brief Deep copy desc into pending, referencing its layout and modules
+static void copyDescriptor(PendingRenderPipeline* pending,
+                           const WGPURenderPipelineDescriptor* desc)
+{
+    pending->descBytes   = descriptorBytes(desc);
+    pending->descStorage = ALLOCATE_BYTES(u8, pending->descBytes);
+    DescriptorArena arena = { pending->descStorage, 0 };
+
+    WGPURenderPipelineDescriptor* copy = &pending->desc;
+    *copy                              = *desc;
+    copy->nextInChain                  = NULL;
+    copy->label                        = arenaString(&arena, desc->label);
+    copy->primitive.nextInChain        = NULL;
+    copy->multisample.nextInChain      = NULL;
+
+    WGPUVertexState* vertex = &copy->vertex;
+    vertex->nextInChain     = NULL;
+    vertex->entryPoint      = arenaString(&arena, desc->vertex.entryPoint);
+    vertex->constants       = arenaConstants(&arena, desc->vertex.constants,
+                                             desc->vertex.constantCount);
+    WGPUVertexBufferLayout* buffers = (WGPUVertexBufferLayout*)arenaCopy(
+      &arena, desc->vertex.buffers,
+      desc->vertex.bufferCount * sizeof(WGPUVertexBufferLayout));
+    for (size_t i = 0; i < vertex->bufferCount; i++) {
+        buffers[i].attributes = (WGPUVertexAttribute*)arenaCopy(
+          &arena, buffers[i].attributes,
+          buffers[i].attributeCount * sizeof(WGPUVertexAttribute));
+    }
+    vertex->buffers = buffers;
+
+    if (desc->depthStencil) {
+        WGPUDepthStencilState* depth = (WGPUDepthStencilState*)arenaCopy(
+          &arena, desc->depthStencil, sizeof(WGPUDepthStencilState));
+        depth->nextInChain = NULL;
+        copy->depthStencil = depth;
+    }
+
+    if (desc->fragment) {
+        WGPUFragmentState* fragment = (WGPUFragmentState*)arenaCopy(
+          &arena, desc->fragment, sizeof(WGPUFragmentState));
+        fragment->nextInChain = NULL;
+        fragment->entryPoint  = arenaString(&arena, fragment->entryPoint);
+        fragment->constants   = arenaConstants(&arena, fragment->constants,
+                                               fragment->constantCount);
+        WGPUColorTargetState* targets = (WGPUColorTargetState*)arenaCopy(
+          &arena, fragment->targets,
+          fragment->targetCount * sizeof(WGPUColorTargetState));
+        for (size_t i = 0; i < fragment->targetCount; i++) {
+            targets[i].nextInChain = NULL;
+            targets[i].blend       = (WGPUBlendState*)arenaCopy(
+              &arena, targets[i].blend, sizeof(WGPUBlendState));
+        }
+        fragment->targets = targets;
+        copy->fragment    = fragment;
+    }
+    ASSERT(arena.used <= pending->descBytes);
+
+    // the caller may release these before the job runs
+    if (copy->layout) wgpuPipelineLayoutReference(copy->layout);
+    wgpuShaderModuleReference(copy->vertex.module);
+    if (copy->fragment) wgpuShaderModuleReference(copy->fragment->module);
+}
+
+static void releaseDescriptor(PendingRenderPipeline* pending)
+{
+    WGPURenderPipelineDescriptor* desc = &pending->desc;
+    WGPU_RELEASE_RESOURCE(PipelineLayout, desc->layout);
+    wgpuShaderModuleRelease(desc->vertex.module);
+    if (desc->fragment) wgpuShaderModuleRelease(desc->fragment->module);
+    FREE_ARRAY(u8, pending->descStorage, pending->descBytes);
+}
+
+/// @brief Job: the blocking create, off the main thread
+static void compileRenderPipeline(void* userData, u32 index)
+{
+    UNUSED_VAR(index);
+    PendingRenderPipeline* pending = (PendingRenderPipeline*)userData;
+    PipelineCache* cache           = pending->cache;
+
+    pending->result
+      = wgpuDeviceCreateRenderPipeline(pending->device, &pending->desc);
+
+    // push for collect()
+    pending->nextCompiled = cache->compiled.load();
+    while (!cache->compiled.compare_exchange_weak(pending->nextCompiled,
+                                                  pending)) {
+    }
+}
+
+#endif
+
+static void onRenderPipelineCompiled(WGPUCreatePipelineAsyncStatus status,
+                                     WGPURenderPipeline pipeline,
+                                     char const* message, void* userdata)
+{
+    PendingRenderPipeline* pending = (PendingRenderPipeline*)userdata;
+    PipelineCache* cache           = pending->cache;
+
+    HashMap::remove(&cache->pendingRenderPipelines, pending->key);
+
+    if (status != WGPUCreatePipelineAsyncStatus_Success) {
+        log_error("async render pipeline compile failed: %s",
+                  message ? message : "");
+        for (u32 i = 0; i < pending->waiterCount; i++)
+            pending->waiters[i]->pending = NULL;
+        WGPU_RELEASE_RESOURCE(RenderPipeline, pipeline);
+        FREE(PendingRenderPipeline, pending);
+        return;
+    }
+
+    // a blocking compile of the same descriptor may have beaten us
+    // (emscripten can't wait for pending compiles)
+    WGPURenderPipeline existing
+      = (WGPURenderPipeline)HashMap::get(&cache->renderPipelines, pending->key);
+    if (existing) {
+        wgpuRenderPipelineRelease(pipeline);
+        pipeline = existing;
+    } else {
+        f64 seconds = glfwGetTime() - pending->startTime;
+        cache->renderPipelineStats.misses++;
+        cache->renderPipelineStats.createSeconds += seconds;
+        log_debug("async compiled render pipeline in %.2f ms",
+                  1000.0 * seconds);
+
+        // the callback's reference becomes the cache's
+        HashMap::put(&cache->renderPipelines, pending->key, pipeline);
+    }
+
+    for (u32 i = 0; i < pending->waiterCount; i++) {
+        RenderPipeline* waiter = pending->waiters[i];
+        wgpuRenderPipelineReference(pipeline);
+        waiter->pipeline = pipeline;
+        waiter->pending  = NULL;
+    }
+
+    FREE(PendingRenderPipeline, pending);
+}
+
+WGPURenderPipeline
+PipelineCache::getRenderPipelineAsync(GraphicsContext* ctx,
+                                      const WGPURenderPipelineDescriptor* desc,
+                                      RenderPipeline* waiter)
+{
+    PipelineCache* cache = ctx->pipelineCache;
+    u64 key              = PipelineCache::hash(desc);
+
+    WGPURenderPipeline pipeline
+      = (WGPURenderPipeline)HashMap::get(&cache->renderPipelines, key);
+    if (pipeline) {
+        cache->renderPipelineStats.hits++;
+        wgpuRenderPipelineReference(pipeline);
+        return pipeline;
+    }
+
+    PendingRenderPipeline* pending = (PendingRenderPipeline*)HashMap::get(
+      &cache->pendingRenderPipelines, key);
+    bool start = pending == NULL;
+    if (start) {
+        pending            = ALLOCATE_COUNT(PendingRenderPipeline, 1);
+        pending->cache     = cache;
+        pending->key       = key;
+        pending->startTime = glfwGetTime();
+        HashMap::put(&cache->pendingRenderPipelines, key, pending);
+    }
+
+    if (waiter) {
+        ASSERT(pending->waiterCount < PIPELINE_CACHE_MAX_WAITERS);
+        pending->waiters[pending->waiterCount++] = waiter;
+        waiter->pending                          = pending;
+    }
+
+    if (start) {
+#ifdef WEBGPU_BACKEND_WGPU
+        // wgpu-native doesn't implement wgpuDeviceCreateRenderPipelineAsync,
+        // compile on a worker instead. Completes from poll() like the
+        // callback would
+        pending->device = ctx->device;
+        copyDescriptor(pending, desc);
+        JobSystem::submit(compileRenderPipeline, pending, 0,
+                          &cache->compiling);
+#else
+        wgpuDeviceCreateRenderPipelineAsync(ctx->device, desc,
+                                            onRenderPipelineCompiled, pending);
+#endif
+    }
+
+    return NULL;
+}
+
+void PipelineCache::cancelWait(RenderPipeline* waiter)
+{
+    PendingRenderPipeline* pending = waiter->pending;
+    if (!pending) return;
+
+    for (u32 i = 0; i < pending->waiterCount; i++) {
+        if (pending->waiters[i] != waiter) continue;
+        pending->waiters[i] = pending->waiters[--pending->waiterCount];
+        break;
+    }
+    waiter->pending = NULL;
+}
+
+void PipelineCache::warmUp(GraphicsContext* ctx,
+                           const WGPURenderPipelineDescriptor* descs, u32 count)
+{
+    for (u32 i = 0; i < count; i++) {
+        WGPURenderPipeline pipeline
+          = PipelineCache::getRenderPipelineAsync(ctx, &descs[i], NULL);
+        WGPU_RELEASE_RESOURCE(RenderPipeline, pipeline);
+    }
+}
+
+void PipelineCache::waitIdle(GraphicsContext* ctx)
+{
+#ifdef __EMSCRIPTEN__
+    // callbacks only run once we yield back to the browser
+    UNUSED_VAR(ctx);
+#else
+#ifdef WEBGPU_BACKEND_WGPU
+    JobSystem::wait(&ctx->pipelineCache->compiling);
+#endif
+    while (PipelineCache::pendingCount(ctx->pipelineCache) > 0)
+        GraphicsContext::poll(ctx);
+#endif
+}
+
+void PipelineCache::collect(GraphicsContext* ctx)
+{
+#ifdef WEBGPU_BACKEND_WGPU
+    PipelineCache* cache           = ctx->pipelineCache;
+    PendingRenderPipeline* pending = cache->compiled.exchange(NULL);
+    while (pending) {
+        // the callback frees pending
+        PendingRenderPipeline* next = pending->nextCompiled;
+        WGPURenderPipeline created  = pending->result;
+        releaseDescriptor(pending);
+        onRenderPipelineCompiled(created ?
+                                   WGPUCreatePipelineAsyncStatus_Success :
+                                   WGPUCreatePipelineAsyncStatus_InternalError,
+                                 created, NULL, pending);
+        pending = next;
+    }
+#else
+    UNUSED_VAR(ctx);
+#endif
+}
+
+u32 PipelineCache::pendingCount(PipelineCache* cache)
+{
+    return cache->pendingRenderPipelines.count;
+}
+
+WGPUComputePipeline
+PipelineCache::getComputePipeline(GraphicsContext* ctx,
+                                  const WGPUComputePipelineDescriptor* desc)
+{
+    PipelineCache* cache = ctx->pipelineCache;
+    u64 key              = PipelineCache::hash(desc);
+
+    WGPUComputePipeline pipeline
+      = (WGPUComputePipeline)HashMap::get(&cache->computePipelines, key);
+    if (pipeline) {
+        cache->computePipelineStats.hits++;
+        wgpuComputePipelineReference(pipeline);
+        return pipeline;
+    }
+
+    f64 start = glfwGetTime();
+    pipeline  = wgpuDeviceCreateComputePipeline(ctx->device, desc);
+    ASSERT(pipeline != NULL);
+
+    f64 seconds = glfwGetTime() - start;
+    cache->computePipelineStats.misses++;
+    cache->computePipelineStats.createSeconds += seconds;
+    log_debug("compiled compute pipeline '%s' in %.2f ms",
+              desc->label ? desc->label : "", 1000.0 * seconds);
+
+    HashMap::put(&cache->computePipelines, key, pipeline);
+    wgpuComputePipelineReference(pipeline);
+    return pipeline;
+}
+
+static void logCacheStats(const char* name, PipelineCacheStats* stats,
+                          u32 count)
+{
+    log_info("%-18s %4d cached, %6llu hits, %4llu misses, %8.2f ms creating",
+             name, count, (unsigned long long)stats->hits,
+             (unsigned long long)stats->misses, 1000.0 * stats->createSeconds);
+}
+
+void PipelineCache::logStats(PipelineCache* cache)
+{
+    logCacheStats("shader modules", &cache->shaderModuleStats,
+                  cache->shaderModules.count);
+    logCacheStats("bind group layouts", &cache->bindGroupLayoutStats,
+                  cache->bindGroupLayouts.count);
+    logCacheStats("pipeline layouts", &cache->pipelineLayoutStats,
+                  cache->pipelineLayouts.count);
+    logCacheStats("render pipelines", &cache->renderPipelineStats,
+                  cache->renderPipelines.count);
+    logCacheStats("compute pipelines", &cache->computePipelineStats,
+                  cache->computePipelines.count);
+}
+
+void PipelineCache::release(PipelineCache* cache)
+{
+    // in-flight callbacks point at the cache, waitIdle() first
+    ASSERT(PipelineCache::pendingCount(cache) == 0);
+    // collected jobs may not have dropped their counter yet
+    JobSystem::wait(&cache->compiling);
+
+    // release dependents first
+    HashMap* map = &cache->renderPipelines;
+    for (u32 i = 0; i < map->capacity; i++)
+        if (HashMap::occupied(map, i))
+            wgpuRenderPipelineRelease(
+              (WGPURenderPipeline)map->entries[i].value);
+
+    map = &cache->computePipelines;
+    for (u32 i = 0; i < map->capacity; i++)
+        if (HashMap::occupied(map, i))
+            wgpuComputePipelineRelease(
+              (WGPUComputePipeline)map->entries[i].value);
+
+    map = &cache->pipelineLayouts;
+    for (u32 i = 0; i < map->capacity; i++)
+        if (HashMap::occupied(map, i))
+            wgpuPipelineLayoutRelease(
+              (WGPUPipelineLayout)map->entries[i].value);
+
+    map = &cache->bindGroupLayouts;
+    for (u32 i = 0; i < map->capacity; i++)
+        if (HashMap::occupied(map, i))
+            wgpuBindGroupLayoutRelease(
+              (WGPUBindGroupLayout)map->entries[i].value);
+
+    map = &cache->shaderModules;
+    for (u32 i = 0; i < map->capacity; i++)
+        if (HashMap::occupied(map, i))
+            wgpuShaderModuleRelease((WGPUShaderModule)map->entries[i].value);
+
+    HashMap::free(&cache->pendingRenderPipelines);
+    HashMap::free(&cache->renderPipelines);
+    HashMap::free(&cache->computePipelines);
+    HashMap::free(&cache->pipelineLayouts);
+    HashMap::free(&cache->bindGroupLayouts);
+    HashMap::free(&cache->shaderModules);
+
+    // not *cache = {}, the atomics can't be assigned
+    cache->shaderModuleStats    = {};
+    cache->bindGroupLayoutStats = {};
+    cache->pipelineLayoutStats  = {};
+    cache->renderPipelineStats  = {};
+    cache->computePipelineStats = {};
+}
+
+// ============================================================================
+// Binding Cache
+// ============================================================================
+
+struct CachedBinding {
+    u64 key;
+    void* handle; // WGPUSampler or WGPUBindGroup
+    bool isSampler;
+    u32 refCount;
+    u64 lastUsed; // useClock when the refcount last dropped to 0
+
+    // handles the bind group references, for purge()
+    void* resources[BINDING_CACHE_MAX_RESOURCES];
+    u32 resourceCount;
+};
+
+struct BindingCacheState {
+    HashMap samplers;   // hash(desc)   -> CachedBinding*
+    HashMap bindGroups; // hash(desc)   -> CachedBinding*
+    HashMap handles;    // hash(handle) -> CachedBinding*
+
+    BindingCacheStats samplerStats;
+    BindingCacheStats bindGroupStats;
+    u32 unusedBindGroups;
+    u64 useClock;
+};
+
+static BindingCacheState bindingCache = {};
+
+static u64 handleKey(void* handle)
+{
+    return hashCombine(HASH_SEED, (u64)handle);
+}
+
+u64 BindingCache::hash(const WGPUSamplerDescriptor* desc)
+{
+    u64 hash = hashCombine(HASH_SEED, desc->addressModeU);
+    hash     = hashCombine(hash, desc->addressModeV);
+    hash     = hashCombine(hash, desc->addressModeW);
+    hash     = hashCombine(hash, desc->magFilter);
+    hash     = hashCombine(hash, desc->minFilter);
+    hash     = hashCombine(hash, desc->mipmapFilter);
+    hash     = hashBytes(&desc->lodMinClamp, sizeof(f32), hash);
+    hash     = hashBytes(&desc->lodMaxClamp, sizeof(f32), hash);
+    hash     = hashCombine(hash, desc->compare);
+    return hashCombine(hash, desc->maxAnisotropy);
+}
+
+u64 BindingCache::hash(const WGPUBindGroupDescriptor* desc)
+{
+    u64 hash = hashCombine(HASH_SEED, (u64)desc->layout);
+    hash     = hashCombine(hash, desc->entryCount);
+    for (size_t i = 0; i < desc->entryCount; i++) {
+        const WGPUBindGroupEntry* e = &desc->entries[i];
+
+        hash = hashCombine(hash, e->binding);
+        hash = hashCombine(hash, (u64)e->buffer);
+        hash = hashCombine(hash, e->offset);
+        hash = hashCombine(hash, e->size);
+        hash = hashCombine(hash, (u64)e->sampler);
+        hash = hashCombine(hash, (u64)e->textureView);
+    }
+    return hash;
+}
+
+static CachedBinding* acquire(HashMap* map, u64 key, BindingCacheStats* stats)
+{
+    CachedBinding* entry = (CachedBinding*)HashMap::get(map, key);
+    if (!entry) return NULL;
+
+    stats->hits++;
+    if (entry->refCount++ == 0) {
+        stats->referenced++;
+        if (!entry->isSampler) bindingCache.unusedBindGroups--;
+    }
+    return entry;
+}
+
+static CachedBinding* insert(HashMap* map, u64 key, void* handle,
+                             BindingCacheStats* stats)
+{
+    CachedBinding* entry = ALLOCATE_COUNT(CachedBinding, 1);
+    entry->key           = key;
+    entry->handle        = handle;
+    entry->refCount      = 1;
+
+    HashMap::put(map, key, entry);
+    HashMap::put(&bindingCache.handles, handleKey(handle), entry);
+
+    stats->misses++;
+    stats->live++;
+    stats->referenced++;
+    stats->peak = MAX(stats->peak, stats->live);
+    return entry;
+}
+
+static void destroy(CachedBinding* entry)
+{
+    HashMap::remove(&bindingCache.handles, handleKey(entry->handle));
+    if (entry->isSampler) {
+        HashMap::remove(&bindingCache.samplers, entry->key);
+        DeletionQueue::defer((WGPUSampler)entry->handle);
+        bindingCache.samplerStats.live--;
+        if (entry->refCount > 0) bindingCache.samplerStats.referenced--;
+    } else {
+        HashMap::remove(&bindingCache.bindGroups, entry->key);
+        DeletionQueue::defer((WGPUBindGroup)entry->handle);
+        bindingCache.bindGroupStats.live--;
+        if (entry->refCount > 0) bindingCache.bindGroupStats.referenced--;
+        else bindingCache.unusedBindGroups--;
+    }
+    FREE(CachedBinding, entry);
+}
+
+static void evictLeastRecentlyUsed()
+{
+    HashMap* map          = &bindingCache.bindGroups;
+    CachedBinding* oldest = NULL;
+    for (u32 i = 0; i < map->capacity; i++) {
+        if (!HashMap::occupied(map, i)) continue;
+        CachedBinding* entry = (CachedBinding*)map->entries[i].value;
+        if (entry->refCount > 0) continue;
+        if (!oldest || entry->lastUsed < oldest->lastUsed) oldest = entry;
+    }
+    if (oldest) destroy(oldest);
+}
+
+WGPUSampler BindingCache::getSampler(GraphicsContext* ctx,
+                                     const WGPUSamplerDescriptor* desc)
+{
+    u64 key = BindingCache::hash(desc);
+    CachedBinding* entry
+      = acquire(&bindingCache.samplers, key, &bindingCache.samplerStats);
+    if (entry) return (WGPUSampler)entry->handle;
+
+    WGPUSampler sampler = wgpuDeviceCreateSampler(ctx->device, desc);
+    ASSERT(sampler != NULL);
+
+    entry = insert(&bindingCache.samplers, key, sampler,
+                   &bindingCache.samplerStats);
+    entry->isSampler = true;
+    return sampler;
+}
+
+WGPUBindGroup BindingCache::getBindGroup(GraphicsContext* ctx,
+                                         const WGPUBindGroupDescriptor* desc)
+{
+    u64 key = BindingCache::hash(desc);
+    CachedBinding* entry
+      = acquire(&bindingCache.bindGroups, key, &bindingCache.bindGroupStats);
+    if (entry) return (WGPUBindGroup)entry->handle;
+
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(ctx->device, desc);
+    ASSERT(bindGroup != NULL);
+
+    entry = insert(&bindingCache.bindGroups, key, bindGroup,
+                   &bindingCache.bindGroupStats);
+    for (size_t i = 0; i < desc->entryCount; i++) {
+        const WGPUBindGroupEntry* e = &desc->entries[i];
+        void* resource              = (void*)e->sampler;
+        if (e->buffer) resource = (void*)e->buffer;
+        if (e->textureView) resource = (void*)e->textureView;
+        ASSERT(entry->resourceCount < BINDING_CACHE_MAX_RESOURCES);
+        entry->resources[entry->resourceCount++] = resource;
+    }
+    return bindGroup;
+}
+
+static void releaseEntry(void* handle)
+{
+    if (!handle) return;
+
+    CachedBinding* entry
+      = (CachedBinding*)HashMap::get(&bindingCache.handles, handleKey(handle));
+    ASSERT(entry != NULL && entry->refCount > 0);
+    if (--entry->refCount > 0) return;
+
+    // samplers are few and small, keep them for the device lifetime
+    if (entry->isSampler) {
+        bindingCache.samplerStats.referenced--;
+        return;
+    }
+
+    bindingCache.bindGroupStats.referenced--;
+    entry->lastUsed = ++bindingCache.useClock;
+    if (++bindingCache.unusedBindGroups > BINDING_CACHE_MAX_UNUSED)
+        evictLeastRecentlyUsed();
+}
+
+void BindingCache::release(WGPUSampler sampler)
+{
+    releaseEntry(sampler);
+}
+
+void BindingCache::release(WGPUBindGroup bindGroup)
+{
+    releaseEntry(bindGroup);
+}
+
+void BindingCache::purge(void* resource)
+{
+    // removal leaves tombstones, iterating while destroying is fine
+    HashMap* map = &bindingCache.bindGroups;
+    for (u32 i = 0; i < map->capacity; i++) {
+        if (!HashMap::occupied(map, i)) continue;
+        CachedBinding* entry = (CachedBinding*)map->entries[i].value;
+        if (entry->refCount > 0) continue;
+        for (u32 r = 0; r < entry->resourceCount; r++) {
+            if (entry->resources[r] == resource) {
+                destroy(entry);
+                break;
+            }
+        }
+    }
+}
+
+BindingCacheStats BindingCache::samplerStats()
+{
+    return bindingCache.samplerStats;
+}
+
+BindingCacheStats BindingCache::bindGroupStats()
+{
+    return bindingCache.bindGroupStats;
+}
+
+static void logBindingCacheStats(const char* name, BindingCacheStats* stats)
+{
+    log_info("%-18s %4d live (%d referenced, peak %d), %6llu hits, %4llu "
+             "misses",
+             name, stats->live, stats->referenced, stats->peak,
+             (unsigned long long)stats->hits,
+             (unsigned long long)stats->misses);
+}
+
+void BindingCache::logStats()
+{
+    logBindingCacheStats("samplers", &bindingCache.samplerStats);
+    logBindingCacheStats("bind groups", &bindingCache.bindGroupStats);
+}
+
+void BindingCache::shutdown()
+{
+    u32 referenced = bindingCache.samplerStats.referenced
+                     + bindingCache.bindGroupStats.referenced;
+    if (referenced > 0)
+        log_info("binding cache: %d objects still referenced at shutdown",
+                 referenced);
+
+    // bind groups first, they reference samplers
+    HashMap* maps[] = { &bindingCache.bindGroups, &bindingCache.samplers };
+    for (u32 m = 0; m < ARRAY_LENGTH(maps); m++) {
+        for (u32 i = 0; i < maps[m]->capacity; i++) {
+            if (!HashMap::occupied(maps[m], i)) continue;
+            destroy((CachedBinding*)maps[m]->entries[i].value);
+        }
+    }
+
+    HashMap::free(&bindingCache.samplers);
+    HashMap::free(&bindingCache.bindGroups);
+    HashMap::free(&bindingCache.handles);
+    bindingCache = {};
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+#include "hash.h"
+#include "jobs.h"
+
+// ============================================================================
+// Pipeline Cache
+// ============================================================================
+
+// Device-lifetime caches for shader modules, bind group layouts, pipeline
+// layouts and render/compute pipelines, keyed by a hash of their descriptor.
+// Identical requests return the existing object instead of recompiling.
+//
+// Objects are keyed by the handles of their (already cached) dependencies:
+// a pipeline descriptor hashes its layout and module handles, which are
+// stable because the cache holds a reference to them until release.
+// Labels are not part of any key.
+//
+// Every get*() returns a new reference, release it as usual with
+// wgpu*Release(). The cache keeps its own reference alive.
+
+// Render pipelines can also be compiled asynchronously
+// (wgpuDeviceCreateRenderPipelineAsync). Requests for the same descriptor
+// are merged; RenderPipelines waiting on a request get their `pipeline`
+// filled in by the completion callback, which runs from
+// GraphicsContext::poll() once per frame.
+//
+// wgpu-native doesn't implement wgpuDeviceCreateRenderPipelineAsync, but
+// its devices are thread safe: there the blocking create runs as a job
+// system job on a copy of the descriptor, and poll() hands finished jobs to
+// the same completion callback on the main thread (collect()).
+
+#define PIPELINE_CACHE_MAX_WAITERS 16
+
+struct PendingRenderPipeline {
+    struct PipelineCache* cache;
+    u64 key;
+    f64 startTime;
+
+    // filled in on completion
+    RenderPipeline* waiters[PIPELINE_CACHE_MAX_WAITERS];
+    u32 waiterCount;
+
+    // wgpu-native: the compile job's own copy of the descriptor (in
+    // descStorage, holding references to its layout and modules), its
+    // result and the link in PipelineCache::compiled
+    WGPUDevice device;
+    WGPURenderPipelineDescriptor desc;
+    u8* descStorage;
+    u64 descBytes;
+    WGPURenderPipeline result;
+    PendingRenderPipeline* nextCompiled;
+};
+
+struct PipelineCacheStats {
+    u64 hits;
+    u64 misses;
+    f64 createSeconds; // total time spent creating on misses
+};
+
+struct PipelineCache {
+    HashMap shaderModules;    // hash(code)       -> WGPUShaderModule
+    HashMap bindGroupLayouts; // hash(entries)    -> WGPUBindGroupLayout
+    HashMap pipelineLayouts;  // hash(layouts)    -> WGPUPipelineLayout
+    HashMap renderPipelines;  // hash(descriptor) -> WGPURenderPipeline
+    HashMap computePipelines; // hash(descriptor) -> WGPUComputePipeline
+
+    // hash(descriptor) -> PendingRenderPipeline*
+    HashMap pendingRenderPipelines;
+
+    // wgpu-native: compile jobs still running, and the finished ones
+    // waiting for collect() (a lock-free stack pushed by workers)
+    JobCounter compiling;
+    std::atomic<PendingRenderPipeline*> compiled;
+
+    PipelineCacheStats shaderModuleStats;
+    PipelineCacheStats bindGroupLayoutStats;
+    PipelineCacheStats pipelineLayoutStats;
+    PipelineCacheStats renderPipelineStats;
+    PipelineCacheStats computePipelineStats;
+
+    static WGPUShaderModule getShaderModule(GraphicsContext* ctx,
+                                            const char* code,
+                                            const char* label);
+
+    static WGPUBindGroupLayout
+    getBindGroupLayout(GraphicsContext* ctx,
+                       const WGPUBindGroupLayoutDescriptor* desc);
+
+    static WGPUPipelineLayout
+    getPipelineLayout(GraphicsContext* ctx,
+                      const WGPUPipelineLayoutDescriptor* desc);
+
+    static WGPURenderPipeline
+    getRenderPipeline(GraphicsContext* ctx,
+                      const WGPURenderPipelineDescriptor* desc);
+
+    /// @brief Non-blocking getRenderPipeline(). Returns a new reference if
+    /// already compiled, otherwise starts (or joins) an async compile and
+    /// returns NULL. waiter (optional) gets waiter->pipeline set on success.
+    static WGPURenderPipeline
+    getRenderPipelineAsync(GraphicsContext* ctx,
+                           const WGPURenderPipelineDescriptor* desc,
+                           RenderPipeline* waiter);
+
+    /// @brief Stop filling in waiter, e.g. it is released before its
+    /// pipeline finished compiling. The compile itself still completes.
+    static void cancelWait(RenderPipeline* waiter);
+
+    /// @brief Start async compiles for all descriptors (loading screens)
+    static void warmUp(GraphicsContext* ctx,
+                       const WGPURenderPipelineDescriptor* descs, u32 count);
+
+    /// @brief Block until all async compiles have finished. Not possible
+    /// on the web, where it returns immediately.
+    static void waitIdle(GraphicsContext* ctx);
+
+    /// @brief Complete the compile jobs that have finished, filling in
+    /// their waiters. wgpu-native only, called by GraphicsContext::poll()
+    static void collect(GraphicsContext* ctx);
+
+    static u32 pendingCount(PipelineCache* cache);
+
+    static WGPUComputePipeline
+    getComputePipeline(GraphicsContext* ctx,
+                       const WGPUComputePipelineDescriptor* desc);
+
+    static u64 hash(const WGPUBindGroupLayoutDescriptor* desc);
+    static u64 hash(const WGPUPipelineLayoutDescriptor* desc);
+    static u64 hash(const WGPURenderPipelineDescriptor* desc);
+    static u64 hash(const WGPUComputePipelineDescriptor* desc);
+
+    static void logStats(PipelineCache* cache);
+
+    static void release(PipelineCache* cache);
+};
+
+// ============================================================================
+// Binding Cache
+// ============================================================================
+
+// Device-level cache for samplers and bind groups, keyed by their
+// descriptors (bind groups by layout and resource handles). Bind group
+// layouts are deduplicated by the PipelineCache above.
+//
+// Unlike the PipelineCache, objects are refcounted by the cache itself:
+// get*() returns a borrowed handle and bumps the refcount, release() drops
+// it. Never call wgpu*Release() on them directly. Unreferenced bind groups
+// stay cached (up to BINDING_CACHE_MAX_UNUSED, least recently used evicted
+// first) so switching back to a previous combination is a hash lookup.
+// Since a cached bind group keeps its resources alive, owners of buffers and
+// texture views call purge() when releasing them.
+//
+// Process-wide like the JobSystem, there is one device. Main thread only.
+
+#define BINDING_CACHE_MAX_RESOURCES 8 // per bind group, for purge()
+#define BINDING_CACHE_MAX_UNUSED 256
+
+struct BindingCacheStats {
+    u64 hits;
+    u64 misses;
+    u32 live;       // objects currently created
+    u32 referenced; // live objects with refcount > 0
+    u32 peak;       // high water mark of live
+};
+
+struct BindingCache {
+    static WGPUSampler getSampler(GraphicsContext* ctx,
+                                  const WGPUSamplerDescriptor* desc);
+    static WGPUBindGroup getBindGroup(GraphicsContext* ctx,
+                                      const WGPUBindGroupDescriptor* desc);
+
+    static void release(WGPUSampler sampler);
+    static void release(WGPUBindGroup bindGroup);
+
+    /// @brief Destroy unreferenced bind groups using resource (a buffer,
+    /// texture view or sampler handle) so it can actually be freed
+    static void purge(void* resource);
+
+    static BindingCacheStats samplerStats();
+    static BindingCacheStats bindGroupStats();
+
+    static u64 hash(const WGPUSamplerDescriptor* desc);
+    static u64 hash(const WGPUBindGroupDescriptor* desc);
+
+    static void logStats();
+
+    /// @brief Destroy everything, reporting objects still referenced
+    static void shutdown();
+};
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <string.h>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
@@ -8,8 +9,25 @@
 #include "memory.h"
 #include "stb/stb_image.h"
 
+#ifdef WEBGPU_BACKEND_WGPU
+#include <webgpu/wgpu.h> // wgpuDevicePoll, wgpuQueueSubmitForIndex
+#endif
+
+#include "cache.h"
 #include "context.h"
+#include "deletion.h"
+#include "geometry.h"
+#include "gpu_memory.h"
+#include "jobs.h"
+#include "lighting.h"
+#include "residency.h"
 #include "shaders.h"
+#include "streaming.h"
+#include "texture_bake.h"
+#include "texture_file.h"
+#include "wgsl.h"
+
+static void warmUpMipMapPipelines(GraphicsContext* ctx);
 
 void printBackend()
 {
@@ -148,6 +166,11 @@ static bool createSwapChain(GraphicsContext* context, u32 width, u32 height)
     // ensure previous swap chain has been released
     ASSERT(context->swapChain == NULL);
 
+    context->width        = width;
+    context->height       = height;
+    context->renderWidth  = width;
+    context->renderHeight = height;
+
     WGPUSwapChainDescriptor swap_chain_desc = {
         NULL,                              // nextInChain
         "The default swap chain",          // label
@@ -155,7 +178,7 @@ static bool createSwapChain(GraphicsContext* context, u32 width, u32 height)
         context->swapChainFormat,          // format
         width,                             // width
         height,                            // height
-        WGPUPresentMode_Fifo,              // presentMode (vsynced)
+        context->presentMode,              // presentMode
     };
     context->swapChain = wgpuDeviceCreateSwapChain(
       context->device, context->surface, &swap_chain_desc);
@@ -175,6 +198,7 @@ static void createDepthTexture(GraphicsContext* context, u32 width, u32 height)
     // only support one format for now
     WGPUTextureFormat depthTextureFormat
       = WGPUTextureFormat_Depth24PlusStencil8;
+    context->depthTextureFormat = depthTextureFormat;
     depthTextureDesc.usage         = WGPUTextureUsage_RenderAttachment;
     depthTextureDesc.dimension     = WGPUTextureDimension_2D;
     depthTextureDesc.size          = { width, height, 1 };
@@ -184,6 +208,10 @@ static void createDepthTexture(GraphicsContext* context, u32 width, u32 height)
     context->depthTexture
       = wgpuDeviceCreateTexture(context->device, &depthTextureDesc);
     ASSERT(context->depthTexture != NULL);
+    GPUMemory::track(context->depthTexture, GPU_MEMORY_RENDER_TARGET,
+                     GPUMemory::textureBytes(depthTextureFormat, width,
+                                             height, 1, 1),
+                     "depth texture");
 
     // Create the view of the depth texture manipulated by the rasterizer
     WGPUTextureViewDescriptor depthTextureViewDesc = {};
@@ -257,13 +285,26 @@ bool GraphicsContext::init(GraphicsContext* context, GLFWwindow* window)
         return false;
     }
 
+    // every texture compression the adapter has, loaders check per format
+    const WGPUFeatureName compressionFeatures[] = {
+        WGPUFeatureName_TextureCompressionBC,
+        WGPUFeatureName_TextureCompressionETC2,
+        WGPUFeatureName_TextureCompressionASTC,
+    };
+    WGPUFeatureName features[ARRAY_LENGTH(compressionFeatures)];
+    u32 featureCount = 0;
+    for (u32 i = 0; i < ARRAY_LENGTH(compressionFeatures); i++) {
+        if (wgpuAdapterHasFeature(context->adapter, compressionFeatures[i]))
+            features[featureCount++] = compressionFeatures[i];
+    }
+
     // TODO add device feature limits
     // simple: inspect adapter max limits and request max
     WGPUDeviceDescriptor deviceDescriptor = {
         NULL,                          // nextInChain
         "WebGPU-Renderer Device",      // label
-        0,                             // requiredFeaturesCount
-        NULL,                          // requiredFeatures
+        featureCount,                  // requiredFeaturesCount
+        features,                      // requiredFeatures
         NULL,                          // requiredLimits
         { NULL, "The default queue" }, // defaultQueue
         NULL,                          // deviceLostCallback,
@@ -277,11 +318,20 @@ bool GraphicsContext::init(GraphicsContext* context, GLFWwindow* window)
     context->queue = wgpuDeviceGetQueue(context->device);
     if (!context->queue) return false;
 
+    context->pipelineCache = ALLOCATE_COUNT(PipelineCache, 1);
+
+    context->framesInFlight = FRAMES_IN_FLIGHT_DEFAULT;
+
+    context->meshPool = ALLOCATE_COUNT(MeshPool, 1);
+    MeshPool::init(context, context->meshPool, MESH_POOL_INITIAL_VERTICES,
+                   MESH_POOL_INITIAL_INDICES);
+
     int window_width, window_height;
     glfwGetWindowSize(window, &window_width, &window_height);
 
     context->swapChainFormat
       = wgpuSurfaceGetPreferredFormat(context->surface, context->adapter);
+    context->presentMode = WGPUPresentMode_Fifo; // vsynced
 
     // Create the swap chain
     if (!createSwapChain(context, window_width, window_height)) return false;
@@ -306,26 +356,279 @@ bool GraphicsContext::init(GraphicsContext* context, GLFWwindow* window)
     context->renderPassDesc.depthStencilAttachment
       = &context->depthStencilAttachment;
 
+    // compile in the background while the app loads
+    warmUpMipMapPipelines(context);
+
     return true;
 }
 
 WGPURenderPassEncoder GraphicsContext::prepareFrame(GraphicsContext* ctx)
 {
+    GraphicsContext::beginFrame(ctx);
+    return GraphicsContext::beginRenderPass(ctx);
+}
+
+// ============================================================================
+// Frames in flight
+// ============================================================================
+
+/// @brief Fences resolve in submission order, so each one completes
+/// exactly the next frame
+static void onFrameDone(WGPUQueueWorkDoneStatus status, void* userdata)
+{
+    if (status != WGPUQueueWorkDoneStatus_Success)
+        log_warn("frame fence: work done status %d", status);
+    GraphicsContext* ctx = (GraphicsContext*)userdata;
+    ctx->framesCompleted++;
+}
+
+static void onStagingMapped(WGPUBufferMapAsyncStatus status, void* userdata)
+{
+    FrameResources* frame = (FrameResources*)userdata;
+    frame->mapPending     = false;
+    // destroyed before the callback on shutdown
+    if (status != WGPUBufferMapAsyncStatus_Success) return;
+
+    frame->staging = (u8*)wgpuBufferGetMappedRange(frame->stagingBuffer, 0,
+                                                   frame->stagingSize);
+}
+
+static void createStaging(GraphicsContext* ctx, FrameResources* frame,
+                          u64 size)
+{
+    WGPUBufferDescriptor desc = {};
+    desc.label                = "frame staging";
+    desc.size                 = size;
+    desc.usage            = WGPUBufferUsage_MapWrite | WGPUBufferUsage_CopySrc;
+    desc.mappedAtCreation = true;
+
+    frame->stagingBuffer = wgpuDeviceCreateBuffer(ctx->device, &desc);
+    ASSERT(frame->stagingBuffer != NULL);
+    GPUMemory::track(frame->stagingBuffer, GPU_MEMORY_STAGING, size,
+                     desc.label);
+
+    frame->staging
+      = (u8*)wgpuBufferGetMappedRange(frame->stagingBuffer, 0, size);
+    frame->stagingSize = size;
+    frame->stagingUsed = 0;
+}
+
+/// @brief Replace a full staging buffer with a bigger one. Copies already
+/// recorded still read from the old one, it's released with the frame.
+static void growStaging(GraphicsContext* ctx, FrameResources* frame,
+                        u64 size)
+{
+    u64 newSize = frame->stagingSize * 2;
+    while (newSize < size) newSize *= 2;
+
+    wgpuBufferUnmap(frame->stagingBuffer);
+    DeletionQueue::defer(frame->stagingBuffer);
+    createStaging(ctx, frame, newSize);
+
+    log_info("frame staging: grew to %llu KB",
+             (unsigned long long)(newSize / 1024));
+}
+
+/// @brief Block until frames [0, frames) are done on the GPU
+static void waitForFrames(GraphicsContext* ctx, u64 frames)
+{
+#ifdef __EMSCRIPTEN__
+    // can't block the browser, fences resolve once we yield
+    UNUSED_VAR(ctx);
+    UNUSED_VAR(frames);
+#else
+    while (ctx->framesCompleted < frames) {
+#if defined(WEBGPU_BACKEND_WGPU)
+        // wait for that frame's submission only, not everything in flight
+        FrameResources* frame
+          = &ctx->frames[(frames - 1) % ctx->framesInFlight];
+        WGPUWrappedSubmissionIndex index
+          = { ctx->queue, frame->submissionIndex };
+        bool tracked = frame->frameIndex == frames - 1;
+        wgpuDevicePoll(ctx->device, true, tracked ? &index : NULL);
+#else
+        GraphicsContext::poll(ctx);
+#endif
+    }
+#endif
+}
+
+/// @brief Slot for the frame being recorded, waiting for the GPU to finish
+/// the frame that used it before
+static FrameResources* acquireFrame(GraphicsContext* ctx)
+{
+    FrameResources* frame
+      = &ctx->frames[ctx->frameIndex % ctx->framesInFlight];
+    if (frame->recording) return frame;
+
+    if (ctx->frameIndex >= ctx->framesInFlight)
+        waitForFrames(ctx, ctx->frameIndex - ctx->framesInFlight + 1);
+
+#ifndef __EMSCRIPTEN__
+    // remapping resolves along with the frame, if not in the same poll
+    while (frame->mapPending) GraphicsContext::poll(ctx);
+#endif
+
+    if (!frame->stagingBuffer)
+        createStaging(ctx, frame, FRAME_STAGING_INITIAL_SIZE);
+
+    frame->stagingUsed = 0;
+    frame->recording   = true;
+    frame->frameIndex  = ctx->frameIndex;
+    return frame;
+}
+
+/// @brief Submit the frame's uploads, then commands (may be NULL, released
+/// here). Fences the work as frame ctx->frameIndex and starts the next one.
+static void submitFrame(GraphicsContext* ctx, WGPUCommandBuffer commands)
+{
+    FrameResources* frame
+      = &ctx->frames[ctx->frameIndex % ctx->framesInFlight];
+    bool staged = frame->recording && frame->stagingUsed > 0;
+    if (staged) {
+        wgpuBufferUnmap(frame->stagingBuffer);
+        frame->staging = NULL;
+    }
+
+    WGPUCommandBuffer buffers[2] = {};
+    u32 count                    = 0;
+    if (frame->uploadEncoder) {
+        buffers[count++] = wgpuCommandEncoderFinish(frame->uploadEncoder, NULL);
+        WGPU_RELEASE_RESOURCE(CommandEncoder, frame->uploadEncoder);
+    }
+    if (commands) buffers[count++] = commands;
+
+#if defined(WEBGPU_BACKEND_WGPU)
+    frame->submissionIndex
+      = wgpuQueueSubmitForIndex(ctx->queue, count, buffers);
+#else
+    wgpuQueueSubmit(ctx->queue, count, buffers);
+#endif
+    for (u32 i = 0; i < count; i++) wgpuCommandBufferRelease(buffers[i]);
+
+    // resolves once the GPU is done reading it, ready for the next frame
+    // using this slot
+    if (staged) {
+        frame->mapPending = true;
+        wgpuBufferMapAsync(frame->stagingBuffer, WGPUMapMode_Write, 0,
+                           frame->stagingSize, onStagingMapped, frame);
+    }
+    frame->recording  = false;
+    frame->frameIndex = ctx->frameIndex;
+
+    wgpuQueueOnSubmittedWorkDone(ctx->queue, onFrameDone, ctx);
+    ctx->frameIndex++;
+    DeletionQueue::setFrame(ctx->frameIndex);
+}
+
+static void releaseFrames(GraphicsContext* ctx)
+{
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT_MAX; i++) {
+        FrameResources* frame = &ctx->frames[i];
+        ASSERT(!frame->recording && frame->uploadEncoder == NULL);
+        // destroying unmaps
+        DeletionQueue::defer(frame->stagingBuffer);
+        *frame = {};
+    }
+}
+
+void GraphicsContext::setFramesInFlight(GraphicsContext* ctx, u32 count)
+{
+    count = CLAMP(count, 1u, (u32)FRAMES_IN_FLIGHT_MAX);
+    if (count == ctx->framesInFlight) return;
+
+    // slots are indexed by frameIndex % framesInFlight
+    GraphicsContext::waitIdle(ctx);
+    releaseFrames(ctx);
+    ctx->framesInFlight = count;
+}
+
+FrameResources* GraphicsContext::currentFrame(GraphicsContext* ctx)
+{
+    return acquireFrame(ctx);
+}
+
+void GraphicsContext::writeBuffer(GraphicsContext* ctx, WGPUBuffer buffer,
+                                  u64 offset, const void* data, u64 size)
+{
+    // copyBufferToBuffer alignment
+    ASSERT(offset % 4 == 0 && size % 4 == 0);
+
+    FrameResources* frame = acquireFrame(ctx);
+    if (!frame->staging) {
+        // emscripten: the slot's staging buffer isn't mapped again yet
+        wgpuQueueWriteBuffer(ctx->queue, buffer, offset, data, size);
+        return;
+    }
+
+    if (frame->stagingUsed + size > frame->stagingSize)
+        growStaging(ctx, frame, size);
+
+    memcpy(frame->staging + frame->stagingUsed, data, size);
+
+    if (!frame->uploadEncoder) {
+        WGPUCommandEncoderDescriptor encoderDesc = {};
+        encoderDesc.label                        = "frame uploads";
+        frame->uploadEncoder
+          = wgpuDeviceCreateCommandEncoder(ctx->device, &encoderDesc);
+    }
+    wgpuCommandEncoderCopyBufferToBuffer(frame->uploadEncoder,
+                                         frame->stagingBuffer,
+                                         frame->stagingUsed, buffer, offset,
+                                         size);
+    frame->stagingUsed += size;
+}
+
+// ============================================================================
+// Frame
+// ============================================================================
+
+WGPUCommandEncoder GraphicsContext::beginFrame(GraphicsContext* ctx)
+{
+    // throttle: wait until the GPU is at most framesInFlight - 1 frames
+    // behind, before acquiring the backbuffer
+    acquireFrame(ctx);
+
     // get target texture view
     ctx->backbufferView = wgpuSwapChainGetCurrentTextureView(ctx->swapChain);
     ASSERT(ctx->backbufferView != NULL);
     ctx->colorAttachment.view = ctx->backbufferView;
 
+    // a depth pre-pass switches these for the frame's main pass
+    ctx->depthStencilAttachment.depthLoadOp = WGPULoadOp_Clear;
+    ctx->renderPassDesc.occlusionQuerySet   = NULL;
+    // and dynamic resolution the target and its viewport
+    ctx->renderWidth  = ctx->width;
+    ctx->renderHeight = ctx->height;
+
     // initialize encoder
     WGPUCommandEncoderDescriptor encoderDesc = {};
     ctx->commandEncoder
       = wgpuDeviceCreateCommandEncoder(ctx->device, &encoderDesc);
 
+    return ctx->commandEncoder;
+}
+
+WGPURenderPassEncoder GraphicsContext::beginRenderPass(GraphicsContext* ctx)
+{
+    ASSERT(ctx->commandEncoder != NULL);
     ctx->renderPassEncoder = wgpuCommandEncoderBeginRenderPass(
       ctx->commandEncoder, &ctx->renderPassDesc);
+    GraphicsContext::setRenderViewport(ctx, ctx->renderPassEncoder);
 
     return ctx->renderPassEncoder;
 }
+
+void GraphicsContext::setRenderViewport(GraphicsContext* ctx,
+                                        WGPURenderPassEncoder renderPass)
+{
+    wgpuRenderPassEncoderSetViewport(renderPass, 0.0f, 0.0f,
+                                     (f32)ctx->renderWidth,
+                                     (f32)ctx->renderHeight, 0.0f, 1.0f);
+    wgpuRenderPassEncoderSetScissorRect(renderPass, 0, 0, ctx->renderWidth,
+                                        ctx->renderHeight);
+}
+
 void GraphicsContext::presentFrame(GraphicsContext* ctx)
 {
     wgpuRenderPassEncoderEnd(ctx->renderPassEncoder);
@@ -334,15 +637,14 @@ void GraphicsContext::presentFrame(GraphicsContext* ctx)
     // release texture view
     wgpuTextureViewRelease(ctx->backbufferView);
 
-    // submit
+    // submit, after this frame's staged uploads
     WGPUCommandBufferDescriptor cmdBufferDescriptor = {};
     WGPUCommandBuffer command
       = wgpuCommandEncoderFinish(ctx->commandEncoder, &cmdBufferDescriptor);
     wgpuCommandEncoderRelease(ctx->commandEncoder);
-
-    // Finally submit the command queue
-    wgpuQueueSubmit(ctx->queue, 1, &command);
-    wgpuCommandBufferRelease(command);
+    // uploads are still open, see onSubmit
+    if (ctx->onSubmit) ctx->onSubmit(ctx, ctx->onSubmitUserdata);
+    submitFrame(ctx, command);
 
     // present
 #ifndef __EMSCRIPTEN__
@@ -350,13 +652,76 @@ void GraphicsContext::presentFrame(GraphicsContext* ctx)
 #endif
 }
 
+void GraphicsContext::poll(GraphicsContext* ctx)
+{
+#if defined(WEBGPU_BACKEND_WGPU)
+    wgpuDevicePoll(ctx->device, false, NULL);
+    // pipelines compiled on workers, see PipelineCache
+    if (ctx->pipelineCache) PipelineCache::collect(ctx);
+#elif defined(WEBGPU_BACKEND_DAWN)
+    wgpuDeviceTick(ctx->device);
+#else
+    // emscripten: callbacks run from the browser event loop
+#endif
+
+    // retire resources of the frames the GPU has finished
+    DeletionQueue::collect(ctx->framesCompleted);
+}
+
+void GraphicsContext::waitIdle(GraphicsContext* ctx)
+{
+    // pending uploads too
+    submitFrame(ctx, NULL);
+    waitForFrames(ctx, ctx->frameIndex);
+
+#ifndef __EMSCRIPTEN__
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT_MAX; i++)
+        while (ctx->frames[i].mapPending) GraphicsContext::poll(ctx);
+#endif
+}
+
+bool GraphicsContext::supportsPresentMode(GraphicsContext* ctx,
+                                          WGPUPresentMode mode)
+{
+    if (mode == WGPUPresentMode_Fifo) return true;
+
+#ifdef __EMSCRIPTEN__
+    // the browser presents on its own schedule
+    UNUSED_VAR(ctx);
+    return false;
+#else
+    WGPUSurfaceCapabilities caps = {};
+    wgpuSurfaceGetCapabilities(ctx->surface, ctx->adapter, &caps);
+    bool supported = false;
+    for (size_t i = 0; i < caps.presentModeCount; i++)
+        if (caps.presentModes[i] == mode) supported = true;
+    wgpuSurfaceCapabilitiesFreeMembers(caps);
+    return supported;
+#endif
+}
+
+bool GraphicsContext::setPresentMode(GraphicsContext* ctx,
+                                     WGPUPresentMode mode)
+{
+    if (mode == ctx->presentMode) return true;
+    if (!GraphicsContext::supportsPresentMode(ctx, mode)) {
+        log_warn("present mode %d not supported by the surface", mode);
+        return false;
+    }
+
+    ctx->presentMode = mode;
+    WGPU_RELEASE_RESOURCE(SwapChain, ctx->swapChain);
+    return createSwapChain(ctx, ctx->width, ctx->height);
+}
+
 void GraphicsContext::resize(GraphicsContext* ctx, u32 width, u32 height)
 {
 
-    // terminate depth buffer
-    WGPU_RELEASE_RESOURCE(TextureView, ctx->depthTextureView);
-    WGPU_DESTROY_RESOURCE(Texture, ctx->depthTexture);
-    WGPU_RELEASE_RESOURCE(Texture, ctx->depthTexture);
+    // terminate depth buffer, frames in flight may still use it
+    DeletionQueue::defer(ctx->depthTextureView);
+    DeletionQueue::defer(ctx->depthTexture);
+    ctx->depthTextureView = NULL;
+    ctx->depthTexture     = NULL;
 
     // terminate swap chain
     WGPU_RELEASE_RESOURCE(SwapChain, ctx->swapChain);
@@ -369,16 +734,36 @@ void GraphicsContext::resize(GraphicsContext* ctx, u32 width, u32 height)
 
 void GraphicsContext::release(GraphicsContext* ctx)
 {
+    BindingCache::logStats();
+    BindingCache::shutdown();
+
+    MeshPool::logStats(ctx->meshPool);
+    MeshPool::release(ctx->meshPool);
+    FREE(MeshPool, ctx->meshPool);
+
+    PipelineCache::waitIdle(ctx);
+    PipelineCache::logStats(ctx->pipelineCache);
+    PipelineCache::release(ctx->pipelineCache);
+    FREE(PipelineCache, ctx->pipelineCache);
+
     // textures
-    wgpuTextureViewRelease(ctx->depthTextureView);
-    wgpuTextureDestroy(ctx->depthTexture);
-    wgpuTextureRelease(ctx->depthTexture);
+    DeletionQueue::defer(ctx->depthTextureView);
+    DeletionQueue::defer(ctx->depthTexture);
+
+    // everything deferred above and before
+    GraphicsContext::waitIdle(ctx);
+    releaseFrames(ctx);
+    DeletionQueue::logStats();
+    DeletionQueue::flush();
 
     wgpuSwapChainRelease(ctx->swapChain);
     wgpuDeviceRelease(ctx->device);
     wgpuAdapterRelease(ctx->adapter);
     wgpuInstanceRelease(ctx->instance);
     wgpuSurfaceRelease(ctx->surface);
+
+    GPUMemory::logStats();
+    GPUMemory::shutdown();
 }
 
 void VertexBuffer::init(GraphicsContext* ctx, VertexBuffer* buf,
@@ -391,11 +776,18 @@ void VertexBuffer::init(GraphicsContext* ctx, VertexBuffer* buf,
     buf->desc.mappedAtCreation = false;
 
     buf->buf = wgpuDeviceCreateBuffer(ctx->device, &buf->desc);
+    GPUMemory::track(buf->buf, GPU_MEMORY_VERTEX, buf->desc.size, label);
 
     if (data)
         wgpuQueueWriteBuffer(ctx->queue, buf->buf, 0, data, buf->desc.size);
 }
 
+void VertexBuffer::release(VertexBuffer* buf)
+{
+    GPUMemory::untrack(buf->buf);
+    WGPU_RELEASE_RESOURCE(Buffer, buf->buf);
+}
+
 void IndexBuffer::init(GraphicsContext* ctx, IndexBuffer* buf, u64 data_length,
                        const u32* data, const char* label)
 {
@@ -406,11 +798,18 @@ void IndexBuffer::init(GraphicsContext* ctx, IndexBuffer* buf, u64 data_length,
     buf->desc.mappedAtCreation = false;
 
     buf->buf = wgpuDeviceCreateBuffer(ctx->device, &buf->desc);
+    GPUMemory::track(buf->buf, GPU_MEMORY_INDEX, buf->desc.size, label);
 
     if (data)
         wgpuQueueWriteBuffer(ctx->queue, buf->buf, 0, data, buf->desc.size);
 }
 
+void IndexBuffer::release(IndexBuffer* buf)
+{
+    GPUMemory::untrack(buf->buf);
+    WGPU_RELEASE_RESOURCE(Buffer, buf->buf);
+}
+
 void VertexBufferLayout::init(VertexBufferLayout* layout, u8 attribute_count,
                               u32* attribute_strides)
 {
@@ -541,7 +940,7 @@ static WGPUBindGroupLayout createBindGroupLayout(GraphicsContext* ctx,
     WGPUBindGroupLayoutDescriptor bindGroupLayoutDesc = {};
     bindGroupLayoutDesc.entryCount                    = 1;
     bindGroupLayoutDesc.entries                       = &bindGroupLayout;
-    return wgpuDeviceCreateBindGroupLayout(ctx->device, &bindGroupLayoutDesc);
+    return PipelineCache::getBindGroupLayout(ctx, &bindGroupLayoutDesc);
 }
 
 // ============================================================================
@@ -558,6 +957,8 @@ void BindGroup::init(GraphicsContext* ctx, BindGroup* bindGroup,
     bufferDesc.mappedAtCreation     = false;
     bufferDesc.usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
     bindGroup->uniformBuffer = wgpuDeviceCreateBuffer(ctx->device, &bufferDesc);
+    GPUMemory::track(bindGroup->uniformBuffer, GPU_MEMORY_UNIFORM, bufferSize,
+                     "bind group uniforms");
 
     // force only 1 @binding per @group
     WGPUBindGroupEntry binding = {};
@@ -575,21 +976,44 @@ void BindGroup::init(GraphicsContext* ctx, BindGroup* bindGroup,
     bindGroup->desc.entries    = &binding;
     bindGroup->desc.entryCount = 1; // force 1 binding per group
 
-    std::cout << "Creating bind group with layout " << layout << std::endl;
+    bindGroup->bindGroup = BindingCache::getBindGroup(ctx, &bindGroup->desc);
 
-    bindGroup->bindGroup
-      = wgpuDeviceCreateBindGroup(ctx->device, &bindGroup->desc);
-    std::cout << "bindGroup: " << bindGroup->bindGroup << std::endl;
+    // entries point at the stack
+    bindGroup->desc.entries    = NULL;
+    bindGroup->desc.entryCount = 0;
+}
+
+void BindGroup::release(BindGroup* bindGroup)
+{
+    BindingCache::release(bindGroup->bindGroup);
+    if (bindGroup->uniformBuffer) {
+        BindingCache::purge(bindGroup->uniformBuffer);
+        DeletionQueue::defer(bindGroup->uniformBuffer);
+    }
+    *bindGroup = {};
 }
 
 // ============================================================================
 // Render Pipeline
 // ============================================================================
 
-void RenderPipeline::init(GraphicsContext* ctx, RenderPipeline* pipeline,
-                          const char* vertexShaderCode,
-                          const char* fragmentShaderCode)
+/// @brief Fills in layouts and desc, then the pipeline itself unless async.
+/// Async compiles fill in waiter->pipeline on completion (waiter may be NULL
+/// for warm-up). Shader code is run through the WGSL preprocessor first,
+/// with the defines of the given ShaderPermutation, then stripped down to
+/// each stage's entry point.
+static void createRenderPipeline(
+  GraphicsContext* ctx, RenderPipeline* pipeline, const char* vertexShaderCode,
+  const char* fragmentShaderCode, u32 permutation,
+  const WGPUConstantEntry* constants, u32 constantCount,
+  const WGPUBindGroupLayoutEntry* drawLayoutEntries, u32 drawLayoutEntryCount,
+  bool async, RenderPipeline* waiter)
 {
+    vertexShaderCode
+      = shaderPermutation(vertexShaderCode, permutation, VS_ENTRY_POINT);
+    fragmentShaderCode
+      = shaderPermutation(fragmentShaderCode, permutation, FS_ENTRY_POINT);
+    ASSERT(vertexShaderCode && fragmentShaderCode);
 
     WGPUPrimitiveState primitiveState = {};
     primitiveState.topology           = WGPUPrimitiveTopology_TriangleList;
@@ -597,46 +1021,58 @@ void RenderPipeline::init(GraphicsContext* ctx, RenderPipeline* pipeline,
     primitiveState.frontFace          = WGPUFrontFace_CCW;
     primitiveState.cullMode           = WGPUCullMode_None; // TODO: backface
 
-    WGPUBlendState blendState             = createBlendState(true);
-    WGPUColorTargetState colorTargetState = {};
-    colorTargetState.format               = ctx->swapChainFormat;
-    colorTargetState.blend                = &blendState;
-    colorTargetState.writeMask            = WGPUColorWriteMask_All;
+    // state referenced by pipeline->desc lives in the pipeline itself, so
+    // variants can be derived from desc later
+    pipeline->blendState = createBlendState(true);
+
+    WGPUColorTargetState* colorTargetState = &pipeline->colorTargetState;
+    *colorTargetState                      = {};
+    colorTargetState->format               = ctx->swapChainFormat;
+    colorTargetState->blend                = &pipeline->blendState;
+    colorTargetState->writeMask            = WGPUColorWriteMask_All;
 
-    WGPUDepthStencilState depth_stencil_state
+    pipeline->depthStencilState
       = createDepthStencilState(WGPUTextureFormat_Depth24PlusStencil8, true);
 
     // Setup shader module
-    ShaderModule vertexShaderModule = {}, fragmentShaderModule = {};
-    ShaderModule::init(ctx, &vertexShaderModule, vertexShaderCode,
-                       "vertex shader");
-    ShaderModule::init(ctx, &fragmentShaderModule, fragmentShaderCode,
-                       "fragment shader");
+    // (one minimal module per stage, each compiled once by the cache)
+    WGPUShaderModule vertexShaderModule = PipelineCache::getShaderModule(
+      ctx, vertexShaderCode, "vertex shader");
+    WGPUShaderModule fragmentShaderModule = PipelineCache::getShaderModule(
+      ctx, fragmentShaderCode, "fragment shader");
 
     // for now hardcode attributes to 3:
     // position, normal, uv
-    VertexBufferLayout vertexBufferLayout = {};
-    u32 attributeStrides[]                = {
+    VertexBufferLayout* vertexBufferLayout = &pipeline->vertexBufferLayout;
+    *vertexBufferLayout                    = {};
+    u32 attributeStrides[]                 = {
         3, // position
         3, // normal
         2, // uv
     };
-    VertexBufferLayout::init(&vertexBufferLayout,
+    VertexBufferLayout::init(vertexBufferLayout,
                              ARRAY_LENGTH(attributeStrides), attributeStrides);
 
     // vertex state
     WGPUVertexState vertexState = {};
-    vertexState.bufferCount     = vertexBufferLayout.attribute_count;
-    vertexState.buffers         = vertexBufferLayout.layouts;
-    vertexState.module          = vertexShaderModule.module;
+    vertexState.bufferCount     = vertexBufferLayout->attribute_count;
+    vertexState.buffers         = vertexBufferLayout->layouts;
+    vertexState.module          = vertexShaderModule;
     vertexState.entryPoint      = VS_ENTRY_POINT;
 
     // fragment state
-    WGPUFragmentState fragmentState = {};
-    fragmentState.module            = fragmentShaderModule.module;
-    fragmentState.entryPoint        = FS_ENTRY_POINT;
-    fragmentState.targetCount       = 1;
-    fragmentState.targets           = &colorTargetState;
+    ASSERT(constantCount <= RENDER_PIPELINE_MAX_CONSTANTS);
+    for (u32 i = 0; i < constantCount; i++)
+        pipeline->constants[i] = constants[i];
+
+    WGPUFragmentState* fragmentState = &pipeline->fragmentState;
+    *fragmentState                   = {};
+    fragmentState->module            = fragmentShaderModule;
+    fragmentState->entryPoint        = FS_ENTRY_POINT;
+    fragmentState->targetCount       = 1;
+    fragmentState->targets           = colorTargetState;
+    fragmentState->constantCount     = constantCount; // `override` values
+    fragmentState->constants         = pipeline->constants;
 
     // multisample state
     WGPUMultisampleState multisampleState   = {};
@@ -652,21 +1088,25 @@ void RenderPipeline::init(GraphicsContext* ctx, RenderPipeline* pipeline,
     {
         WGPUBindGroupLayoutEntry bindGroupLayouts[3];
 
-        // Per material uniforms
+        // Per material uniforms, at the material's slot when the buffer is
+        // a shared MaterialBuffer
         bindGroupLayouts[0]         = {};
         bindGroupLayouts[0].binding = 0;
         bindGroupLayouts[0].visibility // always both for simplicity
           = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
         bindGroupLayouts[0].buffer.type = WGPUBufferBindingType_Uniform;
         bindGroupLayouts[0].buffer.minBindingSize   = sizeof(MaterialUniforms);
-        bindGroupLayouts[0].buffer.hasDynamicOffset = false;
+        bindGroupLayouts[0].buffer.hasDynamicOffset = true;
 
         // per material texture
-        bindGroupLayouts[1]                       = {};
-        bindGroupLayouts[1].binding               = 1;
-        bindGroupLayouts[1].visibility            = WGPUShaderStage_Fragment;
-        bindGroupLayouts[1].texture.sampleType    = WGPUTextureSampleType_Float;
-        bindGroupLayouts[1].texture.viewDimension = WGPUTextureViewDimension_2D;
+        bindGroupLayouts[1]                    = {};
+        bindGroupLayouts[1].binding            = 1;
+        bindGroupLayouts[1].visibility         = WGPUShaderStage_Fragment;
+        bindGroupLayouts[1].texture.sampleType = WGPUTextureSampleType_Float;
+        bindGroupLayouts[1].texture.viewDimension
+          = (permutation & SHADER_PERMUTATION_TEXTURE_ARRAY)
+              ? WGPUTextureViewDimension_2DArray
+              : WGPUTextureViewDimension_2D;
 
         // per material sampler
         bindGroupLayouts[2]              = {};
@@ -679,45 +1119,220 @@ void RenderPipeline::init(GraphicsContext* ctx, RenderPipeline* pipeline,
         bindGroupLayoutDesc.entryCount = ARRAY_LENGTH(bindGroupLayouts);
         bindGroupLayoutDesc.entries    = bindGroupLayouts;
         pipeline->bindGroupLayouts[PER_MATERIAL_GROUP]
-          = wgpuDeviceCreateBindGroupLayout(ctx->device, &bindGroupLayoutDesc);
+          = PipelineCache::getBindGroupLayout(ctx, &bindGroupLayoutDesc);
+    }
+
+    if (drawLayoutEntries) {
+        WGPUBindGroupLayoutDescriptor bindGroupLayoutDesc = {};
+        bindGroupLayoutDesc.entryCount = drawLayoutEntryCount;
+        bindGroupLayoutDesc.entries    = drawLayoutEntries;
+        pipeline->bindGroupLayouts[PER_DRAW_GROUP]
+          = PipelineCache::getBindGroupLayout(ctx, &bindGroupLayoutDesc);
+    } else {
+        pipeline->bindGroupLayouts[PER_DRAW_GROUP]
+          = createBindGroupLayout(ctx, PER_DRAW_GROUP, sizeof(DrawUniforms));
     }
 
-    pipeline->bindGroupLayouts[PER_DRAW_GROUP]
-      = createBindGroupLayout(ctx, PER_DRAW_GROUP, sizeof(DrawUniforms));
+    pipeline->bindGroupLayoutCount = LIGHTING_GROUP;
+    if (permutation & SHADER_PERMUTATION_CLUSTERED_LIGHTING) {
+        pipeline->bindGroupLayouts[LIGHTING_GROUP]
+          = ClusteredLighting::bindGroupLayout(ctx);
+        pipeline->bindGroupLayoutCount = LIGHTING_GROUP + 1;
+    }
 
     WGPUPipelineLayoutDescriptor layoutDesc = {};
-    layoutDesc.bindGroupLayoutCount = ARRAY_LENGTH(pipeline->bindGroupLayouts);
+    layoutDesc.bindGroupLayoutCount = pipeline->bindGroupLayoutCount;
     layoutDesc.bindGroupLayouts = pipeline->bindGroupLayouts; // one per @group
     WGPUPipelineLayout pipelineLayout
-      = wgpuDeviceCreatePipelineLayout(ctx->device, &layoutDesc);
-
-    // bind groups
-    BindGroup::init(ctx, &pipeline->bindGroups[PER_FRAME_GROUP],
-                    pipeline->bindGroupLayouts[PER_FRAME_GROUP],
-                    sizeof(FrameUniforms));
+      = PipelineCache::getPipelineLayout(ctx, &layoutDesc);
 
     pipeline->desc              = {};
     pipeline->desc.label        = "render pipeline";
     pipeline->desc.layout       = pipelineLayout; // TODO
     pipeline->desc.primitive    = primitiveState;
     pipeline->desc.vertex       = vertexState;
-    pipeline->desc.fragment     = &fragmentState;
-    pipeline->desc.depthStencil = &depth_stencil_state;
+    pipeline->desc.fragment     = fragmentState;
+    pipeline->desc.depthStencil = &pipeline->depthStencilState;
     pipeline->desc.multisample  = multisampleState;
 
-    pipeline->pipeline
-      = wgpuDeviceCreateRenderPipeline(ctx->device, &pipeline->desc);
+    // alpha tested geometry needs its fragment stage to write depth, custom
+    // draw layouts (instancing) don't match the pre-pass vertex shader
+    pipeline->depthPrepassCompatible
+      = !(permutation & SHADER_PERMUTATION_ALPHA_TEST) && !drawLayoutEntries;
+
+    if (async) {
+        // may already be filled in by the waiter callback on backends that
+        // complete immediately, don't overwrite it
+        WGPURenderPipeline ready
+          = PipelineCache::getRenderPipelineAsync(ctx, &pipeline->desc, waiter);
+        if (ready) pipeline->pipeline = ready;
+    } else {
+        pipeline->pipeline
+          = PipelineCache::getRenderPipeline(ctx, &pipeline->desc);
+        ASSERT(pipeline->pipeline != NULL);
+    }
 
-    ASSERT(pipeline->pipeline != NULL);
+    // release wgpu resources (the cache keeps its own references, which
+    // desc keeps pointing at)
+    wgpuShaderModuleRelease(vertexShaderModule);
+    wgpuShaderModuleRelease(fragmentShaderModule);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+}
+
+void RenderPipeline::init(GraphicsContext* ctx, RenderPipeline* pipeline,
+                          const char* vertexShaderCode,
+                          const char* fragmentShaderCode,
+                          const WGPUBindGroupLayoutEntry* drawLayoutEntries,
+                          u32 drawLayoutEntryCount)
+{
+    createRenderPipeline(ctx, pipeline, vertexShaderCode, fragmentShaderCode,
+                         SHADER_PERMUTATION_NONE, NULL, 0, drawLayoutEntries,
+                         drawLayoutEntryCount, false, NULL);
+
+    // bind groups
+    BindGroup::init(ctx, &pipeline->bindGroups[PER_FRAME_GROUP],
+                    pipeline->bindGroupLayouts[PER_FRAME_GROUP],
+                    sizeof(FrameUniforms));
+}
+
+void RenderPipeline::initAsync(
+  GraphicsContext* ctx, RenderPipeline* pipeline, RenderPipeline* placeholder,
+  const char* vertexShaderCode, const char* fragmentShaderCode,
+  const WGPUBindGroupLayoutEntry* drawLayoutEntries, u32 drawLayoutEntryCount)
+{
+    pipeline->placeholder = placeholder;
+    createRenderPipeline(ctx, pipeline, vertexShaderCode, fragmentShaderCode,
+                         SHADER_PERMUTATION_NONE, NULL, 0, drawLayoutEntries,
+                         drawLayoutEntryCount, true, pipeline);
+
+    // layouts are known up front, bind groups can be created right away
+    BindGroup::init(ctx, &pipeline->bindGroups[PER_FRAME_GROUP],
+                    pipeline->bindGroupLayouts[PER_FRAME_GROUP],
+                    sizeof(FrameUniforms));
+}
+
+void RenderPipeline::initPermutation(
+  GraphicsContext* ctx, RenderPipeline* pipeline, const char* shaderCode,
+  u32 permutation, const WGPUConstantEntry* constants, u32 constantCount,
+  const WGPUBindGroupLayoutEntry* drawLayoutEntries, u32 drawLayoutEntryCount)
+{
+    createRenderPipeline(ctx, pipeline, shaderCode, shaderCode, permutation,
+                         constants, constantCount, drawLayoutEntries,
+                         drawLayoutEntryCount, false, NULL);
+
+    BindGroup::init(ctx, &pipeline->bindGroups[PER_FRAME_GROUP],
+                    pipeline->bindGroupLayouts[PER_FRAME_GROUP],
+                    sizeof(FrameUniforms));
+}
+
+void RenderPipeline::warmUp(GraphicsContext* ctx,
+                            const char* const* shaderCodes, u32 count)
+{
+    for (u32 i = 0; i < count; i++) {
+        RenderPipeline scratch = {};
+        createRenderPipeline(ctx, &scratch, shaderCodes[i], shaderCodes[i],
+                             SHADER_PERMUTATION_NONE, NULL, 0, NULL, 0, true,
+                             NULL);
+        RenderPipeline::release(&scratch); // the cache keeps the result
+    }
+}
+
+WGPURenderPipeline RenderPipeline::current(RenderPipeline* pipeline)
+{
+    if (pipeline->pipeline) return pipeline->pipeline;
+    if (pipeline->placeholder) return pipeline->placeholder->pipeline;
+    return NULL;
+}
+
+bool RenderPipeline::depthPrepassVariants(GraphicsContext* ctx,
+                                          RenderPipeline* pipeline)
+{
+    if (!pipeline->depthPrepassCompatible || !pipeline->pipeline)
+        return false;
+    if (pipeline->depthPrepassPipeline && pipeline->depthEqualPipeline)
+        return true;
+
+    // derived from desc, so both share the pipeline layout and its bind
+    // groups stay valid when switching between them
+    if (!pipeline->depthPrepassPipeline) {
+        const char* code = shaderPermutation(
+          depthPrepassShaderCode, SHADER_PERMUTATION_NONE, VS_ENTRY_POINT);
+        ASSERT(code != NULL);
+        WGPUShaderModule module
+          = PipelineCache::getShaderModule(ctx, code, "depth prepass");
+
+        WGPURenderPipelineDescriptor desc = pipeline->desc;
+        desc.label                        = "depth prepass";
+        desc.vertex.module                = module;
+        desc.vertex.bufferCount           = 1; // positions only
+        desc.fragment                     = NULL;
+        pipeline->depthPrepassPipeline
+          = PipelineCache::getRenderPipelineAsync(ctx, &desc, NULL);
+
+        wgpuShaderModuleRelease(module);
+    }
+
+    if (!pipeline->depthEqualPipeline) {
+        // every visible pixel already has its final depth: shade exactly
+        // the fragments that match it
+        WGPUDepthStencilState depthStencil = pipeline->depthStencilState;
+        depthStencil.depthCompare          = WGPUCompareFunction_Equal;
+        depthStencil.depthWriteEnabled     = false;
+
+        WGPURenderPipelineDescriptor desc = pipeline->desc;
+        desc.label                        = "depth equal shading";
+        desc.depthStencil                 = &depthStencil;
+        pipeline->depthEqualPipeline
+          = PipelineCache::getRenderPipelineAsync(ctx, &desc, NULL);
+    }
 
-    // release wgpu resources
-    ShaderModule::release(&vertexShaderModule);
-    ShaderModule::release(&fragmentShaderModule);
+    return pipeline->depthPrepassPipeline && pipeline->depthEqualPipeline;
 }
 
 void RenderPipeline::release(RenderPipeline* pipeline)
 {
-    wgpuRenderPipelineRelease(pipeline->pipeline);
+    PipelineCache::cancelWait(pipeline);
+    BindGroup::release(&pipeline->bindGroups[PER_FRAME_GROUP]);
+    for (u32 i = 0; i < ARRAY_LENGTH(pipeline->bindGroupLayouts); i++)
+        WGPU_RELEASE_RESOURCE(BindGroupLayout, pipeline->bindGroupLayouts[i]);
+    WGPU_RELEASE_RESOURCE(RenderPipeline, pipeline->pipeline);
+    WGPU_RELEASE_RESOURCE(RenderPipeline, pipeline->depthPrepassPipeline);
+    WGPU_RELEASE_RESOURCE(RenderPipeline, pipeline->depthEqualPipeline);
+}
+
+// ============================================================================
+// Compute Pipeline
+// ============================================================================
+
+void ComputePipeline::init(GraphicsContext* ctx, ComputePipeline* pipeline,
+                           const char* shaderCode, const char* entryPoint,
+                           const char* label)
+{
+    shaderCode
+      = shaderPermutation(shaderCode, SHADER_PERMUTATION_NONE, entryPoint);
+    ASSERT(shaderCode != NULL);
+    WGPUShaderModule shaderModule
+      = PipelineCache::getShaderModule(ctx, shaderCode, label);
+
+    WGPUComputePipelineDescriptor pipelineDesc = {};
+    pipelineDesc.label                         = label;
+    pipelineDesc.layout                        = NULL; // auto
+    pipelineDesc.compute.module                = shaderModule;
+    pipelineDesc.compute.entryPoint            = entryPoint;
+
+    pipeline->pipeline = PipelineCache::getComputePipeline(ctx, &pipelineDesc);
+    ASSERT(pipeline->pipeline != NULL);
+
+    pipeline->bindGroupLayout
+      = wgpuComputePipelineGetBindGroupLayout(pipeline->pipeline, 0);
+
+    wgpuShaderModuleRelease(shaderModule);
+}
+
+void ComputePipeline::release(ComputePipeline* pipeline)
+{
+    WGPU_RELEASE_RESOURCE(BindGroupLayout, pipeline->bindGroupLayout);
+    WGPU_RELEASE_RESOURCE(ComputePipeline, pipeline->pipeline);
 }
 
 // ============================================================================
@@ -742,6 +1357,10 @@ void DepthTexture::init(GraphicsContext* ctx, DepthTexture* depthTexture,
     depthTextureDesc.usage = WGPUTextureUsage_RenderAttachment;
     depthTexture->texture
       = wgpuDeviceCreateTexture(ctx->device, &depthTextureDesc);
+    u64 depthBytes = GPUMemory::textureBytes(
+      format, depthTextureDesc.size.width, depthTextureDesc.size.height, 1, 1);
+    GPUMemory::track(depthTexture->texture, GPU_MEMORY_RENDER_TARGET,
+                     depthBytes, "depth texture");
 
     // Create the view of the depth texture manipulated by the rasterizer
     WGPUTextureViewDescriptor depthTextureViewDesc{};
@@ -760,6 +1379,7 @@ void DepthTexture::init(GraphicsContext* ctx, DepthTexture* depthTexture,
 
 void DepthTexture::release(DepthTexture* depthTexture)
 {
+    GPUMemory::untrack(depthTexture->texture);
     wgpuTextureViewRelease(depthTexture->view);
     wgpuTextureDestroy(depthTexture->texture);
     wgpuTextureRelease(depthTexture->texture);
@@ -769,38 +1389,28 @@ void DepthTexture::release(DepthTexture* depthTexture)
 // MipMapGenerator (static)
 // ============================================================================
 
-#define NUMBER_OF_TEXTURE_FORMATS WGPUTextureFormat_ASTC12x12UnormSrgb // 94
-
 /// @brief Determines the number of mip levels needed for a full mip chain
 static u32 mipLevelCount(int width, int height)
 {
     return (u32)(floor((float)(log2(MAX(width, height))))) + 1;
 }
 
-// TODO make part of GraphicsContext and cleanup
-struct MipMapGenerator {
-    GraphicsContext* ctx;
-    WGPUSampler sampler;
-
-    // Pipeline for every texture format used.
-    // TODO: can layout be shared?
-    WGPUBindGroupLayout pipeline_layouts[(u32)NUMBER_OF_TEXTURE_FORMATS];
-    WGPURenderPipeline pipelines[(u32)NUMBER_OF_TEXTURE_FORMATS];
-    bool active_pipelines[(u32)NUMBER_OF_TEXTURE_FORMATS];
-
-    // Vertex state and Fragment state are shared between all pipelines
-    WGPUVertexState vertexState;
-    WGPUFragmentState fragmentState;
+static MipMapGenerator mipMapGenerator = {};
 
-    static void init(GraphicsContext* ctx, MipMapGenerator* generator);
-    static WGPURenderPipeline getPipeline(MipMapGenerator* generator,
-                                          WGPUTextureFormat format);
-    static WGPUTexture generate(MipMapGenerator* generator, WGPUTexture texture,
-                                WGPUTextureDescriptor* texture_desc);
-    static void release(MipMapGenerator* generator);
-};
+MipMapGenerator* MipMapGenerator::get(GraphicsContext* ctx)
+{
+    if (mipMapGenerator.ctx == NULL)
+        MipMapGenerator::init(ctx, &mipMapGenerator);
+    return &mipMapGenerator;
+}
 
-static MipMapGenerator mipMapGenerator = {};
+static void warmUpMipMapPipelines(GraphicsContext* ctx)
+{
+    MipMapGenerator::init(ctx, &mipMapGenerator);
+    // format used by Texture::initFromFile
+    MipMapGenerator::getPipeline(&mipMapGenerator, WGPUTextureFormat_RGBA8Unorm,
+                                 true);
+}
 
 void MipMapGenerator::init(GraphicsContext* ctx, MipMapGenerator* generator)
 {
@@ -834,15 +1444,19 @@ void MipMapGenerator::release(MipMapGenerator* generator)
         }
     }
 
-    // release shaders
-    // if (generator->vertexState.module != NULL)
-    wgpuShaderModuleRelease(generator->vertexState.module);
-    // if (generator->fragmentState.module != NULL)
-    wgpuShaderModuleRelease(generator->fragmentState.module);
+    // release shader (single reference shared by both stages)
+    WGPU_RELEASE_RESOURCE(ShaderModule, generator->vertexState.module);
+    generator->fragmentState.module = NULL;
+
+    for (u32 i = 0; i < (u32)NUMBER_OF_TEXTURE_FORMATS; i++) {
+        WGPU_RELEASE_RESOURCE(BindGroupLayout, generator->computeLayouts[i]);
+        WGPU_RELEASE_RESOURCE(ComputePipeline, generator->computePipelines[i]);
+    }
 }
 
 WGPURenderPipeline MipMapGenerator::getPipeline(MipMapGenerator* generator,
-                                                WGPUTextureFormat format)
+                                                WGPUTextureFormat format,
+                                                bool async)
 {
     u32 pipeline_index = (u32)format;
     ASSERT(pipeline_index < (u32)NUMBER_OF_TEXTURE_FORMATS)
@@ -870,21 +1484,19 @@ WGPURenderPipeline MipMapGenerator::getPipeline(MipMapGenerator* generator,
     // only create once.
     if (!generator->vertexState.module || !generator->fragmentState.module) {
 
-        ShaderModule vertexShaderModule = {}, fragmentShaderModule = {};
-        ShaderModule::init(ctx, &vertexShaderModule, mipMapShader,
-                           "mipmap vertex shader");
-        ShaderModule::init(ctx, &fragmentShaderModule, mipMapShader,
-                           "mipmap fragment shader");
+        // both stages share one cached module
+        WGPUShaderModule shaderModule
+          = PipelineCache::getShaderModule(ctx, mipMapShader, "mipmap shader");
         // vertex state
         generator->vertexState             = {};
         generator->vertexState.bufferCount = 0;
         generator->vertexState.buffers     = NULL;
-        generator->vertexState.module      = vertexShaderModule.module;
+        generator->vertexState.module      = shaderModule;
         generator->vertexState.entryPoint  = VS_ENTRY_POINT;
 
         // fragment state
         generator->fragmentState             = {};
-        generator->fragmentState.module      = fragmentShaderModule.module;
+        generator->fragmentState.module      = shaderModule;
         generator->fragmentState.entryPoint  = FS_ENTRY_POINT;
         generator->fragmentState.targetCount = 1;
         generator->fragmentState.targets     = &color_target_state_desc;
@@ -893,6 +1505,9 @@ WGPURenderPipeline MipMapGenerator::getPipeline(MipMapGenerator* generator,
         // MipMapGenerator_release shader modules need to be saved for creating
         // other pipelines
     }
+    // target format differs per pipeline, and must not point at a previous
+    // call's stack
+    generator->fragmentState.targets = &color_target_state_desc;
 
     // Multisample state
     WGPUMultisampleState multisampleState   = {};
@@ -909,8 +1524,17 @@ WGPURenderPipeline MipMapGenerator::getPipeline(MipMapGenerator* generator,
     pipelineDesc.multisample = multisampleState;
 
     // Create rendering pipeline using the specified states
-    generator->pipelines[pipeline_index]
-      = wgpuDeviceCreateRenderPipeline(ctx->device, &pipelineDesc);
+    if (async) {
+        // a later blocking call waits for this compile instead of starting
+        // another one
+        WGPURenderPipeline ready
+          = PipelineCache::getRenderPipelineAsync(ctx, &pipelineDesc, NULL);
+        if (!ready) return NULL;
+        generator->pipelines[pipeline_index] = ready;
+    } else {
+        generator->pipelines[pipeline_index]
+          = PipelineCache::getRenderPipeline(ctx, &pipelineDesc);
+    }
     ASSERT(generator->pipelines[pipeline_index] != NULL);
 
     // Store the bind group layout of the created pipeline
@@ -926,13 +1550,150 @@ WGPURenderPipeline MipMapGenerator::getPipeline(MipMapGenerator* generator,
     return generator->pipelines[pipeline_index];
 }
 
+bool MipMapGenerator::computeSupported(WGPUTextureFormat format)
+{
+    // storage formats in core WebGPU that textureLoad returns as floats
+    switch (format) {
+        case WGPUTextureFormat_RGBA8Unorm:
+        case WGPUTextureFormat_RGBA8Snorm:
+        case WGPUTextureFormat_RGBA16Float:
+        case WGPUTextureFormat_R32Float:
+        case WGPUTextureFormat_RG32Float:
+        case WGPUTextureFormat_RGBA32Float: return true;
+        default: return false;
+    }
+}
+
+static const char* storageFormatName(WGPUTextureFormat format)
+{
+    switch (format) {
+        case WGPUTextureFormat_RGBA8Unorm: return "rgba8unorm";
+        case WGPUTextureFormat_RGBA8Snorm: return "rgba8snorm";
+        case WGPUTextureFormat_RGBA16Float: return "rgba16float";
+        case WGPUTextureFormat_R32Float: return "r32float";
+        case WGPUTextureFormat_RG32Float: return "rg32float";
+        case WGPUTextureFormat_RGBA32Float: return "rgba32float";
+        default: return NULL;
+    }
+}
+
+WGPUComputePipeline
+MipMapGenerator::getComputePipeline(MipMapGenerator* generator,
+                                    WGPUTextureFormat format)
+{
+    ASSERT(MipMapGenerator::computeSupported(format));
+    u32 index = (u32)format;
+    if (generator->computePipelines[index])
+        return generator->computePipelines[index];
+
+    GraphicsContext* ctx = generator->ctx;
+
+    // the storage texture format is part of the WGSL type
+    ShaderDefine define = { "MIP_STORAGE_FORMAT", storageFormatName(format) };
+    char* code = ShaderPreprocessor::process(mipMapComputeShader, &define, 1);
+    ASSERT(code != NULL);
+    WGPUShaderModule shaderModule
+      = PipelineCache::getShaderModule(ctx, code, "mipmap compute shader");
+    ShaderPreprocessor::freeSource(code);
+
+    WGPUComputePipelineDescriptor pipelineDesc = {};
+    pipelineDesc.label                         = "mipmap compute pipeline";
+    pipelineDesc.layout                        = NULL; // auto
+    pipelineDesc.compute.module                = shaderModule;
+    pipelineDesc.compute.entryPoint            = CS_ENTRY_POINT;
+
+    generator->computePipelines[index]
+      = PipelineCache::getComputePipeline(ctx, &pipelineDesc);
+    ASSERT(generator->computePipelines[index] != NULL);
+    generator->computeLayouts[index] = wgpuComputePipelineGetBindGroupLayout(
+      generator->computePipelines[index], 0);
+
+    wgpuShaderModuleRelease(shaderModule);
+    return generator->computePipelines[index];
+}
+
+static void generateCompute(MipMapGenerator* generator, WGPUTexture texture,
+                            const WGPUTextureDescriptor* desc,
+                            WGPUCommandEncoder encoder)
+{
+    GraphicsContext* ctx = generator->ctx;
+    WGPUComputePipeline pipeline
+      = MipMapGenerator::getComputePipeline(generator, desc->format);
+    WGPUBindGroupLayout layout = generator->computeLayouts[(u32)desc->format];
+
+    const u32 layers = MAX(desc->size.depthOrArrayLayers, 1u);
+    const u32 levels = desc->mipLevelCount;
+    const u32 passes
+      = (levels - 1 + MIP_COMPUTE_LEVELS - 1) / MIP_COMPUTE_LEVELS;
+
+    // per dispatch: source level + MIP_COMPUTE_LEVELS destinations
+    const u32 viewCount       = passes * (1 + MIP_COMPUTE_LEVELS);
+    WGPUTextureView* views    = ALLOCATE_COUNT(WGPUTextureView, viewCount);
+    WGPUBindGroup* bindGroups = ALLOCATE_COUNT(WGPUBindGroup, passes);
+
+    WGPUTextureViewDescriptor viewDesc = {};
+    viewDesc.label                     = "mipmap compute view";
+    viewDesc.aspect                    = WGPUTextureAspect_All;
+    viewDesc.mipLevelCount             = 1;
+    viewDesc.dimension                 = WGPUTextureViewDimension_2DArray;
+    viewDesc.baseArrayLayer            = 0;
+    viewDesc.arrayLayerCount           = layers;
+
+    WGPUComputePassDescriptor passDesc = {};
+    passDesc.label                     = "mipmap compute";
+    WGPUComputePassEncoder pass
+      = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+    wgpuComputePassEncoderSetPipeline(pass, pipeline);
+
+    for (u32 p = 0; p < passes; p++) {
+        u32 base                   = p * MIP_COMPUTE_LEVELS;
+        WGPUTextureView* passViews = &views[p * (1 + MIP_COMPUTE_LEVELS)];
+        WGPUBindGroupEntry entries[1 + MIP_COMPUTE_LEVELS] = {};
+
+        for (u32 i = 0; i <= MIP_COMPUTE_LEVELS; i++) {
+            // slots past the last level repeat it; the shader sees the
+            // unchanged size and skips them
+            viewDesc.baseMipLevel  = MIN(base + i, levels - 1);
+            passViews[i]           = wgpuTextureCreateView(texture, &viewDesc);
+            entries[i].binding     = i;
+            entries[i].textureView = passViews[i];
+        }
+
+        WGPUBindGroupDescriptor bindGroupDesc = {};
+        bindGroupDesc.layout                  = layout;
+        bindGroupDesc.entryCount              = ARRAY_LENGTH(entries);
+        bindGroupDesc.entries                 = entries;
+        bindGroups[p] = wgpuDeviceCreateBindGroup(ctx->device, &bindGroupDesc);
+
+        // one workgroup per tile of the first level written
+        u32 width  = MAX(desc->size.width >> (base + 1), 1u);
+        u32 height = MAX(desc->size.height >> (base + 1), 1u);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, bindGroups[p], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(
+          pass, (width + MIP_COMPUTE_TILE_SIZE - 1) / MIP_COMPUTE_TILE_SIZE,
+          (height + MIP_COMPUTE_TILE_SIZE - 1) / MIP_COMPUTE_TILE_SIZE, layers);
+    }
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+
+    // the recorded dispatches still use these
+    for (u32 i = 0; i < viewCount; i++) DeletionQueue::defer(views[i]);
+    for (u32 i = 0; i < passes; i++) DeletionQueue::defer(bindGroups[i]);
+    FREE_ARRAY(WGPUTextureView, views, viewCount);
+    FREE_ARRAY(WGPUBindGroup, bindGroups, passes);
+}
+
+static void generateRender(MipMapGenerator* generator, WGPUTexture texture,
+                           WGPUTextureDescriptor* texture_desc,
+                           WGPUCommandEncoder cmd_encoder);
+
 WGPUTexture MipMapGenerator::generate(MipMapGenerator* generator,
                                       WGPUTexture texture,
-                                      WGPUTextureDescriptor* texture_desc)
+                                      WGPUTextureDescriptor* texture_desc,
+                                      WGPUCommandEncoder encoder,
+                                      MipMapPath path)
 {
-    WGPURenderPipeline pipeline
-      = MipMapGenerator::getPipeline(generator, texture_desc->format);
-
     log_trace("Generating %d mip levels for texture %s",
               texture_desc->mipLevelCount, texture_desc->label);
 
@@ -943,6 +1704,46 @@ WGPUTexture MipMapGenerator::generate(MipMapGenerator* generator,
         );
         return NULL;
     }
+    if (texture_desc->mipLevelCount < 2) return texture;
+
+    bool computeCapable
+      = MipMapGenerator::computeSupported(texture_desc->format)
+        && (texture_desc->usage & WGPUTextureUsage_StorageBinding);
+    if (path == MIP_MAP_PATH_COMPUTE && !computeCapable) {
+        log_warn("compute mip generation needs a storage format and usage, "
+                 "using the render path for %s",
+                 texture_desc->label);
+    }
+
+    // standalone: record and submit our own
+    WGPUCommandEncoder ownEncoder = NULL;
+    if (!encoder) {
+        ownEncoder = wgpuDeviceCreateCommandEncoder(generator->ctx->device,
+                                                    NULL);
+        encoder    = ownEncoder;
+    }
+
+    if (path != MIP_MAP_PATH_RENDER && computeCapable)
+        generateCompute(generator, texture, texture_desc, encoder);
+    else
+        generateRender(generator, texture, texture_desc, encoder);
+
+    if (ownEncoder) {
+        WGPUCommandBuffer commands = wgpuCommandEncoderFinish(ownEncoder, NULL);
+        ASSERT(commands != NULL);
+        wgpuCommandEncoderRelease(ownEncoder);
+        wgpuQueueSubmit(generator->ctx->queue, 1, &commands);
+        wgpuCommandBufferRelease(commands);
+    }
+    return texture;
+}
+
+static void generateRender(MipMapGenerator* generator, WGPUTexture texture,
+                           WGPUTextureDescriptor* texture_desc,
+                           WGPUCommandEncoder cmd_encoder)
+{
+    WGPURenderPipeline pipeline
+      = MipMapGenerator::getPipeline(generator, texture_desc->format);
 
     GraphicsContext* ctx        = generator->ctx;
     WGPUTexture mip_texture     = texture;
@@ -977,10 +1778,14 @@ WGPUTexture MipMapGenerator::generate(MipMapGenerator* generator,
 
         mip_texture = wgpuDeviceCreateTexture(ctx->device, &mip_texture_desc);
         ASSERT(mip_texture != NULL);
+        GPUMemory::track(mip_texture, GPU_MEMORY_TEXTURE,
+                         GPUMemory::textureBytes(
+                           mip_texture_desc.format, mip_level_size.width,
+                           mip_level_size.height, array_layer_count,
+                           mip_texture_desc.mipLevelCount),
+                         "mip generation scratch");
     }
 
-    WGPUCommandEncoder cmd_encoder
-      = wgpuDeviceCreateCommandEncoder(ctx->device, NULL);
     u32 pipeline_index = (u32)texture_desc->format;
     WGPUBindGroupLayout bind_group_layout
       = generator->pipeline_layouts[pipeline_index];
@@ -1106,69 +1911,102 @@ WGPUTexture MipMapGenerator::generate(MipMapGenerator* generator,
         }
     }
 
-    WGPUCommandBuffer command_buffer
-      = wgpuCommandEncoderFinish(cmd_encoder, NULL);
-    ASSERT(command_buffer != NULL);
-    WGPU_RELEASE_RESOURCE(CommandEncoder, cmd_encoder)
-
-    // Sumbit commmand buffer
-    wgpuQueueSubmit(ctx->queue, 1, &command_buffer);
-
     { // cleanup
-        WGPU_RELEASE_RESOURCE(CommandBuffer, command_buffer)
-
-        if (!render_to_source) {
-            WGPU_RELEASE_RESOURCE(Texture, mip_texture);
-        }
+        // the recorded passes still use these
+        if (!render_to_source) DeletionQueue::defer(mip_texture);
 
         for (uint32_t i = 0; i < views_count; ++i) {
-            WGPU_RELEASE_RESOURCE(TextureView, views[i]);
+            DeletionQueue::defer(views[i]);
         }
         FREE_ARRAY(WGPUTextureView, views, views_count);
 
         for (uint32_t i = 0; i < bind_group_count; ++i) {
-            WGPU_RELEASE_RESOURCE(BindGroup, bind_groups[i]);
+            DeletionQueue::defer(bind_groups[i]);
         }
         FREE_ARRAY(WGPUBindGroup, bind_groups, bind_group_count);
     }
-
-    return texture;
 }
 
 // ============================================================================
 // Texture
 // ============================================================================
 
-void Texture::initFromFile(GraphicsContext* ctx, Texture* texture,
-                           const char* filename, bool genMipMaps)
+// Force loading 4 channel images to 3 channel by stb becasue Dawn
+// doesn't support 3 channel formats currently. The group is discussing
+// on whether webgpu shoud support 3 channel format.
+// https://github.com/gpuweb/gpuweb/issues/66#issuecomment-410021505
+#define TEXTURE_DESIRED_COMPS STBI_rgb_alpha // force 4 channels
+
+// one window of Texture::initFromFiles(), decoded by the job system.
+// KTX2/DDS files are only read and parsed, images go through the bake cache
+// when bake is set
+struct TextureDecodeJob {
+    const char* const* filenames;
+    const TextureBakeSettings* bake;
+    TextureFile files[TEXTURE_BATCH_DECODE_COUNT];
+    BakedTexture baked[TEXTURE_BATCH_DECODE_COUNT];
+    stbi_uc* pixels[TEXTURE_BATCH_DECODE_COUNT];
+    i32 widths[TEXTURE_BATCH_DECODE_COUNT];
+    i32 heights[TEXTURE_BATCH_DECODE_COUNT];
+    const char* failures[TEXTURE_BATCH_DECODE_COUNT];
+};
+
+static void decodeTexture(void* userData, u32 index)
 {
-    ASSERT(texture->texture == NULL);
+    TextureDecodeJob* job = (TextureDecodeJob*)userData;
+    if (TextureFile::isTextureFile(job->filenames[index])) {
+        if (!TextureFile::load(&job->files[index], job->filenames[index]))
+            job->failures[index] = job->files[index].error;
+        return;
+    }
 
-    i32 width = 0, height = 0;
-    // Force loading 4 channel images to 3 channel by stb becasue Dawn
-    // doesn't support 3 channel formats currently. The group is discussing
-    // on whether webgpu shoud support 3 channel format.
-    // https://github.com/gpuweb/gpuweb/issues/66#issuecomment-410021505
-    i32 read_comps    = 0;
-    i32 desired_comps = STBI_rgb_alpha; // force 4 channels
+    if (job->bake) {
+        if (!TextureBakeCache::load(&job->baked[index], job->filenames[index],
+                                    job->bake))
+            job->failures[index] = job->baked[index].error;
+        return;
+    }
 
-    stbi_set_flip_vertically_on_load(true);
-    stbi_uc* pixel_data = stbi_load(filename,     //
-                                    &width,       //
-                                    &height,      //
-                                    &read_comps,  //
-                                    desired_comps //
-    );
+    i32 read_comps = 0;
+    job->pixels[index]
+      = stbi_load(job->filenames[index], &job->widths[index],
+                  &job->heights[index], &read_comps, TEXTURE_DESIRED_COMPS);
+    // per thread, read it here
+    if (job->pixels[index] == NULL)
+        job->failures[index] = stbi_failure_reason();
+}
 
-    if (pixel_data == NULL) {
-        log_error("Couldn't load '%s'\n", filename);
+WGPUSampler Texture::defaultSampler(GraphicsContext* ctx)
+{
+    /* Create the texture sampler */
+    WGPUSamplerDescriptor samplerDesc = {};
+    samplerDesc.addressModeU          = WGPUAddressMode_Repeat;
+    samplerDesc.addressModeV          = WGPUAddressMode_Repeat;
+    samplerDesc.addressModeW          = WGPUAddressMode_Repeat;
 
-        log_error("Reason: %s\n", stbi_failure_reason());
-        return;
-    } else {
-        log_debug("Loaded image %s (%d, %d, %d / %d)\n", filename, width,
-                  height, read_comps, desired_comps);
-    }
+    // TODO: make filtering configurable
+    samplerDesc.minFilter    = WGPUFilterMode_Linear;
+    samplerDesc.magFilter    = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Linear;
+    // samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+
+    // sampling is clamped to the view's mip levels anyway, leaving the
+    // default max lets every texture share one cached sampler
+    samplerDesc.lodMinClamp   = 0.0f;
+    samplerDesc.lodMaxClamp   = 32.0f;
+    samplerDesc.maxAnisotropy = 1; // TODO: try max of 16
+
+    return BindingCache::getSampler(ctx, &samplerDesc);
+}
+
+/// @brief Upload level 0 and record mip generation into encoder
+static void createTexture(GraphicsContext* ctx, Texture* texture,
+                          const char* filename, const stbi_uc* pixels,
+                          i32 width, i32 height, bool genMipMaps,
+                          WGPUCommandEncoder encoder)
+{
+    ASSERT(texture->texture == NULL);
+    const i32 desired_comps = TEXTURE_DESIRED_COMPS;
 
     // save texture info
     texture->width  = width;
@@ -1178,16 +2016,17 @@ void Texture::initFromFile(GraphicsContext* ctx, Texture* texture,
     // default always gen mipmaps
     texture->mip_level_count = genMipMaps ? mipLevelCount(width, height) : 1u;
 
-    // TODO: support compressed texture formats
+    // compressed formats come from KTX2/DDS files, see TextureFile
     texture->format    = WGPUTextureFormat_RGBA8Unorm;
     texture->dimension = WGPUTextureDimension_2D;
 
     // create texture
     WGPUTextureDescriptor textureDesc = {};
-    // render attachment usage is used for mip map generation
+    // storage usage lets mip maps be generated with compute
     textureDesc.usage
       = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
-    // | WGPUTextureUsage_RenderAttachment;
+    if (genMipMaps && MipMapGenerator::computeSupported(texture->format))
+        textureDesc.usage |= WGPUTextureUsage_StorageBinding;
     textureDesc.dimension       = texture->dimension;
     textureDesc.size            = { (u32)width, (u32)height, 1 };
     textureDesc.format          = texture->format;
@@ -1199,6 +2038,10 @@ void Texture::initFromFile(GraphicsContext* ctx, Texture* texture,
 
     texture->texture = wgpuDeviceCreateTexture(ctx->device, &textureDesc);
     ASSERT(texture->texture != NULL);
+    GPUMemory::track(texture->texture, GPU_MEMORY_TEXTURE,
+                     GPUMemory::textureBytes(textureDesc.format, width, height,
+                                             1, textureDesc.mipLevelCount),
+                     filename);
 
     // write texture data
     {
@@ -1222,23 +2065,16 @@ void Texture::initFromFile(GraphicsContext* ctx, Texture* texture,
                              * textureDesc.size.depthOrArrayLayers
                              * desired_comps;
 
-        wgpuQueueWriteTexture(ctx->queue, &destination, pixel_data, dataSize,
+        wgpuQueueWriteTexture(ctx->queue, &destination, pixels, dataSize,
                               &source, &textureDesc.size);
     }
 
     // generate mipmaps
     if (genMipMaps) {
-        if (mipMapGenerator.ctx == NULL)
-            MipMapGenerator::init(ctx, &mipMapGenerator);
-
-        // generate mipmaps
-        MipMapGenerator::generate(&mipMapGenerator, texture->texture,
-                                  &textureDesc);
+        MipMapGenerator::generate(MipMapGenerator::get(ctx), texture->texture,
+                                  &textureDesc, encoder);
     }
 
-    // free pixel data
-    stbi_image_free(pixel_data);
-
     /* Create the texture view */
     WGPUTextureViewDescriptor textureViewDesc = {};
     textureViewDesc.format                    = textureDesc.format;
@@ -1250,57 +2086,409 @@ void Texture::initFromFile(GraphicsContext* ctx, Texture* texture,
     textureViewDesc.aspect                    = WGPUTextureAspect_All;
     texture->view = wgpuTextureCreateView(texture->texture, &textureViewDesc);
 
-    /* Create the texture sampler */
-    WGPUSamplerDescriptor samplerDesc = {};
-    samplerDesc.addressModeU          = WGPUAddressMode_Repeat;
-    samplerDesc.addressModeV          = WGPUAddressMode_Repeat;
-    samplerDesc.addressModeW          = WGPUAddressMode_Repeat;
+    texture->sampler = Texture::defaultSampler(ctx);
+}
 
-    // TODO: make filtering configurable
-    samplerDesc.minFilter    = WGPUFilterMode_Linear;
-    samplerDesc.magFilter    = WGPUFilterMode_Linear;
-    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Linear;
-    // samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+/// @brief Upload every level of a bake as is, no mips generated
+static void createBakedTexture(GraphicsContext* ctx, Texture* texture,
+                               const char* filename, const BakedTexture* baked)
+{
+    ASSERT(texture->texture == NULL);
 
-    samplerDesc.lodMinClamp   = 0.0f;
-    samplerDesc.lodMaxClamp   = (f32)texture->mip_level_count;
-    samplerDesc.maxAnisotropy = 1; // TODO: try max of 16
+    texture->width           = baked->width;
+    texture->height          = baked->height;
+    texture->depth           = 1;
+    texture->mip_level_count = baked->levelCount;
+    texture->format          = baked->format;
+    texture->dimension       = WGPUTextureDimension_2D;
 
-    texture->sampler = wgpuDeviceCreateSampler(ctx->device, &samplerDesc);
-};
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.usage
+      = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    textureDesc.dimension     = texture->dimension;
+    textureDesc.size          = { baked->width, baked->height, 1 };
+    textureDesc.format        = baked->format;
+    textureDesc.mipLevelCount = baked->levelCount;
+    textureDesc.sampleCount   = 1;
+    textureDesc.label         = filename;
+
+    texture->texture = wgpuDeviceCreateTexture(ctx->device, &textureDesc);
+    ASSERT(texture->texture != NULL);
+    GPUMemory::track(texture->texture, GPU_MEMORY_TEXTURE,
+                     GPUMemory::textureBytes(baked->format, baked->width,
+                                             baked->height, 1,
+                                             baked->levelCount),
+                     filename);
+    BakedTexture::upload(ctx, baked, texture->texture);
+
+    WGPUTextureViewDescriptor textureViewDesc = {};
+    textureViewDesc.format                    = baked->format;
+    textureViewDesc.dimension                 = WGPUTextureViewDimension_2D;
+    textureViewDesc.mipLevelCount             = baked->levelCount;
+    textureViewDesc.arrayLayerCount           = 1;
+    textureViewDesc.aspect                    = WGPUTextureAspect_All;
+    texture->view = wgpuTextureCreateView(texture->texture, &textureViewDesc);
+
+    texture->sampler = Texture::defaultSampler(ctx);
+}
+
+bool Texture::initFromTextureFile(GraphicsContext* ctx, Texture* texture,
+                                  const char* label, const TextureFile* file)
+{
+    ASSERT(texture->texture == NULL);
+    if (!TextureFile::formatSupported(ctx, file->format)) {
+        log_error("Couldn't load '%s': texture format %d needs a compression "
+                  "feature the device lacks",
+                  label, file->format);
+        return false;
+    }
+
+    if (file->topRowFirst)
+        log_warn("'%s' is top row first and its format can't be flipped, "
+                 "sample it with V flipped (see TextureFile)",
+                 label);
+
+    texture->width           = file->width;
+    texture->height          = file->height;
+    texture->depth           = file->layers;
+    texture->mip_level_count = file->levelCount;
+    texture->format          = file->format;
+    texture->dimension       = WGPUTextureDimension_2D;
+
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.usage
+      = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    textureDesc.dimension     = texture->dimension;
+    textureDesc.size          = { file->width, file->height, file->layers };
+    textureDesc.format        = file->format;
+    textureDesc.mipLevelCount = file->levelCount;
+    textureDesc.sampleCount   = 1;
+    textureDesc.label         = label;
+
+    texture->texture = wgpuDeviceCreateTexture(ctx->device, &textureDesc);
+    ASSERT(texture->texture != NULL);
+    GPUMemory::track(texture->texture, GPU_MEMORY_TEXTURE,
+                     GPUMemory::textureBytes(file->format, file->width,
+                                             file->height, file->layers,
+                                             file->levelCount),
+                     label);
+    TextureFile::upload(ctx, file, texture->texture);
+
+    WGPUTextureViewDescriptor textureViewDesc = {};
+    textureViewDesc.format                    = file->format;
+    textureViewDesc.dimension                 = WGPUTextureViewDimension_2D;
+    if (file->faces == 6)
+        textureViewDesc.dimension = file->layers > 6
+                                      ? WGPUTextureViewDimension_CubeArray
+                                      : WGPUTextureViewDimension_Cube;
+    else if (file->layers > 1)
+        textureViewDesc.dimension = WGPUTextureViewDimension_2DArray;
+    textureViewDesc.mipLevelCount   = file->levelCount;
+    textureViewDesc.arrayLayerCount = file->layers;
+    textureViewDesc.aspect          = WGPUTextureAspect_All;
+    texture->view = wgpuTextureCreateView(texture->texture, &textureViewDesc);
+
+    texture->sampler = Texture::defaultSampler(ctx);
+    return true;
+}
+
+void Texture::initFromFile(GraphicsContext* ctx, Texture* texture,
+                           const char* filename, bool genMipMaps)
+{
+    Texture::initFromFiles(ctx, texture, &filename, 1, genMipMaps);
+}
+
+u32 Texture::initFromFiles(GraphicsContext* ctx, Texture* textures,
+                           const char* const* filenames, u32 count,
+                           bool genMipMaps)
+{
+    // global, the same for every worker
+    stbi_set_flip_vertically_on_load(true);
+
+    // baked mips are filtered on the CPU once, then loaded as they are
+    TextureBakeSettings bake = {};
+    bake.format              = CPU_MIP_RGBA8_UNORM;
+    bake.filter              = MIP_FILTER_BOX;
+    bake.levelCount          = genMipMaps ? 0 : 1;
+    bake.flipY               = true;
+
+    WGPUCommandEncoderDescriptor encoderDesc = {};
+    encoderDesc.label                        = "texture batch";
+    WGPUCommandEncoder encoder
+      = wgpuDeviceCreateCommandEncoder(ctx->device, &encoderDesc);
+
+    // decode a window at a time so the decoded pixels of a large batch are
+    // never all in memory at once. Queue writes copy the pixels right away
+    // and take effect before the batch's submit
+    TextureDecodeJob* job = ALLOCATE_COUNT(TextureDecodeJob, 1);
+    u32 loaded            = 0;
+    for (u32 first = 0; first < count; first += TEXTURE_BATCH_DECODE_COUNT) {
+        u32 windowCount = MIN(count - first, (u32)TEXTURE_BATCH_DECODE_COUNT);
+        *job            = {};
+        job->filenames  = &filenames[first];
+        job->bake       = TextureBakeCache::enabled() ? &bake : NULL;
+        JobSystem::parallelFor(windowCount, decodeTexture, job);
+
+        for (u32 i = 0; i < windowCount; i++) {
+            const char* filename = filenames[first + i];
+            if (job->baked[i].data) {
+                createBakedTexture(ctx, &textures[first + i], filename,
+                                   &job->baked[i]);
+                BakedTexture::release(&job->baked[i]);
+                loaded++;
+                continue;
+            }
+            if (job->files[i].data) {
+                // mips come with the file, none are generated
+                if (Texture::initFromTextureFile(ctx, &textures[first + i],
+                                                 filename, &job->files[i]))
+                    loaded++;
+                TextureFile::release(&job->files[i]);
+                continue;
+            }
+            if (job->pixels[i] == NULL) {
+                log_error("Couldn't load '%s'\n", filename);
+
+                log_error("Reason: %s\n", job->failures[i]);
+                continue;
+            }
+            log_debug("Loaded image %s (%d, %d)\n", filename, job->widths[i],
+                      job->heights[i]);
+
+            createTexture(ctx, &textures[first + i], filename, job->pixels[i],
+                          job->widths[i], job->heights[i], genMipMaps,
+                          encoder);
+            stbi_image_free(job->pixels[i]);
+            loaded++;
+        }
+    }
+    FREE(TextureDecodeJob, job);
+
+    // every texture's mip generation in one submission
+    WGPUCommandBuffer commands = wgpuCommandEncoderFinish(encoder, NULL);
+    ASSERT(commands != NULL);
+    wgpuCommandEncoderRelease(encoder);
+    wgpuQueueSubmit(ctx->queue, 1, &commands);
+    wgpuCommandBufferRelease(commands);
+
+    if (count > 1)
+        log_debug("texture batch: %d/%d loaded, 1 submission", loaded, count);
+    return loaded;
+}
+
+bool Texture::initArrayFromFiles(GraphicsContext* ctx, Texture* texture,
+                                 const char* const* filenames, u32 count,
+                                 bool genMipMaps)
+{
+    ASSERT(texture->texture == NULL);
+    ASSERT(count > 0);
+
+    // the first image sizes every layer
+    i32 width = 0, height = 0, comps = 0;
+    if (TextureFile::isTextureFile(filenames[0])
+        || !stbi_info(filenames[0], &width, &height, &comps)) {
+        log_error("texture array: couldn't read '%s'", filenames[0]);
+        return false;
+    }
+
+    texture->width           = width;
+    texture->height          = height;
+    texture->depth           = count;
+    texture->mip_level_count = genMipMaps ? mipLevelCount(width, height) : 1u;
+    texture->format          = WGPUTextureFormat_RGBA8Unorm;
+    texture->dimension       = WGPUTextureDimension_2D;
+
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.usage
+      = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    if (genMipMaps && MipMapGenerator::computeSupported(texture->format))
+        textureDesc.usage |= WGPUTextureUsage_StorageBinding;
+    textureDesc.dimension     = texture->dimension;
+    textureDesc.size          = { (u32)width, (u32)height, count };
+    textureDesc.format        = texture->format;
+    textureDesc.mipLevelCount = texture->mip_level_count;
+    textureDesc.sampleCount   = 1;
+    textureDesc.label         = filenames[0];
+
+    texture->texture = wgpuDeviceCreateTexture(ctx->device, &textureDesc);
+    ASSERT(texture->texture != NULL);
+    GPUMemory::track(texture->texture, GPU_MEMORY_TEXTURE,
+                     GPUMemory::textureBytes(textureDesc.format, width, height,
+                                             count, textureDesc.mipLevelCount),
+                     filenames[0]);
+
+    // decoded a window at a time like initFromFiles(), one layer each
+    stbi_set_flip_vertically_on_load(true);
+    TextureDecodeJob* job = ALLOCATE_COUNT(TextureDecodeJob, 1);
+    bool ok               = true;
+    for (u32 first = 0; first < count; first += TEXTURE_BATCH_DECODE_COUNT) {
+        u32 windowCount = MIN(count - first, (u32)TEXTURE_BATCH_DECODE_COUNT);
+        *job            = {};
+        job->filenames  = &filenames[first];
+        JobSystem::parallelFor(windowCount, decodeTexture, job);
+
+        for (u32 i = 0; i < windowCount; i++) {
+            TextureFile::release(&job->files[i]);
+            if (job->pixels[i] == NULL) {
+                log_error("texture array: couldn't load '%s'",
+                          filenames[first + i]);
+                ok = false;
+                continue;
+            }
+            if (job->widths[i] != width || job->heights[i] != height) {
+                log_error("texture array: '%s' is %dx%d, layers are %dx%d",
+                          filenames[first + i], job->widths[i],
+                          job->heights[i], width, height);
+                ok = false;
+            } else {
+                WGPUImageCopyTexture destination = {};
+                destination.texture              = texture->texture;
+                destination.origin               = { 0, 0, first + i };
+                destination.aspect               = WGPUTextureAspect_All;
+                WGPUTextureDataLayout layout     = {};
+                layout.bytesPerRow               = 4 * (u32)width;
+                layout.rowsPerImage              = (u32)height;
+                WGPUExtent3D extent = { (u32)width, (u32)height, 1 };
+                wgpuQueueWriteTexture(ctx->queue, &destination,
+                                      job->pixels[i], 4 * (u64)width * height,
+                                      &layout, &extent);
+            }
+            stbi_image_free(job->pixels[i]);
+        }
+    }
+    FREE(TextureDecodeJob, job);
+
+    if (!ok) {
+        DeletionQueue::defer(texture->texture);
+        *texture = {};
+        return false;
+    }
+
+    // every layer in one pass, see MipMapGenerator
+    if (genMipMaps)
+        MipMapGenerator::generate(MipMapGenerator::get(ctx), texture->texture,
+                                  &textureDesc);
+
+    WGPUTextureViewDescriptor textureViewDesc = {};
+    textureViewDesc.format                    = texture->format;
+    textureViewDesc.dimension       = WGPUTextureViewDimension_2DArray;
+    textureViewDesc.mipLevelCount   = texture->mip_level_count;
+    textureViewDesc.arrayLayerCount = count;
+    textureViewDesc.aspect          = WGPUTextureAspect_All;
+    texture->view = wgpuTextureCreateView(texture->texture, &textureViewDesc);
+
+    texture->sampler = Texture::defaultSampler(ctx);
+    return true;
+}
 
 void Texture::release(Texture* texture)
 {
-    // release textureview
-    WGPU_RELEASE_RESOURCE(TextureView, texture->view);
+    // the decode jobs and the uploads still refer to texture
+    TextureStreaming::cancel(texture);
+    TextureResidency::unmanage(texture);
+
+    // release textureview, including unused cached bind groups holding it
+    BindingCache::purge(texture->view);
+    DeletionQueue::defer(texture->view);
+    texture->view = NULL;
 
-    // release texture
-    WGPU_DESTROY_RESOURCE(Texture, texture->texture)
-    WGPU_RELEASE_RESOURCE(Texture, texture->texture);
+    // release texture once frames in flight are done sampling it
+    DeletionQueue::defer(texture->texture);
+    texture->texture = NULL;
 
     // release sampler
-    WGPU_RELEASE_RESOURCE(Sampler, texture->sampler)
+    BindingCache::release(texture->sampler);
+    texture->sampler = NULL;
 }
 
 // ============================================================================
 // Material
 // ============================================================================
 
+void MaterialBuffer::init(GraphicsContext* ctx, MaterialBuffer* materials,
+                          u32 capacity)
+{
+    ASSERT(materials->buffer == NULL);
+    ASSERT(sizeof(MaterialUniforms) <= MATERIAL_BUFFER_SLOT_SIZE);
+
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.size                 = (u64)capacity * MATERIAL_BUFFER_SLOT_SIZE;
+    bufferDesc.usage
+      = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
+    bufferDesc.label = "material buffer";
+
+    materials->buffer = wgpuDeviceCreateBuffer(ctx->device, &bufferDesc);
+    GPUMemory::track(materials->buffer, GPU_MEMORY_UNIFORM, bufferDesc.size,
+                     "material buffer");
+
+    materials->capacity  = capacity;
+    materials->count     = 0;
+    materials->freeSlots = ALLOCATE_COUNT(u32, capacity);
+    materials->freeCount = 0;
+}
+
+bool MaterialBuffer::allocate(MaterialBuffer* materials, u32* offset)
+{
+    u32 slot = 0;
+    if (materials->freeCount > 0)
+        slot = materials->freeSlots[--materials->freeCount];
+    else if (materials->count < materials->capacity)
+        slot = materials->count++;
+    else
+        return false;
+
+    *offset = slot * MATERIAL_BUFFER_SLOT_SIZE;
+    return true;
+}
+
+void MaterialBuffer::free(MaterialBuffer* materials, u32 offset)
+{
+    ASSERT(offset % MATERIAL_BUFFER_SLOT_SIZE == 0);
+    ASSERT(materials->freeCount < materials->capacity);
+    materials->freeSlots[materials->freeCount++]
+      = offset / MATERIAL_BUFFER_SLOT_SIZE;
+}
+
+void MaterialBuffer::release(MaterialBuffer* materials)
+{
+    BindingCache::purge(materials->buffer);
+    DeletionQueue::defer(materials->buffer);
+    FREE_ARRAY(u32, materials->freeSlots, materials->capacity);
+    *materials = {};
+}
+
 void Material::init(GraphicsContext* ctx, Material* material,
-                    RenderPipeline* pipeline, Texture* texture)
+                    RenderPipeline* pipeline, Texture* texture,
+                    MaterialBuffer* shared)
 {
     ASSERT(material->bindGroup == NULL);
     ASSERT(texture != NULL);
 
     material->texture = texture;
 
-    // uniform buffer
-    WGPUBufferDescriptor bufferDesc = {};
-    bufferDesc.size
-      = sizeof(MaterialUniforms); // TODO: support multiple materials
-    bufferDesc.mappedAtCreation = false;
-    bufferDesc.usage        = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
-    material->uniformBuffer = wgpuDeviceCreateBuffer(ctx->device, &bufferDesc);
+    // uniforms: a slot of the shared buffer, else a buffer of their own
+    material->shared        = NULL;
+    material->uniformOffset = 0;
+    if (shared) {
+        if (MaterialBuffer::allocate(shared, &material->uniformOffset)) {
+            material->shared        = shared;
+            material->uniformBuffer = shared->buffer;
+        } else {
+            log_warn("material buffer full (%d slots), using an own buffer",
+                     shared->capacity);
+        }
+    }
+    if (!material->shared) {
+        WGPUBufferDescriptor bufferDesc = {};
+        bufferDesc.size                 = sizeof(MaterialUniforms);
+        bufferDesc.mappedAtCreation     = false;
+        bufferDesc.usage
+          = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
+        material->uniformBuffer
+          = wgpuDeviceCreateBuffer(ctx->device, &bufferDesc);
+        GPUMemory::track(material->uniformBuffer, GPU_MEMORY_UNIFORM,
+                         bufferDesc.size, "material uniforms");
+    }
 
     // build bind group entries
     {
@@ -1308,9 +2496,9 @@ void Material::init(GraphicsContext* ctx, Material* material,
         WGPUBindGroupEntry* uniformBinding = &material->entries[0];
         *uniformBinding                    = {};
         uniformBinding->binding            = 0; // @binding(0)
-        uniformBinding->offset             = 0;
+        uniformBinding->offset             = 0; // dynamic: uniformOffset
         uniformBinding->buffer             = material->uniformBuffer;
-        uniformBinding->size               = bufferDesc.size;
+        uniformBinding->size               = sizeof(MaterialUniforms);
 
         // texture bindgroup entry
         WGPUBindGroupEntry* textureBinding = &material->entries[1];
@@ -1332,8 +2520,7 @@ void Material::init(GraphicsContext* ctx, Material* material,
     material->desc.entryCount = ARRAY_LENGTH(material->entries);
     ASSERT(material->desc.entryCount == 3);
 
-    material->bindGroup
-      = wgpuDeviceCreateBindGroup(ctx->device, &material->desc);
+    material->bindGroup = BindingCache::getBindGroup(ctx, &material->desc);
 }
 
 /// @brief Bind a texture to a material (replaces previous texture)
@@ -1362,19 +2549,36 @@ void Material::setTexture(GraphicsContext* ctx, Material* material,
         material->entries[2].sampler = texture->sampler;
     }
 
-    // release old bindgroup
-    wgpuBindGroupRelease(material->bindGroup);
+    // get the new bindgroup before releasing the old one, a combination
+    // used before is still cached and costs only a lookup
+    WGPUBindGroup previous = material->bindGroup;
+    material->bindGroup    = BindingCache::getBindGroup(ctx, &material->desc);
+    BindingCache::release(previous);
+}
 
-    // create new bindgroup
-    material->bindGroup
-      = wgpuDeviceCreateBindGroup(ctx->device, &material->desc);
+void Material::setUniforms(GraphicsContext* ctx, Material* material,
+                           const MaterialUniforms* uniforms)
+{
+    wgpuQueueWriteBuffer(ctx->queue, material->uniformBuffer,
+                         material->uniformOffset, uniforms,
+                         sizeof(MaterialUniforms));
 }
 
 void Material::release(Material* material)
 {
-    wgpuBindGroupRelease(material->bindGroup);
+    BindingCache::release(material->bindGroup);
+    material->bindGroup = NULL;
+
+    // the shared buffer lives on, only the slot is returned
+    if (material->shared) {
+        MaterialBuffer::free(material->shared, material->uniformOffset);
+        material->shared        = NULL;
+        material->uniformBuffer = NULL;
+        return;
+    }
 
     // release buffer (TODO create uniform buffer struct)
-    wgpuBufferDestroy(material->uniformBuffer);
-    wgpuBufferRelease(material->uniformBuffer);
+    BindingCache::purge(material->uniformBuffer);
+    DeletionQueue::defer(material->uniformBuffer);
+    material->uniformBuffer = NULL;
 }
\ No newline at end of file
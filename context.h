@@ -22,6 +22,39 @@
 // const * options); WGPUDevice requestDevice(WGPUAdapter adapter,
 // WGPUDeviceDescriptor const * descriptor);
 
+// ============================================================================
+// Frames in flight
+// ============================================================================
+
+// The CPU records up to framesInFlight frames ahead of the GPU. Each frame
+// slot has its own staging buffer: GraphicsContext::writeBuffer() copies
+// into the slot's mapped staging memory and records a GPU copy to the
+// destination, submitted just before the frame. The copies are ordered with
+// the frame's commands, so a single uniform buffer per object is still
+// correct, and the CPU never writes memory the GPU is reading: a slot's
+// staging buffer is only mapped again once its frame has finished.
+
+#define FRAMES_IN_FLIGHT_DEFAULT 2
+#define FRAMES_IN_FLIGHT_MAX 3
+#define FRAME_STAGING_INITIAL_SIZE (64 * 1024)
+
+struct FrameResources {
+    WGPUBuffer stagingBuffer; // MapWrite | CopySrc
+    u8* staging;              // mapped range, NULL while unmapped
+    u64 stagingSize;
+    u64 stagingUsed;
+    bool mapPending;
+    bool recording; // slot acquired for the frame being recorded
+
+    WGPUCommandEncoder uploadEncoder; // staging -> destination copies
+    u64 frameIndex;                   // last frame recorded in this slot
+    u64 submissionIndex;              // wgpu-native only, for waiting
+};
+
+/// @brief See GraphicsContext::onSubmit
+typedef void (*FrameSubmitCallback)(struct GraphicsContext* ctx,
+                                    void* userdata);
+
 // ============================================================================
 // Context
 // =========================================================================================
@@ -36,9 +69,17 @@ struct GraphicsContext {
 
     WGPUSwapChain swapChain;
     WGPUTextureFormat swapChainFormat;
+    WGPUPresentMode presentMode;
+    u32 width; // swap chain and depth texture size
+    u32 height;
+    // scene viewport, from the top left. Smaller than width x height while
+    // DynamicResolution renders at a reduced scale, reset every frame
+    u32 renderWidth;
+    u32 renderHeight;
 
     WGPUTexture depthTexture;
     WGPUTextureView depthTextureView;
+    WGPUTextureFormat depthTextureFormat;
 
     // Per frame resources --------
     WGPUTextureView backbufferView;
@@ -49,13 +90,64 @@ struct GraphicsContext {
     WGPURenderPassEncoder renderPassEncoder;
     WGPUCommandBuffer commandBuffer;
 
+    // Frame tracking --------
+    u64 frameIndex;      // frame being recorded, from 0
+    u64 framesCompleted; // frames [0, framesCompleted) are done on the GPU
+    u32 framesInFlight;
+    FrameResources frames[FRAMES_IN_FLIGHT_MAX]; // frameIndex % framesInFlight
+
+    // called by presentFrame() just before the frame is submitted: the last
+    // chance for writeBuffer() to change what the frame reads (late latching)
+    FrameSubmitCallback onSubmit;
+    void* onSubmitUserdata;
+
     // Window and surface --------
     WGPUSurface surface;
 
+    // Caches --------
+    struct PipelineCache* pipelineCache;
+
+    // Geometry --------
+    struct MeshPool* meshPool; // shared vertex/index buffers for all meshes
+
     // Methods --------
     static bool init(GraphicsContext* context, GLFWwindow* window);
+
+    /// @brief beginFrame() + beginRenderPass()
     static WGPURenderPassEncoder prepareFrame(GraphicsContext* ctx);
+    /// @brief Acquire backbuffer and create the frame command encoder.
+    /// Compute work / copies for this frame can be recorded into
+    /// ctx->commandEncoder before the render pass begins.
+    static WGPUCommandEncoder beginFrame(GraphicsContext* ctx);
+    static WGPURenderPassEncoder beginRenderPass(GraphicsContext* ctx);
+    /// @brief Viewport and scissor to renderWidth x renderHeight, done by
+    /// beginRenderPass(). For other passes on the depth texture
+    static void setRenderViewport(GraphicsContext* ctx,
+                                  WGPURenderPassEncoder renderPass);
     static void presentFrame(GraphicsContext* ctx);
+    /// @brief Process device events: async pipeline compiles, map callbacks,
+    /// etc. Called once per frame by the runner
+    static void poll(GraphicsContext* ctx);
+    /// @brief Block until all submitted work is done (no-op on emscripten)
+    static void waitIdle(GraphicsContext* ctx);
+
+    /// @brief Fifo is always supported, Mailbox and Immediate depend on the
+    /// platform (emscripten: Fifo only)
+    static bool supportsPresentMode(GraphicsContext* ctx,
+                                    WGPUPresentMode mode);
+    /// @brief Recreates the swap chain. Between frames only. Returns false
+    /// (keeping the current mode) if unsupported
+    static bool setPresentMode(GraphicsContext* ctx, WGPUPresentMode mode);
+    /// @brief 1 to FRAMES_IN_FLIGHT_MAX. Waits for the GPU to go idle
+    static void setFramesInFlight(GraphicsContext* ctx, u32 count);
+    /// @brief Resources of the frame being recorded
+    static FrameResources* currentFrame(GraphicsContext* ctx);
+    /// @brief Like wgpuQueueWriteBuffer, but staged through the current
+    /// frame's staging buffer so the CPU never waits on the GPU. Offset and
+    /// size must be multiples of 4, buffer needs CopyDst usage. Don't mix
+    /// with wgpuQueueWriteBuffer on the same buffer within a frame.
+    static void writeBuffer(GraphicsContext* ctx, WGPUBuffer buffer,
+                            u64 offset, const void* data, u64 size);
     static void resize(GraphicsContext* ctx, u32 width, u32 height);
     static void release(GraphicsContext* ctx);
 };
@@ -73,6 +165,7 @@ struct VertexBuffer {
     static void init(GraphicsContext* ctx, VertexBuffer* buf, u64 data_length,
                      const f32* data, // force float data for now
                      const char* label);
+    static void release(VertexBuffer* buf);
 };
 
 struct IndexBuffer {
@@ -82,6 +175,7 @@ struct IndexBuffer {
     static void init(GraphicsContext* ctx, IndexBuffer* buf, u64 data_length,
                      const u32* data, // force float data for now
                      const char* label);
+    static void release(IndexBuffer* buf);
 };
 
 // ============================================================================
@@ -131,20 +225,42 @@ struct BindGroup {
     // WGPUSampler sampler;
     // WGPUTextureView textureView;
 
+    /// @brief Creates the uniform buffer, the bind group itself comes from
+    /// the BindingCache
     static void init(GraphicsContext* ctx, BindGroup* bindGroup,
                      WGPUBindGroupLayout layout, u64 bufferSize);
+
+    static void release(BindGroup* bindGroup);
 };
 
 // ============================================================================
 // Render Pipeline
 // ============================================================================
 
+#define RENDER_PIPELINE_MAX_CONSTANTS 8
+
 struct RenderPipeline {
     WGPURenderPipeline pipeline;
+    // stays valid for the pipeline's lifetime. Points at the state below;
+    // modules and layout are owned by the PipelineCache
     WGPURenderPipelineDescriptor desc;
 
-    // binding layouts: per frame, per material, per draw
-    WGPUBindGroupLayout bindGroupLayouts[3];
+    VertexBufferLayout vertexBufferLayout;
+    WGPUFragmentState fragmentState;
+    WGPUColorTargetState colorTargetState;
+    WGPUBlendState blendState;
+    WGPUDepthStencilState depthStencilState;
+    WGPUConstantEntry constants[RENDER_PIPELINE_MAX_CONSTANTS];
+
+    // depth pre-pass variants (see DepthPrepass), compiled on first use
+    bool depthPrepassCompatible;
+    WGPURenderPipeline depthPrepassPipeline; // positions only, no fragment
+    WGPURenderPipeline depthEqualPipeline;   // shading, depth Equal, no writes
+
+    // binding layouts: per frame, per material, per draw, and lighting for
+    // SHADER_PERMUTATION_CLUSTERED_LIGHTING
+    WGPUBindGroupLayout bindGroupLayouts[4];
+    u32 bindGroupLayoutCount;
 
     // possible optimization: only store material bind group in render pipeline
     // all pipelines can share global bind groups for per frame
@@ -153,14 +269,84 @@ struct RenderPipeline {
     // each pipeline has a unique per-material layout
     // the actual bind groups are stored elsewhere
     BindGroup bindGroups[1]; // just PER_FRAME_GROUP
-
+    // LIGHTING_GROUP, not owned. Set by ClusteredLighting::bind()
+    WGPUBindGroup lightingBindGroup;
+
+    // async compile state. While `pipeline` is NULL draws use the
+    // placeholder's pipeline, or are skipped if there is none. The
+    // placeholder must use the same bind group layouts (the pipeline cache
+    // dedups layouts, so the same layout descriptors are enough)
+    struct PendingRenderPipeline* pending;
+    RenderPipeline* placeholder;
+
+    /// @param drawLayoutEntries optional PER_DRAW_GROUP layout. Defaults to
+    /// a single DrawUniforms uniform buffer at @binding(0)
     static void init(GraphicsContext* ctx, RenderPipeline* pipeline,
                      const char* vertexShaderCode,
-                     const char* fragmentShaderCode);
+                     const char* fragmentShaderCode,
+                     const WGPUBindGroupLayoutEntry* drawLayoutEntries = NULL,
+                     u32 drawLayoutEntryCount                          = 0);
+
+    /// @brief Like init() but compiles in the background. The pipeline is
+    /// usable immediately through current()
+    static void initAsync(GraphicsContext* ctx, RenderPipeline* pipeline,
+                          RenderPipeline* placeholder,
+                          const char* vertexShaderCode,
+                          const char* fragmentShaderCode,
+                          const WGPUBindGroupLayoutEntry* drawLayoutEntries
+                          = NULL,
+                          u32 drawLayoutEntryCount = 0);
+
+    /// @brief Specialized variant of an uber shader (e.g. shaderCode) used
+    /// for both stages. permutation is a ShaderPermutation bitmask,
+    /// constants set `override` declarations of the fragment stage. Bind
+    /// group layouts are the same for every permutation, so materials work
+    /// with any of them; CLUSTERED_LIGHTING only adds LIGHTING_GROUP and
+    /// TEXTURE_ARRAY takes materials with a 2D array texture.
+    static void
+    initPermutation(GraphicsContext* ctx, RenderPipeline* pipeline,
+                    const char* shaderCode, u32 permutation,
+                    const WGPUConstantEntry* constants                = NULL,
+                    u32 constantCount                                 = 0,
+                    const WGPUBindGroupLayoutEntry* drawLayoutEntries = NULL,
+                    u32 drawLayoutEntryCount                          = 0);
+
+    /// @brief Start background compiles for the default layout/state with
+    /// each shader, so later init() calls hit the pipeline cache. Use
+    /// PipelineCache::waitIdle() to block until done (loading screens)
+    static void warmUp(GraphicsContext* ctx, const char* const* shaderCodes,
+                       u32 count);
+
+    /// @brief Pipeline to draw with right now: the compiled pipeline, else
+    /// the placeholder's, else NULL (skip the draw)
+    static WGPURenderPipeline current(RenderPipeline* pipeline);
+
+    /// @brief Request the depth pre-pass variants, compiling them in the
+    /// background if needed.
+    /// @return true once both are ready. Always false for pipelines that
+    /// can't be pre-passed (alpha test, custom draw layouts)
+    static bool depthPrepassVariants(GraphicsContext* ctx,
+                                     RenderPipeline* pipeline);
 
     static void release(RenderPipeline* pipeline);
 };
 
+// ============================================================================
+// Compute Pipeline
+// ============================================================================
+
+struct ComputePipeline {
+    WGPUComputePipeline pipeline;
+    // only @group(0) supported, derived from the shader (layout: auto)
+    WGPUBindGroupLayout bindGroupLayout;
+
+    static void init(GraphicsContext* ctx, ComputePipeline* pipeline,
+                     const char* shaderCode, const char* entryPoint,
+                     const char* label);
+
+    static void release(ComputePipeline* pipeline);
+};
+
 // ============================================================================
 // Depth Texture
 // ============================================================================
@@ -178,10 +364,82 @@ struct DepthTexture {
     static void release(DepthTexture* depthTexture);
 };
 
+// ============================================================================
+// Mip Map Generator
+// ============================================================================
+
+// Fills mip levels 1.. of a 2D texture (including arrays and cube maps) from
+// level 0, on the GPU.
+//
+// The compute path writes MIP_COMPUTE_LEVELS levels per dispatch through
+// storage textures: each workgroup averages a 32x32 source tile down to
+// 16x16, 8x8, 4x4 and 2x2, keeping the intermediate levels in registers and
+// workgroup memory, with array layers along the dispatch z axis. A 4K
+// texture takes 3 dispatches in one compute pass. It needs a storage
+// capable format and StorageBinding usage on the texture.
+//
+// The render path draws one fullscreen triangle per level and layer,
+// sampling the previous level, and goes through a scratch texture plus
+// copies when the texture lacks RenderAttachment usage. It handles every
+// renderable format, including sRGB ones.
+
+#define NUMBER_OF_TEXTURE_FORMATS WGPUTextureFormat_ASTC12x12UnormSrgb // 94
+// per dispatch, WebGPU's default maxStorageTexturesPerShaderStage
+#define MIP_COMPUTE_LEVELS 4
+
+enum MipMapPath {
+    MIP_MAP_PATH_AUTO = 0, // compute if the texture allows, else render
+    MIP_MAP_PATH_RENDER,
+    MIP_MAP_PATH_COMPUTE,
+};
+
+// TODO make part of GraphicsContext and cleanup
+struct MipMapGenerator {
+    GraphicsContext* ctx;
+    WGPUSampler sampler;
+
+    // Pipeline for every texture format used.
+    // TODO: can layout be shared?
+    WGPUBindGroupLayout pipeline_layouts[(u32)NUMBER_OF_TEXTURE_FORMATS];
+    WGPURenderPipeline pipelines[(u32)NUMBER_OF_TEXTURE_FORMATS];
+    bool active_pipelines[(u32)NUMBER_OF_TEXTURE_FORMATS];
+
+    // Vertex state and Fragment state are shared between all pipelines
+    WGPUVertexState vertexState;
+    WGPUFragmentState fragmentState;
+
+    // compute path, per storage format, created on first use
+    WGPUComputePipeline computePipelines[(u32)NUMBER_OF_TEXTURE_FORMATS];
+    WGPUBindGroupLayout computeLayouts[(u32)NUMBER_OF_TEXTURE_FORMATS];
+
+    /// @brief The shared generator, initialized on first use
+    static MipMapGenerator* get(GraphicsContext* ctx);
+
+    static void init(GraphicsContext* ctx, MipMapGenerator* generator);
+    /// @param async only start compiling, returns NULL unless cached
+    static WGPURenderPipeline getPipeline(MipMapGenerator* generator,
+                                          WGPUTextureFormat format,
+                                          bool async = false);
+    static WGPUComputePipeline getComputePipeline(MipMapGenerator* generator,
+                                                  WGPUTextureFormat format);
+    /// @brief Formats the compute path can write (storage formats)
+    static bool computeSupported(WGPUTextureFormat format);
+    /// @param encoder records into it when given (submitting is up to the
+    /// caller), otherwise submits on its own
+    static WGPUTexture generate(MipMapGenerator* generator, WGPUTexture texture,
+                                WGPUTextureDescriptor* texture_desc,
+                                WGPUCommandEncoder encoder = NULL,
+                                MipMapPath path            = MIP_MAP_PATH_AUTO);
+    static void release(MipMapGenerator* generator);
+};
+
 // ============================================================================
 // Texture
 // ============================================================================
 
+// images decoded at once by Texture::initFromFiles(), bounds peak memory
+#define TEXTURE_BATCH_DECODE_COUNT 16
+
 struct Texture {
     u32 width;
     u32 height;
@@ -194,9 +452,39 @@ struct Texture {
     WGPUTextureView view;
     WGPUSampler sampler;
 
+    /// @brief Images via stb_image as RGBA8. .ktx2 and .dds files keep their
+    /// (block compressed) format and bring their own mips, genMipMaps is
+    /// ignored for them
     static void initFromFile(GraphicsContext* ctx, Texture* texture,
                              const char* filename, bool genMipMaps);
 
+    /// @brief Load many files at once: decoded in parallel on the job
+    /// system, uploads and mip generation go out in a single submission.
+    /// Textures that fail to load are left zeroed (logged)
+    /// @return number of textures loaded
+    static u32 initFromFiles(GraphicsContext* ctx, Texture* textures,
+                             const char* const* filenames, u32 count,
+                             bool genMipMaps);
+
+    /// @brief One 2D array texture, a layer per file (in order), for the
+    /// SHADER_PERMUTATION_TEXTURE_ARRAY shaders. Images via stb_image only,
+    /// all the size of the first. False if any fails (logged), texture is
+    /// left zeroed
+    static bool initArrayFromFiles(GraphicsContext* ctx, Texture* texture,
+                                   const char* const* filenames, u32 count,
+                                   bool genMipMaps);
+
+    /// @brief From a parsed (or BCEncoder encoded) TextureFile, its levels
+    /// uploaded as is. False if the device lacks the format's compression
+    /// feature (logged)
+    static bool initFromTextureFile(GraphicsContext* ctx, Texture* texture,
+                                    const char* label,
+                                    const struct TextureFile* file);
+
+    /// @brief The shared sampler for loaded textures, borrowed from the
+    /// BindingCache (release it with BindingCache::release())
+    static WGPUSampler defaultSampler(GraphicsContext* ctx);
+
     static void release(Texture* texture);
 };
 
@@ -204,12 +492,39 @@ struct Texture {
 // Material
 // ============================================================================
 
+// Uniforms of many materials in one buffer, a MATERIAL_BUFFER_SLOT_SIZE
+// slot each, bound with a dynamic offset. Materials of the same buffer
+// with the same texture build identical bind group descriptors, so the
+// BindingCache hands them all one bind group; draws switching between them
+// only change the offset. Pack their textures into layers of one array
+// (Texture::initArrayFromFiles) or rects of one TextureAtlas to get there.
+
+// minUniformBufferOffsetAlignment (256 by default)
+#define MATERIAL_BUFFER_SLOT_SIZE 256
+
+struct MaterialBuffer {
+    WGPUBuffer buffer;
+    u32 capacity; // slots
+    u32 count;    // slots ever handed out
+    u32* freeSlots;
+    u32 freeCount;
+
+    static void init(GraphicsContext* ctx, MaterialBuffer* materials,
+                     u32 capacity);
+    /// @return false when full
+    static bool allocate(MaterialBuffer* materials, u32* offset);
+    static void free(MaterialBuffer* materials, u32 offset);
+    static void release(MaterialBuffer* materials);
+};
+
 /// @brief Material instance provides uniforms/textures/etc
 /// and bindGroup for a given render pipeline.
 /// Each render pipeline is associated with particular material type
 struct Material {
     WGPUBindGroup bindGroup;
-    WGPUBuffer uniformBuffer;
+    WGPUBuffer uniformBuffer; // owned, or shared->buffer
+    u32 uniformOffset;        // dynamic offset of the uniforms
+    MaterialBuffer* shared;
     // glm::vec4 color;
     Texture* texture; // multiple materials can share same texture
 
@@ -219,11 +534,18 @@ struct Material {
 
     // TODO: store MaterialUniforms struct (struct inheritance, like Obj)
 
+    /// @param shared optional, the uniforms get a slot there instead of
+    /// their own buffer (own buffer if it is full, logged)
     static void init(GraphicsContext* ctx, Material* material,
-                     RenderPipeline* pipeline, Texture* texture);
+                     RenderPipeline* pipeline, Texture* texture,
+                     MaterialBuffer* shared = NULL);
 
     static void setTexture(GraphicsContext* ctx, Material* material,
                            Texture* texture);
 
+    /// @brief Write uniforms at the material's offset
+    static void setUniforms(GraphicsContext* ctx, Material* material,
+                            const struct MaterialUniforms* uniforms);
+
     static void release(Material* material);
 };
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#define CPU_MIPS_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "cpu_mips.h"
+#include "jobs.h"
+#include "memory.h"
+
+// ============================================================================
+// Filters
+// ============================================================================
+
+// radius in destination texels
+#define MIP_FILTER_BOX_RADIUS 0.5f
+#define MIP_FILTER_KAISER_RADIUS 3.0f
+#define MIP_FILTER_KAISER_ALPHA 4.0f
+#define MIP_FILTER_LANCZOS_RADIUS 3.0f
+
+static f32 sinc(f32 x)
+{
+    if (fabsf(x) < 1e-5f) return 1.0f;
+    x *= PI;
+    return sinf(x) / x;
+}
+
+// modified Bessel function of the first kind, order 0, by its power series
+static f32 bessel0(f32 x)
+{
+    f32 sum  = 1.0f;
+    f32 term = 1.0f;
+    for (u32 k = 1; term > 1e-7f * sum; k++) {
+        f32 t = x / (2.0f * k);
+        term *= t * t;
+        sum += term;
+    }
+    return sum;
+}
+
+static f32 filterRadius(MipFilter filter)
+{
+    switch (filter) {
+        case MIP_FILTER_KAISER: return MIP_FILTER_KAISER_RADIUS;
+        case MIP_FILTER_LANCZOS: return MIP_FILTER_LANCZOS_RADIUS;
+        default: return MIP_FILTER_BOX_RADIUS;
+    }
+}
+
+static f32 filterWeight(MipFilter filter, f32 x)
+{
+    x = fabsf(x);
+    switch (filter) {
+        case MIP_FILTER_KAISER: {
+            if (x >= MIP_FILTER_KAISER_RADIUS) return 0.0f;
+            f32 t      = x / MIP_FILTER_KAISER_RADIUS;
+            f32 window = bessel0(MIP_FILTER_KAISER_ALPHA * sqrtf(1.0f - t * t))
+                         / bessel0(MIP_FILTER_KAISER_ALPHA);
+            return sinc(x) * window;
+        }
+        case MIP_FILTER_LANCZOS:
+            if (x >= MIP_FILTER_LANCZOS_RADIUS) return 0.0f;
+            return sinc(x) * sinc(x / MIP_FILTER_LANCZOS_RADIUS);
+        default: return x < MIP_FILTER_BOX_RADIUS ? 1.0f : 0.0f;
+    }
+}
+
+// per destination texel along one axis, the same tap count for all
+struct FilterTaps {
+    u32 count;
+    u32* index;   // [size * count], clamped to the source
+    f32* weights; // [size * count], normalized
+    u32 size;     // destination texels
+};
+
+static void buildTaps(FilterTaps* taps, MipFilter filter, u32 srcSize,
+                      u32 dstSize)
+{
+    // source texels per destination texel, the filter stretches with it
+    f32 scale  = (f32)srcSize / dstSize;
+    f32 radius = filterRadius(filter) * scale;
+
+    taps->count   = (u32)ceilf(2.0f * radius) + 1;
+    taps->size    = dstSize;
+    taps->index   = ALLOCATE_COUNT(u32, dstSize * taps->count);
+    taps->weights = ALLOCATE_COUNT(f32, dstSize * taps->count);
+
+    for (u32 d = 0; d < dstSize; d++) {
+        u32* index   = taps->index + d * taps->count;
+        f32* weights = taps->weights + d * taps->count;
+
+        // texel centers are at +0.5
+        f32 center = (d + 0.5f) * scale;
+        i32 first  = (i32)ceilf(center - radius - 0.5f);
+        f32 sum    = 0.0f;
+        for (u32 k = 0; k < taps->count; k++) {
+            i32 s      = first + (i32)k;
+            weights[k] = filterWeight(filter, (s + 0.5f - center) / scale);
+            index[k]   = (u32)CLAMP(s, 0, (i32)srcSize - 1);
+            sum += weights[k];
+        }
+        for (u32 k = 0; k < taps->count; k++) weights[k] /= sum;
+    }
+}
+
+static void releaseTaps(FilterTaps* taps)
+{
+    FREE_ARRAY(u32, taps->index, taps->size * taps->count);
+    FREE_ARRAY(f32, taps->weights, taps->size * taps->count);
+}
+
+// ============================================================================
+// Conversion
+// ============================================================================
+
+struct CPUMipTables {
+    f32 unormToLinear[256];
+    f32 srgbToLinear[256];
+    // linear value where sRGB code i + 1 starts, for exact rounding
+    f32 srgbThresholds[255];
+};
+
+static f32 srgbDecode(f32 v)
+{
+    return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+static CPUMipTables buildTables()
+{
+    CPUMipTables tables = {};
+    for (u32 i = 0; i < 256; i++) {
+        tables.unormToLinear[i] = i / 255.0f;
+        tables.srgbToLinear[i]  = srgbDecode(i / 255.0f);
+    }
+    for (u32 i = 0; i < 255; i++)
+        tables.srgbThresholds[i] = srgbDecode((i + 0.5f) / 255.0f);
+    return tables;
+}
+
+static const CPUMipTables* getTables()
+{
+    // built once, thread safe
+    static const CPUMipTables tables = buildTables();
+    return &tables;
+}
+
+static u8 encodeUnorm(f32 v)
+{
+    return (u8)(CLAMP(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static u8 encodeSRGB(const CPUMipTables* tables, f32 v)
+{
+    // binary search the rounding thresholds, 8 steps
+    u32 code = 0;
+    for (u32 step = 128; step > 0; step >>= 1) {
+        if (code + step <= 255 && v >= tables->srgbThresholds[code + step - 1])
+            code += step;
+    }
+    return (u8)code;
+}
+
+// ============================================================================
+// Level filtering
+// ============================================================================
+
+struct MipLevelJob {
+    // source level, either f32 or 8 bit through a linearizing table
+    const f32* src;
+    const u8* src8;
+    const f32* toLinear;
+    u32 srcWidth;
+
+    f32* dst; // f32 copy of this level for the next one, NULL if last
+    CPUMipLevel* out;
+    CPUMipFormat format;
+
+    FilterTaps tapsX;
+    FilterTaps tapsY;
+};
+
+static void filterRow(const f32* src, const FilterTaps* taps, f32* dst)
+{
+    for (u32 x = 0; x < taps->size; x++) {
+        const u32* index   = taps->index + x * taps->count;
+        const f32* weights = taps->weights + x * taps->count;
+#ifdef CPU_MIPS_SSE
+        __m128 acc = _mm_setzero_ps();
+        for (u32 k = 0; k < taps->count; k++) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(src + 4 * index[k]),
+                                             _mm_set1_ps(weights[k])));
+        }
+        _mm_storeu_ps(dst + 4 * x, acc);
+#else
+        f32 acc[4] = {};
+        for (u32 k = 0; k < taps->count; k++) {
+            const f32* texel = src + 4 * index[k];
+            for (u32 c = 0; c < 4; c++) acc[c] += weights[k] * texel[c];
+        }
+        memcpy(dst + 4 * x, acc, sizeof(acc));
+#endif
+    }
+}
+
+// dst += weight * src over a row of floats
+static void accumulateRow(f32* dst, const f32* src, f32 weight, u32 floats)
+{
+    u32 i = 0;
+#ifdef CPU_MIPS_SSE
+    __m128 w = _mm_set1_ps(weight);
+    for (; i < floats; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), w);
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), v));
+    }
+#endif
+    for (; i < floats; i++) dst[i] += weight * src[i];
+}
+
+static void filterBand(void* userData, u32 band)
+{
+    MipLevelJob* job          = (MipLevelJob*)userData;
+    const FilterTaps* tapsY   = &job->tapsY;
+    const CPUMipTables* table = getTables();
+
+    u32 width = job->tapsX.size;
+    u32 y0    = band * CPU_MIP_BAND_ROWS;
+    u32 y1    = MIN(y0 + CPU_MIP_BAND_ROWS, tapsY->size);
+
+    // clamped tap indices only grow with y
+    u32 rowFirst = tapsY->index[y0 * tapsY->count];
+    u32 rowLast  = tapsY->index[y1 * tapsY->count - 1];
+    u32 rowCount = rowLast - rowFirst + 1;
+
+    // horizontal pass over the source rows the band reads
+    u32 rowFloats   = 4 * width;
+    f32* horizontal = ALLOCATE_COUNT(f32, rowFloats * rowCount);
+    f32* srcRow     = NULL;
+    if (job->src8) srcRow = ALLOCATE_COUNT(f32, 4 * job->srcWidth);
+    for (u32 r = 0; r < rowCount; r++) {
+        u32 y = rowFirst + r;
+        if (job->src8) {
+            const u8* texels = job->src8 + 4 * (u64)job->srcWidth * y;
+            for (u32 i = 0; i < 4 * job->srcWidth; i += 4) {
+                srcRow[i + 0] = job->toLinear[texels[i + 0]];
+                srcRow[i + 1] = job->toLinear[texels[i + 1]];
+                srcRow[i + 2] = job->toLinear[texels[i + 2]];
+                srcRow[i + 3] = table->unormToLinear[texels[i + 3]];
+            }
+            filterRow(srcRow, &job->tapsX, horizontal + r * rowFloats);
+        } else {
+            filterRow(job->src + 4 * (u64)job->srcWidth * y, &job->tapsX,
+                      horizontal + r * rowFloats);
+        }
+    }
+
+    // vertical pass, then encode
+    f32* rowOut = NULL;
+    if (!job->dst) rowOut = ALLOCATE_COUNT(f32, rowFloats);
+    for (u32 y = y0; y < y1; y++) {
+        f32* row = job->dst ? job->dst + (u64)rowFloats * y : rowOut;
+        memset(row, 0, sizeof(f32) * rowFloats);
+
+        const u32* index   = tapsY->index + y * tapsY->count;
+        const f32* weights = tapsY->weights + y * tapsY->count;
+        for (u32 k = 0; k < tapsY->count; k++) {
+            if (weights[k] == 0.0f) continue;
+            accumulateRow(row, horizontal + (index[k] - rowFirst) * rowFloats,
+                          weights[k], rowFloats);
+        }
+
+        if (job->format == CPU_MIP_RGBA32_FLOAT) continue; // row is the output
+        u8* texels = job->out->pixels + (u64)rowFloats * y;
+        for (u32 i = 0; i < rowFloats; i += 4) {
+            for (u32 c = 0; c < 3; c++) {
+                texels[i + c] = job->format == CPU_MIP_RGBA8_SRGB
+                                  ? encodeSRGB(table, row[i + c])
+                                  : encodeUnorm(row[i + c]);
+            }
+            texels[i + 3] = encodeUnorm(row[i + 3]);
+        }
+    }
+
+    if (rowOut) FREE_ARRAY(f32, rowOut, rowFloats);
+    if (srcRow) FREE_ARRAY(f32, srcRow, 4 * job->srcWidth);
+    FREE_ARRAY(f32, horizontal, rowFloats * rowCount);
+}
+
+// ============================================================================
+// CPU Mip Chain
+// ============================================================================
+
+u32 CPUMipChain::bytesPerPixel(CPUMipFormat format)
+{
+    return format == CPU_MIP_RGBA32_FLOAT ? 4 * sizeof(f32) : 4;
+}
+
+void CPUMipChain::generate(CPUMipChain* chain, const void* pixels, u32 width,
+                           u32 height, CPUMipFormat format, MipFilter filter,
+                           u32 levelCount)
+{
+    ASSERT(chain->levelCount == 0);
+    ASSERT(width > 0 && height > 0);
+
+    u32 fullCount = 1;
+    for (u32 size = MAX(width, height); size > 1; size >>= 1) fullCount++;
+    levelCount = levelCount ? MIN(levelCount, fullCount) : fullCount;
+    ASSERT(levelCount <= CPU_MIP_MAX_LEVELS);
+
+    chain->format     = format;
+    chain->levelCount = levelCount;
+
+    u32 bpp            = bytesPerPixel(format);
+    CPUMipLevel* level = &chain->levels[0];
+    level->width       = width;
+    level->height      = height;
+    level->bytes       = (u64)width * height * bpp;
+    level->pixels      = ALLOCATE_BYTES(u8, level->bytes);
+    memcpy(level->pixels, pixels, level->bytes);
+
+    bool isFloat        = format == CPU_MIP_RGBA32_FLOAT;
+    const f32* toLinear = format == CPU_MIP_RGBA8_SRGB
+                            ? getTables()->srgbToLinear
+                            : getTables()->unormToLinear;
+
+    // 8 bit chains keep the previous level in f32 on the side
+    f32* prev     = isFloat ? (f32*)level->pixels : NULL;
+    u64 prevCount = 0;
+    for (u32 l = 1; l < levelCount; l++) {
+        const CPUMipLevel* src = &chain->levels[l - 1];
+        level                  = &chain->levels[l];
+        level->width           = MAX(1u, src->width >> 1);
+        level->height          = MAX(1u, src->height >> 1);
+        level->bytes           = (u64)level->width * level->height * bpp;
+        level->pixels          = ALLOCATE_BYTES(u8, level->bytes);
+
+        MipLevelJob job = {};
+        job.src         = prev;
+        job.src8        = prev ? NULL : chain->levels[0].pixels;
+        job.toLinear    = toLinear;
+        job.srcWidth    = src->width;
+        job.out         = level;
+        job.format      = format;
+        buildTaps(&job.tapsX, filter, src->width, level->width);
+        buildTaps(&job.tapsY, filter, src->height, level->height);
+
+        u64 dstCount = 0;
+        if (isFloat) {
+            job.dst = (f32*)level->pixels;
+        } else if (l + 1 < levelCount) {
+            dstCount = 4 * (u64)level->width * level->height;
+            job.dst  = ALLOCATE_COUNT(f32, dstCount);
+        }
+
+        u32 bands = (level->height + CPU_MIP_BAND_ROWS - 1) / CPU_MIP_BAND_ROWS;
+        JobSystem::parallelFor(bands, filterBand, &job);
+
+        releaseTaps(&job.tapsX);
+        releaseTaps(&job.tapsY);
+        if (!isFloat && prev) FREE_ARRAY(f32, prev, prevCount);
+        prev      = job.dst;
+        prevCount = dstCount;
+    }
+    if (!isFloat && prev) FREE_ARRAY(f32, prev, prevCount);
+}
+
+void CPUMipChain::upload(GraphicsContext* ctx, const CPUMipChain* chain,
+                         WGPUTexture texture, u32 layer)
+{
+    ASSERT(wgpuTextureGetWidth(texture) == chain->levels[0].width);
+    ASSERT(wgpuTextureGetHeight(texture) == chain->levels[0].height);
+
+    u32 bpp   = bytesPerPixel(chain->format);
+    u32 count = MIN(chain->levelCount, wgpuTextureGetMipLevelCount(texture));
+    for (u32 l = 0; l < count; l++) {
+        const CPUMipLevel* level = &chain->levels[l];
+
+        WGPUImageCopyTexture destination = {};
+        destination.texture              = texture;
+        destination.mipLevel             = l;
+        destination.origin               = { 0, 0, layer };
+        destination.aspect               = WGPUTextureAspect_All;
+        WGPUTextureDataLayout layout     = {};
+        layout.bytesPerRow               = level->width * bpp;
+        layout.rowsPerImage              = level->height;
+        WGPUExtent3D extent              = { level->width, level->height, 1 };
+        wgpuQueueWriteTexture(ctx->queue, &destination, level->pixels,
+                              level->bytes, &layout, &extent);
+    }
+}
+
+void CPUMipChain::release(CPUMipChain* chain)
+{
+    for (u32 l = 0; l < chain->levelCount; l++) {
+        CPUMipLevel* level = &chain->levels[l];
+        FREE_ARRAY(u8, level->pixels, level->bytes);
+    }
+    *chain = {};
+}
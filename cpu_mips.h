@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+
+// ============================================================================
+// CPU Mip Chain
+// ============================================================================
+
+// Builds a mip chain on the CPU from decoded pixels, for offline baking and
+// for devices where MipMapGenerator can't run (no render-to-texture, no
+// storage textures). The GPU paths average texels bilinearly; here every
+// level is filtered from the previous one with a separable filter:
+//
+// - box: plain average, 2x2 for even sizes. Cheapest, softest
+// - Kaiser: Kaiser windowed sinc, 3 texel radius. Sharp with little ringing
+// - Lanczos: 3 lobe Lanczos. Sharpest, rings slightly on hard edges
+//
+// Filtering is done in linear space on f32 RGBA, one SSE register per texel
+// (scalar elsewhere). sRGB input is linearized through a table and each
+// level re-encoded with exact rounding; alpha is always linear. Levels are
+// filtered from the previous f32 level, so 8 bit rounding doesn't pile up
+// down the chain. Edges are clamped.
+//
+// Each level is split into bands of CPU_MIP_BAND_ROWS destination rows, one
+// job system job per band. A band filters the source rows it needs
+// horizontally into its own scratch and then vertically, so there is no
+// full size intermediate and only the previous level is kept in f32.
+//
+// Usage:
+//   CPUMipChain chain = {};
+//   CPUMipChain::generate(&chain, pixels, width, height, CPU_MIP_RGBA8_SRGB,
+//                         MIP_FILTER_KAISER);
+//   CPUMipChain::upload(ctx, &chain, texture); // writeTexture per level
+//   CPUMipChain::release(&chain);
+
+#define CPU_MIP_MAX_LEVELS 16 // up to 32K
+#define CPU_MIP_BAND_ROWS 32  // destination rows per job
+
+enum CPUMipFormat {
+    CPU_MIP_RGBA8_UNORM = 0,
+    CPU_MIP_RGBA8_SRGB, // for sRGB encoded color, whatever the texture format
+    CPU_MIP_RGBA32_FLOAT,
+};
+
+enum MipFilter {
+    MIP_FILTER_BOX = 0,
+    MIP_FILTER_KAISER,
+    MIP_FILTER_LANCZOS,
+};
+
+struct CPUMipLevel {
+    u8* pixels; // tightly packed rows
+    u32 width;
+    u32 height;
+    u64 bytes;
+};
+
+struct CPUMipChain {
+    CPUMipFormat format;
+    u32 levelCount;
+    CPUMipLevel levels[CPU_MIP_MAX_LEVELS]; // level 0 is a copy of the input
+
+    static u32 bytesPerPixel(CPUMipFormat format);
+
+    /// @brief Copy pixels into level 0 and filter the levels below it.
+    /// Blocks, the calling thread helps the job system
+    /// @param levelCount 0 for the full chain down to 1x1
+    static void generate(CPUMipChain* chain, const void* pixels, u32 width,
+                         u32 height, CPUMipFormat format, MipFilter filter,
+                         u32 levelCount = 0);
+
+    /// @brief wgpuQueueWriteTexture for every level the texture has, into
+    /// array layer layer. The texture's format must match in texel size
+    static void upload(GraphicsContext* ctx, const CPUMipChain* chain,
+                       WGPUTexture texture, u32 layer = 0);
+
+    static void release(CPUMipChain* chain);
+};
@@ -0,0 +1,315 @@
+#include "culling.h"
+#include "core/log.h"
+#include "deletion.h"
+#include "entity.h"
+#include "gpu_memory.h"
+#include "memory.h"
+#include "shaders.h"
+
+// dynamic storage offsets must be multiples of
+// minStorageBufferOffsetAlignment (256 by default)
+#define VISIBLE_LIST_ALIGNMENT (256 / sizeof(u32))
+
+// ============================================================================
+// Frustum
+// ============================================================================
+
+void extractFrustumPlanes(const glm::mat4& projView, glm::vec4 planes[6])
+{
+    // Gribb/Hartmann, rows of the combined matrix. glm is column major
+    glm::vec4 row0 = glm::vec4(projView[0][0], projView[1][0], projView[2][0],
+                               projView[3][0]);
+    glm::vec4 row1 = glm::vec4(projView[0][1], projView[1][1], projView[2][1],
+                               projView[3][1]);
+    glm::vec4 row2 = glm::vec4(projView[0][2], projView[1][2], projView[2][2],
+                               projView[3][2]);
+    glm::vec4 row3 = glm::vec4(projView[0][3], projView[1][3], projView[2][3],
+                               projView[3][3]);
+
+    planes[0] = row3 + row0; // left
+    planes[1] = row3 - row0; // right
+    planes[2] = row3 + row1; // bottom
+    planes[3] = row3 - row1; // top
+    planes[4] = row2;        // near (0 <= z)
+    planes[5] = row3 - row2; // far  (z <= w)
+
+    for (u32 i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+// ============================================================================
+// GPU Culler
+// ============================================================================
+
+void GPUCuller::init(GraphicsContext* ctx, GPUCuller* culler)
+{
+    WGPUBindGroupLayoutEntry drawLayoutEntries[2] = {};
+
+    // instances
+    drawLayoutEntries[0].binding     = 0;
+    drawLayoutEntries[0].visibility  = WGPUShaderStage_Vertex;
+    drawLayoutEntries[0].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    drawLayoutEntries[0].buffer.minBindingSize = sizeof(InstanceData);
+
+    // visible list, offset to the start of the batch's list
+    drawLayoutEntries[1].binding     = 1;
+    drawLayoutEntries[1].visibility  = WGPUShaderStage_Vertex;
+    drawLayoutEntries[1].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    drawLayoutEntries[1].buffer.minBindingSize   = sizeof(u32);
+    drawLayoutEntries[1].buffer.hasDynamicOffset = true;
+
+    RenderPipeline::init(ctx, &culler->pipeline, instancedShaderCode,
+                         instancedShaderCode, drawLayoutEntries,
+                         ARRAY_LENGTH(drawLayoutEntries));
+
+    ComputePipeline::init(ctx, &culler->cullPipeline, cullShader,
+                          CS_ENTRY_POINT, "frustum cull");
+}
+
+void GPUCuller::addBatch(GPUCuller* culler, Entity* mesh, Material* material,
+                         const glm::mat4* transforms, u32 count)
+{
+    ASSERT(culler->batchCount < GPU_CULL_MAX_BATCHES);
+    ASSERT(culler->instanceBuffer == NULL); // already uploaded
+
+    // local bounding sphere around the origin
+    f32* positions = Vertices::positions(&mesh->vertices);
+    f32 radius2    = 0.0f;
+    for (u32 i = 0; i < mesh->vertices.vertexCount; i++) {
+        glm::vec3 p = glm::vec3(positions[i * 3 + 0], positions[i * 3 + 1],
+                                positions[i * 3 + 2]);
+        radius2     = MAX(radius2, glm::dot(p, p));
+    }
+    f32 radius = sqrtf(radius2);
+
+    // visible lists are packed after each other
+    u32 visibleBase = 0;
+    if (culler->batchCount > 0) {
+        GPUCullBatch* prev = &culler->batches[culler->batchCount - 1];
+        visibleBase        = prev->visibleBase + prev->instanceCount;
+        visibleBase        = (visibleBase + VISIBLE_LIST_ALIGNMENT - 1)
+                      / VISIBLE_LIST_ALIGNMENT * VISIBLE_LIST_ALIGNMENT;
+    }
+
+    GPUCullBatch* batch  = &culler->batches[culler->batchCount];
+    batch->mesh          = mesh;
+    batch->material      = material;
+    batch->firstInstance = culler->instanceCount;
+    batch->instanceCount = count;
+    batch->visibleBase   = visibleBase;
+
+    if (culler->instanceCount + count > culler->instanceCapacity) {
+        u32 newCapacity = MAX(culler->instanceCapacity * 2,
+                              culler->instanceCount + count);
+        culler->instances = (InstanceData*)reallocate(
+          culler->instances, sizeof(InstanceData) * culler->instanceCapacity,
+          sizeof(InstanceData) * newCapacity);
+        culler->instanceCapacity = newCapacity;
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        const glm::mat4& m = transforms[i];
+
+        // scale radius by the largest axis scale
+        f32 scale2 = MAX(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+                         glm::dot(glm::vec3(m[1]), glm::vec3(m[1])));
+        scale2     = MAX(scale2, glm::dot(glm::vec3(m[2]), glm::vec3(m[2])));
+
+        InstanceData* instance   = &culler->instances[culler->instanceCount++];
+        *instance                = {};
+        instance->modelMat       = m;
+        instance->boundingSphere = glm::vec4(glm::vec3(m[3]),
+                                             radius * sqrtf(scale2));
+        instance->batch          = culler->batchCount;
+        instance->visibleBase    = visibleBase;
+    }
+
+    culler->batchCount++;
+}
+
+static WGPUBuffer createBuffer(GraphicsContext* ctx, u64 size,
+                               WGPUBufferUsageFlags usage, const char* label)
+{
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.label                = label;
+    bufferDesc.size                 = size;
+    bufferDesc.usage                = usage | WGPUBufferUsage_CopyDst;
+    bufferDesc.mappedAtCreation     = false;
+    WGPUBuffer buffer = wgpuDeviceCreateBuffer(ctx->device, &bufferDesc);
+    GPUMemory::track(buffer, GPUMemory::bufferCategory(usage), size, label);
+    return buffer;
+}
+
+void GPUCuller::upload(GraphicsContext* ctx, GPUCuller* culler)
+{
+    ASSERT(culler->batchCount > 0);
+    ASSERT(culler->instanceBuffer == NULL);
+
+    u32 maxBatchSize = 0;
+    for (u32 i = 0; i < culler->batchCount; i++)
+        maxBatchSize = MAX(maxBatchSize, culler->batches[i].instanceCount);
+    GPUCullBatch* last = &culler->batches[culler->batchCount - 1];
+
+    // every batch binds a window of visibleBindingSize starting at its
+    // base, so the buffer must extend that far past the last base
+    culler->visibleBindingSize = sizeof(u32) * maxBatchSize;
+    u64 visibleBufferSize
+      = sizeof(u32) * last->visibleBase + culler->visibleBindingSize;
+
+    culler->instanceBuffer
+      = createBuffer(ctx, sizeof(InstanceData) * culler->instanceCount,
+                     WGPUBufferUsage_Storage, "cull instances");
+    culler->visibleBuffer = createBuffer(
+      ctx, visibleBufferSize, WGPUBufferUsage_Storage, "cull visible list");
+    culler->drawArgsBuffer = createBuffer(
+      ctx, sizeof(DrawIndexedIndirectArgs) * culler->batchCount,
+      WGPUBufferUsage_Storage | WGPUBufferUsage_Indirect, "cull draw args");
+    culler->cullUniformBuffer = createBuffer(
+      ctx, sizeof(CullUniforms), WGPUBufferUsage_Uniform, "cull uniforms");
+
+    wgpuQueueWriteBuffer(ctx->queue, culler->instanceBuffer, 0,
+                         culler->instances,
+                         sizeof(InstanceData) * culler->instanceCount);
+
+    // cull bind group
+    {
+        WGPUBindGroupEntry entries[4] = {};
+        entries[0].binding            = 0;
+        entries[0].buffer             = culler->cullUniformBuffer;
+        entries[0].size               = sizeof(CullUniforms);
+        entries[1].binding            = 1;
+        entries[1].buffer             = culler->instanceBuffer;
+        entries[1].size = sizeof(InstanceData) * culler->instanceCount;
+        entries[2].binding = 2;
+        entries[2].buffer  = culler->visibleBuffer;
+        entries[2].size    = visibleBufferSize;
+        entries[3].binding = 3;
+        entries[3].buffer  = culler->drawArgsBuffer;
+        entries[3].size
+          = sizeof(DrawIndexedIndirectArgs) * culler->batchCount;
+
+        WGPUBindGroupDescriptor desc = {};
+        desc.label                   = "cull bind group";
+        desc.layout                  = culler->cullPipeline.bindGroupLayout;
+        desc.entries                 = entries;
+        desc.entryCount              = ARRAY_LENGTH(entries);
+        culler->cullBindGroup = wgpuDeviceCreateBindGroup(ctx->device, &desc);
+    }
+
+    // draw bind group
+    {
+        WGPUBindGroupEntry entries[2] = {};
+        entries[0].binding            = 0;
+        entries[0].buffer             = culler->instanceBuffer;
+        entries[0].size = sizeof(InstanceData) * culler->instanceCount;
+        entries[1].binding = 1;
+        entries[1].buffer  = culler->visibleBuffer;
+        entries[1].size    = culler->visibleBindingSize;
+
+        WGPUBindGroupDescriptor desc = {};
+        desc.label                   = "instanced draw bind group";
+        desc.layout = culler->pipeline.bindGroupLayouts[PER_DRAW_GROUP];
+        desc.entries    = entries;
+        desc.entryCount = ARRAY_LENGTH(entries);
+        culler->drawBindGroup = wgpuDeviceCreateBindGroup(ctx->device, &desc);
+    }
+
+    log_info("gpu culler: %d instances in %d batches", culler->instanceCount,
+             culler->batchCount);
+
+    // instance data lives on the GPU from now on
+    FREE_ARRAY(InstanceData, culler->instances, culler->instanceCapacity);
+    culler->instanceCapacity = 0;
+}
+
+void GPUCuller::cull(GraphicsContext* ctx, GPUCuller* culler,
+                     const glm::mat4& projView)
+{
+    ASSERT(ctx->commandEncoder != NULL);
+
+    // reset instance counts. Staged writes are copied before the frame's
+    // command buffer executes
+    DrawIndexedIndirectArgs args[GPU_CULL_MAX_BATCHES] = {};
+    for (u32 i = 0; i < culler->batchCount; i++) {
+        MeshAllocation* mesh  = &culler->batches[i].mesh->mesh;
+        args[i].indexCount    = mesh->indexCount;
+        args[i].instanceCount = 0;
+        args[i].firstIndex    = mesh->firstIndex;
+        args[i].baseVertex    = (i32)mesh->baseVertex;
+    }
+    GraphicsContext::writeBuffer(
+      ctx, culler->drawArgsBuffer, 0, args,
+      sizeof(DrawIndexedIndirectArgs) * culler->batchCount);
+
+    CullUniforms uniforms = {};
+    extractFrustumPlanes(projView, uniforms.frustumPlanes);
+    uniforms.instanceCount = culler->instanceCount;
+    GraphicsContext::writeBuffer(ctx, culler->cullUniformBuffer, 0, &uniforms,
+                                 sizeof(uniforms));
+
+    WGPUComputePassDescriptor passDesc = {};
+    passDesc.label                     = "frustum cull";
+    WGPUComputePassEncoder pass
+      = wgpuCommandEncoderBeginComputePass(ctx->commandEncoder, &passDesc);
+    wgpuComputePassEncoderSetPipeline(pass, culler->cullPipeline.pipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, culler->cullBindGroup, 0,
+                                       NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(
+      pass,
+      (culler->instanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE,
+      1, 1);
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+}
+
+void GPUCuller::draw(GPUCuller* culler, WGPURenderPassEncoder renderPass)
+{
+    wgpuRenderPassEncoderSetPipeline(renderPass, culler->pipeline.pipeline);
+    wgpuRenderPassEncoderSetBindGroup(
+      renderPass, PER_FRAME_GROUP,
+      culler->pipeline.bindGroups[PER_FRAME_GROUP].bindGroup, 0, NULL);
+
+    MeshPool* boundMeshPool = NULL;
+    for (u32 i = 0; i < culler->batchCount; i++) {
+        GPUCullBatch* batch = &culler->batches[i];
+        Entity* mesh        = batch->mesh;
+
+        wgpuRenderPassEncoderSetBindGroup(renderPass, PER_MATERIAL_GROUP,
+                                          batch->material->bindGroup, 1,
+                                          &batch->material->uniformOffset);
+
+        // shared geometry buffers, firstIndex/baseVertex are in the
+        // indirect args
+        if (mesh->mesh.pool != boundMeshPool) {
+            boundMeshPool = mesh->mesh.pool;
+            MeshPool::setBuffers(boundMeshPool, renderPass);
+        }
+
+        u32 visibleOffset = sizeof(u32) * batch->visibleBase;
+        wgpuRenderPassEncoderSetBindGroup(renderPass, PER_DRAW_GROUP,
+                                          culler->drawBindGroup, 1,
+                                          &visibleOffset);
+
+        wgpuRenderPassEncoderDrawIndexedIndirect(
+          renderPass, culler->drawArgsBuffer,
+          sizeof(DrawIndexedIndirectArgs) * i);
+    }
+}
+
+void GPUCuller::release(GPUCuller* culler)
+{
+    FREE_ARRAY(InstanceData, culler->instances, culler->instanceCapacity);
+
+    DeletionQueue::defer(culler->drawBindGroup);
+    DeletionQueue::defer(culler->cullBindGroup);
+
+    DeletionQueue::defer(culler->cullUniformBuffer);
+    DeletionQueue::defer(culler->drawArgsBuffer);
+    DeletionQueue::defer(culler->visibleBuffer);
+    DeletionQueue::defer(culler->instanceBuffer);
+
+    ComputePipeline::release(&culler->cullPipeline);
+    RenderPipeline::release(&culler->pipeline);
+
+    *culler = {};
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "common.h"
+#include "context.h"
+
+struct Entity;
+struct InstanceData;
+
+// ============================================================================
+// GPU Culler
+// ============================================================================
+
+// GPU-driven frustum culling. All instances live in one storage buffer;
+// a compute pass tests each instance's bounding sphere against the frustum
+// and appends the visible ones to a per-batch list, incrementing that batch's
+// drawIndexedIndirect instanceCount. The render pass then issues one
+// indirect draw per batch, no CPU readback.
+//
+// A batch is one mesh + material. Instances of a batch are drawn with
+// @builtin(instance_index) indexing the batch's visible list, which is bound
+// through a dynamic storage offset (firstInstance != 0 in indirect draws
+// needs the optional indirect-first-instance feature).
+
+#define GPU_CULL_MAX_BATCHES 64
+
+struct GPUCullBatch {
+    Entity* mesh; // geometry source, only vertices/gpu buffers are used
+    Material* material;
+    u32 firstInstance; // into the instance buffer
+    u32 instanceCount;
+    u32 visibleBase; // into the visible list, 256 byte aligned
+};
+
+struct GPUCuller {
+    // instanced variant of the default pipeline, PER_DRAW_GROUP reads
+    // instances + visible list instead of a DrawUniforms buffer
+    RenderPipeline pipeline;
+    ComputePipeline cullPipeline;
+
+    GPUCullBatch batches[GPU_CULL_MAX_BATCHES];
+    u32 batchCount;
+
+    // cpu staging, freed on upload
+    InstanceData* instances;
+    u32 instanceCount;
+    u32 instanceCapacity;
+
+    WGPUBuffer instanceBuffer;
+    WGPUBuffer visibleBuffer;  // u32 instance indices, per batch
+    WGPUBuffer drawArgsBuffer; // DrawIndexedIndirectArgs per batch
+    WGPUBuffer cullUniformBuffer;
+    u64 visibleBindingSize; // largest batch list, bound with dynamic offset
+
+    WGPUBindGroup cullBindGroup;
+    WGPUBindGroup drawBindGroup;
+
+    static void init(GraphicsContext* ctx, GPUCuller* culler);
+
+    /// @brief Add a batch of instances sharing mesh + material. World space
+    /// bounding spheres are computed from the mesh positions and transforms.
+    /// Must be called before upload()
+    static void addBatch(GPUCuller* culler, Entity* mesh, Material* material,
+                         const glm::mat4* transforms, u32 count);
+
+    /// @brief Create GPU buffers and bind groups for all added batches
+    static void upload(GraphicsContext* ctx, GPUCuller* culler);
+
+    /// @brief Record the cull dispatch into ctx->commandEncoder.
+    /// Call between GraphicsContext::beginFrame() and beginRenderPass()
+    static void cull(GraphicsContext* ctx, GPUCuller* culler,
+                     const glm::mat4& projView);
+
+    /// @brief One drawIndexedIndirect per batch
+    static void draw(GPUCuller* culler, WGPURenderPassEncoder renderPass);
+
+    static void release(GPUCuller* culler);
+};
+
+/// @brief Normalized frustum planes (xyz = inward normal, w = distance) for a
+/// zero-to-one depth projection. Order: left, right, bottom, top, near, far
+void extractFrustumPlanes(const glm::mat4& projView, glm::vec4 planes[6]);
@@ -0,0 +1,175 @@
+#include <string.h>
+
+#include "core/log.h"
+#include "deletion.h"
+#include "gpu_memory.h"
+#include "memory.h"
+
+// ============================================================================
+// Deferred Deletion
+// ============================================================================
+
+#define DELETION_QUEUE_MIN_CAPACITY 64
+
+struct DeferredDeletion {
+    void* handle;
+    u64 frame; // retired while recording this frame
+    DeferredDeletionType type;
+};
+
+struct DeletionQueueState {
+    // FIFO, frames never decrease, so completed entries form a prefix
+    DeferredDeletion* items;
+    u32 count;
+    u32 capacity;
+
+    u64 frame;
+    DeletionQueueStats stats;
+};
+
+static DeletionQueueState deletionQueue = {};
+
+static void push(DeferredDeletionType type, void* handle)
+{
+    if (!handle) return;
+
+    DeletionQueueState* q = &deletionQueue;
+    if (q->count == q->capacity) {
+        u32 capacity = MAX(q->capacity * 2, (u32)DELETION_QUEUE_MIN_CAPACITY);
+        q->items     = (DeferredDeletion*)reallocate(
+          q->items, sizeof(DeferredDeletion) * q->capacity,
+          sizeof(DeferredDeletion) * capacity);
+        q->capacity = capacity;
+    }
+
+    DeferredDeletion* item = &q->items[q->count++];
+    item->handle           = handle;
+    item->frame            = q->frame;
+    item->type             = type;
+
+    q->stats.deferred++;
+    q->stats.pending = q->count;
+    q->stats.peak    = MAX(q->stats.peak, q->count);
+}
+
+static void releaseNow(DeferredDeletion* item)
+{
+    switch (item->type) {
+        case DEFERRED_DELETION_BUFFER: {
+            WGPUBuffer buffer = (WGPUBuffer)item->handle;
+            GPUMemory::untrack(buffer);
+            wgpuBufferDestroy(buffer);
+            wgpuBufferRelease(buffer);
+        } break;
+        case DEFERRED_DELETION_TEXTURE: {
+            WGPUTexture texture = (WGPUTexture)item->handle;
+            GPUMemory::untrack(texture);
+            wgpuTextureDestroy(texture);
+            wgpuTextureRelease(texture);
+        } break;
+        case DEFERRED_DELETION_TEXTURE_VIEW:
+            wgpuTextureViewRelease((WGPUTextureView)item->handle);
+            break;
+        case DEFERRED_DELETION_SAMPLER:
+            wgpuSamplerRelease((WGPUSampler)item->handle);
+            break;
+        case DEFERRED_DELETION_BIND_GROUP:
+            wgpuBindGroupRelease((WGPUBindGroup)item->handle);
+            break;
+        case DEFERRED_DELETION_RENDER_BUNDLE:
+            wgpuRenderBundleRelease((WGPURenderBundle)item->handle);
+            break;
+        case DEFERRED_DELETION_QUERY_SET: {
+            WGPUQuerySet querySet = (WGPUQuerySet)item->handle;
+            wgpuQuerySetDestroy(querySet);
+            wgpuQuerySetRelease(querySet);
+        } break;
+        default: ASSERT(false); break;
+    }
+}
+
+void DeletionQueue::defer(WGPUBuffer buffer)
+{
+    push(DEFERRED_DELETION_BUFFER, buffer);
+}
+
+void DeletionQueue::defer(WGPUTexture texture)
+{
+    push(DEFERRED_DELETION_TEXTURE, texture);
+}
+
+void DeletionQueue::defer(WGPUTextureView view)
+{
+    push(DEFERRED_DELETION_TEXTURE_VIEW, view);
+}
+
+void DeletionQueue::defer(WGPUSampler sampler)
+{
+    push(DEFERRED_DELETION_SAMPLER, sampler);
+}
+
+void DeletionQueue::defer(WGPUBindGroup bindGroup)
+{
+    push(DEFERRED_DELETION_BIND_GROUP, bindGroup);
+}
+
+void DeletionQueue::defer(WGPURenderBundle bundle)
+{
+    push(DEFERRED_DELETION_RENDER_BUNDLE, bundle);
+}
+
+void DeletionQueue::defer(WGPUQuerySet querySet)
+{
+    push(DEFERRED_DELETION_QUERY_SET, querySet);
+}
+
+void DeletionQueue::setFrame(u64 frameIndex)
+{
+    ASSERT(frameIndex >= deletionQueue.frame);
+    deletionQueue.frame = frameIndex;
+}
+
+void DeletionQueue::collect(u64 completedFrames)
+{
+    DeletionQueueState* q = &deletionQueue;
+
+    u32 done = 0;
+    while (done < q->count && q->items[done].frame < completedFrames)
+        releaseNow(&q->items[done++]);
+    if (done == 0) return;
+
+    // keep the rest in order at the front
+    q->count -= done;
+    memmove(q->items, q->items + done, sizeof(DeferredDeletion) * q->count);
+
+    q->stats.released += done;
+    q->stats.pending = q->count;
+    q->stats.batches++;
+}
+
+void DeletionQueue::flush()
+{
+    DeletionQueueState* q = &deletionQueue;
+    for (u32 i = 0; i < q->count; i++) releaseNow(&q->items[i]);
+    q->stats.released += q->count;
+    q->stats.pending = 0;
+
+    FREE_ARRAY(DeferredDeletion, q->items, q->capacity);
+    q->count    = 0;
+    q->capacity = 0;
+}
+
+DeletionQueueStats DeletionQueue::stats()
+{
+    return deletionQueue.stats;
+}
+
+void DeletionQueue::logStats()
+{
+    DeletionQueueStats* stats = &deletionQueue.stats;
+    log_info("%-18s %6llu deferred, %6llu released in %d batches, %d "
+             "pending (peak %d)",
+             "deletion queue", (unsigned long long)stats->deferred,
+             (unsigned long long)stats->released, stats->batches,
+             stats->pending, stats->peak);
+}
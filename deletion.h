@@ -0,0 +1,68 @@
+#pragma once
+
+#include <webgpu/webgpu.h>
+
+#include "common.h"
+
+// ============================================================================
+// Deferred Deletion
+// ============================================================================
+
+// Resources retired while the GPU may still be using them (recorded into the
+// current frame, a previous frame still in flight, or a submitted copy) are
+// handed to the deletion queue instead of being released right away. Each is
+// tagged with the frame it was retired in and released once the GPU has
+// finished that frame, as reported by wgpuQueueOnSubmittedWorkDone.
+//
+// Releases are batched: collect() runs once per frame from
+// GraphicsContext::poll(), not at the call sites. Buffers and textures are
+// destroyed as well, freeing their memory without waiting for the last
+// reference to go away.
+//
+// Process wide like the binding cache, main thread only. GraphicsContext
+// advances the frame and reports completed frames.
+
+enum DeferredDeletionType {
+    DEFERRED_DELETION_BUFFER = 0, // destroy + release
+    DEFERRED_DELETION_TEXTURE,    // destroy + release
+    DEFERRED_DELETION_TEXTURE_VIEW,
+    DEFERRED_DELETION_SAMPLER,
+    DEFERRED_DELETION_BIND_GROUP,
+    DEFERRED_DELETION_RENDER_BUNDLE,
+    DEFERRED_DELETION_QUERY_SET, // destroy + release
+    DEFERRED_DELETION_TYPE_COUNT,
+};
+
+struct DeletionQueueStats {
+    u64 deferred; // total handed to the queue
+    u64 released; // total released
+    u32 pending;  // waiting for their frame to complete
+    u32 peak;     // high water mark of pending
+    u32 batches;  // collect() calls that released something
+};
+
+struct DeletionQueue {
+    /// @brief Release handle (NULL is ignored) once the current frame is
+    /// done on the GPU. Buffers and textures are untracked from GPUMemory
+    /// when actually destroyed.
+    static void defer(WGPUBuffer buffer);
+    static void defer(WGPUTexture texture);
+    static void defer(WGPUTextureView view);
+    static void defer(WGPUSampler sampler);
+    static void defer(WGPUBindGroup bindGroup);
+    static void defer(WGPURenderBundle bundle);
+    static void defer(WGPUQuerySet querySet);
+
+    /// @brief Called after the frame's submit: later deferrals belong to
+    /// frameIndex
+    static void setFrame(u64 frameIndex);
+
+    /// @brief Release everything retired before frame completedFrames
+    static void collect(u64 completedFrames);
+
+    /// @brief Release everything now. Only once the device is idle
+    static void flush();
+
+    static DeletionQueueStats stats();
+    static void logStats();
+};
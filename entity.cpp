@@ -32,11 +32,17 @@ void Entity::setVertices(Entity* entity, Vertices* vertices,
     ASSERT(entity->vertices.vertexData == NULL);
     entity->vertices = *vertices; // points to same memory
 
-    // build gpu buffers
-    VertexBuffer::init(ctx, &entity->gpuVertices, 8 * vertices->vertexCount,
-                       vertices->vertexData, "vertices");
-    IndexBuffer::init(ctx, &entity->gpuIndices, vertices->indicesCount,
-                      vertices->indices, "indices");
+    f32* positions = Vertices::positions(vertices);
+    f32 radius2    = 0.0f;
+    for (u32 i = 0; i < vertices->vertexCount; i++) {
+        glm::vec3 p = glm::vec3(positions[i * 3 + 0], positions[i * 3 + 1],
+                                positions[i * 3 + 2]);
+        radius2     = MAX(radius2, glm::dot(p, p));
+    }
+    entity->boundingRadius = sqrtf(radius2);
+
+    // upload into the shared mesh buffers
+    MeshPool::allocate(ctx, ctx->meshPool, vertices, &entity->mesh);
 }
 
 glm::mat4 Entity::modelMatrix(Entity* entity)
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "context.h"
+#include "geometry.h"
 #include "shapes.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -37,9 +38,12 @@ struct Entity {
 
     // cpu geometry (TODO share across entities)
     Vertices vertices;
-    // gpu geometry (renderable) (TODO share across entities)
-    VertexBuffer gpuVertices;
-    IndexBuffer gpuIndices;
+    // gpu geometry (renderable), a range of the context's MeshPool. Can be
+    // shared across entities by copying
+    MeshAllocation mesh;
+    // local bounding sphere around the origin, set by setVertices(). Copy it
+    // along with the mesh
+    f32 boundingRadius;
 
     // BindGroupEntry to hold model uniform buffer
     // currently only model matrices
@@ -0,0 +1,168 @@
+#include <GLFW/glfw3.h>
+
+#include "bc_encoder.h"
+#include "context.h"
+#include "core/log.h"
+#include "cpu_mips.h"
+#include "example.h"
+#include "memory.h"
+#include "stb/stb_image.h"
+#include "texture_file.h"
+
+// BC encoder benchmark: every source/format pair is encoded on the job
+// system (throughput in megapixels per second of level 0, best of a few
+// runs), decoded again and compared with the source (PSNR over the channels
+// the format keeps). Then the albedo goes through the load time path: CPU
+// mip chain, BC7 for every level, uploaded through a TextureFile.
+// Results are logged once at startup.
+//
+// Cases without a file are generated: every 4x4 block half one color, half
+// the other, two columns each. Red against green and magenta against cyan
+// are anti-correlated channels, which an encoder fitting along the block's
+// bounding box diagonal blends into a solid block.
+
+#define BC_BENCH_ITERATIONS 3
+#define BC_BENCH_PATTERN_SIZE 256
+
+struct BCBenchCase {
+    const char* filename; // NULL for a generated pattern
+    BCFormat format;
+    u32 colors[2]; // the pattern's, RGBA8 little endian
+};
+
+static const BCBenchCase benchCases[] = {
+    { "./assets/fourareen/fourareen2K_albedo.jpg", BC_FORMAT_BC1, {} },
+    { "./assets/fourareen/fourareen2K_albedo.jpg", BC_FORMAT_BC3, {} },
+    { "./assets/fourareen/fourareen2K_albedo.jpg", BC_FORMAT_BC7, {} },
+    { "./assets/brickwall_albedo.png", BC_FORMAT_BC1, {} },
+    { "./assets/brickwall_albedo.png", BC_FORMAT_BC7, {} },
+    { "./assets/brickwall_normal.png", BC_FORMAT_BC5, {} },
+    { "./assets/brickwall_height.png", BC_FORMAT_BC4, {} },
+    { NULL, BC_FORMAT_BC1, { 0xFF0000FFu, 0xFF00FF00u } }, // red, green
+    { NULL, BC_FORMAT_BC3, { 0xFF0000FFu, 0xFF00FF00u } },
+    { NULL, BC_FORMAT_BC7, { 0xFF0000FFu, 0xFF00FF00u } },
+    { NULL, BC_FORMAT_BC1, { 0xFFFF00FFu, 0xFFFFFF00u } }, // magenta, cyan
+    { NULL, BC_FORMAT_BC7, { 0xFFFF00FFu, 0xFFFFFF00u } },
+};
+
+static const char* formatNames[] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+
+static GraphicsContext* gctx = NULL;
+static Texture texture       = {};
+
+static u32* generatePattern(const BCBenchCase* bench)
+{
+    u32 size    = BC_BENCH_PATTERN_SIZE;
+    u32* pixels = ALLOCATE_COUNT(u32, size * size);
+    for (u32 y = 0; y < size; y++)
+        for (u32 x = 0; x < size; x++)
+            pixels[y * size + x] = bench->colors[(x >> 1) & 1];
+    return pixels;
+}
+
+static void benchCase(const BCBenchCase* bench)
+{
+    i32 width = 0, height = 0, comps = 0;
+    char name[64];
+    u8* pixels = NULL;
+    if (bench->filename) {
+        snprintf(name, sizeof(name), "%s", bench->filename);
+        pixels = stbi_load(bench->filename, &width, &height, &comps, 4);
+    } else {
+        snprintf(name, sizeof(name), "pattern %08X/%08X", bench->colors[0],
+                 bench->colors[1]);
+        pixels = (u8*)generatePattern(bench);
+        width = height = BC_BENCH_PATTERN_SIZE;
+    }
+    if (pixels == NULL) {
+        log_error("bc bench: couldn't load '%s'", bench->filename);
+        return;
+    }
+
+    u64 blockBytes = BCEncoder::encodedBytes(bench->format, width, height);
+    u64 texelBytes = 4 * (u64)width * height;
+    u8* blocks     = ALLOCATE_BYTES(u8, blockBytes);
+    u8* decoded    = ALLOCATE_BYTES(u8, texelBytes);
+
+    f64 best = 1e30;
+    for (u32 i = 0; i < BC_BENCH_ITERATIONS; i++) {
+        f64 start = glfwGetTime();
+        BCEncoder::encode(pixels, width, height, bench->format, blocks);
+        best = MIN(best, glfwGetTime() - start);
+    }
+    BCEncoder::decode(blocks, width, height, bench->format, decoded);
+    f64 psnr = BCEncoder::psnr(pixels, decoded, width, height,
+                               BCEncoder::channelMask(bench->format));
+
+    log_info("  %-44s %4dx%-4d %s: %7.1f MP/s, PSNR %5.2f dB", name, width,
+             height, formatNames[bench->format],
+             (f64)width * height / 1e6 / best, psnr);
+
+    FREE_ARRAY(u8, blocks, blockBytes);
+    FREE_ARRAY(u8, decoded, texelBytes);
+    if (bench->filename) stbi_image_free(pixels);
+    else FREE_ARRAY(u8, pixels, texelBytes);
+}
+
+static void loadCompressed(const char* filename, BCFormat format)
+{
+    if (!TextureFile::formatSupported(gctx,
+                                      BCEncoder::textureFormat(format, true))) {
+        log_info("bc bench: no BC support on this device, skipping upload");
+        return;
+    }
+
+    i32 width = 0, height = 0, comps = 0;
+    stbi_uc* pixels = stbi_load(filename, &width, &height, &comps, 4);
+    if (pixels == NULL) return;
+
+    f64 start         = glfwGetTime();
+    CPUMipChain chain = {};
+    CPUMipChain::generate(&chain, pixels, width, height, CPU_MIP_RGBA8_SRGB,
+                          MIP_FILTER_KAISER);
+    stbi_image_free(pixels);
+
+    TextureFile file = {};
+    if (BCEncoder::encodeMipChain(&chain, format, &file)) {
+        Texture::initFromTextureFile(gctx, &texture, filename, &file);
+        log_info("bc bench: %s with %d %s levels (%.1f MB) in %.1f ms",
+                 filename, file.levelCount, formatNames[format],
+                 file.size / (1024.0 * 1024.0),
+                 1000.0 * (glfwGetTime() - start));
+    } else {
+        log_error("bc bench: %s", file.error);
+    }
+    TextureFile::release(&file);
+    CPUMipChain::release(&chain);
+}
+
+static void onInit(GraphicsContext* ctx, GLFWwindow* window)
+{
+    UNUSED_VAR(window);
+    gctx = ctx;
+
+    log_info("bc bench: best of %d", BC_BENCH_ITERATIONS);
+    for (u32 i = 0; i < ARRAY_LENGTH(benchCases); i++)
+        benchCase(&benchCases[i]);
+
+    loadCompressed(benchCases[0].filename, BC_FORMAT_BC7);
+}
+
+static void onRender()
+{
+    GraphicsContext::prepareFrame(gctx);
+    GraphicsContext::presentFrame(gctx);
+}
+
+static void onExit()
+{
+    if (texture.texture) Texture::release(&texture);
+}
+
+void Example_BCBench(ExampleCallbacks* callbacks)
+{
+    *callbacks           = {};
+    callbacks->onInit    = onInit;
+    callbacks->onRender  = onRender;
+    callbacks->onExit    = onExit;
+}
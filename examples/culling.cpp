@@ -0,0 +1,181 @@
+#include <GLFW/glfw3.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp> // quatToMat4
+
+#include "cache.h"
+#include "context.h"
+#include "core/log.h"
+#include "culling.h"
+#include "entity.h"
+#include "example.h"
+#include "memory.h"
+#include "shaders.h"
+
+// GPU-driven rendering: ~100k instances in a few batches, frustum culled by a
+// compute pass and drawn with one drawIndexedIndirect per batch. The CPU cost
+// per frame is constant regardless of instance count or visibility.
+
+#define CULLING_GRID_SIZE 46 // 46^3 ~= 97k instances
+#define CULLING_SPACING 4.0f
+
+static GraphicsContext* gctx = NULL;
+static GLFWwindow* window    = NULL;
+
+static GPUCuller culler        = {};
+static Entity cameraEntity     = {};
+static Entity cubeMesh         = {};
+static Entity sphereMesh       = {}; // low poly stand-in, a 2 segment cube
+static Texture texture         = {};
+static Material cubeMaterial   = {};
+static Material sphereMaterial = {};
+
+// entities still own a DrawUniforms bind group, unused here since transforms
+// come from the instance buffer
+static WGPUBindGroupLayout entityLayout = NULL;
+
+static f64 lastReportTime = 0.0;
+
+static void setColor(Material* material, glm::vec4 color)
+{
+    MaterialUniforms materialUniforms = {};
+    materialUniforms.color            = color;
+    wgpuQueueWriteBuffer(gctx->queue, material->uniformBuffer, 0,
+                         &materialUniforms, sizeof(materialUniforms));
+}
+
+static void onInit(GraphicsContext* ctx, GLFWwindow* w)
+{
+    gctx   = ctx;
+    window = w;
+
+    GPUCuller::init(gctx, &culler);
+    RenderPipeline* pipeline = &culler.pipeline;
+
+    WGPUBindGroupLayoutEntry entityLayoutEntry = {};
+    entityLayoutEntry.binding                  = 0;
+    entityLayoutEntry.visibility               = WGPUShaderStage_Vertex;
+    entityLayoutEntry.buffer.type           = WGPUBufferBindingType_Uniform;
+    entityLayoutEntry.buffer.minBindingSize = sizeof(DrawUniforms);
+    WGPUBindGroupLayoutDescriptor entityLayoutDesc = {};
+    entityLayoutDesc.entryCount                    = 1;
+    entityLayoutDesc.entries                       = &entityLayoutEntry;
+    entityLayout
+      = PipelineCache::getBindGroupLayout(gctx, &entityLayoutDesc);
+
+    Entity::init(&cameraEntity, gctx, entityLayout);
+
+    Texture::initFromFile(gctx, &texture, "./assets/uv.png", true);
+    Material::init(gctx, &cubeMaterial, pipeline, &texture);
+    Material::init(gctx, &sphereMaterial, pipeline, &texture);
+    setColor(&cubeMaterial, glm::vec4(1.0f));
+    setColor(&sphereMaterial, glm::vec4(1.0f, 0.6f, 0.3f, 1.0f));
+
+    // meshes, geometry only
+    CubeParams cubeParams = { 1.0f, 1.0f, 1.0f, 1, 1, 1 };
+    Vertices cubeVertices = createCube(&cubeParams);
+    Entity::init(&cubeMesh, gctx, entityLayout);
+    Entity::setVertices(&cubeMesh, &cubeVertices, gctx);
+
+    CubeParams sphereParams = { 0.8f, 0.8f, 0.8f, 2, 2, 2 };
+    Vertices sphereVertices = createCube(&sphereParams);
+    Entity::init(&sphereMesh, gctx, entityLayout);
+    Entity::setVertices(&sphereMesh, &sphereVertices, gctx);
+
+    // fill a 3d grid, alternating meshes in a checker pattern
+    const u32 total = CULLING_GRID_SIZE * CULLING_GRID_SIZE * CULLING_GRID_SIZE;
+    glm::mat4* cubeTransforms   = ALLOCATE_COUNT(glm::mat4, total);
+    glm::mat4* sphereTransforms = ALLOCATE_COUNT(glm::mat4, total);
+    u32 cubeCount = 0, sphereCount = 0;
+
+    f32 half = 0.5f * CULLING_SPACING * CULLING_GRID_SIZE;
+    for (u32 i = 0; i < total; i++) {
+        u32 x = i % CULLING_GRID_SIZE;
+        u32 y = (i / CULLING_GRID_SIZE) % CULLING_GRID_SIZE;
+        u32 z = i / (CULLING_GRID_SIZE * CULLING_GRID_SIZE);
+        glm::vec3 pos = glm::vec3(x, y, z) * CULLING_SPACING - glm::vec3(half);
+        glm::mat4 transform = glm::translate(MAT_IDENTITY, pos);
+        transform           = glm::rotate(transform, (f32)i, VEC_UP);
+
+        if ((x + y + z) % 2 == 0) cubeTransforms[cubeCount++] = transform;
+        else sphereTransforms[sphereCount++] = transform;
+    }
+
+    GPUCuller::addBatch(&culler, &cubeMesh, &cubeMaterial, cubeTransforms,
+                        cubeCount);
+    GPUCuller::addBatch(&culler, &sphereMesh, &sphereMaterial,
+                        sphereTransforms, sphereCount);
+    GPUCuller::upload(gctx, &culler);
+
+    FREE_ARRAY(glm::mat4, cubeTransforms, total);
+    FREE_ARRAY(glm::mat4, sphereTransforms, total);
+}
+
+static void onUpdate(f32 dt)
+{
+    UNUSED_VAR(dt);
+    f32 time = (f32)glfwGetTime();
+
+    // fly through the middle of the grid, looking outwards
+    f32 radius       = 0.25f * CULLING_SPACING * CULLING_GRID_SIZE;
+    cameraEntity.pos = glm::vec3(radius * cos(0.1f * time), 0.0f,
+                                 radius * sin(0.1f * time));
+    glm::vec3 target = 2.0f * cameraEntity.pos
+                       + glm::vec3(0.0f, radius * sin(0.3f * time), 0.0f);
+    cameraEntity.rot = glm::conjugate(
+      glm::toQuat(glm::lookAt(cameraEntity.pos, target, VEC_UP)));
+    cameraEntity.farPlane = 2.0f * CULLING_SPACING * CULLING_GRID_SIZE;
+}
+
+static void onRender()
+{
+    GraphicsContext::beginFrame(gctx);
+
+    i32 width, height;
+    glfwGetWindowSize(window, &width, &height);
+    f32 aspect = (f32)width / (f32)height;
+
+    FrameUniforms frameUniforms = {};
+    frameUniforms.projectionMat
+      = Entity::projectionMatrix(&cameraEntity, aspect);
+    frameUniforms.viewMat = Entity::viewMatrix(&cameraEntity);
+    frameUniforms.projViewMat
+      = frameUniforms.projectionMat * frameUniforms.viewMat;
+    frameUniforms.dirLight = glm::normalize(glm::vec3(0.3f, -1.0f, -0.5f));
+    frameUniforms.time     = (f32)glfwGetTime();
+    GraphicsContext::writeBuffer(
+      gctx, culler.pipeline.bindGroups[PER_FRAME_GROUP].uniformBuffer, 0,
+      &frameUniforms, sizeof(frameUniforms));
+
+    // compute pass, recorded before the render pass in the same encoder
+    GPUCuller::cull(gctx, &culler, frameUniforms.projViewMat);
+
+    WGPURenderPassEncoder renderPass = GraphicsContext::beginRenderPass(gctx);
+    GPUCuller::draw(&culler, renderPass);
+    GraphicsContext::presentFrame(gctx);
+
+    f64 now = glfwGetTime();
+    if (now - lastReportTime >= 1.0) {
+        log_info("culling: %d instances, %d indirect draws",
+                 culler.instanceCount, culler.batchCount);
+        lastReportTime = now;
+    }
+}
+
+static void onExit()
+{
+    GPUCuller::release(&culler);
+    Material::release(&cubeMaterial);
+    Material::release(&sphereMaterial);
+    Texture::release(&texture);
+    WGPU_RELEASE_RESOURCE(BindGroupLayout, entityLayout);
+}
+
+void Example_Culling(ExampleCallbacks* callbacks)
+{
+    *callbacks          = {};
+    callbacks->onInit   = onInit;
+    callbacks->onUpdate = onUpdate;
+    callbacks->onRender = onRender;
+    callbacks->onExit   = onExit;
+}
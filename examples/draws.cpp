@@ -0,0 +1,184 @@
+#include <GLFW/glfw3.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp> // quatToMat4
+
+#include "context.h"
+#include "core/log.h"
+#include "entity.h"
+#include "example.h"
+#include "jobs.h"
+#include "renderer.h"
+#include "shaders.h"
+
+// Draw call stress test: a large grid of cubes, each its own entity with its
+// own per-draw bind group. The visible set is rebuilt every frame (simple
+// distance cull) so the draw list can't be cached and is re-recorded in
+// parallel across the job system workers. P toggles the depth pre-pass.
+
+#define DRAWS_GRID_SIZE 224 // 224^2 ~= 50k draws
+#define DRAWS_ENTITY_COUNT (DRAWS_GRID_SIZE * DRAWS_GRID_SIZE)
+#define DRAWS_SPACING 2.0f
+
+static GraphicsContext* gctx = NULL;
+static GLFWwindow* window    = NULL;
+
+static RenderPipeline pipeline = {};
+static Entity cameraEntity     = {};
+static Entity cubeEntity       = {}; // owns the shared cube geometry
+static Entity* entities        = NULL;
+static Texture texture         = {};
+static Material material       = {};
+static DrawList drawList       = {};
+static DepthPrepass prepass    = {};
+
+// recording stats, printed once per second
+static f64 recordSeconds  = 0.0;
+static u64 recordFrames   = 0;
+static f64 lastReportTime = 0.0;
+static f32 cullRadius     = 0.0f;
+
+static void onInit(GraphicsContext* ctx, GLFWwindow* w)
+{
+    gctx   = ctx;
+    window = w;
+
+    RenderPipeline::init(gctx, &pipeline, shaderCode, shaderCode);
+
+    Entity::init(&cameraEntity, gctx,
+                 pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+
+    Texture::initFromFile(gctx, &texture, "./assets/uv.png", true);
+    Material::init(gctx, &material, &pipeline, &texture);
+    DepthPrepass::init(gctx, &prepass);
+
+    MaterialUniforms materialUniforms = {};
+    materialUniforms.color            = glm::vec4(1.0f);
+    wgpuQueueWriteBuffer(gctx->queue, material.uniformBuffer, 0,
+                         &materialUniforms, sizeof(materialUniforms));
+
+    CubeParams cubeParams = { 1.0f, 1.0f, 1.0f, 1, 1, 1 };
+    Vertices cubeVertices = createCube(&cubeParams);
+    Entity::init(&cubeEntity, gctx, pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+    Entity::setVertices(&cubeEntity, &cubeVertices, gctx);
+
+    entities = ALLOCATE_COUNT(Entity, DRAWS_ENTITY_COUNT);
+    f32 half = 0.5f * DRAWS_SPACING * DRAWS_GRID_SIZE;
+    for (u32 i = 0; i < DRAWS_ENTITY_COUNT; i++) {
+        Entity* entity = &entities[i];
+        Entity::init(entity, gctx, pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+
+        // share geometry with the prototype cube
+        entity->vertices = cubeEntity.vertices;
+        entity->mesh     = cubeEntity.mesh;
+
+        entity->pos
+          = glm::vec3((i % DRAWS_GRID_SIZE) * DRAWS_SPACING - half, 0.0f,
+                      (i / DRAWS_GRID_SIZE) * DRAWS_SPACING - half);
+
+        // transforms are static, upload once
+        DrawUniforms drawUniforms = {};
+        drawUniforms.modelMat     = Entity::modelMatrix(entity);
+        wgpuQueueWriteBuffer(gctx->queue, entity->bindGroup.uniformBuffer, 0,
+                             &drawUniforms, sizeof(drawUniforms));
+    }
+
+    log_info("draws example: %d entities, %d job workers", DRAWS_ENTITY_COUNT,
+             JobSystem::workerCount());
+}
+
+static void onUpdate(f32 dt)
+{
+    UNUSED_VAR(dt);
+    f32 time = (f32)glfwGetTime();
+
+    // orbit high above the grid
+    f32 radius       = 0.6f * DRAWS_SPACING * DRAWS_GRID_SIZE;
+    cameraEntity.pos = glm::vec3(radius * cos(0.1f * time), 0.5f * radius,
+                                 radius * sin(0.1f * time));
+    cameraEntity.rot = glm::conjugate(glm::toQuat(
+      glm::lookAt(cameraEntity.pos, glm::vec3(0.0f), VEC_UP)));
+    cameraEntity.farPlane = 4.0f * radius;
+
+    // pulse the visible radius so membership changes every frame
+    cullRadius = (0.35f + 0.15f * sin(time))
+                 * (DRAWS_SPACING * DRAWS_GRID_SIZE);
+}
+
+static void onKey(i32 key, i32 scancode, i32 action, i32 mods)
+{
+    UNUSED_VAR(scancode);
+    UNUSED_VAR(mods);
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        prepass.enabled = !prepass.enabled;
+}
+
+static void onRender()
+{
+    GraphicsContext::beginFrame(gctx);
+
+    i32 width, height;
+    glfwGetWindowSize(window, &width, &height);
+    f32 aspect = (f32)width / (f32)height;
+
+    FrameUniforms frameUniforms = {};
+    frameUniforms.projectionMat
+      = Entity::projectionMatrix(&cameraEntity, aspect);
+    frameUniforms.viewMat = Entity::viewMatrix(&cameraEntity);
+    frameUniforms.projViewMat
+      = frameUniforms.projectionMat * frameUniforms.viewMat;
+    frameUniforms.dirLight = glm::normalize(glm::vec3(0.3f, -1.0f, -0.5f));
+    frameUniforms.time     = (f32)glfwGetTime();
+    GraphicsContext::writeBuffer(
+      gctx, pipeline.bindGroups[PER_FRAME_GROUP].uniformBuffer, 0,
+      &frameUniforms, sizeof(frameUniforms));
+
+    // rebuild visible set
+    DrawList::reset(&drawList);
+    f32 cullRadius2 = cullRadius * cullRadius;
+    for (u32 i = 0; i < DRAWS_ENTITY_COUNT; i++) {
+        glm::vec3 p = entities[i].pos;
+        if (p.x * p.x + p.z * p.z > cullRadius2) continue;
+        DrawList::add(&drawList, &pipeline, &material, &entities[i]);
+    }
+
+    f64 start = glfwGetTime();
+    DepthPrepass::execute(gctx, &prepass, &drawList);
+    WGPURenderPassEncoder renderPass = GraphicsContext::beginRenderPass(gctx);
+    DepthPrepass::beginShading(&prepass, renderPass);
+    DrawList::execute(gctx, &drawList, renderPass);
+    DepthPrepass::endShading(&prepass, renderPass);
+    recordSeconds += glfwGetTime() - start;
+    recordFrames++;
+
+    GraphicsContext::presentFrame(gctx);
+
+    if (start - lastReportTime >= 1.0) {
+        log_info("draws: %d visible, record+execute %.3f ms/frame",
+                 drawList.count, 1000.0 * recordSeconds / recordFrames);
+        DepthPrepass::logStats(&prepass);
+        recordSeconds  = 0.0;
+        recordFrames   = 0;
+        lastReportTime = start;
+    }
+}
+
+static void onExit()
+{
+    DrawList::free(&drawList);
+    DepthPrepass::release(&prepass);
+    FREE_ARRAY(Entity, entities, DRAWS_ENTITY_COUNT);
+    Material::release(&material);
+    Texture::release(&texture);
+    RenderPipeline::release(&pipeline);
+}
+
+void Example_Draws(ExampleCallbacks* callbacks)
+{
+    *callbacks          = {};
+    callbacks->onInit   = onInit;
+    callbacks->onUpdate = onUpdate;
+    callbacks->onRender = onRender;
+    callbacks->onExit   = onExit;
+    callbacks->onKey    = onKey;
+}
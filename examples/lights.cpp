@@ -0,0 +1,249 @@
+#include <GLFW/glfw3.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp> // quatToMat4
+
+#include "context.h"
+#include "core/log.h"
+#include "entity.h"
+#include "example.h"
+#include "hash.h"
+#include "lighting.h"
+#include "renderer.h"
+#include "resolution.h"
+#include "shaders.h"
+#include "wgsl.h"
+
+// Clustered lighting benchmark: a field of pillars lit by thousands of
+// small orbiting point lights. Keys 1-4 switch between 1k, 2.5k, 5k and 10k
+// lights. Light assignment (transform, binning, compaction) and total frame
+// time are logged once per second; with clustering, frame time should grow
+// far slower than the light count.
+//
+// Dynamic resolution holds 60 fps by rendering the scene at 50-100% of the
+// window size; R toggles it, the current scale is logged with the stats.
+
+#define LIGHTS_GRID_SIZE 32
+#define LIGHTS_PILLAR_COUNT (LIGHTS_GRID_SIZE * LIGHTS_GRID_SIZE)
+#define LIGHTS_SPACING 4.0f
+#define LIGHTS_RADIUS 3.0f
+
+static const u32 lightCounts[] = { 1000, 2500, 5000, 10000 };
+
+static GraphicsContext* gctx = NULL;
+static GLFWwindow* window    = NULL;
+
+static RenderPipeline pipeline      = {};
+static ClusteredLighting lighting   = {};
+static DynamicResolution dynamicRes = {};
+static Entity cameraEntity          = {};
+static Entity floorEntity           = {}; // owns the shared cube geometry
+static Entity* pillars              = NULL;
+static Texture texture              = {};
+static Material material            = {};
+static DrawList drawList            = {};
+static u32 lightCount               = 0;
+
+// stats, printed once per second
+static f64 assignSeconds  = 0.0;
+static f64 frameSeconds   = 0.0;
+static f64 lastFrameTime  = 0.0;
+static u64 statFrames     = 0;
+static f64 lastReportTime = 0.0;
+
+static void initEntity(Entity* entity, glm::vec3 pos, glm::vec3 scale)
+{
+    Entity::init(entity, gctx, pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+    if (entity != &floorEntity) {
+        // share geometry with the floor
+        entity->vertices = floorEntity.vertices;
+        entity->mesh     = floorEntity.mesh;
+    }
+    entity->pos = pos;
+    entity->sca = scale;
+
+    DrawUniforms drawUniforms = {};
+    drawUniforms.modelMat     = Entity::modelMatrix(entity);
+    wgpuQueueWriteBuffer(gctx->queue, entity->bindGroup.uniformBuffer, 0,
+                         &drawUniforms, sizeof(drawUniforms));
+}
+
+static void setLightCount(u32 count)
+{
+    ClusteredLighting::clearLights(&lighting);
+    for (u32 i = 0; i < count; i++) {
+        PointLight* light = ClusteredLighting::addLight(&lighting);
+        u64 h             = hashCombine(HASH_SEED, i);
+        light->color
+          = glm::vec3((h & 0xFF) / 255.0f, ((h >> 8) & 0xFF) / 255.0f,
+                      ((h >> 16) & 0xFF) / 255.0f);
+        light->radius    = LIGHTS_RADIUS;
+        light->intensity = 1.0f;
+    }
+    lightCount = count;
+    log_info("lights example: %d point lights", count);
+}
+
+static void onInit(GraphicsContext* ctx, GLFWwindow* w)
+{
+    gctx   = ctx;
+    window = w;
+
+    RenderPipeline::initPermutation(gctx, &pipeline, shaderCode,
+                                    SHADER_PERMUTATION_CLUSTERED_LIGHTING);
+
+    Entity::init(&cameraEntity, gctx,
+                 pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+    cameraEntity.farPlane = 300.0f;
+    ClusteredLighting::init(gctx, &lighting, cameraEntity.nearPlane,
+                            cameraEntity.farPlane);
+    DynamicResolution::init(gctx, &dynamicRes, 1.0f / 60.0f);
+
+    Texture::initFromFile(gctx, &texture, "./assets/uv.png", true);
+    Material::init(gctx, &material, &pipeline, &texture);
+
+    MaterialUniforms materialUniforms = {};
+    materialUniforms.color            = glm::vec4(0.8f);
+    wgpuQueueWriteBuffer(gctx->queue, material.uniformBuffer, 0,
+                         &materialUniforms, sizeof(materialUniforms));
+
+    CubeParams cubeParams = { 1.0f, 1.0f, 1.0f, 1, 1, 1 };
+    Vertices cubeVertices = createCube(&cubeParams);
+
+    f32 extent = LIGHTS_SPACING * LIGHTS_GRID_SIZE;
+    initEntity(&floorEntity, glm::vec3(0.0f, -0.5f, 0.0f),
+               glm::vec3(extent, 1.0f, extent));
+    Entity::setVertices(&floorEntity, &cubeVertices, gctx);
+    DrawList::add(&drawList, &pipeline, &material, &floorEntity);
+
+    pillars = ALLOCATE_COUNT(Entity, LIGHTS_PILLAR_COUNT);
+    for (u32 i = 0; i < LIGHTS_PILLAR_COUNT; i++) {
+        glm::vec3 pos = glm::vec3(
+          ((i % LIGHTS_GRID_SIZE) + 0.5f) * LIGHTS_SPACING - 0.5f * extent,
+          1.5f,
+          ((i / LIGHTS_GRID_SIZE) + 0.5f) * LIGHTS_SPACING - 0.5f * extent);
+        initEntity(&pillars[i], pos, glm::vec3(1.0f, 3.0f, 1.0f));
+        DrawList::add(&drawList, &pipeline, &material, &pillars[i]);
+    }
+
+    setLightCount(lightCounts[0]);
+}
+
+static void onKey(i32 key, i32 scancode, i32 action, i32 mods)
+{
+    UNUSED_VAR(scancode);
+    UNUSED_VAR(mods);
+    if (action != GLFW_PRESS) return;
+    if (key == GLFW_KEY_R) {
+        dynamicRes.enabled = !dynamicRes.enabled;
+        log_info("dynamic resolution %s", dynamicRes.enabled ? "on" : "off");
+        return;
+    }
+    i32 preset = key - GLFW_KEY_1;
+    if (preset >= 0 && preset < (i32)ARRAY_LENGTH(lightCounts))
+        setLightCount(lightCounts[preset]);
+}
+
+static void onUpdate(f32 dt)
+{
+    UNUSED_VAR(dt);
+    f32 time = (f32)glfwGetTime();
+
+    // slow orbit around the field
+    f32 radius       = 0.6f * LIGHTS_SPACING * LIGHTS_GRID_SIZE;
+    cameraEntity.pos = glm::vec3(radius * cos(0.05f * time), 0.3f * radius,
+                                 radius * sin(0.05f * time));
+    cameraEntity.rot = glm::conjugate(glm::toQuat(
+      glm::lookAt(cameraEntity.pos, glm::vec3(0.0f), VEC_UP)));
+
+    // lights circle between the pillars, spread over the field
+    f32 extent = LIGHTS_SPACING * LIGHTS_GRID_SIZE;
+    for (u32 i = 0; i < lighting.lightCount; i++) {
+        u64 h     = hashCombine(HASH_SEED + 1, i);
+        f32 u     = (h & 0xFFFF) / 65535.0f;
+        f32 v     = ((h >> 16) & 0xFFFF) / 65535.0f;
+        f32 phase = ((h >> 32) & 0xFFFF) / 65535.0f * 6.2832f;
+        f32 speed = 0.5f + ((h >> 48) & 0xFF) / 255.0f;
+        f32 angle = speed * time + phase;
+        lighting.lights[i].position
+          = glm::vec3((u - 0.5f) * extent + 1.5f * cos(angle), 0.75f,
+                      (v - 0.5f) * extent + 1.5f * sin(angle));
+    }
+}
+
+static void onRender()
+{
+    f64 start = glfwGetTime();
+    if (lastFrameTime > 0.0)
+        DynamicResolution::update(&dynamicRes, (f32)(start - lastFrameTime));
+
+    GraphicsContext::beginFrame(gctx);
+    DynamicResolution::beginScene(gctx, &dynamicRes);
+
+    i32 width, height;
+    glfwGetWindowSize(window, &width, &height);
+    f32 aspect = (f32)width / (f32)height;
+
+    FrameUniforms frameUniforms = {};
+    frameUniforms.projectionMat
+      = Entity::projectionMatrix(&cameraEntity, aspect);
+    frameUniforms.viewMat = Entity::viewMatrix(&cameraEntity);
+    frameUniforms.projViewMat
+      = frameUniforms.projectionMat * frameUniforms.viewMat;
+    // dim sun, the point lights do the work
+    frameUniforms.dirLight = glm::normalize(glm::vec3(0.3f, -1.0f, -0.5f));
+    frameUniforms.time     = (f32)glfwGetTime();
+    GraphicsContext::writeBuffer(
+      gctx, pipeline.bindGroups[PER_FRAME_GROUP].uniformBuffer, 0,
+      &frameUniforms, sizeof(frameUniforms));
+
+    f64 assignStart = glfwGetTime();
+    ClusteredLighting::update(gctx, &lighting, frameUniforms.viewMat,
+                              frameUniforms.projectionMat);
+    ClusteredLighting::bind(&lighting, &pipeline);
+    assignSeconds += glfwGetTime() - assignStart;
+
+    WGPURenderPassEncoder renderPass = GraphicsContext::beginRenderPass(gctx);
+    DrawList::execute(gctx, &drawList, renderPass);
+    DynamicResolution::endScene(gctx, &dynamicRes);
+    GraphicsContext::presentFrame(gctx);
+
+    if (lastFrameTime > 0.0) {
+        frameSeconds += start - lastFrameTime;
+        statFrames++;
+    }
+    lastFrameTime = start;
+
+    if (statFrames > 0 && start - lastReportTime >= 1.0) {
+        log_info("lights: %d, assign %.3f ms, frame %.3f ms, scale %.2f",
+                 lightCount, 1000.0 * assignSeconds / statFrames,
+                 1000.0 * frameSeconds / statFrames,
+                 dynamicRes.enabled ? dynamicRes.scale : 1.0f);
+        ClusteredLighting::logStats(&lighting);
+        assignSeconds  = 0.0;
+        frameSeconds   = 0.0;
+        statFrames     = 0;
+        lastReportTime = start;
+    }
+}
+
+static void onExit()
+{
+    DrawList::free(&drawList);
+    FREE_ARRAY(Entity, pillars, LIGHTS_PILLAR_COUNT);
+    ClusteredLighting::release(&lighting);
+    DynamicResolution::release(&dynamicRes);
+    Material::release(&material);
+    Texture::release(&texture);
+    RenderPipeline::release(&pipeline);
+}
+
+void Example_Lights(ExampleCallbacks* callbacks)
+{
+    *callbacks          = {};
+    callbacks->onInit   = onInit;
+    callbacks->onUpdate = onUpdate;
+    callbacks->onRender = onRender;
+    callbacks->onExit   = onExit;
+    callbacks->onKey    = onKey;
+}
@@ -0,0 +1,161 @@
+#include <GLFW/glfw3.h>
+
+#include "context.h"
+#include "core/log.h"
+#include "cpu_mips.h"
+#include "deletion.h"
+#include "example.h"
+#include "gpu_memory.h"
+#include "memory.h"
+
+// Mip generation benchmark: the compute path (MIP_COMPUTE_LEVELS levels per
+// dispatch) vs the render path (one pass per level and layer, through a
+// scratch texture and copies, as Texture::initFromFile textures lack
+// RenderAttachment usage). Times are wall clock from the first generate()
+// to the GPU going idle, over several 2K and 4K RGBA8 textures, a 6 layer
+// cube map and a texture array. Level 0 is uploaded once, outside the timing.
+// The single layer textures are also run through the CPU mip chain with each
+// filter, timing CPUMipChain::generate() alone (the upload is not included).
+// Results are logged once at startup.
+
+#define MIP_BENCH_ITERATIONS 10
+
+struct MipBenchTexture {
+    const char* label;
+    u32 size;
+    u32 layers;
+};
+
+static const MipBenchTexture benchTextures[] = {
+    { "2K", 2048, 1 },
+    { "4K", 4096, 1 },
+    { "1K cube", 1024, 6 },
+    { "2K array x4", 2048, 4 },
+};
+
+static const char* cpuFilterNames[] = { "box", "kaiser", "lanczos" };
+
+static GraphicsContext* gctx = NULL;
+
+static u32* createPattern(u32 size)
+{
+    // some pattern, contents don't matter for the timing
+    u32 texels  = size * size;
+    u32* pixels = ALLOCATE_COUNT(u32, texels);
+    for (u32 i = 0; i < texels; i++) pixels[i] = i * 2654435761u;
+    return pixels;
+}
+
+static WGPUTexture createTexture(const MipBenchTexture* bench,
+                                 WGPUTextureDescriptor* desc)
+{
+    u32 levels = 1;
+    for (u32 s = bench->size; s > 1; s >>= 1) levels++;
+    WGPUTextureUsageFlags usage = WGPUTextureUsage_TextureBinding
+                                  | WGPUTextureUsage_CopyDst
+                                  | WGPUTextureUsage_StorageBinding;
+
+    *desc               = {};
+    desc->label         = bench->label;
+    desc->usage         = usage;
+    desc->dimension     = WGPUTextureDimension_2D;
+    desc->size          = { bench->size, bench->size, bench->layers };
+    desc->format        = WGPUTextureFormat_RGBA8Unorm;
+    desc->mipLevelCount = levels;
+    desc->sampleCount   = 1;
+
+    WGPUTexture texture = wgpuDeviceCreateTexture(gctx->device, desc);
+    GPUMemory::track(texture, GPU_MEMORY_TEXTURE,
+                     GPUMemory::textureBytes(desc->format, bench->size,
+                                             bench->size, bench->layers,
+                                             desc->mipLevelCount),
+                     desc->label);
+
+    u32 texels  = bench->size * bench->size;
+    u32* pixels = createPattern(bench->size);
+
+    WGPUImageCopyTexture destination = {};
+    destination.texture              = texture;
+    destination.aspect               = WGPUTextureAspect_All;
+    WGPUTextureDataLayout layout     = {};
+    layout.bytesPerRow               = bench->size * 4;
+    layout.rowsPerImage              = bench->size;
+    WGPUExtent3D extent              = { bench->size, bench->size, 1 };
+    for (u32 layer = 0; layer < bench->layers; layer++) {
+        destination.origin = { 0, 0, layer };
+        wgpuQueueWriteTexture(gctx->queue, &destination, pixels,
+                              texels * sizeof(u32), &layout, &extent);
+    }
+    FREE_ARRAY(u32, pixels, texels);
+    return texture;
+}
+
+static f64 benchPath(MipMapPath path, WGPUTexture texture,
+                     WGPUTextureDescriptor* desc)
+{
+    MipMapGenerator* generator = MipMapGenerator::get(gctx);
+
+    // compile outside the timing
+    MipMapGenerator::generate(generator, texture, desc, NULL, path);
+    GraphicsContext::waitIdle(gctx);
+
+    f64 start = glfwGetTime();
+    for (u32 i = 0; i < MIP_BENCH_ITERATIONS; i++)
+        MipMapGenerator::generate(generator, texture, desc, NULL, path);
+    GraphicsContext::waitIdle(gctx);
+    return (glfwGetTime() - start) / MIP_BENCH_ITERATIONS;
+}
+
+static void benchCPU(const MipBenchTexture* bench, WGPUTexture texture)
+{
+    u32* pixels = createPattern(bench->size);
+    f64 ms[ARRAY_LENGTH(cpuFilterNames)];
+    for (u32 f = 0; f < ARRAY_LENGTH(cpuFilterNames); f++) {
+        CPUMipChain chain = {};
+        f64 start         = glfwGetTime();
+        CPUMipChain::generate(&chain, pixels, bench->size, bench->size,
+                              CPU_MIP_RGBA8_SRGB, (MipFilter)f);
+        ms[f] = 1000.0 * (glfwGetTime() - start);
+        CPUMipChain::upload(gctx, &chain, texture);
+        CPUMipChain::release(&chain);
+    }
+    FREE_ARRAY(u32, pixels, bench->size * bench->size);
+
+    log_info("  %-12s cpu srgb: %s %8.3f, %s %8.3f, %s %8.3f", bench->label,
+             cpuFilterNames[0], ms[0], cpuFilterNames[1], ms[1],
+             cpuFilterNames[2], ms[2]);
+}
+
+static void onInit(GraphicsContext* ctx, GLFWwindow* window)
+{
+    UNUSED_VAR(window);
+    gctx = ctx;
+
+    log_info("mip bench: %d iterations, ms per texture", MIP_BENCH_ITERATIONS);
+    for (u32 i = 0; i < ARRAY_LENGTH(benchTextures); i++) {
+        WGPUTextureDescriptor desc = {};
+        WGPUTexture texture        = createTexture(&benchTextures[i], &desc);
+
+        f64 render  = benchPath(MIP_MAP_PATH_RENDER, texture, &desc);
+        f64 compute = benchPath(MIP_MAP_PATH_COMPUTE, texture, &desc);
+        log_info("  %-12s %2d levels: render %8.3f, compute %8.3f (%.1fx)",
+                 desc.label, desc.mipLevelCount, 1000.0 * render,
+                 1000.0 * compute, render / compute);
+        if (benchTextures[i].layers == 1) benchCPU(&benchTextures[i], texture);
+
+        DeletionQueue::defer(texture);
+    }
+}
+
+static void onRender()
+{
+    GraphicsContext::prepareFrame(gctx);
+    GraphicsContext::presentFrame(gctx);
+}
+
+void Example_MipBench(ExampleCallbacks* callbacks)
+{
+    *callbacks          = {};
+    callbacks->onInit   = onInit;
+    callbacks->onRender = onRender;
+}
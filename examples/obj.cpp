@@ -10,12 +10,19 @@
 #include "core/log.h"
 #include "entity.h"
 #include "example.h"
+#include "latency.h"
+#include "renderer.h"
 #include "shaders.h"
+#include "streaming.h"
 
 // arc camera impl with velocity / dampening
 // https://webgpu.github.io/webgpu-samples/?sample=cameras#camera.ts
 // Original Arcball camera paper?
 // https://www.talisman.org/~erlkonig/misc/shoemake92-arcball.pdf
+//
+// Low latency viewer: keys 1-3 pick the Fifo, Mailbox or Immediate present
+// mode, F toggles a 120 fps frame limiter and L late latching of the camera
+// from the cursor position. Input to submit latency is logged every second.
 
 struct Spherical {
     f32 radius;
@@ -50,6 +57,14 @@ static Entity* renderables[1]  = { &objEntity };
 static Texture texture         = {};
 static Material material       = {};
 
+// scene geometry never changes after load, record it once into a bundle
+static DrawList staticDrawList       = {};
+static RenderBundleCache bundleCache = {};
+
+static FrameUniforms frameUniforms = {}; // rewritten by the late latch
+static bool lateLatch              = true;
+static f64 lastReportTime          = 0.0;
+
 typedef void (*Example_OnMouseButton)(i32 button, i32 action, i32 mods);
 typedef void (*Example_OnScroll)(f64 xoffset, f64 yoffset);
 typedef void (*Example_OnCursorPosition)(f64 xpos, f64 ypos);
@@ -92,12 +107,76 @@ static void onCursorPosition(f64 xpos, f64 ypos)
     mouseY = ypos;
 }
 
+static void updateCamera()
+{
+    cameraEntity.pos = arcOrigin + Spherical::toCartesian(cameraSpherical);
+    // camera lookat arcball origin
+    cameraEntity.rot = glm::conjugate(
+      glm::toQuat(glm::lookAt(cameraEntity.pos, arcOrigin, VEC_UP)));
+}
+
+// runs right before submit: re-read the cursor, which may have moved while
+// the frame was recorded, and point the camera with it
+static void latchCamera(GraphicsContext* ctx, void* userdata)
+{
+    UNUSED_VAR(userdata);
+    if (!lateLatch) return;
+
+    f64 xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    LowLatency::markInput();
+    if (xpos == mouseX && ypos == mouseY) return;
+
+    onCursorPosition(xpos, ypos);
+    updateCamera();
+    frameUniforms.viewMat = Entity::viewMatrix(&cameraEntity);
+    frameUniforms.projViewMat
+      = frameUniforms.projectionMat * frameUniforms.viewMat;
+    GraphicsContext::writeBuffer(
+      ctx, pipeline.bindGroups[PER_FRAME_GROUP].uniformBuffer, 0,
+      &frameUniforms, sizeof(frameUniforms));
+}
+
+static void onKey(i32 key, i32 scancode, i32 action, i32 mods)
+{
+    UNUSED_VAR(scancode);
+    UNUSED_VAR(mods);
+    if (action != GLFW_PRESS) return;
+
+    static const WGPUPresentMode presentModes[] = {
+        WGPUPresentMode_Fifo,
+        WGPUPresentMode_Mailbox,
+        WGPUPresentMode_Immediate,
+    };
+    i32 mode = key - GLFW_KEY_1;
+    if (mode >= 0 && mode < (i32)ARRAY_LENGTH(presentModes)) {
+        if (GraphicsContext::setPresentMode(gctx, presentModes[mode]))
+            log_info("obj example: present mode %d", presentModes[mode]);
+    } else if (key == GLFW_KEY_F) {
+        LowLatency::setFrameLimit(LowLatency::frameLimit() > 0.0f ? 0.0f
+                                                                  : 120.0f);
+        log_info("obj example: frame limit %.0f", LowLatency::frameLimit());
+    } else if (key == GLFW_KEY_L) {
+        lateLatch = !lateLatch;
+        log_info("obj example: late latching %s", lateLatch ? "on" : "off");
+    }
+}
+
+static void onTextureStreamed(GraphicsContext* ctx, Texture* streamed,
+                              void* userdata)
+{
+    UNUSED_VAR(userdata);
+    Material::setTexture(ctx, &material, streamed);
+}
+
 static void onInit(GraphicsContext* ctx, GLFWwindow* w)
 {
     gctx   = ctx;
     window = w;
 
-    RenderPipeline::init(gctx, &pipeline, shaderCode, shaderCode);
+    // compiles in the background while the model and textures load. Draws
+    // are skipped (no placeholder) until it's ready
+    RenderPipeline::initAsync(gctx, &pipeline, NULL, shaderCode, shaderCode);
 
     Entity::init(&cameraEntity, gctx,
                  pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
@@ -105,8 +184,10 @@ static void onInit(GraphicsContext* ctx, GLFWwindow* w)
 
     Entity::init(&objEntity, gctx, pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
 
-    Texture::initFromFile(gctx, &texture,
-                          "./assets/fourareen/fourareen2K_albedo.jpg", true);
+    // starts as a grey 1x1 view, the material is rebound as levels arrive
+    TextureStreaming::stream(gctx, &texture,
+                             "./assets/fourareen/fourareen2K_albedo.jpg",
+                             onTextureStreamed, NULL);
 
     Material::init(gctx, &material, &pipeline, &texture);
 
@@ -156,6 +237,12 @@ static void onInit(GraphicsContext* ctx, GLFWwindow* w)
         Entity::setVertices(&objEntity, &vertices, gctx);
         // Entity::setVertices(&planeEntity, &vertices, &g_ctx);
     }
+
+    for (Entity* entity : renderables)
+        DrawList::add(&staticDrawList, &pipeline, &material, entity);
+
+    LowLatency::init(gctx, WGPUPresentMode_Mailbox);
+    LowLatency::setLateLatch(latchCamera, NULL);
 }
 
 static void onUpdate(f32 dt)
@@ -164,24 +251,17 @@ static void onUpdate(f32 dt)
     // std::cout << "basic example onUpdate" << std::endl;
     Entity::rotateOnLocalAxis(&objEntity, glm::vec3(0.0, 1.0, 0.0), -0.01f);
 
-    { // update camera
-        cameraEntity.pos = arcOrigin + Spherical::toCartesian(cameraSpherical);
-        // camera lookat arcball origin
-        cameraEntity.rot = glm::conjugate(
-          glm::toQuat(glm::lookAt(cameraEntity.pos, arcOrigin, VEC_UP)));
-    }
+    updateCamera();
 }
 
 static void onRender()
 {
     // std::cout << "-----basic example onRender" << std::endl;
     WGPURenderPassEncoder renderPass = GraphicsContext::prepareFrame(gctx);
-    // set shader
-    wgpuRenderPassEncoderSetPipeline(renderPass, pipeline.pipeline);
 
     // set frame uniforms
-    f32 time                    = (f32)glfwGetTime();
-    FrameUniforms frameUniforms = {};
+    f32 time      = (f32)glfwGetTime();
+    frameUniforms = {};
 
     // TODO: store in window context global state
     i32 width, height;
@@ -195,82 +275,49 @@ static void onRender()
       = frameUniforms.projectionMat * frameUniforms.viewMat;
     frameUniforms.dirLight = VEC_FORWARD;
     frameUniforms.time     = time;
-    wgpuQueueWriteBuffer(gctx->queue,
-                         pipeline.bindGroups[PER_FRAME_GROUP].uniformBuffer, 0,
-                         &frameUniforms, sizeof(frameUniforms));
-    // set frame bind group
-    wgpuRenderPassEncoderSetBindGroup(
-      renderPass, PER_FRAME_GROUP,
-      pipeline.bindGroups[PER_FRAME_GROUP].bindGroup, 0, NULL);
+    GraphicsContext::writeBuffer(
+      gctx, pipeline.bindGroups[PER_FRAME_GROUP].uniformBuffer, 0,
+      &frameUniforms, sizeof(frameUniforms));
 
     // material uniforms
     MaterialUniforms materialUniforms = {};
     materialUniforms.color            = glm::vec4(1.0, 1.0, 1.0, 1.0);
-    wgpuQueueWriteBuffer(gctx->queue,                                //
-                         material.uniformBuffer,                     //
-                         0,                                          //
-                         &materialUniforms, sizeof(materialUniforms) //
+    GraphicsContext::writeBuffer(gctx,                                   //
+                                 material.uniformBuffer,                 //
+                                 0,                                      //
+                                 &materialUniforms, sizeof(materialUniforms) //
     );
-    // set material bind groups
-    wgpuRenderPassEncoderSetBindGroup(renderPass, PER_MATERIAL_GROUP,
-                                      material.bindGroup, 0, NULL);
 
-    // TODO: loop over renderables and draw
+    // model uniforms
+    // uniform contents are not baked into the bundle, only the buffers are
     for (Entity* entity : renderables) {
-        // check drawable
-        if (!entity->vertices.vertexData) continue;
-
-        // check indexed draw
-        // bool indexedDraw = entity->vertices.indicesCount > 0;
-
-        // set vertex attributes
-        wgpuRenderPassEncoderSetVertexBuffer(
-          renderPass, 0, entity->gpuVertices.buf, 0,
-          sizeof(f32) * entity->vertices.vertexCount * 3);
-
-        auto normalsOffset = sizeof(f32) * entity->vertices.vertexCount * 3;
-
-        wgpuRenderPassEncoderSetVertexBuffer(
-          renderPass, 1, entity->gpuVertices.buf, normalsOffset,
-          sizeof(f32) * entity->vertices.vertexCount * 3);
-
-        auto texcoordsOffset = sizeof(f32) * entity->vertices.vertexCount * 6;
-
-        wgpuRenderPassEncoderSetVertexBuffer(
-          renderPass, 2, entity->gpuVertices.buf, texcoordsOffset,
-          sizeof(f32) * entity->vertices.vertexCount * 2);
-
-        // populate index buffer
-        // if (indexedDraw)
-        wgpuRenderPassEncoderSetIndexBuffer(renderPass, entity->gpuIndices.buf,
-                                            WGPUIndexFormat_Uint32, 0,
-                                            entity->gpuIndices.desc.size);
-        // else
-        //     wgpuRenderPassEncoderDraw(
-        //       renderPass, entity->vertices.vertexCount, 1, 0, 0);
-
-        // model uniforms
         DrawUniforms drawUniforms = {};
         drawUniforms.modelMat     = Entity::modelMatrix(entity);
-        wgpuQueueWriteBuffer(gctx->queue, entity->bindGroup.uniformBuffer, 0,
-                             &drawUniforms, sizeof(drawUniforms));
-        // set model bind group
-        wgpuRenderPassEncoderSetBindGroup(renderPass, PER_DRAW_GROUP,
-                                          entity->bindGroup.bindGroup, 0, NULL);
-        // draw call (indexed)
-        wgpuRenderPassEncoderDrawIndexed(
-          renderPass, entity->vertices.indicesCount, 1, 0, 0, 0);
-        // draw call (nonindexed)
-        // wgpuRenderPassEncoderDraw(renderPass,
-        //                           entity->vertices.vertexCount, 1,
-        //                           0, 0);
+        GraphicsContext::writeBuffer(gctx, entity->bindGroup.uniformBuffer, 0,
+                                     &drawUniforms, sizeof(drawUniforms));
     }
 
+    // replay the cached static draw list (re-recorded only when its
+    // membership, materials or pipelines change)
+    WGPURenderBundle bundle
+      = RenderBundleCache::get(gctx, &bundleCache, &staticDrawList);
+    wgpuRenderPassEncoderExecuteBundles(renderPass, 1, &bundle);
+    RenderBundleCache::endFrame(&bundleCache);
+
     GraphicsContext::presentFrame(gctx);
+
+    if (time - lastReportTime >= 1.0) {
+        LowLatency::logStats();
+        LowLatency::resetStats();
+        lastReportTime = time;
+    }
 }
 
 static void onExit()
 {
+    LowLatency::release(gctx);
+    RenderBundleCache::release(&bundleCache);
+    DrawList::free(&staticDrawList);
     RenderPipeline::release(&pipeline);
 }
 
@@ -285,4 +332,5 @@ void Example_Obj(ExampleCallbacks* callbacks)
     callbacks->onMouseButton    = onMouseButton;
     callbacks->onScroll         = onScroll;
     callbacks->onCursorPosition = onCursorPosition;
+    callbacks->onKey            = onKey;
 }
\ No newline at end of file
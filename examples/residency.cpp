@@ -0,0 +1,200 @@
+#include <GLFW/glfw3.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp> // quatToMat4
+
+#include "context.h"
+#include "core/log.h"
+#include "entity.h"
+#include "example.h"
+#include "memory.h"
+#include "renderer.h"
+#include "residency.h"
+#include "shaders.h"
+
+// Texture residency: two rows of cubes down a long corridor, every cube with
+// its own managed texture, cycling through residencyFiles. At full size
+// they need far more than the residency budget; the camera flies up and
+// down the corridor and only the cubes close to it keep their large levels.
+// B toggles the budget between small and large.
+//
+// Residency stats are logged once per second.
+
+#define RESIDENCY_CUBE_COUNT 64
+#define RESIDENCY_SPACING 6.0f
+#define RESIDENCY_SMALL_BUDGET (96ull << 20)
+#define RESIDENCY_LARGE_BUDGET (1024ull << 20)
+
+static const char* residencyFiles[] = {
+    "./assets/fourareen/fourareen2K_albedo.jpg",
+    "./assets/brickwall_albedo.png",
+    "./assets/uv.png",
+};
+
+static GraphicsContext* gctx = NULL;
+static GLFWwindow* window    = NULL;
+
+static RenderPipeline pipeline = {};
+static Entity cameraEntity     = {};
+static Entity cubeEntity       = {}; // owns the shared cube geometry
+static Entity* entities        = NULL;
+static Texture* textures       = NULL;
+static Material* materials     = NULL;
+
+static DrawList drawList  = {};
+static bool smallBudget   = true;
+static f64 lastReportTime = 0.0;
+
+static void onTextureReplaced(GraphicsContext* ctx, Texture* texture,
+                              void* userdata)
+{
+    Material::setTexture(ctx, (Material*)userdata, texture);
+}
+
+static void onInit(GraphicsContext* ctx, GLFWwindow* w)
+{
+    gctx   = ctx;
+    window = w;
+
+    TextureResidency::setBudget(RESIDENCY_SMALL_BUDGET);
+
+    RenderPipeline::init(gctx, &pipeline, shaderCode, shaderCode);
+    Entity::init(&cameraEntity, gctx,
+                 pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+
+    CubeParams cubeParams = { 2.0f, 2.0f, 2.0f, 1, 1, 1 };
+    Vertices cubeVertices = createCube(&cubeParams);
+    Entity::init(&cubeEntity, gctx, pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+    Entity::setVertices(&cubeEntity, &cubeVertices, gctx);
+
+    entities  = ALLOCATE_COUNT(Entity, RESIDENCY_CUBE_COUNT);
+    textures  = ALLOCATE_COUNT(Texture, RESIDENCY_CUBE_COUNT);
+    materials = ALLOCATE_COUNT(Material, RESIDENCY_CUBE_COUNT);
+    for (u32 i = 0; i < RESIDENCY_CUBE_COUNT; i++) {
+        // every cube its own texture, even when the file is the same
+        const char* file = residencyFiles[i % ARRAY_LENGTH(residencyFiles)];
+        TextureResidency::manage(gctx, &textures[i], file, onTextureReplaced,
+                                 &materials[i]);
+        Material::init(gctx, &materials[i], &pipeline, &textures[i]);
+
+        MaterialUniforms uniforms = {};
+        uniforms.color            = glm::vec4(1.0f);
+        Material::setUniforms(gctx, &materials[i], &uniforms);
+
+        Entity* entity = &entities[i];
+        Entity::init(entity, gctx, pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+
+        // share geometry with the prototype cube
+        entity->vertices       = cubeEntity.vertices;
+        entity->mesh           = cubeEntity.mesh;
+        entity->boundingRadius = cubeEntity.boundingRadius;
+
+        entity->pos = glm::vec3((i % 2) ? 2.5f : -2.5f, 0.0f,
+                                -(f32)(i / 2) * RESIDENCY_SPACING);
+
+        DrawUniforms drawUniforms = {};
+        drawUniforms.modelMat     = Entity::modelMatrix(entity);
+        wgpuQueueWriteBuffer(gctx->queue, entity->bindGroup.uniformBuffer, 0,
+                             &drawUniforms, sizeof(drawUniforms));
+    }
+
+    log_info("texture residency: %d textures, budget %.0f MB. B toggles the "
+             "budget",
+             RESIDENCY_CUBE_COUNT, RESIDENCY_SMALL_BUDGET / (1024.0 * 1024.0));
+}
+
+static void onUpdate(f32 dt)
+{
+    UNUSED_VAR(dt);
+    f32 time   = (f32)glfwGetTime();
+    f32 length = 0.5f * RESIDENCY_CUBE_COUNT * RESIDENCY_SPACING;
+
+    // up and down the corridor, looking ahead
+    f32 z            = -0.5f * length * (1.0f - cosf(0.1f * time));
+    f32 heading      = sinf(0.1f * time) >= 0.0f ? -1.0f : 1.0f;
+    cameraEntity.pos = glm::vec3(0.0f, 1.0f, z + 4.0f);
+    cameraEntity.rot = glm::conjugate(glm::toQuat(glm::lookAt(
+      cameraEntity.pos, cameraEntity.pos + glm::vec3(0.0f, -0.1f, heading),
+      VEC_UP)));
+    cameraEntity.farPlane = 2.0f * length;
+}
+
+static void onKey(i32 key, i32 scancode, i32 action, i32 mods)
+{
+    UNUSED_VAR(scancode);
+    UNUSED_VAR(mods);
+    if (key != GLFW_KEY_B || action != GLFW_PRESS) return;
+
+    smallBudget = !smallBudget;
+    u64 budget  = smallBudget ? RESIDENCY_SMALL_BUDGET : RESIDENCY_LARGE_BUDGET;
+    TextureResidency::setBudget(budget);
+    log_info("texture residency: budget %.0f MB", budget / (1024.0 * 1024.0));
+}
+
+static void onRender()
+{
+    GraphicsContext::beginFrame(gctx);
+
+    i32 width, height;
+    glfwGetWindowSize(window, &width, &height);
+    f32 aspect = (f32)width / (f32)height;
+
+    FrameUniforms frameUniforms = {};
+    frameUniforms.projectionMat
+      = Entity::projectionMatrix(&cameraEntity, aspect);
+    frameUniforms.viewMat = Entity::viewMatrix(&cameraEntity);
+    frameUniforms.projViewMat
+      = frameUniforms.projectionMat * frameUniforms.viewMat;
+    frameUniforms.dirLight = glm::normalize(glm::vec3(0.3f, -1.0f, -0.5f));
+    frameUniforms.time     = (f32)glfwGetTime();
+    GraphicsContext::writeBuffer(
+      gctx, pipeline.bindGroups[PER_FRAME_GROUP].uniformBuffer, 0,
+      &frameUniforms, sizeof(frameUniforms));
+
+    DrawList::reset(&drawList);
+    for (u32 i = 0; i < RESIDENCY_CUBE_COUNT; i++)
+        DrawList::add(&drawList, &pipeline, &materials[i], &entities[i]);
+
+    // what this frame needs, applied by the next TextureResidency::update()
+    TextureResidency::recordDrawList(&drawList, &cameraEntity, gctx->height);
+
+    WGPURenderPassEncoder renderPass = GraphicsContext::beginRenderPass(gctx);
+    DrawList::execute(gctx, &drawList, renderPass);
+
+    GraphicsContext::presentFrame(gctx);
+
+    f64 now = glfwGetTime();
+    if (now - lastReportTime >= 1.0) {
+        TextureResidencyStats stats = TextureResidency::stats();
+        log_info("texture residency: %.1f MB resident, %.1f MB wanted, "
+                 "budget %.1f MB, %d loading, %d loads, %d evictions",
+                 stats.residentBytes / (1024.0 * 1024.0),
+                 stats.wantedBytes / (1024.0 * 1024.0),
+                 stats.budget / (1024.0 * 1024.0), stats.loading, stats.loads,
+                 stats.evictions);
+        lastReportTime = now;
+    }
+}
+
+static void onExit()
+{
+    DrawList::free(&drawList);
+    for (u32 i = 0; i < RESIDENCY_CUBE_COUNT; i++) {
+        Material::release(&materials[i]);
+        if (textures[i].texture) Texture::release(&textures[i]);
+    }
+    FREE_ARRAY(Material, materials, RESIDENCY_CUBE_COUNT);
+    FREE_ARRAY(Texture, textures, RESIDENCY_CUBE_COUNT);
+    FREE_ARRAY(Entity, entities, RESIDENCY_CUBE_COUNT);
+    RenderPipeline::release(&pipeline);
+}
+
+void Example_Residency(ExampleCallbacks* callbacks)
+{
+    *callbacks          = {};
+    callbacks->onInit   = onInit;
+    callbacks->onUpdate = onUpdate;
+    callbacks->onRender = onRender;
+    callbacks->onExit   = onExit;
+    callbacks->onKey    = onKey;
+}
@@ -0,0 +1,107 @@
+#include <cstring>
+
+#include <GLFW/glfw3.h>
+
+#include "context.h"
+#include "core/log.h"
+#include "example.h"
+#include "shaders.h"
+#include "wgsl.h"
+
+// Shader module creation benchmark: every permutation of the default shaders
+// compiled as one full module shared by both stages (before stripping) vs
+// one stripped module per stage (after). Modules are created directly,
+// bypassing the pipeline cache, so every iteration is a cold compile.
+// Results are logged once at startup; numbers are meant for wgpu-native,
+// where wgpuDeviceCreateShaderModule parses and validates synchronously.
+
+#define SHADER_BENCH_ITERATIONS 20
+
+static GraphicsContext* gctx = NULL;
+
+struct ShaderBenchResult {
+    f64 seconds;
+    u64 bytes;
+    u32 modules;
+};
+
+static void createModule(const char* code, ShaderBenchResult* result)
+{
+    ShaderModule module = {};
+    f64 start           = glfwGetTime();
+    ShaderModule::init(gctx, &module, code, "shader bench");
+    result->seconds += glfwGetTime() - start;
+    result->bytes += strlen(code);
+    result->modules++;
+    ShaderModule::release(&module);
+}
+
+static void onInit(GraphicsContext* ctx, GLFWwindow* window)
+{
+    UNUSED_VAR(window);
+    gctx = ctx;
+
+#if defined(WEBGPU_BACKEND_WGPU)
+    const char* backend = "wgpu-native";
+#elif defined(WEBGPU_BACKEND_DAWN)
+    const char* backend = "dawn";
+#else
+    const char* backend = "browser";
+#endif
+
+    const char* sources[] = { shaderCode, instancedShaderCode };
+
+    ShaderBenchResult full     = {};
+    ShaderBenchResult stripped = {};
+    f64 stripSeconds           = 0.0;
+
+    for (u32 iteration = 0; iteration < SHADER_BENCH_ITERATIONS; iteration++) {
+        for (u32 s = 0; s < ARRAY_LENGTH(sources); s++) {
+            for (u32 p = 0; p < SHADER_PERMUTATION_COUNT; p++) {
+                const char* source = shaderPermutation(sources[s], p);
+
+                // before: the same module for both stages
+                createModule(source, &full);
+
+                // after: per stage
+                f64 start = glfwGetTime();
+                char* vertex
+                  = ShaderPreprocessor::strip(source, VS_ENTRY_POINT);
+                char* fragment
+                  = ShaderPreprocessor::strip(source, FS_ENTRY_POINT);
+                stripSeconds += glfwGetTime() - start;
+
+                createModule(vertex, &stripped);
+                createModule(fragment, &stripped);
+
+                ShaderPreprocessor::freeSource(vertex);
+                ShaderPreprocessor::freeSource(fragment);
+            }
+        }
+    }
+
+    log_info("shader bench (%s): %d iterations", backend,
+             SHADER_BENCH_ITERATIONS);
+    log_info("  full:     %d modules, %.1f KB, %.3f ms total, %.3f ms/module",
+             full.modules, full.bytes / 1024.0, 1000.0 * full.seconds,
+             1000.0 * full.seconds / full.modules);
+    log_info("  stripped: %d modules, %.1f KB, %.3f ms total, %.3f ms/module "
+             "(+%.3f ms stripping)",
+             stripped.modules, stripped.bytes / 1024.0,
+             1000.0 * stripped.seconds,
+             1000.0 * stripped.seconds / stripped.modules,
+             1000.0 * stripSeconds);
+}
+
+static void onRender()
+{
+    GraphicsContext::prepareFrame(gctx);
+    GraphicsContext::presentFrame(gctx);
+}
+
+void Example_ShaderBench(ExampleCallbacks* callbacks)
+{
+    *callbacks          = {};
+    callbacks->onInit   = onInit;
+    callbacks->onRender = onRender;
+}
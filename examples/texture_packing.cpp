@@ -0,0 +1,323 @@
+#include <GLFW/glfw3.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp> // quatToMat4
+
+#include "context.h"
+#include "core/log.h"
+#include "entity.h"
+#include "example.h"
+#include "memory.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "texture_atlas.h"
+#include "wgsl.h"
+
+// Material bind group sharing: a grid of cubes, every one its own material,
+// the materials using PACKING_IMAGE_COUNT small generated images. M cycles
+// through the ways of binding them:
+//
+// - separate: a texture and a uniform buffer per material, a bind group
+//   switch for every draw
+// - atlas: the images packed into one TextureAtlas, the uniforms in one
+//   MaterialBuffer, every material on the same bind group
+// - array: the brickwall maps as layers of one texture array
+//   (SHADER_PERMUTATION_TEXTURE_ARRAY), also one bind group
+//
+// Bind group switches and recording time are logged once per second.
+
+#define PACKING_GRID_SIZE 32
+#define PACKING_ENTITY_COUNT (PACKING_GRID_SIZE * PACKING_GRID_SIZE)
+#define PACKING_IMAGE_COUNT 64
+#define PACKING_SPACING 2.0f
+
+enum PackingMode {
+    PACKING_SEPARATE = 0,
+    PACKING_ATLAS,
+    PACKING_ARRAY,
+    PACKING_MODE_COUNT,
+};
+
+static const char* modeNames[] = { "separate", "atlas", "array" };
+
+static const char* arrayFilenames[] = {
+    "./assets/brickwall_albedo.png",
+    "./assets/brickwall_normal.png",
+    "./assets/brickwall_height.png",
+};
+
+static GraphicsContext* gctx = NULL;
+static GLFWwindow* window    = NULL;
+
+static RenderPipeline pipeline      = {};
+static RenderPipeline arrayPipeline = {};
+static Entity cameraEntity          = {};
+static Entity cubeEntity            = {}; // owns the shared cube geometry
+static Entity* entities             = NULL;
+
+static TextureAtlas separateTextures[PACKING_IMAGE_COUNT] = {};
+static TextureAtlas atlas                                 = {};
+static Texture arrayTexture                               = {};
+static MaterialBuffer materialBuffer                      = {};
+static Material* materials[PACKING_MODE_COUNT]            = {};
+static bool modeLoaded[PACKING_MODE_COUNT]                = {};
+
+static DrawList drawList = {};
+static u32 mode          = PACKING_ATLAS;
+
+static f64 recordSeconds  = 0.0;
+static u64 recordFrames   = 0;
+static f64 lastReportTime = 0.0;
+
+/// @brief Checkerboard of a per image hue, sizes between 24 and 120
+/// @return the pixels, owned by the caller
+static u32* createImage(u32 index, TextureAtlasImage* image)
+{
+    u32 width     = 24 + (index * 37) % 97;
+    u32 height    = 24 + (index * 53) % 97;
+    image->width  = width;
+    image->height = height;
+
+    // one hue per image
+    f32 hue = 2.0f * PI * index / PACKING_IMAGE_COUNT;
+    glm::vec3 rgb
+      = 0.5f + 0.5f * glm::cos(glm::vec3(hue, hue + 2.1f, hue + 4.2f));
+
+    u32* pixels   = ALLOCATE_COUNT(u32, width * height);
+    image->pixels = (const u8*)pixels;
+    for (u32 y = 0; y < height; y++) {
+        for (u32 x = 0; x < width; x++) {
+            f32 shade    = ((x / 8 + y / 8) & 1) ? 1.0f : 0.5f;
+            glm::uvec3 c = glm::uvec3(rgb * shade * 255.0f);
+
+            pixels[y * width + x] = 0xFF000000u | (c.b << 16) | (c.g << 8)
+                                    | c.r;
+        }
+    }
+    return pixels;
+}
+
+static void initMaterials(u32 packing, RenderPipeline* materialPipeline,
+                          Texture* (*texture)(u32 image),
+                          glm::vec4 (*uvRect)(u32 image), bool shared)
+{
+    materials[packing] = ALLOCATE_COUNT(Material, PACKING_ENTITY_COUNT);
+    for (u32 i = 0; i < PACKING_ENTITY_COUNT; i++) {
+        u32 image          = i % PACKING_IMAGE_COUNT;
+        Material* material = &materials[packing][i];
+        Material::init(gctx, material, materialPipeline, texture(image),
+                       shared ? &materialBuffer : NULL);
+
+        MaterialUniforms uniforms = {};
+        uniforms.color            = glm::vec4(1.0f);
+        uniforms.uvRect           = uvRect(image);
+        uniforms.textureLayer     = image % ARRAY_LENGTH(arrayFilenames);
+        Material::setUniforms(gctx, material, &uniforms);
+    }
+    modeLoaded[packing] = true;
+}
+
+static Texture* separateTexture(u32 image)
+{
+    return &separateTextures[image].texture;
+}
+
+static glm::vec4 separateRect(u32 image)
+{
+    return separateTextures[image].uvRects[0];
+}
+
+static Texture* atlasTexture(u32 image)
+{
+    UNUSED_VAR(image);
+    return &atlas.texture;
+}
+
+static glm::vec4 atlasRect(u32 image)
+{
+    return atlas.uvRects[image];
+}
+
+static Texture* layerTexture(u32 image)
+{
+    UNUSED_VAR(image);
+    return &arrayTexture;
+}
+
+static glm::vec4 fullRect(u32 image)
+{
+    UNUSED_VAR(image);
+    return glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+}
+
+static void onInit(GraphicsContext* ctx, GLFWwindow* w)
+{
+    gctx   = ctx;
+    window = w;
+
+    RenderPipeline::init(gctx, &pipeline, shaderCode, shaderCode);
+    RenderPipeline::initPermutation(gctx, &arrayPipeline, shaderCode,
+                                    SHADER_PERMUTATION_TEXTURE_ARRAY);
+
+    Entity::init(&cameraEntity, gctx,
+                 pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+
+    // images: each one on its own, and all of them packed
+    TextureAtlasImage images[PACKING_IMAGE_COUNT];
+    u32* pixels[PACKING_IMAGE_COUNT];
+    for (u32 i = 0; i < PACKING_IMAGE_COUNT; i++) {
+        pixels[i] = createImage(i, &images[i]);
+        TextureAtlas::init(gctx, &separateTextures[i], &images[i], 1);
+    }
+    TextureAtlas::init(gctx, &atlas, images, PACKING_IMAGE_COUNT);
+    for (u32 i = 0; i < PACKING_IMAGE_COUNT; i++)
+        FREE_ARRAY(u32, pixels[i], images[i].width * images[i].height);
+
+    MaterialBuffer::init(gctx, &materialBuffer, 2 * PACKING_ENTITY_COUNT);
+    initMaterials(PACKING_SEPARATE, &pipeline, separateTexture, separateRect,
+                  false);
+    initMaterials(PACKING_ATLAS, &pipeline, atlasTexture, atlasRect, true);
+    if (Texture::initArrayFromFiles(gctx, &arrayTexture, arrayFilenames,
+                                    ARRAY_LENGTH(arrayFilenames), true))
+        initMaterials(PACKING_ARRAY, &arrayPipeline, layerTexture, fullRect,
+                      true);
+
+    CubeParams cubeParams = { 1.0f, 1.0f, 1.0f, 1, 1, 1 };
+    Vertices cubeVertices = createCube(&cubeParams);
+    Entity::init(&cubeEntity, gctx, pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+    Entity::setVertices(&cubeEntity, &cubeVertices, gctx);
+
+    entities = ALLOCATE_COUNT(Entity, PACKING_ENTITY_COUNT);
+    f32 half = 0.5f * PACKING_SPACING * PACKING_GRID_SIZE;
+    for (u32 i = 0; i < PACKING_ENTITY_COUNT; i++) {
+        Entity* entity = &entities[i];
+        Entity::init(entity, gctx, pipeline.bindGroupLayouts[PER_DRAW_GROUP]);
+
+        // share geometry with the prototype cube
+        entity->vertices = cubeEntity.vertices;
+        entity->mesh     = cubeEntity.mesh;
+
+        entity->pos
+          = glm::vec3((i % PACKING_GRID_SIZE) * PACKING_SPACING - half, 0.0f,
+                      (i / PACKING_GRID_SIZE) * PACKING_SPACING - half);
+
+        DrawUniforms drawUniforms = {};
+        drawUniforms.modelMat     = Entity::modelMatrix(entity);
+        wgpuQueueWriteBuffer(gctx->queue, entity->bindGroup.uniformBuffer, 0,
+                             &drawUniforms, sizeof(drawUniforms));
+    }
+
+    log_info("texture packing: %d materials, %d images, atlas %dx%d. M "
+             "cycles the mode",
+             PACKING_ENTITY_COUNT, PACKING_IMAGE_COUNT, atlas.texture.width,
+             atlas.texture.height);
+}
+
+static void onUpdate(f32 dt)
+{
+    UNUSED_VAR(dt);
+    f32 time = (f32)glfwGetTime();
+
+    f32 radius       = 0.8f * PACKING_SPACING * PACKING_GRID_SIZE;
+    cameraEntity.pos = glm::vec3(radius * cos(0.1f * time), 0.5f * radius,
+                                 radius * sin(0.1f * time));
+    cameraEntity.rot = glm::conjugate(glm::toQuat(
+      glm::lookAt(cameraEntity.pos, glm::vec3(0.0f), VEC_UP)));
+    cameraEntity.farPlane = 4.0f * radius;
+}
+
+static void onKey(i32 key, i32 scancode, i32 action, i32 mods)
+{
+    UNUSED_VAR(scancode);
+    UNUSED_VAR(mods);
+    if (key != GLFW_KEY_M || action != GLFW_PRESS) return;
+
+    do {
+        mode = (mode + 1) % PACKING_MODE_COUNT;
+    } while (!modeLoaded[mode]);
+    log_info("texture packing: %s", modeNames[mode]);
+}
+
+static void onRender()
+{
+    GraphicsContext::beginFrame(gctx);
+
+    i32 width, height;
+    glfwGetWindowSize(window, &width, &height);
+    f32 aspect = (f32)width / (f32)height;
+
+    RenderPipeline* current
+      = mode == PACKING_ARRAY ? &arrayPipeline : &pipeline;
+
+    FrameUniforms frameUniforms = {};
+    frameUniforms.projectionMat
+      = Entity::projectionMatrix(&cameraEntity, aspect);
+    frameUniforms.viewMat = Entity::viewMatrix(&cameraEntity);
+    frameUniforms.projViewMat
+      = frameUniforms.projectionMat * frameUniforms.viewMat;
+    frameUniforms.dirLight = glm::normalize(glm::vec3(0.3f, -1.0f, -0.5f));
+    frameUniforms.time     = (f32)glfwGetTime();
+    GraphicsContext::writeBuffer(
+      gctx, current->bindGroups[PER_FRAME_GROUP].uniformBuffer, 0,
+      &frameUniforms, sizeof(frameUniforms));
+
+    DrawList::reset(&drawList);
+    u32 switches             = 0;
+    WGPUBindGroup boundGroup = NULL;
+    for (u32 i = 0; i < PACKING_ENTITY_COUNT; i++) {
+        Material* material = &materials[mode][i];
+        DrawList::add(&drawList, current, material, &entities[i]);
+        if (material->bindGroup != boundGroup) switches++;
+        boundGroup = material->bindGroup;
+    }
+
+    f64 start = glfwGetTime();
+
+    WGPURenderPassEncoder renderPass = GraphicsContext::beginRenderPass(gctx);
+    DrawList::execute(gctx, &drawList, renderPass);
+    recordSeconds += glfwGetTime() - start;
+    recordFrames++;
+
+    GraphicsContext::presentFrame(gctx);
+
+    if (start - lastReportTime >= 1.0) {
+        log_info("texture packing: %s, %d draws, %d material bind group "
+                 "switches, record+execute %.3f ms/frame",
+                 modeNames[mode], drawList.count, switches,
+                 1000.0 * recordSeconds / recordFrames);
+        recordSeconds  = 0.0;
+        recordFrames   = 0;
+        lastReportTime = start;
+    }
+}
+
+static void onExit()
+{
+    DrawList::free(&drawList);
+    for (u32 m = 0; m < PACKING_MODE_COUNT; m++) {
+        if (!materials[m]) continue;
+        for (u32 i = 0; i < PACKING_ENTITY_COUNT; i++)
+            Material::release(&materials[m][i]);
+        FREE_ARRAY(Material, materials[m], PACKING_ENTITY_COUNT);
+    }
+    MaterialBuffer::release(&materialBuffer);
+
+    for (u32 i = 0; i < PACKING_IMAGE_COUNT; i++)
+        TextureAtlas::release(&separateTextures[i]);
+    TextureAtlas::release(&atlas);
+    if (arrayTexture.texture) Texture::release(&arrayTexture);
+
+    FREE_ARRAY(Entity, entities, PACKING_ENTITY_COUNT);
+    RenderPipeline::release(&pipeline);
+    RenderPipeline::release(&arrayPipeline);
+}
+
+void Example_TexturePacking(ExampleCallbacks* callbacks)
+{
+    *callbacks          = {};
+    callbacks->onInit   = onInit;
+    callbacks->onUpdate = onUpdate;
+    callbacks->onRender = onRender;
+    callbacks->onExit   = onExit;
+    callbacks->onKey    = onKey;
+}
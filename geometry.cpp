@@ -0,0 +1,391 @@
+#include "geometry.h"
+#include "core/log.h"
+#include "deletion.h"
+#include "gpu_memory.h"
+#include "memory.h"
+
+// ============================================================================
+// Buddy Allocator
+// ============================================================================
+
+enum BuddyBlockState {
+    BUDDY_BLOCK_NONE = 0, // not a block head (inside a bigger block)
+    BUDDY_BLOCK_FREE,
+    BUDDY_BLOCK_ALLOCATED,
+};
+
+static u32 slotCount(BuddyAllocator* a)
+{
+    return (u32)(a->capacity / a->minBlock);
+}
+
+static void pushFree(BuddyAllocator* a, u32 slot, u32 order)
+{
+    BuddyBlock* block = &a->blocks[slot];
+    block->order      = (u8)order;
+    block->state      = BUDDY_BLOCK_FREE;
+    block->prev       = BUDDY_NONE;
+    block->next       = a->freeLists[order];
+    if (block->next != BUDDY_NONE) a->blocks[block->next].prev = slot;
+    a->freeLists[order] = slot;
+    a->freeBlocks++;
+}
+
+static void removeFree(BuddyAllocator* a, u32 slot)
+{
+    BuddyBlock* block = &a->blocks[slot];
+    ASSERT(block->state == BUDDY_BLOCK_FREE);
+
+    if (block->prev != BUDDY_NONE) a->blocks[block->prev].next = block->next;
+    else a->freeLists[block->order] = block->next;
+    if (block->next != BUDDY_NONE) a->blocks[block->next].prev = block->prev;
+
+    block->state = BUDDY_BLOCK_NONE;
+    a->freeBlocks--;
+}
+
+/// @brief Free a block, merging with its buddy as far up as possible
+static void insertFree(BuddyAllocator* a, u32 slot, u32 order)
+{
+    while (order + 1 < a->levels) {
+        u32 buddy = slot ^ (1u << order);
+        if (a->blocks[buddy].state != BUDDY_BLOCK_FREE
+            || a->blocks[buddy].order != order)
+            break;
+        removeFree(a, buddy);
+        slot = MIN(slot, buddy);
+        order++;
+    }
+    pushFree(a, slot, order);
+}
+
+void BuddyAllocator::init(BuddyAllocator* a, u32 minBlock, u64 capacity)
+{
+    ASSERT(minBlock > 0 && (minBlock & (minBlock - 1)) == 0);
+
+    *a          = {};
+    a->minBlock = minBlock;
+    a->levels   = 1;
+    while (((u64)minBlock << (a->levels - 1)) < capacity) a->levels++;
+    ASSERT(a->levels <= BUDDY_MAX_LEVELS);
+    a->capacity = (u64)minBlock << (a->levels - 1);
+
+    for (u32 i = 0; i < BUDDY_MAX_LEVELS; i++) a->freeLists[i] = BUDDY_NONE;
+    a->blocks = ALLOCATE_COUNT(BuddyBlock, slotCount(a));
+    pushFree(a, 0, a->levels - 1);
+}
+
+bool BuddyAllocator::allocate(BuddyAllocator* a, u32 size, u32* offset)
+{
+    if (size == 0) size = 1;
+
+    u32 order = 0;
+    while (((u64)a->minBlock << order) < size) order++;
+    if (order >= a->levels) return false;
+
+    // smallest free block that fits
+    u32 level = order;
+    while (level < a->levels && a->freeLists[level] == BUDDY_NONE) level++;
+    if (level == a->levels) return false;
+
+    u32 slot = a->freeLists[level];
+    removeFree(a, slot);
+
+    // split, keeping the left half
+    while (level > order) {
+        level--;
+        pushFree(a, slot + (1u << level), level);
+    }
+
+    BuddyBlock* block = &a->blocks[slot];
+    block->order      = (u8)order;
+    block->state      = BUDDY_BLOCK_ALLOCATED;
+    block->requested  = size;
+
+    a->allocated += (u64)a->minBlock << order;
+    a->requested += size;
+    a->allocations++;
+
+    *offset = slot * a->minBlock;
+    return true;
+}
+
+void BuddyAllocator::free(BuddyAllocator* a, u32 offset)
+{
+    ASSERT(offset % a->minBlock == 0);
+    u32 slot          = offset / a->minBlock;
+    BuddyBlock* block = &a->blocks[slot];
+    ASSERT(block->state == BUDDY_BLOCK_ALLOCATED);
+
+    a->allocated -= (u64)a->minBlock << block->order;
+    a->requested -= block->requested;
+    a->allocations--;
+
+    block->state = BUDDY_BLOCK_NONE;
+    insertFree(a, slot, block->order);
+}
+
+void BuddyAllocator::grow(BuddyAllocator* a)
+{
+    ASSERT(a->levels < BUDDY_MAX_LEVELS);
+
+    u32 oldSlots = slotCount(a);
+    a->blocks    = (BuddyBlock*)reallocate(a->blocks,
+                                           oldSlots * sizeof(BuddyBlock),
+                                           2 * oldSlots * sizeof(BuddyBlock));
+    a->capacity *= 2;
+    a->levels++;
+
+    // the new right half is one free block, merging with the old range if
+    // that was completely free
+    insertFree(a, oldSlots, a->levels - 2);
+}
+
+BuddyAllocatorStats BuddyAllocator::stats(BuddyAllocator* a)
+{
+    BuddyAllocatorStats stats = {};
+    stats.capacity            = a->capacity;
+    stats.allocated           = a->allocated;
+    stats.requested           = a->requested;
+    stats.allocations         = a->allocations;
+    stats.freeBlocks          = a->freeBlocks;
+
+    for (i32 level = (i32)a->levels - 1; level >= 0; level--) {
+        if (a->freeLists[level] != BUDDY_NONE) {
+            stats.largestFree = (u64)a->minBlock << level;
+            break;
+        }
+    }
+
+    u64 free = a->capacity - a->allocated;
+    if (a->allocated > 0)
+        stats.internalFragmentation
+          = 1.0f - (f32)a->requested / (f32)a->allocated;
+    if (free > 0)
+        stats.externalFragmentation
+          = 1.0f - (f32)stats.largestFree / (f32)free;
+    return stats;
+}
+
+void BuddyAllocator::release(BuddyAllocator* a)
+{
+    FREE_ARRAY(BuddyBlock, a->blocks, slotCount(a));
+    *a = {};
+}
+
+// ============================================================================
+// Mesh Pool
+// ============================================================================
+
+// bytes per vertex of each stream
+#define MESH_POOL_POSITION_STRIDE (3 * sizeof(f32))
+#define MESH_POOL_NORMAL_STRIDE (3 * sizeof(f32))
+#define MESH_POOL_TEXCOORD_STRIDE (2 * sizeof(f32))
+#define MESH_POOL_INDEX_STRIDE sizeof(u32)
+
+static WGPUBuffer createPoolBuffer(GraphicsContext* ctx, u64 size,
+                                   WGPUBufferUsageFlags usage,
+                                   const char* label)
+{
+    WGPUBufferDescriptor desc = {};
+    desc.label                = label;
+    desc.size                 = size;
+    desc.usage = usage | WGPUBufferUsage_CopyDst | WGPUBufferUsage_CopySrc;
+    WGPUBuffer buffer = wgpuDeviceCreateBuffer(ctx->device, &desc);
+    GPUMemory::track(buffer, GPUMemory::bufferCategory(usage), size, label);
+    return buffer;
+}
+
+/// @brief Replace buffer with one twice the size, copying the contents over
+static void growBuffer(GraphicsContext* ctx, WGPUCommandEncoder encoder,
+                       WGPUBuffer* buffer, u64 oldSize,
+                       WGPUBufferUsageFlags usage, const char* label)
+{
+    WGPUBuffer grown = createPoolBuffer(ctx, 2 * oldSize, usage, label);
+    wgpuCommandEncoderCopyBufferToBuffer(encoder, *buffer, 0, grown, 0,
+                                         oldSize);
+
+    // the copy and any already recorded draws still use it
+    DeletionQueue::defer(*buffer);
+    *buffer = grown;
+}
+
+static void growVertices(GraphicsContext* ctx, MeshPool* pool)
+{
+    u64 oldCapacity = pool->vertexAllocator.capacity;
+    BuddyAllocator::grow(&pool->vertexAllocator);
+
+    WGPUCommandEncoderDescriptor encoderDesc = {};
+    encoderDesc.label                        = "mesh pool grow";
+    WGPUCommandEncoder encoder
+      = wgpuDeviceCreateCommandEncoder(ctx->device, &encoderDesc);
+
+    growBuffer(ctx, encoder, &pool->positionBuffer,
+               oldCapacity * MESH_POOL_POSITION_STRIDE, WGPUBufferUsage_Vertex,
+               "mesh pool positions");
+    growBuffer(ctx, encoder, &pool->normalBuffer,
+               oldCapacity * MESH_POOL_NORMAL_STRIDE, WGPUBufferUsage_Vertex,
+               "mesh pool normals");
+    growBuffer(ctx, encoder, &pool->texcoordBuffer,
+               oldCapacity * MESH_POOL_TEXCOORD_STRIDE, WGPUBufferUsage_Vertex,
+               "mesh pool texcoords");
+
+    WGPUCommandBuffer commands = wgpuCommandEncoderFinish(encoder, NULL);
+    wgpuQueueSubmit(ctx->queue, 1, &commands);
+    wgpuCommandBufferRelease(commands);
+    wgpuCommandEncoderRelease(encoder);
+
+    pool->growCount++;
+    log_info("mesh pool: grew vertex buffers to %llu vertices",
+             (unsigned long long)pool->vertexAllocator.capacity);
+}
+
+static void growIndices(GraphicsContext* ctx, MeshPool* pool)
+{
+    u64 oldCapacity = pool->indexAllocator.capacity;
+    BuddyAllocator::grow(&pool->indexAllocator);
+
+    WGPUCommandEncoderDescriptor encoderDesc = {};
+    encoderDesc.label                        = "mesh pool grow";
+    WGPUCommandEncoder encoder
+      = wgpuDeviceCreateCommandEncoder(ctx->device, &encoderDesc);
+
+    growBuffer(ctx, encoder, &pool->indexBuffer,
+               oldCapacity * MESH_POOL_INDEX_STRIDE, WGPUBufferUsage_Index,
+               "mesh pool indices");
+
+    WGPUCommandBuffer commands = wgpuCommandEncoderFinish(encoder, NULL);
+    wgpuQueueSubmit(ctx->queue, 1, &commands);
+    wgpuCommandBufferRelease(commands);
+    wgpuCommandEncoderRelease(encoder);
+
+    pool->growCount++;
+    log_info("mesh pool: grew index buffer to %llu indices",
+             (unsigned long long)pool->indexAllocator.capacity);
+}
+
+void MeshPool::init(GraphicsContext* ctx, MeshPool* pool, u32 vertexCapacity,
+                    u32 indexCapacity)
+{
+    *pool = {};
+    BuddyAllocator::init(&pool->vertexAllocator, MESH_POOL_MIN_BLOCK,
+                         vertexCapacity);
+    BuddyAllocator::init(&pool->indexAllocator, MESH_POOL_MIN_BLOCK,
+                         indexCapacity);
+
+    u64 vertices         = pool->vertexAllocator.capacity;
+    pool->positionBuffer = createPoolBuffer(
+      ctx, vertices * MESH_POOL_POSITION_STRIDE, WGPUBufferUsage_Vertex,
+      "mesh pool positions");
+    pool->normalBuffer = createPoolBuffer(
+      ctx, vertices * MESH_POOL_NORMAL_STRIDE, WGPUBufferUsage_Vertex,
+      "mesh pool normals");
+    pool->texcoordBuffer = createPoolBuffer(
+      ctx, vertices * MESH_POOL_TEXCOORD_STRIDE, WGPUBufferUsage_Vertex,
+      "mesh pool texcoords");
+    pool->indexBuffer = createPoolBuffer(
+      ctx, pool->indexAllocator.capacity * MESH_POOL_INDEX_STRIDE,
+      WGPUBufferUsage_Index, "mesh pool indices");
+}
+
+void MeshPool::allocate(GraphicsContext* ctx, MeshPool* pool,
+                        Vertices* vertices, MeshAllocation* mesh)
+{
+    *mesh             = {};
+    mesh->pool        = pool;
+    mesh->vertexCount = vertices->vertexCount;
+    mesh->indexCount  = vertices->indicesCount;
+
+    while (!BuddyAllocator::allocate(&pool->vertexAllocator,
+                                     vertices->vertexCount, &mesh->baseVertex))
+        growVertices(ctx, pool);
+    while (!BuddyAllocator::allocate(&pool->indexAllocator,
+                                     vertices->indicesCount, &mesh->firstIndex))
+        growIndices(ctx, pool);
+
+    // vertex data stored in single contiguous array
+    // [positions | normals | texcoords]
+    const u64 n = vertices->vertexCount;
+    wgpuQueueWriteBuffer(ctx->queue, pool->positionBuffer,
+                         mesh->baseVertex * MESH_POOL_POSITION_STRIDE,
+                         Vertices::positions(vertices),
+                         n * MESH_POOL_POSITION_STRIDE);
+    wgpuQueueWriteBuffer(ctx->queue, pool->normalBuffer,
+                         mesh->baseVertex * MESH_POOL_NORMAL_STRIDE,
+                         Vertices::normals(vertices),
+                         n * MESH_POOL_NORMAL_STRIDE);
+    wgpuQueueWriteBuffer(ctx->queue, pool->texcoordBuffer,
+                         mesh->baseVertex * MESH_POOL_TEXCOORD_STRIDE,
+                         Vertices::texcoords(vertices),
+                         n * MESH_POOL_TEXCOORD_STRIDE);
+    wgpuQueueWriteBuffer(ctx->queue, pool->indexBuffer,
+                         mesh->firstIndex * MESH_POOL_INDEX_STRIDE,
+                         vertices->indices,
+                         vertices->indicesCount * MESH_POOL_INDEX_STRIDE);
+}
+
+void MeshPool::free(MeshAllocation* mesh)
+{
+    if (!mesh->pool) return;
+    BuddyAllocator::free(&mesh->pool->vertexAllocator, mesh->baseVertex);
+    BuddyAllocator::free(&mesh->pool->indexAllocator, mesh->firstIndex);
+    *mesh = {};
+}
+
+void MeshPool::setBuffers(MeshPool* pool, WGPURenderPassEncoder encoder)
+{
+    wgpuRenderPassEncoderSetVertexBuffer(encoder, 0, pool->positionBuffer, 0,
+                                         WGPU_WHOLE_SIZE);
+    wgpuRenderPassEncoderSetVertexBuffer(encoder, 1, pool->normalBuffer, 0,
+                                         WGPU_WHOLE_SIZE);
+    wgpuRenderPassEncoderSetVertexBuffer(encoder, 2, pool->texcoordBuffer, 0,
+                                         WGPU_WHOLE_SIZE);
+    wgpuRenderPassEncoderSetIndexBuffer(encoder, pool->indexBuffer,
+                                        WGPUIndexFormat_Uint32, 0,
+                                        WGPU_WHOLE_SIZE);
+}
+
+void MeshPool::setBuffers(MeshPool* pool, WGPURenderBundleEncoder encoder)
+{
+    wgpuRenderBundleEncoderSetVertexBuffer(encoder, 0, pool->positionBuffer, 0,
+                                           WGPU_WHOLE_SIZE);
+    wgpuRenderBundleEncoderSetVertexBuffer(encoder, 1, pool->normalBuffer, 0,
+                                           WGPU_WHOLE_SIZE);
+    wgpuRenderBundleEncoderSetVertexBuffer(encoder, 2, pool->texcoordBuffer,
+                                           0, WGPU_WHOLE_SIZE);
+    wgpuRenderBundleEncoderSetIndexBuffer(encoder, pool->indexBuffer,
+                                          WGPUIndexFormat_Uint32, 0,
+                                          WGPU_WHOLE_SIZE);
+}
+
+static void logAllocatorStats(const char* name, BuddyAllocator* allocator)
+{
+    BuddyAllocatorStats stats = BuddyAllocator::stats(allocator);
+    log_info("mesh pool %-8s %d allocations, %llu / %llu used (%llu "
+             "requested), largest free %llu, fragmentation %.1f%% internal "
+             "%.1f%% external",
+             name, stats.allocations, (unsigned long long)stats.allocated,
+             (unsigned long long)stats.capacity,
+             (unsigned long long)stats.requested,
+             (unsigned long long)stats.largestFree,
+             100.0f * stats.internalFragmentation,
+             100.0f * stats.externalFragmentation);
+}
+
+void MeshPool::logStats(MeshPool* pool)
+{
+    logAllocatorStats("vertices", &pool->vertexAllocator);
+    logAllocatorStats("indices", &pool->indexAllocator);
+    log_info("mesh pool grew %d times", pool->growCount);
+}
+
+void MeshPool::release(MeshPool* pool)
+{
+    DeletionQueue::defer(pool->positionBuffer);
+    DeletionQueue::defer(pool->normalBuffer);
+    DeletionQueue::defer(pool->texcoordBuffer);
+    DeletionQueue::defer(pool->indexBuffer);
+    BuddyAllocator::release(&pool->vertexAllocator);
+    BuddyAllocator::release(&pool->indexAllocator);
+    *pool = {};
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+#include "shapes.h"
+
+// ============================================================================
+// Buddy Allocator
+// ============================================================================
+
+// Power of two buddy allocator over an abstract range of units (vertices,
+// indices, bytes, ...). Only bookkeeping, the caller owns the memory.
+// Blocks are minBlock << order units; frees coalesce with their buddy.
+// The range can be doubled in place: the old range becomes the left half,
+// so existing offsets stay valid.
+
+#define BUDDY_MAX_LEVELS 32
+#define BUDDY_NONE 0xFFFFFFFF
+
+struct BuddyBlock {
+    u32 next; // free list links, BUDDY_NONE terminated
+    u32 prev;
+    u32 requested; // units asked for, allocated heads only
+    u8 order;
+    u8 state;
+};
+
+struct BuddyAllocatorStats {
+    u64 capacity;    // units
+    u64 allocated;   // units in allocated blocks (rounded up)
+    u64 requested;   // units actually asked for
+    u64 largestFree; // biggest single allocation that fits right now
+    u32 allocations;
+    u32 freeBlocks;
+
+    // 1 - requested / allocated: waste from rounding up to a power of 2
+    f32 internalFragmentation;
+    // 1 - largestFree / free: free space unusable for one big allocation
+    f32 externalFragmentation;
+};
+
+struct BuddyAllocator {
+    u32 minBlock; // units, power of 2
+    u32 levels;
+    u64 capacity;
+    BuddyBlock* blocks; // one per minBlock slot
+    u32 freeLists[BUDDY_MAX_LEVELS];
+
+    u64 allocated;
+    u64 requested;
+    u32 allocations;
+    u32 freeBlocks;
+
+    /// @brief capacity is rounded up to minBlock * 2^n
+    static void init(BuddyAllocator* a, u32 minBlock, u64 capacity);
+
+    /// @return false if no block is big enough (grow() and retry)
+    static bool allocate(BuddyAllocator* a, u32 size, u32* offset);
+    static void free(BuddyAllocator* a, u32 offset);
+
+    /// @brief Double the capacity, keeping all existing allocations
+    static void grow(BuddyAllocator* a);
+
+    static BuddyAllocatorStats stats(BuddyAllocator* a);
+    static void release(BuddyAllocator* a);
+};
+
+// ============================================================================
+// Mesh Pool
+// ============================================================================
+
+// All mesh geometry lives in a few large buffers, one per attribute stream
+// (de-interleaved, matching VertexBufferLayout) plus one index buffer.
+// Meshes get a range of each instead of their own buffers, and are drawn
+// with baseVertex/firstIndex. Indices stay relative to the mesh's first
+// vertex. Buffers are bound once per pass instead of once per draw.
+//
+// When full, the pool doubles the affected buffers and copies the old
+// contents over on the GPU. Offsets don't change, but the buffer handles
+// do, so anything recorded against the old ones (bundles) must be
+// re-recorded; DrawList::hash() includes them.
+
+#define MESH_POOL_MIN_BLOCK 64 // vertices or indices
+#define MESH_POOL_INITIAL_VERTICES (1 << 16)
+#define MESH_POOL_INITIAL_INDICES (1 << 18)
+
+struct MeshPool;
+
+/// @brief A mesh's slice of the pool
+struct MeshAllocation {
+    MeshPool* pool;
+    u32 baseVertex;
+    u32 vertexCount;
+    u32 firstIndex;
+    u32 indexCount;
+};
+
+struct MeshPool {
+    BuddyAllocator vertexAllocator; // in vertices
+    BuddyAllocator indexAllocator;  // in indices
+
+    // [positions | normals | texcoords] streams, vertex slots 0, 1, 2
+    WGPUBuffer positionBuffer;
+    WGPUBuffer normalBuffer;
+    WGPUBuffer texcoordBuffer;
+    WGPUBuffer indexBuffer;
+
+    u32 growCount;
+
+    static void init(GraphicsContext* ctx, MeshPool* pool, u32 vertexCapacity,
+                     u32 indexCapacity);
+
+    /// @brief Allocate and upload a mesh
+    static void allocate(GraphicsContext* ctx, MeshPool* pool,
+                         Vertices* vertices, MeshAllocation* mesh);
+    static void free(MeshAllocation* mesh);
+
+    /// @brief Bind the shared vertex and index buffers
+    static void setBuffers(MeshPool* pool, WGPURenderPassEncoder encoder);
+    static void setBuffers(MeshPool* pool, WGPURenderBundleEncoder encoder);
+
+    static void logStats(MeshPool* pool);
+    static void release(MeshPool* pool);
+};
@@ -0,0 +1,372 @@
+#include <string.h>
+
+#include "core/log.h"
+#include "gpu_memory.h"
+#include "hash.h"
+#include "memory.h"
+
+// ============================================================================
+// GPU Memory Tracker
+// ============================================================================
+
+struct GPUMemoryEntry {
+    void* handle;
+    u64 bytes;
+    GPUMemoryCategory category;
+    char label[GPU_MEMORY_LABEL_LENGTH];
+};
+
+struct GPUMemoryBudgetListener {
+    GPUMemoryBudgetCallback callback;
+    void* userdata;
+};
+
+struct GPUMemoryState {
+    HashMap entries; // hash(handle) -> GPUMemoryEntry*
+
+    GPUMemoryStats categories[GPU_MEMORY_CATEGORY_COUNT];
+    GPUMemoryStats total;
+
+    u64 budget;
+    bool budgetInitialized;
+    bool overBudget; // warning logged, re-armed when back under budget
+    bool inCallback;
+    GPUMemoryBudgetListener listeners[GPU_MEMORY_MAX_CALLBACKS];
+    u32 listenerCount;
+};
+
+static GPUMemoryState gpuMemory = {};
+
+static const char* categoryNames[GPU_MEMORY_CATEGORY_COUNT] = {
+    "vertex",  "index",   "uniform",       "storage", "indirect",
+    "staging", "texture", "render target",
+};
+
+static u64 handleKey(void* handle)
+{
+    return hashCombine(HASH_SEED, (u64)handle);
+}
+
+static void initBudget()
+{
+    if (gpuMemory.budgetInitialized) return;
+    gpuMemory.budget            = GPU_MEMORY_DEFAULT_BUDGET;
+    gpuMemory.budgetInitialized = true;
+}
+
+static void addBytes(GPUMemoryStats* stats, u64 bytes)
+{
+    stats->bytes += bytes;
+    stats->count++;
+    if (stats->bytes > stats->peak) stats->peak = stats->bytes;
+}
+
+static void removeBytes(GPUMemoryStats* stats, u64 bytes)
+{
+    ASSERT(stats->bytes >= bytes && stats->count > 0);
+    stats->bytes -= bytes;
+    stats->count--;
+}
+
+static void checkBudget()
+{
+    initBudget();
+    u64 used   = gpuMemory.total.bytes;
+    u64 budget = gpuMemory.budget;
+    if (budget == 0 || used <= budget) {
+        gpuMemory.overBudget = false;
+        return;
+    }
+
+    if (!gpuMemory.overBudget) {
+        log_warn("gpu memory: %.1f MB in use, over the %.1f MB budget",
+                 used / (1024.0 * 1024.0), budget / (1024.0 * 1024.0));
+        gpuMemory.overBudget = true;
+    }
+
+    // callbacks free resources, which untracks them; don't recurse
+    if (gpuMemory.inCallback) return;
+    gpuMemory.inCallback = true;
+    for (u32 i = 0; i < gpuMemory.listenerCount; i++) {
+        if (gpuMemory.total.bytes <= budget) break;
+        GPUMemoryBudgetListener* listener = &gpuMemory.listeners[i];
+        listener->callback(gpuMemory.total.bytes, budget, listener->userdata);
+    }
+    gpuMemory.inCallback = false;
+
+    if (gpuMemory.total.bytes <= budget) gpuMemory.overBudget = false;
+}
+
+void GPUMemory::track(void* handle, GPUMemoryCategory category, u64 bytes,
+                      const char* label)
+{
+    if (!handle) return;
+    ASSERT(category < GPU_MEMORY_CATEGORY_COUNT);
+
+    u64 key               = handleKey(handle);
+    GPUMemoryEntry* entry = (GPUMemoryEntry*)HashMap::get(&gpuMemory.entries,
+                                                          key);
+    if (entry) {
+        // handle reused without untrack, e.g. a leak
+        log_warn("gpu memory: %p (%s) tracked twice", handle, entry->label);
+        untrack(handle);
+    }
+
+    entry           = ALLOCATE_COUNT(GPUMemoryEntry, 1);
+    entry->handle   = handle;
+    entry->bytes    = bytes;
+    entry->category = category;
+    if (label) strncpy(entry->label, label, GPU_MEMORY_LABEL_LENGTH - 1);
+    HashMap::put(&gpuMemory.entries, key, entry);
+
+    addBytes(&gpuMemory.categories[category], bytes);
+    addBytes(&gpuMemory.total, bytes);
+
+    checkBudget();
+}
+
+void GPUMemory::untrack(void* handle)
+{
+    if (!handle) return;
+
+    u64 key               = handleKey(handle);
+    GPUMemoryEntry* entry = (GPUMemoryEntry*)HashMap::get(&gpuMemory.entries,
+                                                          key);
+    if (!entry) return;
+
+    removeBytes(&gpuMemory.categories[entry->category], entry->bytes);
+    removeBytes(&gpuMemory.total, entry->bytes);
+
+    HashMap::remove(&gpuMemory.entries, key);
+    FREE(GPUMemoryEntry, entry);
+
+    if (gpuMemory.total.bytes <= gpuMemory.budget)
+        gpuMemory.overBudget = false;
+}
+
+GPUMemoryCategory GPUMemory::bufferCategory(WGPUBufferUsageFlags usage)
+{
+    // most specific usage first, storage buffers are often also vertex
+    // buffers (instance data) and indirect buffers also storage (culling)
+    if (usage & WGPUBufferUsage_MapWrite) return GPU_MEMORY_STAGING;
+    if (usage & WGPUBufferUsage_Indirect) return GPU_MEMORY_INDIRECT;
+    if (usage & WGPUBufferUsage_Storage) return GPU_MEMORY_STORAGE;
+    if (usage & WGPUBufferUsage_Index) return GPU_MEMORY_INDEX;
+    if (usage & WGPUBufferUsage_Vertex) return GPU_MEMORY_VERTEX;
+    return GPU_MEMORY_UNIFORM;
+}
+
+u32 GPUMemory::formatBlock(WGPUTextureFormat format, u32* blockWidth,
+                           u32* blockHeight)
+{
+    *blockWidth  = 1;
+    *blockHeight = 1;
+
+    switch (format) {
+        case WGPUTextureFormat_R8Unorm:
+        case WGPUTextureFormat_R8Snorm:
+        case WGPUTextureFormat_R8Uint:
+        case WGPUTextureFormat_R8Sint:
+        case WGPUTextureFormat_Stencil8: return 1;
+
+        case WGPUTextureFormat_R16Uint:
+        case WGPUTextureFormat_R16Sint:
+        case WGPUTextureFormat_R16Float:
+        case WGPUTextureFormat_RG8Unorm:
+        case WGPUTextureFormat_RG8Snorm:
+        case WGPUTextureFormat_RG8Uint:
+        case WGPUTextureFormat_RG8Sint:
+        case WGPUTextureFormat_Depth16Unorm: return 2;
+
+        case WGPUTextureFormat_R32Float:
+        case WGPUTextureFormat_R32Uint:
+        case WGPUTextureFormat_R32Sint:
+        case WGPUTextureFormat_RG16Uint:
+        case WGPUTextureFormat_RG16Sint:
+        case WGPUTextureFormat_RG16Float:
+        case WGPUTextureFormat_RGBA8Unorm:
+        case WGPUTextureFormat_RGBA8UnormSrgb:
+        case WGPUTextureFormat_RGBA8Snorm:
+        case WGPUTextureFormat_RGBA8Uint:
+        case WGPUTextureFormat_RGBA8Sint:
+        case WGPUTextureFormat_BGRA8Unorm:
+        case WGPUTextureFormat_BGRA8UnormSrgb:
+        case WGPUTextureFormat_RGB10A2Uint:
+        case WGPUTextureFormat_RGB10A2Unorm:
+        case WGPUTextureFormat_RG11B10Ufloat:
+        case WGPUTextureFormat_RGB9E5Ufloat:
+        case WGPUTextureFormat_Depth24Plus:
+        case WGPUTextureFormat_Depth24PlusStencil8:
+        case WGPUTextureFormat_Depth32Float: return 4;
+
+        case WGPUTextureFormat_RG32Float:
+        case WGPUTextureFormat_RG32Uint:
+        case WGPUTextureFormat_RG32Sint:
+        case WGPUTextureFormat_RGBA16Uint:
+        case WGPUTextureFormat_RGBA16Sint:
+        case WGPUTextureFormat_RGBA16Float:
+        case WGPUTextureFormat_Depth32FloatStencil8: return 8;
+
+        case WGPUTextureFormat_RGBA32Float:
+        case WGPUTextureFormat_RGBA32Uint:
+        case WGPUTextureFormat_RGBA32Sint: return 16;
+
+        default: break;
+    }
+
+    // block compressed
+    if (format >= WGPUTextureFormat_BC1RGBAUnorm
+        && format <= WGPUTextureFormat_EACRG11Snorm) {
+        *blockWidth  = 4;
+        *blockHeight = 4;
+        switch (format) {
+            case WGPUTextureFormat_BC1RGBAUnorm:
+            case WGPUTextureFormat_BC1RGBAUnormSrgb:
+            case WGPUTextureFormat_BC4RUnorm:
+            case WGPUTextureFormat_BC4RSnorm:
+            case WGPUTextureFormat_ETC2RGB8Unorm:
+            case WGPUTextureFormat_ETC2RGB8UnormSrgb:
+            case WGPUTextureFormat_ETC2RGB8A1Unorm:
+            case WGPUTextureFormat_ETC2RGB8A1UnormSrgb:
+            case WGPUTextureFormat_EACR11Unorm:
+            case WGPUTextureFormat_EACR11Snorm: return 8;
+            default: return 16;
+        }
+    }
+
+    // ASTC: always 16 byte blocks, formats come in unorm/srgb pairs
+    if (format >= WGPUTextureFormat_ASTC4x4Unorm
+        && format <= WGPUTextureFormat_ASTC12x12UnormSrgb) {
+        static const u8 astcBlocks[][2] = {
+            { 4, 4 },  { 5, 4 },  { 5, 5 },   { 6, 5 },   { 6, 6 },
+            { 8, 5 },  { 8, 6 },  { 8, 8 },   { 10, 5 },  { 10, 6 },
+            { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 },
+        };
+        u32 index    = (format - WGPUTextureFormat_ASTC4x4Unorm) / 2;
+        *blockWidth  = astcBlocks[index][0];
+        *blockHeight = astcBlocks[index][1];
+        return 16;
+    }
+
+    return 0;
+}
+
+u64 GPUMemory::textureBytes(WGPUTextureFormat format, u32 width, u32 height,
+                            u32 layers, u32 mipLevels)
+{
+    u32 blockWidth = 1, blockHeight = 1;
+    u32 blockBytes = formatBlock(format, &blockWidth, &blockHeight);
+    if (blockBytes == 0) {
+        log_warn("gpu memory: unknown size for texture format %d", format);
+        return 0;
+    }
+
+    u64 bytes = 0;
+    for (u32 mip = 0; mip < MAX(mipLevels, 1u); mip++) {
+        // mip sizes round down (matching wgpu), but never below 1 texel
+        u32 w = MAX(width >> mip, 1u);
+        u32 h = MAX(height >> mip, 1u);
+        u64 blocksX = (w + blockWidth - 1) / blockWidth;
+        u64 blocksY = (h + blockHeight - 1) / blockHeight;
+        bytes += blocksX * blocksY * blockBytes;
+    }
+    return bytes * MAX(layers, 1u);
+}
+
+void GPUMemory::setBudget(u64 bytes)
+{
+    gpuMemory.budget            = bytes;
+    gpuMemory.budgetInitialized = true;
+    gpuMemory.overBudget        = false;
+    checkBudget();
+}
+
+u64 GPUMemory::budget()
+{
+    initBudget();
+    return gpuMemory.budget;
+}
+
+void GPUMemory::addBudgetCallback(GPUMemoryBudgetCallback callback,
+                                  void* userdata)
+{
+    ASSERT(callback != NULL);
+    if (gpuMemory.listenerCount >= GPU_MEMORY_MAX_CALLBACKS) {
+        log_error("gpu memory: too many budget callbacks (max %d)",
+                  GPU_MEMORY_MAX_CALLBACKS);
+        return;
+    }
+    gpuMemory.listeners[gpuMemory.listenerCount++] = { callback, userdata };
+}
+
+void GPUMemory::removeBudgetCallback(GPUMemoryBudgetCallback callback,
+                                     void* userdata)
+{
+    for (u32 i = 0; i < gpuMemory.listenerCount; i++) {
+        GPUMemoryBudgetListener* listener = &gpuMemory.listeners[i];
+        if (listener->callback != callback || listener->userdata != userdata)
+            continue;
+        // swap remove, callback order doesn't matter
+        *listener = gpuMemory.listeners[--gpuMemory.listenerCount];
+        return;
+    }
+}
+
+GPUMemoryStats GPUMemory::stats(GPUMemoryCategory category)
+{
+    ASSERT(category < GPU_MEMORY_CATEGORY_COUNT);
+    return gpuMemory.categories[category];
+}
+
+GPUMemoryStats GPUMemory::totalStats()
+{
+    return gpuMemory.total;
+}
+
+static void logMemoryStats(const char* name, GPUMemoryStats* stats)
+{
+    log_info("%-18s %5d live, %9.2f MB (peak %9.2f MB)", name, stats->count,
+             stats->bytes / (1024.0 * 1024.0),
+             stats->peak / (1024.0 * 1024.0));
+}
+
+void GPUMemory::logStats(bool details)
+{
+    for (u32 i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++)
+        logMemoryStats(categoryNames[i], &gpuMemory.categories[i]);
+    logMemoryStats("total", &gpuMemory.total);
+
+    u64 budget = GPUMemory::budget();
+    if (budget)
+        log_info("%-18s %.2f MB", "budget", budget / (1024.0 * 1024.0));
+
+    if (!details) return;
+
+    HashMap* map = &gpuMemory.entries;
+    for (u32 i = 0; i < map->capacity; i++) {
+        if (!HashMap::occupied(map, i)) continue;
+        GPUMemoryEntry* entry = (GPUMemoryEntry*)map->entries[i].value;
+        log_info("  %-14s %10.1f KB  %s", categoryNames[entry->category],
+                 entry->bytes / 1024.0, entry->label);
+    }
+}
+
+void GPUMemory::shutdown()
+{
+    HashMap* map = &gpuMemory.entries;
+    if (map->count > 0)
+        log_info("gpu memory: %d resources (%.2f MB) never untracked",
+                 map->count, gpuMemory.total.bytes / (1024.0 * 1024.0));
+
+    for (u32 i = 0; i < map->capacity; i++) {
+        if (!HashMap::occupied(map, i)) continue;
+        GPUMemoryEntry* entry = (GPUMemoryEntry*)map->entries[i].value;
+        log_trace("  leaked %s (%s, %llu bytes)", entry->label,
+                  categoryNames[entry->category],
+                  (unsigned long long)entry->bytes);
+        FREE(GPUMemoryEntry, entry);
+    }
+
+    HashMap::free(map);
+    gpuMemory = {};
+}
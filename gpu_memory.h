@@ -0,0 +1,86 @@
+#pragma once
+
+#include <webgpu/webgpu.h>
+
+#include "common.h"
+
+// ============================================================================
+// GPU Memory Tracker
+// ============================================================================
+
+// Accounting for the buffers and textures we create. WebGPU has no way to
+// query actual allocation sizes, so entries record the logical size
+// (buffer size, or texel bytes summed over all mips and layers); drivers add
+// alignment and padding on top. Swap chain images are owned by the surface
+// and not tracked.
+//
+// Every creation site calls track() with the handle and every release site
+// calls untrack() before releasing it. Not thread safe, main thread only.
+//
+// When the total goes over the budget a warning is logged once (re-armed
+// when usage drops back under it) and the budget callbacks run, so owners of
+// evictable resources (caches, streamed textures) can free some.
+
+#define GPU_MEMORY_LABEL_LENGTH 64
+#define GPU_MEMORY_MAX_CALLBACKS 8
+// leave headroom on 2 GB devices for the swap chain, driver and other apps
+#define GPU_MEMORY_DEFAULT_BUDGET (1536ull << 20)
+
+enum GPUMemoryCategory {
+    GPU_MEMORY_VERTEX = 0,
+    GPU_MEMORY_INDEX,
+    GPU_MEMORY_UNIFORM,
+    GPU_MEMORY_STORAGE,
+    GPU_MEMORY_INDIRECT,
+    GPU_MEMORY_STAGING, // mappable upload buffers
+    GPU_MEMORY_TEXTURE,
+    GPU_MEMORY_RENDER_TARGET, // color and depth attachments
+    GPU_MEMORY_CATEGORY_COUNT,
+};
+
+struct GPUMemoryStats {
+    u64 bytes; // currently allocated
+    u64 peak;  // high water mark of bytes
+    u32 count; // live resources
+};
+
+/// @brief Called while over budget with the current usage. Free what you
+/// can (untrack() as usual); the callbacks are not re-entered.
+typedef void (*GPUMemoryBudgetCallback)(u64 used, u64 budget, void* userdata);
+
+struct GPUMemory {
+    /// @brief Register a buffer or texture. label is copied (may be NULL)
+    static void track(void* handle, GPUMemoryCategory category, u64 bytes,
+                      const char* label);
+    /// @brief No-op for handles that were never tracked
+    static void untrack(void* handle);
+
+    /// @brief Category for a buffer from its usage flags
+    static GPUMemoryCategory bufferCategory(WGPUBufferUsageFlags usage);
+
+    /// @brief Bytes per texel block and block size in texels, 0 for unknown
+    /// formats. Uncompressed formats have 1x1 blocks
+    static u32 formatBlock(WGPUTextureFormat format, u32* blockWidth,
+                           u32* blockHeight);
+
+    /// @brief Size of a 2D texture with all its mips, 0 for unknown formats
+    static u64 textureBytes(WGPUTextureFormat format, u32 width, u32 height,
+                            u32 layers, u32 mipLevels);
+
+    /// @brief 0 disables the budget
+    static void setBudget(u64 bytes);
+    static u64 budget();
+    static void addBudgetCallback(GPUMemoryBudgetCallback callback,
+                                  void* userdata);
+    static void removeBudgetCallback(GPUMemoryBudgetCallback callback,
+                                     void* userdata);
+
+    static GPUMemoryStats stats(GPUMemoryCategory category);
+    static GPUMemoryStats totalStats();
+
+    /// @brief Per category totals, and with details every live resource
+    static void logStats(bool details = false);
+
+    /// @brief Reports resources never untracked, then forgets everything
+    static void shutdown();
+};
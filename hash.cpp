@@ -0,0 +1,106 @@
+#include "hash.h"
+#include "memory.h"
+
+static u64 sanitizeKey(u64 key)
+{
+    // never collide with the reserved empty/deleted markers
+    return key <= HASH_MAP_DELETED_KEY ? key + 2 : key;
+}
+
+// returns slot of key if present, otherwise the first usable slot
+static u32 findSlot(HashMapEntry* entries, u32 capacity, u64 key)
+{
+    u32 mask      = capacity - 1;
+    u32 index     = (u32)(key & mask);
+    i64 tombstone = -1;
+
+    for (;;) {
+        HashMapEntry* entry = &entries[index];
+        if (entry->key == HASH_MAP_EMPTY_KEY) {
+            return tombstone >= 0 ? (u32)tombstone : index;
+        } else if (entry->key == HASH_MAP_DELETED_KEY) {
+            if (tombstone < 0) tombstone = index;
+        } else if (entry->key == key) {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+static void grow(HashMap* map, u32 newCapacity)
+{
+    HashMapEntry* entries = ALLOCATE_COUNT(HashMapEntry, newCapacity);
+
+    // re-insert live entries, dropping tombstones
+    for (u32 i = 0; i < map->capacity; i++) {
+        HashMapEntry* entry = &map->entries[i];
+        if (entry->key <= HASH_MAP_DELETED_KEY) continue;
+        entries[findSlot(entries, newCapacity, entry->key)] = *entry;
+    }
+
+    FREE_ARRAY(HashMapEntry, map->entries, map->capacity);
+    map->entries  = entries;
+    map->capacity = newCapacity;
+    map->deleted  = 0;
+}
+
+void* HashMap::get(HashMap* map, u64 key)
+{
+    if (map->count == 0) return NULL;
+    key                 = sanitizeKey(key);
+    HashMapEntry* entry = &map->entries[findSlot(map->entries, map->capacity, key)];
+    return entry->key == key ? entry->value : NULL;
+}
+
+void HashMap::put(HashMap* map, u64 key, void* value)
+{
+    // keep load factor (including tombstones) under 3/4
+    if ((map->count + map->deleted + 1) * 4 > map->capacity * 3) {
+        u32 newCapacity = map->capacity < HASH_MAP_MIN_CAPACITY ?
+                            HASH_MAP_MIN_CAPACITY :
+                            map->capacity;
+        while ((map->count + 1) * 2 > newCapacity) newCapacity *= 2;
+        grow(map, newCapacity);
+    }
+
+    key                 = sanitizeKey(key);
+    HashMapEntry* entry = &map->entries[findSlot(map->entries, map->capacity, key)];
+    if (entry->key != key) {
+        if (entry->key == HASH_MAP_DELETED_KEY) map->deleted--;
+        map->count++;
+    }
+    entry->key   = key;
+    entry->value = value;
+}
+
+bool HashMap::remove(HashMap* map, u64 key)
+{
+    if (map->count == 0) return false;
+    key                 = sanitizeKey(key);
+    HashMapEntry* entry = &map->entries[findSlot(map->entries, map->capacity, key)];
+    if (entry->key != key) return false;
+
+    entry->key   = HASH_MAP_DELETED_KEY;
+    entry->value = NULL;
+    map->count--;
+    map->deleted++;
+    return true;
+}
+
+bool HashMap::occupied(HashMap* map, u32 index)
+{
+    return map->entries[index].key > HASH_MAP_DELETED_KEY;
+}
+
+void HashMap::clear(HashMap* map)
+{
+    for (u32 i = 0; i < map->capacity; i++) map->entries[i] = {};
+    map->count   = 0;
+    map->deleted = 0;
+}
+
+void HashMap::free(HashMap* map)
+{
+    FREE_ARRAY(HashMapEntry, map->entries, map->capacity);
+    *map = {};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "common.h"
+
+// ============================================================================
+// Hashing
+// ============================================================================
+
+// 64-bit FNV-1a
+// http://www.isthe.com/chongo/tech/comp/fnv/index.html
+#define HASH_SEED 0xcbf29ce484222325ull
+#define HASH_PRIME 0x100000001b3ull
+
+inline u64 hashBytes(const void* data, u64 size, u64 seed = HASH_SEED)
+{
+    const u8* bytes = (const u8*)data;
+    u64 hash        = seed;
+    for (u64 i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= HASH_PRIME;
+    }
+    return hash;
+}
+
+inline u64 hashString(const char* str, u64 seed = HASH_SEED)
+{
+    u64 hash = seed;
+    if (str == NULL) return hash;
+    for (; *str; str++) {
+        hash ^= (u8)*str;
+        hash *= HASH_PRIME;
+    }
+    return hash;
+}
+
+/// @brief mix a single 64-bit value (e.g. a pointer or enum) into a hash
+inline u64 hashCombine(u64 hash, u64 value)
+{
+    return hashBytes(&value, sizeof(value), hash);
+}
+
+// ============================================================================
+// HashMap
+// ============================================================================
+
+// Open addressing (linear probing) map from u64 keys to opaque pointers.
+// Keys are expected to already be well distributed hashes.
+// Key 0 and 1 are reserved for empty and deleted slots; they are remapped on
+// insert/lookup so callers never have to care.
+
+#define HASH_MAP_EMPTY_KEY 0ull
+#define HASH_MAP_DELETED_KEY 1ull
+#define HASH_MAP_MIN_CAPACITY 16
+
+struct HashMapEntry {
+    u64 key;
+    void* value;
+};
+
+struct HashMap {
+    HashMapEntry* entries;
+    u32 capacity; // always a power of 2
+    u32 count;    // live entries
+    u32 deleted;  // tombstones
+
+    static void* get(HashMap* map, u64 key);
+    static void put(HashMap* map, u64 key, void* value);
+    static bool remove(HashMap* map, u64 key);
+
+    /// @brief true if the slot at index holds a live entry (for iteration)
+    static bool occupied(HashMap* map, u32 index);
+
+    static void clear(HashMap* map);
+    static void free(HashMap* map);
+};
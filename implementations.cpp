@@ -7,6 +7,23 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
+// stb_image can give a thread its own flip flag but can't read it back or
+// hand the thread back to the global flag. TextureBakeCache overrides it
+// for a single decode on job system workers and restores it afterwards.
+// -1: the thread follows stbi_set_flip_vertically_on_load()
+int stbiFlipThreadState()
+{
+    return stbi__vertically_flip_on_load_set
+             ? stbi__vertically_flip_on_load_local
+             : -1;
+}
+
+void stbiRestoreFlipThreadState(int state)
+{
+    stbi__vertically_flip_on_load_local = state > 0;
+    stbi__vertically_flip_on_load_set   = state >= 0;
+}
+
 #define CGLTF_IMPLEMENTATION
 #include <cgltf/cgltf.h>
 
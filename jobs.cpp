@@ -0,0 +1,237 @@
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define JOBS_NO_THREADS
+#endif
+
+#ifndef JOBS_NO_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#include "core/log.h"
+#include "jobs.h"
+#include "memory.h"
+
+#define JOB_SYSTEM_MAX_WORKERS 32
+
+struct Job {
+    JobFunc fn;
+    void* userData;
+    u32 index;
+    JobCounter* counter;
+};
+
+static void runJob(Job* job)
+{
+    job->fn(job->userData, job->index);
+    if (job->counter) job->counter->pending.fetch_sub(1);
+}
+
+bool JobCounter::done(JobCounter* counter)
+{
+    return counter->pending.load() == 0;
+}
+
+#ifdef JOBS_NO_THREADS
+
+// ============================================================================
+// Single threaded fallback
+// ============================================================================
+
+void JobSystem::init(u32 threadCount)
+{
+    UNUSED_VAR(threadCount);
+    log_debug("job system: no thread support, running jobs inline");
+}
+
+u32 JobSystem::workerCount()
+{
+    return 0;
+}
+
+void JobSystem::parallelFor(u32 count, JobFunc fn, void* userData)
+{
+    for (u32 i = 0; i < count; i++) fn(userData, i);
+}
+
+void JobSystem::submit(JobFunc fn, void* userData, u32 index,
+                       JobCounter* counter)
+{
+    UNUSED_VAR(counter); // already complete by the time we return
+    fn(userData, index);
+}
+
+void JobSystem::wait(JobCounter* counter)
+{
+    UNUSED_VAR(counter);
+}
+
+void JobSystem::release()
+{
+}
+
+#else
+
+// ============================================================================
+// Thread pool
+// ============================================================================
+
+struct JobQueue {
+    Job* jobs; // ring buffer
+    u32 capacity;
+    u32 head;
+    u32 count;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit;
+
+    std::thread workers[JOB_SYSTEM_MAX_WORKERS];
+    u32 workerCount;
+};
+
+static JobQueue jobQueue;
+
+// must hold jobQueue.mutex
+static void pushJob(Job job)
+{
+    JobQueue* q = &jobQueue;
+    if (q->count == q->capacity) {
+        u32 newCapacity = q->capacity < 64 ? 64 : q->capacity * 2;
+        Job* jobs       = ALLOCATE_COUNT(Job, newCapacity);
+        for (u32 i = 0; i < q->count; i++)
+            jobs[i] = q->jobs[(q->head + i) % q->capacity];
+        FREE_ARRAY(Job, q->jobs, q->capacity);
+        q->jobs     = jobs;
+        q->capacity = newCapacity;
+        q->head     = 0;
+    }
+    q->jobs[(q->head + q->count) % q->capacity] = job;
+    q->count++;
+}
+
+// must hold jobQueue.mutex
+static bool popJob(Job* job)
+{
+    JobQueue* q = &jobQueue;
+    if (q->count == 0) return false;
+    *job    = q->jobs[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    return true;
+}
+
+static bool tryRunJob()
+{
+    Job job = {};
+    {
+        std::lock_guard<std::mutex> lock(jobQueue.mutex);
+        if (!popJob(&job)) return false;
+    }
+    runJob(&job);
+    return true;
+}
+
+static void workerLoop()
+{
+    for (;;) {
+        Job job = {};
+        {
+            std::unique_lock<std::mutex> lock(jobQueue.mutex);
+            jobQueue.wake.wait(
+              lock, [] { return jobQueue.quit || jobQueue.count > 0; });
+            if (jobQueue.quit && jobQueue.count == 0) return;
+            popJob(&job);
+        }
+        runJob(&job);
+    }
+}
+
+void JobSystem::init(u32 threadCount)
+{
+    ASSERT(jobQueue.workerCount == 0);
+
+    if (threadCount == 0) {
+        u32 cores   = std::thread::hardware_concurrency();
+        threadCount = cores > 1 ? cores - 1 : 1;
+    }
+    threadCount = MIN(threadCount, JOB_SYSTEM_MAX_WORKERS);
+
+    jobQueue.quit = false;
+    for (u32 i = 0; i < threadCount; i++)
+        jobQueue.workers[i] = std::thread(workerLoop);
+    jobQueue.workerCount = threadCount;
+
+    log_debug("job system: started %d worker threads", threadCount);
+}
+
+u32 JobSystem::workerCount()
+{
+    return jobQueue.workerCount;
+}
+
+void JobSystem::parallelFor(u32 count, JobFunc fn, void* userData)
+{
+    if (count == 0) return;
+
+    // not worth waking anyone up
+    if (count == 1 || jobQueue.workerCount == 0) {
+        for (u32 i = 0; i < count; i++) fn(userData, i);
+        return;
+    }
+
+    JobCounter counter;
+    counter.pending.store(count);
+    {
+        std::lock_guard<std::mutex> lock(jobQueue.mutex);
+        for (u32 i = 0; i < count; i++)
+            pushJob({ fn, userData, i, &counter });
+    }
+    jobQueue.wake.notify_all();
+
+    JobSystem::wait(&counter);
+}
+
+void JobSystem::submit(JobFunc fn, void* userData, u32 index,
+                       JobCounter* counter)
+{
+    if (jobQueue.workerCount == 0) {
+        fn(userData, index);
+        return;
+    }
+
+    if (counter) counter->pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(jobQueue.mutex);
+        pushJob({ fn, userData, index, counter });
+    }
+    jobQueue.wake.notify_one();
+}
+
+void JobSystem::wait(JobCounter* counter)
+{
+    while (!JobCounter::done(counter)) {
+        // help out instead of blocking. If the queue is empty the remaining
+        // jobs are already running on workers
+        if (!tryRunJob()) std::this_thread::yield();
+    }
+}
+
+void JobSystem::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobQueue.mutex);
+        jobQueue.quit = true;
+    }
+    jobQueue.wake.notify_all();
+
+    for (u32 i = 0; i < jobQueue.workerCount; i++) jobQueue.workers[i].join();
+    jobQueue.workerCount = 0;
+
+    FREE_ARRAY(Job, jobQueue.jobs, jobQueue.capacity);
+    jobQueue.capacity = 0;
+    jobQueue.head     = 0;
+    jobQueue.count    = 0;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+
+#include "common.h"
+
+// ============================================================================
+// Job System
+// ============================================================================
+
+// Minimal worker thread pool. Jobs are plain function pointers + userdata,
+// like the example callbacks. Builds without thread support (emscripten
+// without pthreads) run every job inline on the calling thread.
+
+typedef void (*JobFunc)(void* userData, u32 index);
+
+/// @brief Tracks completion of a group of jobs
+struct JobCounter {
+    std::atomic<u32> pending;
+
+    static bool done(JobCounter* counter);
+};
+
+struct JobSystem {
+    /// @brief Start worker threads. threadCount 0 = one per core minus the
+    /// main thread.
+    static void init(u32 threadCount);
+
+    /// @brief Number of worker threads (not counting the caller)
+    static u32 workerCount();
+
+    /// @brief Run fn(userData, i) for i in [0, count) and block until all
+    /// are done. The calling thread helps execute jobs.
+    static void parallelFor(u32 count, JobFunc fn, void* userData);
+
+    /// @brief Queue a single job without waiting. counter (optional) is
+    /// incremented now and decremented when the job finishes.
+    static void submit(JobFunc fn, void* userData, u32 index,
+                       JobCounter* counter);
+
+    /// @brief Block until counter reaches 0, helping with queued jobs
+    static void wait(JobCounter* counter);
+
+    static void release();
+};
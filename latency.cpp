@@ -0,0 +1,153 @@
+#include <GLFW/glfw3.h>
+
+#ifndef __EMSCRIPTEN__
+#include <chrono>
+#include <thread>
+#endif
+
+#include "core/log.h"
+#include "latency.h"
+
+// ============================================================================
+// Low Latency Presentation
+// ============================================================================
+
+struct LowLatencyState {
+    f64 frameSeconds;  // limiter period, 0 = unlimited
+    f64 nextFrameTime; // start of the next frame slot
+    f64 inputTime;     // input of the frame being recorded was sampled
+
+    LateLatchCallback lateLatch;
+    void* lateLatchUserdata;
+
+    LowLatencyStats stats;
+};
+
+static LowLatencyState lowLatency = {};
+
+static const char* presentModeName(WGPUPresentMode mode)
+{
+    switch (mode) {
+        case WGPUPresentMode_Fifo: return "fifo";
+        case WGPUPresentMode_FifoRelaxed: return "fifo relaxed";
+        case WGPUPresentMode_Immediate: return "immediate";
+        case WGPUPresentMode_Mailbox: return "mailbox";
+        default: return "unknown";
+    }
+}
+
+static void onSubmit(GraphicsContext* ctx, void* userdata)
+{
+    UNUSED_VAR(userdata);
+
+    if (lowLatency.lateLatch)
+        lowLatency.lateLatch(ctx, lowLatency.lateLatchUserdata);
+
+    if (lowLatency.inputTime <= 0.0) return;
+    f64 latency = glfwGetTime() - lowLatency.inputTime;
+
+    LowLatencyStats* stats = &lowLatency.stats;
+    stats->frames++;
+    stats->inputToSubmitSeconds += latency;
+    stats->maxInputToSubmitSeconds
+      = MAX(stats->maxInputToSubmitSeconds, latency);
+}
+
+void LowLatency::init(GraphicsContext* ctx, WGPUPresentMode presentMode,
+                      f32 fps)
+{
+    if (!GraphicsContext::setPresentMode(ctx, presentMode))
+        GraphicsContext::setPresentMode(ctx, WGPUPresentMode_Fifo);
+    log_info("low latency: %s present mode",
+             presentModeName(ctx->presentMode));
+
+    LowLatency::setFrameLimit(fps);
+    ctx->onSubmit         = onSubmit;
+    ctx->onSubmitUserdata = NULL;
+}
+
+void LowLatency::setFrameLimit(f32 fps)
+{
+    lowLatency.frameSeconds  = fps > 0.0f ? 1.0 / fps : 0.0;
+    lowLatency.nextFrameTime = 0.0;
+}
+
+f32 LowLatency::frameLimit()
+{
+    return lowLatency.frameSeconds > 0.0 ? (f32)(1.0 / lowLatency.frameSeconds)
+                                         : 0.0f;
+}
+
+void LowLatency::setLateLatch(LateLatchCallback callback, void* userdata)
+{
+    lowLatency.lateLatch         = callback;
+    lowLatency.lateLatchUserdata = userdata;
+}
+
+void LowLatency::beginFrame()
+{
+    f64 now = glfwGetTime();
+
+#ifndef __EMSCRIPTEN__
+    // the browser paces frames with requestAnimationFrame, can't block
+    if (lowLatency.frameSeconds > 0.0) {
+        f64 wakeTime = lowLatency.nextFrameTime;
+        if (now < wakeTime) {
+            // sleep is coarse (~1 ms or worse), spin the rest
+            f64 sleepSeconds = wakeTime - now - LOW_LATENCY_SPIN_SECONDS;
+            if (sleepSeconds > 0.0) {
+                std::this_thread::sleep_for(
+                  std::chrono::duration<f64>(sleepSeconds));
+            }
+            while (glfwGetTime() < wakeTime) std::this_thread::yield();
+
+            f64 woke = glfwGetTime();
+            lowLatency.stats.limiterSeconds += woke - now;
+            now = woke;
+        }
+
+        // a frame that ran long starts a new schedule instead of being
+        // followed by a burst of catch up frames
+        lowLatency.nextFrameTime += lowLatency.frameSeconds;
+        if (lowLatency.nextFrameTime < now)
+            lowLatency.nextFrameTime = now + lowLatency.frameSeconds;
+    }
+#endif
+
+    lowLatency.inputTime = now;
+}
+
+void LowLatency::markInput()
+{
+    lowLatency.inputTime = glfwGetTime();
+}
+
+LowLatencyStats LowLatency::stats()
+{
+    return lowLatency.stats;
+}
+
+void LowLatency::resetStats()
+{
+    lowLatency.stats = {};
+}
+
+void LowLatency::logStats()
+{
+    LowLatencyStats* stats = &lowLatency.stats;
+    if (stats->frames == 0) return;
+    log_info("low latency: input to submit avg %.2f ms, max %.2f ms, limiter "
+             "wait avg %.2f ms over %d frames",
+             1000.0 * stats->inputToSubmitSeconds / stats->frames,
+             1000.0 * stats->maxInputToSubmitSeconds,
+             1000.0 * stats->limiterSeconds / stats->frames, stats->frames);
+}
+
+void LowLatency::release(GraphicsContext* ctx)
+{
+    if (ctx->onSubmit == onSubmit) {
+        ctx->onSubmit         = NULL;
+        ctx->onSubmitUserdata = NULL;
+    }
+    lowLatency = {};
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+
+// ============================================================================
+// Low Latency Presentation
+// ============================================================================
+
+// Cuts the time between reading input and showing its result:
+//
+// - present mode: Mailbox (newest frame replaces a queued one, no tearing)
+//   or Immediate (tears) instead of Fifo, which can queue up a frame or two
+//   behind vsync. See GraphicsContext::setPresentMode()
+// - frame limiter: with an uncapped present mode the CPU would run
+//   arbitrarily far ahead, so beginFrame() sleeps until the next frame slot
+//   and only then lets the runner poll input. Waiting before sampling input
+//   rather than after submitting is what keeps latency down
+// - late latching: the latch callback runs from GraphicsContext::onSubmit,
+//   after the frame has been recorded, and rewrites the camera uniforms from
+//   the newest input state (e.g. glfwGetCursorPos) with writeBuffer(). Only
+//   uniform contents change; CPU work done earlier with the older camera
+//   (culling, light assignment) is not redone, so keep the latched change
+//   small (one frame of camera motion)
+//
+// Input to submit latency is measured from beginFrame(), or the latest
+// markInput() (call it where input is actually read, e.g. in the latch), to
+// the frame's submit. Present and display latency come on top and are not
+// visible to the application.
+//
+// Process wide like the job system, main thread only. The runner calls
+// beginFrame() every frame; the rest is up to the application.
+
+#define LOW_LATENCY_SPIN_SECONDS 0.002 // busy wait the tail of a limiter wait
+
+/// @brief Called just before submit, rewrite late latched uniforms here
+typedef void (*LateLatchCallback)(GraphicsContext* ctx, void* userdata);
+
+struct LowLatencyStats {
+    u32 frames;               // submitted since the last resetStats()
+    f64 inputToSubmitSeconds; // summed over frames
+    f64 maxInputToSubmitSeconds;
+    f64 limiterSeconds; // summed time beginFrame() waited
+};
+
+struct LowLatency {
+    /// @brief Installs the submit hook on ctx. fps 0 leaves frames
+    /// unlimited. Falls back to Fifo if presentMode is unsupported
+    static void init(GraphicsContext* ctx, WGPUPresentMode presentMode,
+                     f32 fps = 0.0f);
+
+    /// @brief 0 disables the limiter
+    static void setFrameLimit(f32 fps);
+    static f32 frameLimit();
+
+    /// @brief NULL disables late latching
+    static void setLateLatch(LateLatchCallback callback, void* userdata);
+
+    /// @brief Wait for the frame limiter, then mark input as sampled. Call
+    /// right before polling window events
+    static void beginFrame();
+
+    /// @brief Input was (re)sampled now, measure latency from here
+    static void markInput();
+
+    static LowLatencyStats stats();
+    static void resetStats();
+    /// @brief Averages since the last resetStats()
+    static void logStats();
+
+    /// @brief Removes the submit hook
+    static void release(GraphicsContext* ctx);
+};
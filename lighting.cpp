@@ -0,0 +1,453 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#define CLUSTERED_LIGHTING_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "cache.h"
+#include "core/log.h"
+#include "deletion.h"
+#include "gpu_memory.h"
+#include "jobs.h"
+#include "lighting.h"
+#include "memory.h"
+
+#define CLUSTERS_PER_SLICE (CLUSTER_GRID_X * CLUSTER_GRID_Y)
+
+// ============================================================================
+// Clustered Lighting
+// ============================================================================
+
+static WGPUBuffer createBuffer(GraphicsContext* ctx, u64 size,
+                               WGPUBufferUsageFlags usage, const char* label)
+{
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.label                = label;
+    bufferDesc.size                 = size;
+    bufferDesc.usage                = usage | WGPUBufferUsage_CopyDst;
+    bufferDesc.mappedAtCreation     = false;
+    WGPUBuffer buffer = wgpuDeviceCreateBuffer(ctx->device, &bufferDesc);
+    GPUMemory::track(buffer, GPUMemory::bufferCategory(usage), size, label);
+    return buffer;
+}
+
+static void createBindGroup(GraphicsContext* ctx, ClusteredLighting* lighting)
+{
+    // the previous one may still be in a recorded bundle or frame in flight
+    DeletionQueue::defer(lighting->bindGroup);
+
+    WGPUBindGroupEntry entries[4] = {};
+    entries[0].binding            = 0;
+    entries[0].buffer             = lighting->uniformBuffer;
+    entries[0].size               = sizeof(ClusterUniforms);
+    entries[1].binding            = 1;
+    entries[1].buffer             = lighting->lightBuffer;
+    entries[1].size               = lighting->lightBufferSize;
+    entries[2].binding            = 2;
+    entries[2].buffer             = lighting->rangeBuffer;
+    entries[2].size               = sizeof(ClusterLightRange) * CLUSTER_COUNT;
+    entries[3].binding            = 3;
+    entries[3].buffer             = lighting->indexBuffer;
+    entries[3].size               = lighting->indexBufferSize;
+
+    WGPUBindGroupDescriptor desc = {};
+    desc.label                   = "clustered lighting";
+    desc.layout                  = lighting->layout;
+    desc.entries                 = entries;
+    desc.entryCount              = ARRAY_LENGTH(entries);
+    lighting->bindGroup = wgpuDeviceCreateBindGroup(ctx->device, &desc);
+}
+
+WGPUBindGroupLayout ClusteredLighting::bindGroupLayout(GraphicsContext* ctx)
+{
+    WGPUBindGroupLayoutEntry entries[4] = {};
+
+    entries[0].binding               = 0;
+    entries[0].visibility            = WGPUShaderStage_Fragment;
+    entries[0].buffer.type           = WGPUBufferBindingType_Uniform;
+    entries[0].buffer.minBindingSize = sizeof(ClusterUniforms);
+
+    // lights
+    entries[1].binding               = 1;
+    entries[1].visibility            = WGPUShaderStage_Fragment;
+    entries[1].buffer.type           = WGPUBufferBindingType_ReadOnlyStorage;
+    entries[1].buffer.minBindingSize = sizeof(PointLight);
+
+    // per cluster ranges
+    entries[2].binding               = 2;
+    entries[2].visibility            = WGPUShaderStage_Fragment;
+    entries[2].buffer.type           = WGPUBufferBindingType_ReadOnlyStorage;
+    entries[2].buffer.minBindingSize = sizeof(ClusterLightRange);
+
+    // light indices
+    entries[3].binding               = 3;
+    entries[3].visibility            = WGPUShaderStage_Fragment;
+    entries[3].buffer.type           = WGPUBufferBindingType_ReadOnlyStorage;
+    entries[3].buffer.minBindingSize = sizeof(u32);
+
+    WGPUBindGroupLayoutDescriptor desc = {};
+    desc.label                         = "clustered lighting";
+    desc.entryCount                    = ARRAY_LENGTH(entries);
+    desc.entries                       = entries;
+    return PipelineCache::getBindGroupLayout(ctx, &desc);
+}
+
+void ClusteredLighting::init(GraphicsContext* ctx, ClusteredLighting* lighting,
+                             f32 zNear, f32 zFar)
+{
+    ASSERT(zNear > 0.0f && zFar > zNear);
+
+    *lighting       = {};
+    lighting->zNear = zNear;
+    lighting->zFar  = zFar;
+
+    lighting->clusterLists
+      = ALLOCATE_COUNT(u32, CLUSTER_COUNT * CLUSTER_MAX_LIGHTS);
+    lighting->clusterCounts = ALLOCATE_COUNT(u32, CLUSTER_COUNT);
+    lighting->ranges        = ALLOCATE_COUNT(ClusterLightRange, CLUSTER_COUNT);
+
+    lighting->lightBufferSize
+      = sizeof(PointLight) * CLUSTERED_LIGHTING_INITIAL_LIGHTS;
+    lighting->indexBufferSize
+      = sizeof(u32) * CLUSTERED_LIGHTING_INITIAL_INDICES;
+
+    lighting->uniformBuffer
+      = createBuffer(ctx, sizeof(ClusterUniforms), WGPUBufferUsage_Uniform,
+                     "cluster uniforms");
+    lighting->lightBuffer
+      = createBuffer(ctx, lighting->lightBufferSize, WGPUBufferUsage_Storage,
+                     "point lights");
+    lighting->rangeBuffer
+      = createBuffer(ctx, sizeof(ClusterLightRange) * CLUSTER_COUNT,
+                     WGPUBufferUsage_Storage, "cluster light ranges");
+    lighting->indexBuffer
+      = createBuffer(ctx, lighting->indexBufferSize, WGPUBufferUsage_Storage,
+                     "cluster light indices");
+
+    lighting->layout = ClusteredLighting::bindGroupLayout(ctx);
+    createBindGroup(ctx, lighting);
+}
+
+PointLight* ClusteredLighting::addLight(ClusteredLighting* lighting)
+{
+    if (lighting->lightCount == lighting->lightCapacity) {
+        u32 newCapacity = MAX(lighting->lightCapacity * 2,
+                              (u32)CLUSTERED_LIGHTING_INITIAL_LIGHTS);
+        lighting->lights = (PointLight*)reallocate(
+          lighting->lights, sizeof(PointLight) * lighting->lightCapacity,
+          sizeof(PointLight) * newCapacity);
+        lighting->lightCapacity = newCapacity;
+    }
+
+    PointLight* light = &lighting->lights[lighting->lightCount++];
+    *light            = {};
+    return light;
+}
+
+void ClusteredLighting::clearLights(ClusteredLighting* lighting)
+{
+    lighting->lightCount = 0;
+}
+
+// view space bounds of every light. Padding lights sit at depth 0 with a
+// negative radius, so they never overlap a slice
+static void transformLights(ClusteredLighting* lighting,
+                            const glm::mat4& viewMat)
+{
+    u32 count = (lighting->lightCount + 3) & ~3u;
+    if (count > lighting->viewCapacity) {
+        u32 oldCapacity = lighting->viewCapacity;
+        u32 newCapacity = MAX(oldCapacity * 2, count);
+        f32** streams[]
+          = { &lighting->viewX, &lighting->viewY, &lighting->viewZ,
+              &lighting->viewRadius };
+        for (u32 i = 0; i < ARRAY_LENGTH(streams); i++) {
+            *streams[i]
+              = (f32*)reallocate(*streams[i], sizeof(f32) * oldCapacity,
+                                 sizeof(f32) * newCapacity);
+        }
+        lighting->viewCapacity = newCapacity;
+    }
+
+    const PointLight* lights = lighting->lights;
+    u32 i                    = 0;
+
+#ifdef CLUSTERED_LIGHTING_SSE
+    // rows of the view matrix (glm is column major), z row negated so
+    // viewZ is the distance in front of the camera
+    __m128 m[3][4];
+    for (u32 col = 0; col < 4; col++) {
+        m[0][col] = _mm_set1_ps(viewMat[col][0]);
+        m[1][col] = _mm_set1_ps(viewMat[col][1]);
+        m[2][col] = _mm_set1_ps(-viewMat[col][2]);
+    }
+
+    for (; i + 4 <= lighting->lightCount; i += 4) {
+        const PointLight* l = &lights[i];
+
+        __m128 x = _mm_setr_ps(l[0].position.x, l[1].position.x,
+                               l[2].position.x, l[3].position.x);
+        __m128 y = _mm_setr_ps(l[0].position.y, l[1].position.y,
+                               l[2].position.y, l[3].position.y);
+        __m128 z = _mm_setr_ps(l[0].position.z, l[1].position.z,
+                               l[2].position.z, l[3].position.z);
+
+        f32* out[3] = { lighting->viewX, lighting->viewY, lighting->viewZ };
+        for (u32 row = 0; row < 3; row++) {
+            __m128 v = _mm_add_ps(_mm_mul_ps(m[row][0], x), m[row][3]);
+            v        = _mm_add_ps(v, _mm_mul_ps(m[row][1], y));
+            v        = _mm_add_ps(v, _mm_mul_ps(m[row][2], z));
+            _mm_storeu_ps(out[row] + i, v);
+        }
+        _mm_storeu_ps(lighting->viewRadius + i,
+                      _mm_setr_ps(l[0].radius, l[1].radius, l[2].radius,
+                                  l[3].radius));
+    }
+#endif
+
+    for (; i < lighting->lightCount; i++) {
+        glm::vec4 p = viewMat * glm::vec4(lights[i].position, 1.0f);
+
+        lighting->viewX[i]      = p.x;
+        lighting->viewY[i]      = p.y;
+        lighting->viewZ[i]      = -p.z;
+        lighting->viewRadius[i] = lights[i].radius;
+    }
+
+    for (; i < count; i++) {
+        lighting->viewX[i]      = 0.0f;
+        lighting->viewY[i]      = 0.0f;
+        lighting->viewZ[i]      = 0.0f;
+        lighting->viewRadius[i] = -1.0f;
+    }
+}
+
+struct ClusterAssignJob {
+    ClusteredLighting* lighting;
+    f32 projX; // projectionMat[0][0]
+    f32 projY; // projectionMat[1][1]
+};
+
+static inline u32 tileIndex(f32 ndc, u32 tiles)
+{
+    f32 t = (0.5f * ndc + 0.5f) * tiles;
+    return (u32)CLAMP(t, 0.0f, (f32)(tiles - 1));
+}
+
+static void binLight(ClusterAssignJob* job, u32 slice, u32 light, f32 sliceNear,
+                     f32 sliceFar)
+{
+    ClusteredLighting* lighting = job->lighting;
+    f32 x                       = lighting->viewX[light];
+    f32 y                       = lighting->viewY[light];
+    f32 z                       = lighting->viewZ[light];
+    f32 r                       = lighting->viewRadius[light];
+
+    // the sphere's view space box, clipped to the slice, projected. x / z
+    // is monotonic in z, so the extremes are at the box corners
+    f32 zMin = MAX(z - r, sliceNear);
+    f32 zMax = MIN(z + r, sliceFar);
+    f32 x0   = job->projX * MIN((x - r) / zMin, (x - r) / zMax);
+    f32 x1   = job->projX * MAX((x + r) / zMin, (x + r) / zMax);
+    f32 y0   = job->projY * MIN((y - r) / zMin, (y - r) / zMax);
+    f32 y1   = job->projY * MAX((y + r) / zMin, (y + r) / zMax);
+    if (x1 < -1.0f || x0 > 1.0f || y1 < -1.0f || y0 > 1.0f) return;
+
+    // tiles count rows from the top like fragment coordinates
+    u32 tx0 = tileIndex(x0, CLUSTER_GRID_X);
+    u32 tx1 = tileIndex(x1, CLUSTER_GRID_X);
+    u32 ty0 = tileIndex(-y1, CLUSTER_GRID_Y);
+    u32 ty1 = tileIndex(-y0, CLUSTER_GRID_Y);
+
+    u32 sliceBase = slice * CLUSTERS_PER_SLICE;
+    for (u32 ty = ty0; ty <= ty1; ty++) {
+        for (u32 tx = tx0; tx <= tx1; tx++) {
+            u32 cluster = sliceBase + ty * CLUSTER_GRID_X + tx;
+            u32 n       = lighting->clusterCounts[cluster]++;
+            if (n < CLUSTER_MAX_LIGHTS)
+                lighting->clusterLists[cluster * CLUSTER_MAX_LIGHTS + n]
+                  = light;
+        }
+    }
+}
+
+// one depth slice per job, slices own disjoint clusters
+static void assignSlice(void* userData, u32 slice)
+{
+    ClusterAssignJob* job       = (ClusterAssignJob*)userData;
+    ClusteredLighting* lighting = job->lighting;
+
+    f32 ratio     = lighting->zFar / lighting->zNear;
+    f32 sliceNear = lighting->zNear * powf(ratio, (f32)slice / CLUSTER_GRID_Z);
+    f32 sliceFar
+      = lighting->zNear * powf(ratio, (f32)(slice + 1) / CLUSTER_GRID_Z);
+
+    memset(lighting->clusterCounts + slice * CLUSTERS_PER_SLICE, 0,
+           sizeof(u32) * CLUSTERS_PER_SLICE);
+
+    u32 count = (lighting->lightCount + 3) & ~3u;
+    u32 i     = 0;
+
+#ifdef CLUSTERED_LIGHTING_SSE
+    // reject 4 lights at a time on depth, most miss any given slice
+    __m128 nearPlane = _mm_set1_ps(sliceNear);
+    __m128 farPlane  = _mm_set1_ps(sliceFar);
+    for (; i < count; i += 4) {
+        __m128 z    = _mm_loadu_ps(lighting->viewZ + i);
+        __m128 r    = _mm_loadu_ps(lighting->viewRadius + i);
+        __m128 hits = _mm_and_ps(
+          _mm_cmpge_ps(_mm_add_ps(z, r), nearPlane),
+          _mm_cmple_ps(_mm_sub_ps(z, r), farPlane));
+        // padding has r < 0 and z = 0, never a hit
+        hits = _mm_and_ps(hits, _mm_cmpge_ps(r, _mm_setzero_ps()));
+
+        u32 mask = (u32)_mm_movemask_ps(hits);
+        while (mask) {
+            u32 lane = 0;
+            while (!(mask & (1u << lane))) lane++;
+            mask &= mask - 1;
+            binLight(job, slice, i + lane, sliceNear, sliceFar);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        f32 z = lighting->viewZ[i];
+        f32 r = lighting->viewRadius[i];
+        if (r < 0.0f || z + r < sliceNear || z - r > sliceFar) continue;
+        binLight(job, slice, i, sliceNear, sliceFar);
+    }
+}
+
+// grow a storage buffer to hold size bytes, 1.5x headroom
+static bool reserve(GraphicsContext* ctx, WGPUBuffer* buffer, u64* bufferSize,
+                    u64 size, const char* label)
+{
+    if (size <= *bufferSize) return false;
+
+    DeletionQueue::defer(*buffer);
+    *bufferSize = MAX(size + size / 2, *bufferSize * 2);
+    *buffer = createBuffer(ctx, *bufferSize, WGPUBufferUsage_Storage, label);
+    return true;
+}
+
+void ClusteredLighting::update(GraphicsContext* ctx,
+                               ClusteredLighting* lighting,
+                               const glm::mat4& viewMat,
+                               const glm::mat4& projectionMat)
+{
+    transformLights(lighting, viewMat);
+
+    ClusterAssignJob job = {};
+    job.lighting         = lighting;
+    job.projX            = projectionMat[0][0];
+    job.projY            = projectionMat[1][1];
+    JobSystem::parallelFor(CLUSTER_GRID_Z, assignSlice, &job);
+
+    // compact, cluster lists are already in cluster index order
+    ClusteredLightingStats* stats = &lighting->stats;
+    *stats                        = {};
+    stats->lights                 = lighting->lightCount;
+
+    u32 total = 0;
+    for (u32 c = 0; c < CLUSTER_COUNT; c++) {
+        u32 n                = lighting->clusterCounts[c];
+        stats->maxPerCluster = MAX(stats->maxPerCluster, n);
+        if (n > CLUSTER_MAX_LIGHTS) {
+            stats->droppedIndices += n - CLUSTER_MAX_LIGHTS;
+            n = CLUSTER_MAX_LIGHTS;
+        }
+        if (n > 0) stats->activeClusters++;
+
+        lighting->ranges[c].offset = total;
+        lighting->ranges[c].count  = n;
+        total += n;
+    }
+    stats->indices = total;
+
+    if (total > lighting->indexCapacity) {
+        u32 newCapacity = MAX(lighting->indexCapacity * 2, total);
+        lighting->indices
+          = (u32*)reallocate(lighting->indices,
+                             sizeof(u32) * lighting->indexCapacity,
+                             sizeof(u32) * newCapacity);
+        lighting->indexCapacity = newCapacity;
+    }
+    for (u32 c = 0; c < CLUSTER_COUNT; c++) {
+        memcpy(lighting->indices + lighting->ranges[c].offset,
+               lighting->clusterLists + c * CLUSTER_MAX_LIGHTS,
+               sizeof(u32) * lighting->ranges[c].count);
+    }
+
+    // upload
+    bool grown
+      = reserve(ctx, &lighting->lightBuffer, &lighting->lightBufferSize,
+                sizeof(PointLight) * lighting->lightCount, "point lights");
+    grown |= reserve(ctx, &lighting->indexBuffer, &lighting->indexBufferSize,
+                     sizeof(u32) * total, "cluster light indices");
+    if (grown) createBindGroup(ctx, lighting);
+
+    f32 logRatio             = logf(lighting->zFar / lighting->zNear);
+    ClusterUniforms uniforms = {};
+    uniforms.gridSize   = glm::uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y,
+                                     CLUSTER_GRID_Z, lighting->lightCount);
+    uniforms.screenSize
+      = glm::vec2((f32)ctx->renderWidth, (f32)ctx->renderHeight);
+    uniforms.sliceScale = CLUSTER_GRID_Z / logRatio;
+    uniforms.sliceBias  = -CLUSTER_GRID_Z * logf(lighting->zNear) / logRatio;
+    GraphicsContext::writeBuffer(ctx, lighting->uniformBuffer, 0, &uniforms,
+                                 sizeof(uniforms));
+
+    if (lighting->lightCount > 0) {
+        GraphicsContext::writeBuffer(ctx, lighting->lightBuffer, 0,
+                                     lighting->lights,
+                                     sizeof(PointLight) * lighting->lightCount);
+    }
+    GraphicsContext::writeBuffer(ctx, lighting->rangeBuffer, 0,
+                                 lighting->ranges,
+                                 sizeof(ClusterLightRange) * CLUSTER_COUNT);
+    if (total > 0) {
+        GraphicsContext::writeBuffer(ctx, lighting->indexBuffer, 0,
+                                     lighting->indices, sizeof(u32) * total);
+    }
+}
+
+void ClusteredLighting::bind(ClusteredLighting* lighting,
+                             RenderPipeline* pipeline)
+{
+    ASSERT(pipeline->bindGroupLayoutCount > LIGHTING_GROUP);
+    pipeline->lightingBindGroup = lighting->bindGroup;
+}
+
+void ClusteredLighting::logStats(ClusteredLighting* lighting)
+{
+    ClusteredLightingStats* stats = &lighting->stats;
+    log_info("clustered lighting: %d lights, %d refs in %d/%d clusters (max "
+             "%d, %d dropped)",
+             stats->lights, stats->indices, stats->activeClusters,
+             CLUSTER_COUNT, stats->maxPerCluster, stats->droppedIndices);
+}
+
+void ClusteredLighting::release(ClusteredLighting* lighting)
+{
+    FREE_ARRAY(PointLight, lighting->lights, lighting->lightCapacity);
+    FREE_ARRAY(f32, lighting->viewX, lighting->viewCapacity);
+    FREE_ARRAY(f32, lighting->viewY, lighting->viewCapacity);
+    FREE_ARRAY(f32, lighting->viewZ, lighting->viewCapacity);
+    FREE_ARRAY(f32, lighting->viewRadius, lighting->viewCapacity);
+    FREE_ARRAY(u32, lighting->clusterLists, CLUSTER_COUNT * CLUSTER_MAX_LIGHTS);
+    FREE_ARRAY(u32, lighting->clusterCounts, CLUSTER_COUNT);
+    FREE_ARRAY(ClusterLightRange, lighting->ranges, CLUSTER_COUNT);
+    FREE_ARRAY(u32, lighting->indices, lighting->indexCapacity);
+
+    DeletionQueue::defer(lighting->bindGroup);
+    DeletionQueue::defer(lighting->uniformBuffer);
+    DeletionQueue::defer(lighting->lightBuffer);
+    DeletionQueue::defer(lighting->rangeBuffer);
+    DeletionQueue::defer(lighting->indexBuffer);
+    WGPU_RELEASE_RESOURCE(BindGroupLayout, lighting->layout);
+
+    *lighting = {};
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "common.h"
+#include "context.h"
+#include "shaders.h"
+
+// ============================================================================
+// Clustered Lighting
+// ============================================================================
+
+// Clustered forward shading for many point lights. The view frustum is split
+// into CLUSTER_GRID_X x CLUSTER_GRID_Y screen tiles and CLUSTER_GRID_Z depth
+// slices, spaced exponentially so clusters stay roughly cube shaped. Each
+// frame every light's bounding sphere is binned into the clusters it may
+// touch. The fragment shader finds its cluster from the pixel position and
+// view depth and loops over those lights only, so shading cost follows the
+// lights per cluster instead of the total light count.
+//
+// Assignment runs on the CPU. Lights are transformed to view space 4 at a
+// time with SSE (scalar elsewhere), then every depth slice is binned on a
+// job system worker into fixed size per cluster lists; references beyond
+// CLUSTER_MAX_LIGHTS are dropped and counted. The lists are compacted into
+// one index buffer and uploaded together with the lights and per cluster
+// ranges through the frame's staging memory.
+//
+// Pipelines opt in with SHADER_PERMUTATION_CLUSTERED_LIGHTING, which adds
+// LIGHTING_GROUP to their layout, and bind() points them at the lighting's
+// bind group.
+//
+// Usage, every frame after GraphicsContext::beginFrame():
+//   (add or move lights)
+//   ClusteredLighting::update(ctx, &lighting, viewMat, projectionMat);
+//   ClusteredLighting::bind(&lighting, &pipeline);
+
+#define CLUSTER_MAX_LIGHTS 256 // per cluster
+#define CLUSTERED_LIGHTING_INITIAL_LIGHTS 256
+#define CLUSTERED_LIGHTING_INITIAL_INDICES (1 << 16)
+
+struct ClusteredLightingStats {
+    u32 lights;
+    u32 indices;        // light references over all clusters
+    u32 activeClusters; // with at least one light
+    u32 maxPerCluster;  // before dropping
+    u32 droppedIndices; // cluster was full
+};
+
+struct ClusteredLighting {
+    PointLight* lights; // world space, edit freely between updates
+    u32 lightCount;
+    u32 lightCapacity;
+
+    // depth range split into slices, usually the camera's near/far planes
+    f32 zNear;
+    f32 zFar;
+
+    // view space bounds, SoA and padded to a multiple of 4 for SIMD
+    f32* viewX;
+    f32* viewY;
+    f32* viewZ; // distance in front of the camera
+    f32* viewRadius;
+    u32 viewCapacity;
+
+    // binning scratch: CLUSTER_MAX_LIGHTS slots per cluster
+    u32* clusterLists;
+    u32* clusterCounts;
+
+    // compacted
+    ClusterLightRange* ranges; // CLUSTER_COUNT
+    u32* indices;
+    u32 indexCapacity;
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer lightBuffer;
+    WGPUBuffer rangeBuffer;
+    WGPUBuffer indexBuffer;
+    u64 lightBufferSize;
+    u64 indexBufferSize;
+
+    WGPUBindGroupLayout layout;
+    WGPUBindGroup bindGroup; // recreated when a buffer grows
+
+    ClusteredLightingStats stats;
+
+    static void init(GraphicsContext* ctx, ClusteredLighting* lighting,
+                     f32 zNear, f32 zFar);
+
+    /// @brief Append a light, zeroed. Valid until the next addLight()
+    static PointLight* addLight(ClusteredLighting* lighting);
+    static void clearLights(ClusteredLighting* lighting);
+
+    /// @brief Bin lights into clusters for this view and stage the upload.
+    /// projectionMat must be a symmetric perspective projection
+    static void update(GraphicsContext* ctx, ClusteredLighting* lighting,
+                       const glm::mat4& viewMat,
+                       const glm::mat4& projectionMat);
+
+    /// @brief Use this lighting with a CLUSTERED_LIGHTING pipeline. Call
+    /// after update(), which may recreate the bind group
+    static void bind(ClusteredLighting* lighting, RenderPipeline* pipeline);
+
+    /// @brief LIGHTING_GROUP layout, a new reference (PipelineCache)
+    static WGPUBindGroupLayout bindGroupLayout(GraphicsContext* ctx);
+
+    static void logStats(ClusteredLighting* lighting);
+    static void release(ClusteredLighting* lighting);
+};
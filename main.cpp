@@ -24,11 +24,14 @@
 // #define WEBGPU_BACKEND_WGPU
 // #define WEBGPU_BACKEND_EMSCRIPTEN
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    // optional example name, e.g. `WebGPU-Renderer Draws`
+    const char* exampleName = argc > 1 ? argv[1] : NULL;
+
     ExampleRunner runner = {};
     if (!ExampleRunner::init(&runner)) return EXIT_FAILURE;
-    ExampleRunner::run(&runner);
+    ExampleRunner::run(&runner, exampleName);
     ExampleRunner::release(&runner);
 
 #if 0
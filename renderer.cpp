@@ -0,0 +1,568 @@
+#include "renderer.h"
+#include "core/log.h"
+#include "deletion.h"
+#include "entity.h"
+#include "gpu_memory.h"
+#include "jobs.h"
+#include "memory.h"
+#include "shaders.h"
+
+// ============================================================================
+// Draw List
+// ============================================================================
+
+void DrawList::add(DrawList* list, RenderPipeline* pipeline,
+                   Material* material, Entity* entity)
+{
+    if (list->count == list->capacity) {
+        u32 newCapacity = list->capacity < 8 ? 8 : list->capacity * 2;
+        list->calls     = (DrawCall*)reallocate(
+          list->calls, sizeof(DrawCall) * list->capacity,
+          sizeof(DrawCall) * newCapacity);
+        list->capacity = newCapacity;
+    }
+
+    DrawCall* call = &list->calls[list->count++];
+    call->pipeline = pipeline;
+    call->material = material;
+    call->entity   = entity;
+}
+
+void DrawList::reset(DrawList* list)
+{
+    list->count          = 0;
+    list->depthPrepassed = false;
+}
+
+// pipeline for the main pass: the depth Equal variant when the draw is
+// already in the depth buffer
+static WGPURenderPipeline shadingPipeline(DrawList* list, DrawCall* call)
+{
+    RenderPipeline* pipeline = call->pipeline;
+    // variants are only created by DepthPrepass::execute, so both being set
+    // means this draw was pre-passed
+    if (list->depthPrepassed && pipeline->depthPrepassPipeline
+        && pipeline->depthEqualPipeline)
+        return pipeline->depthEqualPipeline;
+    return RenderPipeline::current(pipeline);
+}
+
+void DrawList::free(DrawList* list)
+{
+    FREE_ARRAY(DrawCall, list->calls, list->capacity);
+    *list = {};
+}
+
+u64 DrawList::hash(GraphicsContext* ctx, DrawList* list)
+{
+    // bundles are only compatible with passes of the same attachment formats
+    u64 hash = hashCombine(HASH_SEED, (u64)ctx->swapChainFormat);
+    hash     = hashCombine(hash, (u64)ctx->depthTextureFormat);
+    hash     = hashCombine(hash, (u64)list->depthPrepassed);
+
+    for (u32 i = 0; i < list->count; i++) {
+        DrawCall* call = &list->calls[i];
+        Entity* entity = call->entity;
+
+        // changes when an async compile finishes, re-recording the bundle
+        hash = hashCombine(hash, (u64)shadingPipeline(list, call));
+        hash = hashCombine(
+          hash, (u64)call->pipeline->bindGroups[PER_FRAME_GROUP].bindGroup);
+        hash = hashCombine(hash, (u64)call->pipeline->lightingBindGroup);
+        hash = hashCombine(hash, (u64)call->material->bindGroup);
+        hash = hashCombine(hash, call->material->uniformOffset);
+        hash = hashCombine(hash, (u64)entity->bindGroup.bindGroup);
+        // pool buffers change when the pool grows
+        MeshAllocation* mesh = &entity->mesh;
+
+        hash = hashCombine(hash, (u64)mesh->pool->positionBuffer);
+        hash = hashCombine(hash, (u64)mesh->pool->indexBuffer);
+        hash = hashCombine(hash, mesh->baseVertex);
+        hash = hashCombine(hash, mesh->firstIndex);
+        hash = hashCombine(hash, mesh->indexCount);
+    }
+    return hash;
+}
+
+void DrawList::encode(WGPURenderBundleEncoder encoder, DrawList* list,
+                      u32 begin, u32 end)
+{
+    // skip redundant state changes between consecutive draws
+    RenderPipeline* boundPipeline = NULL;
+    Material* boundMaterial       = NULL;
+    MeshPool* boundMeshPool       = NULL;
+
+    for (u32 i = begin; i < end; i++) {
+        DrawCall* call = &list->calls[i];
+        Entity* entity = call->entity;
+
+        // check drawable
+        if (!entity->vertices.vertexData) continue;
+
+        // still compiling and no placeholder
+        WGPURenderPipeline current = shadingPipeline(list, call);
+        if (!current) continue;
+
+        if (call->pipeline != boundPipeline) {
+            boundPipeline = call->pipeline;
+            boundMaterial = NULL;
+            wgpuRenderBundleEncoderSetPipeline(encoder, current);
+            wgpuRenderBundleEncoderSetBindGroup(
+              encoder, PER_FRAME_GROUP,
+              boundPipeline->bindGroups[PER_FRAME_GROUP].bindGroup, 0, NULL);
+            if (boundPipeline->lightingBindGroup)
+                wgpuRenderBundleEncoderSetBindGroup(
+                  encoder, LIGHTING_GROUP, boundPipeline->lightingBindGroup, 0,
+                  NULL);
+        }
+
+        // materials sharing a MaterialBuffer and texture have the same bind
+        // group, only the dynamic offset differs
+        if (call->material != boundMaterial) {
+            boundMaterial = call->material;
+            wgpuRenderBundleEncoderSetBindGroup(
+              encoder, PER_MATERIAL_GROUP, boundMaterial->bindGroup, 1,
+              &boundMaterial->uniformOffset);
+        }
+
+        // geometry: shared buffers, bound once
+        MeshAllocation* mesh = &entity->mesh;
+        if (mesh->pool != boundMeshPool) {
+            boundMeshPool = mesh->pool;
+            MeshPool::setBuffers(boundMeshPool, encoder);
+        }
+
+        // model bind group
+        wgpuRenderBundleEncoderSetBindGroup(
+          encoder, PER_DRAW_GROUP, entity->bindGroup.bindGroup, 0, NULL);
+
+        wgpuRenderBundleEncoderDrawIndexed(encoder, mesh->indexCount, 1,
+                                           mesh->firstIndex, mesh->baseVertex,
+                                           0);
+    }
+}
+
+void DrawList::encodeDepth(WGPURenderBundleEncoder encoder, DrawList* list,
+                           u32 begin, u32 end)
+{
+    RenderPipeline* boundPipeline    = NULL;
+    WGPUBindGroup boundMaterialGroup = NULL;
+    MeshPool* boundMeshPool          = NULL;
+
+    for (u32 i = begin; i < end; i++) {
+        DrawCall* call           = &list->calls[i];
+        Entity* entity           = call->entity;
+        RenderPipeline* pipeline = call->pipeline;
+
+        if (!entity->vertices.vertexData) continue;
+        // must match shadingPipeline()
+        if (!pipeline->depthPrepassPipeline || !pipeline->depthEqualPipeline)
+            continue;
+
+        if (pipeline != boundPipeline) {
+            boundPipeline      = pipeline;
+            boundMaterialGroup = NULL;
+            wgpuRenderBundleEncoderSetPipeline(encoder,
+                                               pipeline->depthPrepassPipeline);
+            wgpuRenderBundleEncoderSetBindGroup(
+              encoder, PER_FRAME_GROUP,
+              pipeline->bindGroups[PER_FRAME_GROUP].bindGroup, 0, NULL);
+            // part of the shared layout as well
+            if (pipeline->lightingBindGroup)
+                wgpuRenderBundleEncoderSetBindGroup(encoder, LIGHTING_GROUP,
+                                                    pipeline->lightingBindGroup,
+                                                    0, NULL);
+        }
+
+        // unused by the shader but part of the shared layout: any offset
+        // will do, rebind only when the bind group changes
+        Material* material = call->material;
+        if (material->bindGroup != boundMaterialGroup) {
+            boundMaterialGroup = material->bindGroup;
+            wgpuRenderBundleEncoderSetBindGroup(encoder, PER_MATERIAL_GROUP,
+                                                boundMaterialGroup, 1,
+                                                &material->uniformOffset);
+        }
+
+        // positions only
+        MeshAllocation* mesh = &entity->mesh;
+        if (mesh->pool != boundMeshPool) {
+            boundMeshPool = mesh->pool;
+            wgpuRenderBundleEncoderSetVertexBuffer(
+              encoder, 0, boundMeshPool->positionBuffer, 0, WGPU_WHOLE_SIZE);
+            wgpuRenderBundleEncoderSetIndexBuffer(
+              encoder, boundMeshPool->indexBuffer, WGPUIndexFormat_Uint32, 0,
+              WGPU_WHOLE_SIZE);
+        }
+
+        wgpuRenderBundleEncoderSetBindGroup(
+          encoder, PER_DRAW_GROUP, entity->bindGroup.bindGroup, 0, NULL);
+
+        wgpuRenderBundleEncoderDrawIndexed(encoder, mesh->indexCount, 1,
+                                           mesh->firstIndex, mesh->baseVertex,
+                                           0);
+    }
+}
+
+struct RecordJob {
+    DrawList* list;
+    WGPURenderBundleEncoder* encoders;
+    WGPURenderBundle* bundles;
+    u32 chunkSize;
+    bool depthOnly;
+};
+
+static void recordChunk(void* userData, u32 chunk)
+{
+    RecordJob* job = (RecordJob*)userData;
+    u32 begin      = chunk * job->chunkSize;
+    u32 end        = MIN(begin + job->chunkSize, job->list->count);
+
+    if (job->depthOnly)
+        DrawList::encodeDepth(job->encoders[chunk], job->list, begin, end);
+    else
+        DrawList::encode(job->encoders[chunk], job->list, begin, end);
+
+    WGPURenderBundleDescriptor bundleDesc = {};
+    bundleDesc.label                      = "draw list chunk";
+    job->bundles[chunk]
+      = wgpuRenderBundleEncoderFinish(job->encoders[chunk], &bundleDesc);
+}
+
+u32 DrawList::recordParallel(GraphicsContext* ctx, DrawList* list,
+                             WGPURenderBundle* bundles, bool depthOnly)
+{
+    if (list->count == 0) return 0;
+
+    // one chunk per thread (workers + caller), but never tiny chunks
+    u32 maxChunks  = (list->count + DRAW_LIST_MIN_DRAWS_PER_CHUNK - 1)
+                     / DRAW_LIST_MIN_DRAWS_PER_CHUNK;
+    u32 chunkCount = MIN(JobSystem::workerCount() + 1, DRAW_LIST_MAX_CHUNKS);
+    chunkCount     = MIN(chunkCount, maxChunks);
+
+    RecordJob job = {};
+    job.list      = list;
+    job.chunkSize = (list->count + chunkCount - 1) / chunkCount;
+    job.bundles   = bundles;
+    job.depthOnly = depthOnly;
+
+    // create encoders up front on this thread so only encoder-local calls
+    // happen on the workers
+    WGPURenderBundleEncoder encoders[DRAW_LIST_MAX_CHUNKS];
+    for (u32 i = 0; i < chunkCount; i++)
+        encoders[i]
+          = createRenderBundleEncoder(ctx, "draw list chunk", depthOnly);
+    job.encoders = encoders;
+
+#ifdef WEBGPU_BACKEND_DAWN
+    // Dawn native objects are not safe to use from multiple threads without
+    // the implicit device synchronization toggle; record serially.
+    for (u32 i = 0; i < chunkCount; i++) recordChunk(&job, i);
+#else
+    JobSystem::parallelFor(chunkCount, recordChunk, &job);
+#endif
+
+    for (u32 i = 0; i < chunkCount; i++)
+        WGPU_RELEASE_RESOURCE(RenderBundleEncoder, encoders[i]);
+
+    return chunkCount;
+}
+
+void DrawList::execute(GraphicsContext* ctx, DrawList* list,
+                       WGPURenderPassEncoder renderPass)
+{
+    WGPURenderBundle bundles[DRAW_LIST_MAX_CHUNKS];
+    u32 bundleCount = DrawList::recordParallel(ctx, list, bundles);
+    if (bundleCount == 0) return;
+
+    wgpuRenderPassEncoderExecuteBundles(renderPass, bundleCount, bundles);
+
+    // the pass keeps its own references
+    for (u32 i = 0; i < bundleCount; i++)
+        WGPU_RELEASE_RESOURCE(RenderBundle, bundles[i]);
+}
+
+// ============================================================================
+// Render Bundle Cache
+// ============================================================================
+
+WGPURenderBundleEncoder createRenderBundleEncoder(GraphicsContext* ctx,
+                                                  const char* label,
+                                                  bool depthOnly)
+{
+    WGPURenderBundleEncoderDescriptor desc = {};
+    desc.label                             = label;
+    desc.colorFormatCount                  = depthOnly ? 0 : 1;
+    desc.colorFormats = depthOnly ? NULL : &ctx->swapChainFormat;
+    desc.depthStencilFormat                = ctx->depthTextureFormat;
+    desc.sampleCount                       = 1;
+    desc.depthReadOnly                     = false;
+    desc.stencilReadOnly                   = false;
+    return wgpuDeviceCreateRenderBundleEncoder(ctx->device, &desc);
+}
+
+WGPURenderBundle RenderBundleCache::get(GraphicsContext* ctx,
+                                        RenderBundleCache* cache,
+                                        DrawList* list)
+{
+    u64 key = DrawList::hash(ctx, list);
+
+    RenderBundleCacheEntry* entry
+      = (RenderBundleCacheEntry*)HashMap::get(&cache->bundles, key);
+    if (entry) {
+        cache->hits++;
+        entry->lastUsedFrame = cache->frame;
+        return entry->bundle;
+    }
+
+    // miss: record the whole list once
+    cache->misses++;
+    log_trace("recording render bundle for %d draws", list->count);
+
+    WGPURenderBundleEncoder encoder
+      = createRenderBundleEncoder(ctx, "static draw list");
+    DrawList::encode(encoder, list, 0, list->count);
+
+    WGPURenderBundleDescriptor bundleDesc = {};
+    bundleDesc.label                      = "static draw list";
+
+    entry                = ALLOCATE_COUNT(RenderBundleCacheEntry, 1);
+    entry->bundle        = wgpuRenderBundleEncoderFinish(encoder, &bundleDesc);
+    entry->lastUsedFrame = cache->frame;
+    ASSERT(entry->bundle != NULL);
+    WGPU_RELEASE_RESOURCE(RenderBundleEncoder, encoder);
+
+    HashMap::put(&cache->bundles, key, entry);
+    return entry->bundle;
+}
+
+void RenderBundleCache::endFrame(RenderBundleCache* cache)
+{
+    cache->frame++;
+
+    HashMap* map = &cache->bundles;
+    for (u32 i = 0; i < map->capacity; i++) {
+        if (!HashMap::occupied(map, i)) continue;
+
+        RenderBundleCacheEntry* entry
+          = (RenderBundleCacheEntry*)map->entries[i].value;
+        if (cache->frame - entry->lastUsedFrame
+            <= RENDER_BUNDLE_CACHE_MAX_IDLE_FRAMES)
+            continue;
+
+        DeletionQueue::defer(entry->bundle);
+        FREE(RenderBundleCacheEntry, entry);
+        // removing only leaves a tombstone, safe while iterating
+        HashMap::remove(map, map->entries[i].key);
+    }
+}
+
+void RenderBundleCache::invalidate(RenderBundleCache* cache)
+{
+    HashMap* map = &cache->bundles;
+    for (u32 i = 0; i < map->capacity; i++) {
+        if (!HashMap::occupied(map, i)) continue;
+        RenderBundleCacheEntry* entry
+          = (RenderBundleCacheEntry*)map->entries[i].value;
+        // may have been executed this frame already
+        DeletionQueue::defer(entry->bundle);
+        FREE(RenderBundleCacheEntry, entry);
+    }
+    HashMap::clear(map);
+}
+
+void RenderBundleCache::release(RenderBundleCache* cache)
+{
+    RenderBundleCache::invalidate(cache);
+    HashMap::free(&cache->bundles);
+    *cache = {};
+}
+
+// ============================================================================
+// Depth Pre-pass
+// ============================================================================
+
+#define DEPTH_PREPASS_QUERY_BYTES (DEPTH_PREPASS_QUERY_COUNT * sizeof(u64))
+
+static WGPUBuffer createQueryBuffer(GraphicsContext* ctx, const char* label,
+                                   WGPUBufferUsageFlags usage)
+{
+    WGPUBufferDescriptor desc = {};
+    desc.label                = label;
+    desc.size                 = DEPTH_PREPASS_QUERY_BYTES;
+    desc.usage                = usage;
+
+    WGPUBuffer buffer = wgpuDeviceCreateBuffer(ctx->device, &desc);
+    ASSERT(buffer != NULL);
+    GPUMemory::track(buffer, GPUMemory::bufferCategory(usage), desc.size,
+                     label);
+    return buffer;
+}
+
+void DepthPrepass::init(GraphicsContext* ctx, DepthPrepass* prepass,
+                        bool enabled)
+{
+    *prepass         = {};
+    prepass->enabled = enabled;
+
+    WGPUQuerySetDescriptor querySetDesc = {};
+    querySetDesc.label                  = "depth prepass occlusion";
+    querySetDesc.type                   = WGPUQueryType_Occlusion;
+    querySetDesc.count                  = DEPTH_PREPASS_QUERY_COUNT;
+    prepass->querySet = wgpuDeviceCreateQuerySet(ctx->device, &querySetDesc);
+    ASSERT(prepass->querySet != NULL);
+
+    prepass->resolveBuffer = createQueryBuffer(
+      ctx, "depth prepass resolve",
+      WGPUBufferUsage_QueryResolve | WGPUBufferUsage_CopySrc);
+    prepass->readbackBuffer = createQueryBuffer(
+      ctx, "depth prepass readback",
+      WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst);
+}
+
+static void onQueriesMapped(WGPUBufferMapAsyncStatus status, void* userdata)
+{
+    DepthPrepass* prepass = (DepthPrepass*)userdata;
+    prepass->readback     = DEPTH_PREPASS_READBACK_IDLE;
+    // destroyed before the callback on shutdown
+    if (status != WGPUBufferMapAsyncStatus_Success) return;
+
+    const u64* samples = (const u64*)wgpuBufferGetConstMappedRange(
+      prepass->readbackBuffer, 0, DEPTH_PREPASS_QUERY_BYTES);
+
+    DepthPrepassStats* stats = &prepass->stats;
+    stats->depthSamples
+      = prepass->queriedDepth ? samples[DEPTH_PREPASS_QUERY_DEPTH] : 0;
+    stats->shadingSamples = samples[DEPTH_PREPASS_QUERY_SHADING];
+
+    f32 pixels             = (f32)MAX(prepass->pixels, 1u);
+    stats->depthOverdraw   = stats->depthSamples / pixels;
+    stats->shadingOverdraw = stats->shadingSamples / pixels;
+
+    wgpuBufferUnmap(prepass->readbackBuffer);
+}
+
+// one step per frame, so nothing waits on the GPU: resolve the queries the
+// frame after they were written, map them once that copy was submitted
+static void advanceReadback(GraphicsContext* ctx, DepthPrepass* prepass)
+{
+    switch (prepass->readback) {
+        case DEPTH_PREPASS_READBACK_QUERIED: {
+            wgpuCommandEncoderResolveQuerySet(
+              ctx->commandEncoder, prepass->querySet, 0,
+              DEPTH_PREPASS_QUERY_COUNT, prepass->resolveBuffer, 0);
+            wgpuCommandEncoderCopyBufferToBuffer(
+              ctx->commandEncoder, prepass->resolveBuffer, 0,
+              prepass->readbackBuffer, 0, DEPTH_PREPASS_QUERY_BYTES);
+            prepass->readback = DEPTH_PREPASS_READBACK_COPIED;
+        } break;
+        case DEPTH_PREPASS_READBACK_COPIED: {
+            prepass->readback = DEPTH_PREPASS_READBACK_MAPPING;
+            wgpuBufferMapAsync(prepass->readbackBuffer, WGPUMapMode_Read, 0,
+                               DEPTH_PREPASS_QUERY_BYTES, onQueriesMapped,
+                               prepass);
+        } break;
+        default: break;
+    }
+}
+
+void DepthPrepass::execute(GraphicsContext* ctx, DepthPrepass* prepass,
+                           DrawList* list)
+{
+    ASSERT(ctx->commandEncoder != NULL);
+    advanceReadback(ctx, prepass);
+
+    // query this frame if the previous results have been read
+    prepass->querying = prepass->readback == DEPTH_PREPASS_READBACK_IDLE;
+    if (prepass->querying) {
+        prepass->readback                     = DEPTH_PREPASS_READBACK_QUERIED;
+        prepass->queriedDepth                 = false;
+        ctx->renderPassDesc.occlusionQuerySet = prepass->querySet;
+
+        // dynamic resolution only renders part of the target
+        prepass->pixels = ctx->renderWidth * ctx->renderHeight;
+    }
+
+    list->depthPrepassed          = false;
+    prepass->stats.prepassedDraws = 0;
+    prepass->stats.skippedDraws   = 0;
+    if (!prepass->enabled) return;
+
+    // request variants once per pipeline run, lists are usually sorted
+    RenderPipeline* lastPipeline = NULL;
+    bool lastReady               = false;
+    for (u32 i = 0; i < list->count; i++) {
+        RenderPipeline* pipeline = list->calls[i].pipeline;
+        if (pipeline != lastPipeline) {
+            lastPipeline = pipeline;
+            lastReady    = RenderPipeline::depthPrepassVariants(ctx, pipeline);
+        }
+        if (lastReady)
+            prepass->stats.prepassedDraws++;
+        else
+            prepass->stats.skippedDraws++;
+    }
+    if (prepass->stats.prepassedDraws == 0) return;
+
+    // depth only: clears and stores depth, the main pass loads it
+    WGPURenderPassDescriptor passDesc = {};
+    passDesc.label                    = "depth prepass";
+    passDesc.depthStencilAttachment   = &ctx->depthStencilAttachment;
+    passDesc.occlusionQuerySet = prepass->querying ? prepass->querySet : NULL;
+
+    WGPURenderPassEncoder pass
+      = wgpuCommandEncoderBeginRenderPass(ctx->commandEncoder, &passDesc);
+    GraphicsContext::setRenderViewport(ctx, pass);
+    if (prepass->querying) {
+        wgpuRenderPassEncoderBeginOcclusionQuery(pass,
+                                                 DEPTH_PREPASS_QUERY_DEPTH);
+        prepass->queriedDepth = true;
+    }
+
+    WGPURenderBundle bundles[DRAW_LIST_MAX_CHUNKS];
+    u32 bundleCount = DrawList::recordParallel(ctx, list, bundles, true);
+    wgpuRenderPassEncoderExecuteBundles(pass, bundleCount, bundles);
+    for (u32 i = 0; i < bundleCount; i++)
+        WGPU_RELEASE_RESOURCE(RenderBundle, bundles[i]);
+
+    if (prepass->querying) wgpuRenderPassEncoderEndOcclusionQuery(pass);
+    wgpuRenderPassEncoderEnd(pass);
+    wgpuRenderPassEncoderRelease(pass);
+
+    ctx->depthStencilAttachment.depthLoadOp = WGPULoadOp_Load;
+    list->depthPrepassed                    = true;
+}
+
+void DepthPrepass::beginShading(DepthPrepass* prepass,
+                                WGPURenderPassEncoder renderPass)
+{
+    if (!prepass->querying) return;
+    wgpuRenderPassEncoderBeginOcclusionQuery(renderPass,
+                                             DEPTH_PREPASS_QUERY_SHADING);
+}
+
+void DepthPrepass::endShading(DepthPrepass* prepass,
+                              WGPURenderPassEncoder renderPass)
+{
+    if (!prepass->querying) return;
+    wgpuRenderPassEncoderEndOcclusionQuery(renderPass);
+}
+
+void DepthPrepass::logStats(DepthPrepass* prepass)
+{
+    DepthPrepassStats* stats = &prepass->stats;
+    log_info("depth prepass %s: %d draws pre-passed, %d skipped, overdraw "
+             "%.2f depth, %.2f shaded",
+             prepass->enabled ? "on" : "off", stats->prepassedDraws,
+             stats->skippedDraws, stats->depthOverdraw,
+             stats->shadingOverdraw);
+}
+
+void DepthPrepass::release(DepthPrepass* prepass)
+{
+    // destroying the readback buffer cancels a pending map
+    DeletionQueue::defer(prepass->querySet);
+    DeletionQueue::defer(prepass->resolveBuffer);
+    DeletionQueue::defer(prepass->readbackBuffer);
+    *prepass = {};
+}
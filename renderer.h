@@ -0,0 +1,199 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+#include "hash.h"
+
+struct Entity;
+
+// chunks smaller than this are not worth a bundle + a thread handoff
+#define DRAW_LIST_MIN_DRAWS_PER_CHUNK 512
+#define DRAW_LIST_MAX_CHUNKS 64
+
+// ============================================================================
+// Draw List
+// ============================================================================
+
+/// @brief A single draw: which geometry, drawn with which material/pipeline.
+/// Uniform *contents* (model matrix, material color, ...) are not part of the
+/// draw call; they live in GPU buffers and can change without re-recording.
+struct DrawCall {
+    RenderPipeline* pipeline;
+    Material* material;
+    Entity* entity;
+};
+
+struct DrawList {
+    DrawCall* calls;
+    u32 count;
+    u32 capacity;
+
+    // set by DepthPrepass::execute for the current frame, cleared by
+    // reset(): draws already in the depth buffer shade with depth Equal
+    bool depthPrepassed;
+
+    static void add(DrawList* list, RenderPipeline* pipeline,
+                    Material* material, Entity* entity);
+    static void reset(DrawList* list); // keeps allocation
+    static void free(DrawList* list);
+
+    /// @brief Hash of everything baked into recorded commands: membership,
+    /// order, pipelines, bind groups and buffers. Two lists with the same hash
+    /// record identical commands.
+    static u64 hash(GraphicsContext* ctx, DrawList* list);
+
+    /// @brief Record draws [begin, end) into a render bundle encoder
+    static void encode(WGPURenderBundleEncoder encoder, DrawList* list,
+                       u32 begin, u32 end);
+
+    /// @brief Record the depth pre-pass version of draws [begin, end):
+    /// positions only, skipping draws without pre-pass variants
+    static void encodeDepth(WGPURenderBundleEncoder encoder, DrawList* list,
+                            u32 begin, u32 end);
+
+    /// @brief Split the list into chunks and record each into its own
+    /// bundle on the job system workers. bundles[i] always holds chunk i, so
+    /// executing them in order reproduces the serial draw order.
+    /// @return number of bundles written (<= DRAW_LIST_MAX_CHUNKS). Caller
+    /// owns and must release them.
+    static u32 recordParallel(GraphicsContext* ctx, DrawList* list,
+                              WGPURenderBundle* bundles,
+                              bool depthOnly = false);
+
+    /// @brief recordParallel + execute into the pass + release
+    static void execute(GraphicsContext* ctx, DrawList* list,
+                        WGPURenderPassEncoder renderPass);
+};
+
+// ============================================================================
+// Render Bundle Cache
+// ============================================================================
+
+// Static draw lists are recorded once into a WGPURenderBundle and replayed
+// with wgpuRenderPassEncoderExecuteBundles. Bundles are keyed by
+// DrawList::hash() so they are re-recorded only when membership, materials or
+// pipelines change.
+//
+// Note: a cached bundle holds references to every object it uses, so a
+// released bind group/pipeline can't be reallocated at the same address while
+// the bundle is alive. Handle-based hashing is therefore safe.
+
+// bundles not used for this many frames are released
+#define RENDER_BUNDLE_CACHE_MAX_IDLE_FRAMES 120
+
+struct RenderBundleCacheEntry {
+    WGPURenderBundle bundle;
+    u64 lastUsedFrame;
+};
+
+struct RenderBundleCache {
+    HashMap bundles; // DrawList::hash -> RenderBundleCacheEntry*
+    u64 frame;
+
+    // stats
+    u64 hits;
+    u64 misses;
+
+    /// @brief Returns a bundle for the draw list, recording it on a miss.
+    /// The cache owns the returned bundle.
+    static WGPURenderBundle get(GraphicsContext* ctx, RenderBundleCache* cache,
+                                DrawList* list);
+
+    /// @brief Advance frame counter and evict idle bundles
+    static void endFrame(RenderBundleCache* cache);
+
+    /// @brief Drop all cached bundles (e.g. after swap chain format change)
+    static void invalidate(RenderBundleCache* cache);
+
+    static void release(RenderBundleCache* cache);
+};
+
+/// @brief Create a bundle encoder compatible with the main render pass, or
+/// with depthOnly the depth pre-pass (no color attachment)
+WGPURenderBundleEncoder createRenderBundleEncoder(GraphicsContext* ctx,
+                                                  const char* label,
+                                                  bool depthOnly = false);
+
+// ============================================================================
+// Depth Pre-pass
+// ============================================================================
+
+// Renders opaque geometry into the depth texture first, positions only and
+// without a fragment stage. The main pass then loads that depth and shades
+// with depthCompare Equal and depth writes off, so every pixel runs the
+// fragment shader once no matter the draw order. Pays off when fragments
+// are expensive and overdraw is high; costs a second vertex pass.
+//
+// Per draw, the pipeline's pre-pass variants are derived from its
+// descriptor and compiled in the background. Until they are ready (and for
+// alpha tested or custom layout pipelines) the draw skips the pre-pass and
+// shades normally with depth Less.
+//
+// Overdraw is measured with occlusion queries around both passes (samples
+// passing the depth test / pixels), every few frames, read back without
+// stalling. With the pre-pass disabled only the shading pass is queried,
+// giving the overdraw it saves. WebGPU only guarantees a non-zero result
+// when some sample passed; native backends report exact counts, others may
+// just report 1.
+//
+// Usage, every frame:
+//   GraphicsContext::beginFrame(ctx);
+//   DepthPrepass::execute(ctx, &prepass, &list);
+//   pass = GraphicsContext::beginRenderPass(ctx);
+//   DepthPrepass::beginShading(&prepass, pass);
+//   DrawList::execute(ctx, &list, pass);
+//   DepthPrepass::endShading(&prepass, pass);
+
+enum DepthPrepassQuery {
+    DEPTH_PREPASS_QUERY_DEPTH = 0,
+    DEPTH_PREPASS_QUERY_SHADING,
+    DEPTH_PREPASS_QUERY_COUNT,
+};
+
+enum DepthPrepassReadback {
+    DEPTH_PREPASS_READBACK_IDLE = 0,
+    DEPTH_PREPASS_READBACK_QUERIED, // queries recorded, not resolved
+    DEPTH_PREPASS_READBACK_COPIED,  // resolved and copied, not submitted
+    DEPTH_PREPASS_READBACK_MAPPING, // waiting for mapAsync
+};
+
+struct DepthPrepassStats {
+    u64 depthSamples;   // samples written by the pre-pass
+    u64 shadingSamples; // samples shaded by the main pass
+    f32 depthOverdraw;  // per pixel, = shading overdraw without pre-pass
+    f32 shadingOverdraw;
+    u32 prepassedDraws; // last frame
+    u32 skippedDraws;   // no pre-pass variant (yet)
+};
+
+struct DepthPrepass {
+    bool enabled; // per scene toggle
+
+    WGPUQuerySet querySet;
+    WGPUBuffer resolveBuffer;
+    WGPUBuffer readbackBuffer;
+    DepthPrepassReadback readback;
+    bool querying; // this frame
+    bool queriedDepth;
+    u32 pixels; // of the queried frame
+
+    DepthPrepassStats stats;
+
+    static void init(GraphicsContext* ctx, DepthPrepass* prepass,
+                     bool enabled = true);
+
+    /// @brief Record the depth-only pass for list into ctx->commandEncoder
+    /// and set up the main pass to load it. Call every frame after
+    /// GraphicsContext::beginFrame(), enabled or not, before beginRenderPass
+    static void execute(GraphicsContext* ctx, DepthPrepass* prepass,
+                        DrawList* list);
+
+    /// @brief Bracket the main pass draws for overdraw stats
+    static void beginShading(DepthPrepass* prepass,
+                             WGPURenderPassEncoder renderPass);
+    static void endShading(DepthPrepass* prepass,
+                           WGPURenderPassEncoder renderPass);
+
+    static void logStats(DepthPrepass* prepass);
+    static void release(DepthPrepass* prepass);
+};
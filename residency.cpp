@@ -0,0 +1,541 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "stb/stb_image.h"
+
+#include "cache.h"
+#include "core/log.h"
+#include "deletion.h"
+#include "entity.h"
+#include "gpu_memory.h"
+#include "hash.h"
+#include "jobs.h"
+#include "memory.h"
+#include "renderer.h"
+#include "residency.h"
+#include "texture_bake.h"
+
+// ============================================================================
+// Texture Residency
+// ============================================================================
+
+struct ResidentTexture {
+    Texture* texture;
+    char* filename;
+    u32 filenameBytes;
+    TextureResidencyCallback callback;
+    void* userdata;
+
+    // full chain, from the file header
+    u32 width;
+    u32 height;
+    u32 levels;
+    u32 minBase; // largest level never evicted
+
+    u32 residentBase; // full chain level that is level 0 of the texture
+    u32 wantedBase;   // from the last frame that used the texture
+    u32 frameWanted;  // feedback of the current frame
+    u32 targetBase;   // after fitting the budget, this update
+    u64 lastUsedFrame;
+    bool failed; // couldn't be decoded, stays as it is
+
+    // written by the decode job, read once counter is done. The levels come
+    // from the bake cache when it's enabled
+    bool loading;
+    JobCounter counter;
+    CPUMipChain chain;
+    BakedTexture baked;
+    bool decodeFailed;
+};
+
+struct TextureResidencyState {
+    bool initialized;
+    u64 budget;
+    u64 pressure; // GPUMemory overshoot, taken off the next update's budget
+    MipFilter filter;
+    u64 frame;
+
+    ResidentTexture** textures;
+    u32 count;
+    u32 capacity;
+    HashMap lookup; // Texture* -> ResidentTexture*
+
+    TextureResidencyStats stats;
+};
+
+static TextureResidencyState residency = {};
+
+static u64 textureKey(const Texture* texture)
+{
+    return hashCombine(HASH_SEED, (u64)texture);
+}
+
+/// @brief Bytes of the full chain's levels from base down
+static u64 rangeBytes(const ResidentTexture* resident, u32 base)
+{
+    return GPUMemory::textureBytes(WGPUTextureFormat_RGBA8Unorm,
+                                   MAX(resident->width >> base, 1u),
+                                   MAX(resident->height >> base, 1u), 1,
+                                   resident->levels - base);
+}
+
+/// @brief Bytes of the top level to be resident
+static u64 targetLevelBytes(const ResidentTexture* resident)
+{
+    return rangeBytes(resident, resident->targetBase)
+           - rangeBytes(resident, resident->targetBase + 1);
+}
+
+/// @brief More levels than the last feedback asked for, or not used by the
+/// last frame at all
+static bool surplus(const ResidentTexture* resident)
+{
+    return resident->lastUsedFrame != residency.frame
+           || resident->targetBase < resident->wantedBase;
+}
+
+/// @brief a's top level goes before b's: surplus first, then least
+/// recently used, then largest
+static bool evictsBefore(const ResidentTexture* a, const ResidentTexture* b)
+{
+    if (surplus(a) != surplus(b)) return surplus(a);
+    if (a->lastUsedFrame != b->lastUsedFrame)
+        return a->lastUsedFrame < b->lastUsedFrame;
+    return targetLevelBytes(a) > targetLevelBytes(b);
+}
+
+static const CPUMipLevel* decodedLevel(const ResidentTexture* resident,
+                                       u32 level)
+{
+    return resident->baked.data ? &resident->baked.levels[level]
+                                : &resident->chain.levels[level];
+}
+
+static void decodeResident(void* userData, u32 index)
+{
+    UNUSED_VAR(index);
+    ResidentTexture* resident = (ResidentTexture*)userData;
+
+    if (TextureBakeCache::enabled()) {
+        TextureBakeSettings bake = {};
+        bake.format              = CPU_MIP_RGBA8_UNORM;
+        bake.filter              = residency.filter;
+        bake.flipY               = true;
+        resident->decodeFailed
+          = !TextureBakeCache::load(&resident->baked, resident->filename,
+                                    &bake)
+            || resident->baked.width != resident->width
+            || resident->baked.height != resident->height;
+        return;
+    }
+
+    i32 width = 0, height = 0, comps = 0;
+    stbi_uc* pixels
+      = stbi_load(resident->filename, &width, &height, &comps, STBI_rgb_alpha);
+    if (pixels == NULL) {
+        resident->decodeFailed = true;
+        return;
+    }
+
+    // the file changed since manage() read its header
+    if ((u32)width != resident->width || (u32)height != resident->height) {
+        resident->decodeFailed = true;
+    } else {
+        CPUMipChain::generate(&resident->chain, pixels, width, height,
+                              CPU_MIP_RGBA8_UNORM, residency.filter);
+    }
+    stbi_image_free(pixels);
+}
+
+/// @brief Texture for the full chain's levels from base down
+static WGPUTexture createTexture(GraphicsContext* ctx,
+                                 const ResidentTexture* resident, u32 base)
+{
+    u32 width  = MAX(resident->width >> base, 1u);
+    u32 height = MAX(resident->height >> base, 1u);
+
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.usage = WGPUTextureUsage_TextureBinding
+                        | WGPUTextureUsage_CopyDst | WGPUTextureUsage_CopySrc;
+
+    textureDesc.dimension     = WGPUTextureDimension_2D;
+    textureDesc.size          = { width, height, 1 };
+    textureDesc.format        = WGPUTextureFormat_RGBA8Unorm;
+    textureDesc.mipLevelCount = resident->levels - base;
+    textureDesc.sampleCount   = 1;
+    textureDesc.label         = resident->filename;
+    WGPUTexture texture = wgpuDeviceCreateTexture(ctx->device, &textureDesc);
+    GPUMemory::track(texture, GPU_MEMORY_TEXTURE, rangeBytes(resident, base),
+                     resident->filename);
+    return texture;
+}
+
+/// @brief Swap in texture, holding the full chain's levels from base down
+static void replaceTexture(GraphicsContext* ctx, ResidentTexture* resident,
+                           WGPUTexture texture, u32 base)
+{
+    Texture* owner               = resident->texture;
+    WGPUTexture previousTexture  = owner->texture;
+    WGPUTextureView previousView = owner->view;
+
+    owner->texture         = texture;
+    owner->view            = wgpuTextureCreateView(texture, NULL);
+    owner->width           = MAX(resident->width >> base, 1u);
+    owner->height          = MAX(resident->height >> base, 1u);
+    owner->mip_level_count = resident->levels - base;
+    resident->residentBase = base;
+
+    // let the owner rebind before the old view's bind groups go
+    if (resident->callback) resident->callback(ctx, owner, resident->userdata);
+    BindingCache::purge(previousView);
+    DeletionQueue::defer(previousView);
+    DeletionQueue::defer(previousTexture);
+}
+
+/// @brief Keep the levels from base down, copied on the GPU
+static void evict(GraphicsContext* ctx, ResidentTexture* resident, u32 base)
+{
+    ASSERT(base > resident->residentBase);
+    WGPUTexture texture = createTexture(ctx, resident, base);
+
+    WGPUCommandEncoderDescriptor encoderDesc = {};
+    encoderDesc.label                        = "texture eviction";
+    WGPUCommandEncoder encoder
+      = wgpuDeviceCreateCommandEncoder(ctx->device, &encoderDesc);
+    for (u32 level = base; level < resident->levels; level++) {
+        WGPUImageCopyTexture source = {};
+        source.texture              = resident->texture->texture;
+        source.mipLevel             = level - resident->residentBase;
+        source.aspect               = WGPUTextureAspect_All;
+
+        WGPUImageCopyTexture destination = {};
+        destination.texture              = texture;
+        destination.mipLevel             = level - base;
+        destination.aspect               = WGPUTextureAspect_All;
+
+        WGPUExtent3D extent = { MAX(resident->width >> level, 1u),
+                                MAX(resident->height >> level, 1u), 1 };
+        wgpuCommandEncoderCopyTextureToTexture(encoder, &source, &destination,
+                                               &extent);
+    }
+    WGPUCommandBuffer commands = wgpuCommandEncoderFinish(encoder, NULL);
+    wgpuQueueSubmit(ctx->queue, 1, &commands);
+    wgpuCommandBufferRelease(commands);
+    wgpuCommandEncoderRelease(encoder);
+
+    replaceTexture(ctx, resident, texture, base);
+    residency.stats.evictions++;
+}
+
+/// @brief Upload the decoded levels from base down into a new texture
+static void load(GraphicsContext* ctx, ResidentTexture* resident, u32 base)
+{
+    ASSERT(base < resident->residentBase);
+    WGPUTexture texture = createTexture(ctx, resident, base);
+
+    for (u32 level = base; level < resident->levels; level++) {
+        const CPUMipLevel* src = decodedLevel(resident, level);
+
+        WGPUImageCopyTexture destination = {};
+        destination.texture              = texture;
+        destination.mipLevel             = level - base;
+        destination.aspect               = WGPUTextureAspect_All;
+        WGPUTextureDataLayout layout     = {};
+        layout.bytesPerRow               = 4 * src->width;
+        layout.rowsPerImage              = src->height;
+        WGPUExtent3D extent              = { src->width, src->height, 1 };
+        wgpuQueueWriteTexture(ctx->queue, &destination, src->pixels,
+                              src->bytes, &layout, &extent);
+    }
+
+    replaceTexture(ctx, resident, texture, base);
+    residency.stats.loads++;
+}
+
+static void freeResident(ResidentTexture* resident)
+{
+    CPUMipChain::release(&resident->chain);
+    BakedTexture::release(&resident->baked);
+    FREE_ARRAY(char, resident->filename, resident->filenameBytes);
+    FREE(ResidentTexture, resident);
+}
+
+static void removeResident(u32 index)
+{
+    ResidentTexture* resident = residency.textures[index];
+    HashMap::remove(&residency.lookup, textureKey(resident->texture));
+    freeResident(resident);
+
+    // order doesn't matter, fill the gap with the last one
+    residency.textures[index] = residency.textures[--residency.count];
+}
+
+static void onGPUMemoryOverBudget(u64 used, u64 budget, void* userdata)
+{
+    UNUSED_VAR(userdata);
+    residency.pressure = MAX(residency.pressure, used - budget);
+}
+
+void TextureResidency::init(u64 budget, MipFilter filter)
+{
+    if (!residency.initialized)
+        GPUMemory::addBudgetCallback(onGPUMemoryOverBudget, NULL);
+    residency.initialized = true;
+    residency.budget      = budget;
+    residency.filter      = filter;
+}
+
+void TextureResidency::setBudget(u64 bytes)
+{
+    if (!residency.initialized) TextureResidency::init();
+    residency.budget = bytes;
+}
+
+bool TextureResidency::manage(GraphicsContext* ctx, Texture* texture,
+                              const char* filename,
+                              TextureResidencyCallback callback,
+                              void* userdata)
+{
+    ASSERT(texture->texture == NULL);
+    if (!residency.initialized) TextureResidency::init();
+
+    i32 width = 0, height = 0, comps = 0;
+    if (!stbi_info(filename, &width, &height, &comps)) {
+        log_error("texture residency: couldn't read '%s': %s", filename,
+                  stbi_failure_reason());
+        return false;
+    }
+
+    ResidentTexture* resident = ALLOCATE_COUNT(ResidentTexture, 1);
+    resident->texture         = texture;
+    resident->filenameBytes   = (u32)strlen(filename) + 1;
+    resident->filename        = ALLOCATE_COUNT(char, resident->filenameBytes);
+    memcpy(resident->filename, filename, resident->filenameBytes);
+    resident->callback = callback;
+    resident->userdata = userdata;
+    resident->width    = width;
+    resident->height   = height;
+    resident->levels   = 1;
+    for (u32 size = MAX(width, height); size > 1; size >>= 1)
+        resident->levels++;
+    resident->minBase = 0;
+    while ((MAX(width, height) >> resident->minBase)
+           > TEXTURE_RESIDENCY_MIN_SIZE)
+        resident->minBase++;
+    resident->residentBase  = resident->levels - 1;
+    resident->wantedBase    = resident->minBase;
+    resident->frameWanted   = resident->minBase;
+    resident->lastUsedFrame = residency.frame;
+    resident->counter.pending.store(0);
+
+    // a grey 1x1 tail until the first load
+    texture->texture = createTexture(ctx, resident, resident->residentBase);
+    texture->view    = wgpuTextureCreateView(texture->texture, NULL);
+
+    texture->width           = 1;
+    texture->height          = 1;
+    texture->depth           = 1;
+    texture->mip_level_count = 1;
+    texture->format          = WGPUTextureFormat_RGBA8Unorm;
+    texture->dimension       = WGPUTextureDimension_2D;
+    texture->sampler         = Texture::defaultSampler(ctx);
+
+    u32 placeholder                  = TEXTURE_RESIDENCY_PLACEHOLDER;
+    WGPUImageCopyTexture destination = {};
+    destination.texture              = texture->texture;
+    destination.aspect               = WGPUTextureAspect_All;
+    WGPUTextureDataLayout layout     = {};
+    layout.bytesPerRow               = sizeof(placeholder);
+    layout.rowsPerImage              = 1;
+    WGPUExtent3D extent              = { 1, 1, 1 };
+    wgpuQueueWriteTexture(ctx->queue, &destination, &placeholder,
+                          sizeof(placeholder), &layout, &extent);
+
+    if (residency.count == residency.capacity) {
+        u32 capacity = residency.capacity < 16 ? 16 : residency.capacity * 2;
+        residency.textures
+          = (ResidentTexture**)reallocate(residency.textures,
+                                          sizeof(ResidentTexture*)
+                                            * residency.capacity,
+                                          sizeof(ResidentTexture*) * capacity);
+        residency.capacity = capacity;
+    }
+    residency.textures[residency.count++] = resident;
+    HashMap::put(&residency.lookup, textureKey(texture), resident);
+    return true;
+}
+
+void TextureResidency::unmanage(Texture* texture)
+{
+    for (u32 i = 0; i < residency.count; i++) {
+        ResidentTexture* resident = residency.textures[i];
+        if (resident->texture != texture) continue;
+
+        // the decode job writes into the record
+        JobSystem::wait(&resident->counter);
+        removeResident(i);
+        return;
+    }
+}
+
+void TextureResidency::request(const Texture* texture, f32 texels)
+{
+    ResidentTexture* resident
+      = (ResidentTexture*)HashMap::get(&residency.lookup, textureKey(texture));
+    if (resident == NULL) return;
+
+    // smallest level with at least texels
+    u32 size = MAX(resident->width, resident->height);
+    u32 base = 0;
+    while (base < resident->minBase && (f32)(size >> (base + 1)) >= texels)
+        base++;
+
+    resident->frameWanted   = MIN(resident->frameWanted, base);
+    resident->lastUsedFrame = residency.frame;
+}
+
+void TextureResidency::recordDrawList(const DrawList* list, Entity* camera,
+                                      u32 viewportHeight)
+{
+    if (residency.count == 0) return;
+
+    // pixels per world unit at distance 1
+    f32 pixelsPerUnit
+      = 0.5f * viewportHeight / tanf(0.5f * glm::radians(camera->fovDegrees));
+
+    for (u32 i = 0; i < list->count; i++) {
+        const DrawCall* call = &list->calls[i];
+        if (call->material == NULL || call->material->texture == NULL)
+            continue;
+
+        Entity* entity = call->entity;
+        f32 scale      = MAX(fabsf(entity->sca.x),
+                             MAX(fabsf(entity->sca.y), fabsf(entity->sca.z)));
+        f32 radius     = entity->boundingRadius * scale;
+
+        // distance to the sphere's nearest point, the whole texture when
+        // the camera is inside
+        f32 distance = glm::length(entity->pos - camera->pos) - radius;
+        f32 texels   = distance > camera->nearPlane
+                         ? 2.0f * radius * pixelsPerUnit / distance
+                         : FLT_MAX;
+        TextureResidency::request(call->material->texture, texels);
+    }
+}
+
+void TextureResidency::update(GraphicsContext* ctx)
+{
+    // finished decodes
+    u32 loading = 0;
+    for (u32 i = 0; i < residency.count; i++) {
+        ResidentTexture* resident = residency.textures[i];
+        if (!resident->loading) continue;
+        if (!JobCounter::done(&resident->counter)) {
+            loading++;
+            continue;
+        }
+
+        resident->loading = false;
+        if (resident->decodeFailed) {
+            // keeps what it has
+            log_error("texture residency: couldn't load '%s'",
+                      resident->filename);
+            resident->failed = true;
+        } else if (resident->targetBase < resident->residentBase) {
+            // the target is from the last update, still the best guess
+            load(ctx, resident, resident->targetBase);
+        }
+        CPUMipChain::release(&resident->chain);
+        BakedTexture::release(&resident->baked);
+    }
+
+    // targets from the last frame's feedback. Textures grow to what they
+    // asked for and keep anything beyond that until the budget needs it
+    u64 wanted = 0;
+    u64 total  = 0;
+    for (u32 i = 0; i < residency.count; i++) {
+        ResidentTexture* resident = residency.textures[i];
+        bool used = resident->lastUsedFrame == residency.frame;
+        if (used) resident->wantedBase = resident->frameWanted;
+        resident->frameWanted = resident->minBase;
+
+        if (resident->failed) {
+            resident->targetBase = resident->residentBase;
+        } else if (used) {
+            resident->targetBase
+              = MIN(resident->wantedBase, resident->residentBase);
+        } else {
+            resident->targetBase
+              = MIN(resident->residentBase, resident->minBase);
+        }
+        wanted += rangeBytes(resident, resident->wantedBase);
+        total += rangeBytes(resident, resident->targetBase);
+    }
+
+    // GPUMemory overshoot since the last update
+    u64 budget = residency.budget - MIN(residency.pressure, residency.budget);
+    residency.pressure = 0;
+
+    // drop top levels one at a time. Only runs over budget, fine for
+    // hundreds of textures
+    while (total > budget) {
+        ResidentTexture* victim = NULL;
+        for (u32 i = 0; i < residency.count; i++) {
+            ResidentTexture* resident = residency.textures[i];
+            if (resident->targetBase >= resident->minBase) continue;
+            if (victim == NULL || evictsBefore(resident, victim))
+                victim = resident;
+        }
+        if (victim == NULL) break; // the minimum levels alone don't fit
+
+        total -= targetLevelBytes(victim);
+        victim->targetBase++;
+    }
+
+    // apply: evictions right away, loads a few at a time
+    u64 residentBytes = 0;
+    for (u32 i = 0; i < residency.count; i++) {
+        ResidentTexture* resident = residency.textures[i];
+        if (resident->loading) {
+            // the target is checked again once the decode is done
+        } else if (resident->targetBase > resident->residentBase) {
+            evict(ctx, resident, resident->targetBase);
+        } else if (resident->targetBase < resident->residentBase
+                   && loading < TEXTURE_RESIDENCY_MAX_LOADS) {
+            // global, the same for every worker (see
+            // Texture::initFromFiles())
+            stbi_set_flip_vertically_on_load(true);
+            resident->loading      = true;
+            resident->decodeFailed = false;
+            JobSystem::submit(decodeResident, resident, 0, &resident->counter);
+            loading++;
+        }
+        residentBytes += rangeBytes(resident, resident->residentBase);
+    }
+
+    residency.stats.managed       = residency.count;
+    residency.stats.loading       = loading;
+    residency.stats.residentBytes = residentBytes;
+    residency.stats.wantedBytes   = wanted;
+    residency.stats.budget        = budget;
+    residency.frame++;
+}
+
+TextureResidencyStats TextureResidency::stats()
+{
+    return residency.stats;
+}
+
+void TextureResidency::release()
+{
+    while (residency.count > 0) {
+        JobSystem::wait(&residency.textures[0]->counter);
+        removeResident(0);
+    }
+    FREE_ARRAY(ResidentTexture*, residency.textures, residency.capacity);
+    HashMap::free(&residency.lookup);
+    if (residency.initialized)
+        GPUMemory::removeBudgetCallback(onGPUMemoryOverBudget, NULL);
+    residency = {};
+}
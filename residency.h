@@ -0,0 +1,103 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+#include "cpu_mips.h"
+
+struct DrawList;
+struct Entity;
+
+// ============================================================================
+// Texture Residency
+// ============================================================================
+
+// Keeps only the mip levels textures need on the GPU, within a byte budget,
+// for scenes with more texture data than fits in VRAM. A managed texture
+// always holds a contiguous tail of its full mip chain: the GPU texture is
+// recreated at the size of its largest resident level whenever that
+// changes.
+//
+// How much a texture needs comes from usage feedback: recordDrawList()
+// estimates the screen footprint of every draw from its entity's bounding
+// sphere, and the texture of its material gets the smallest level that
+// still has a texel per pixel (assuming the texture spans the object once;
+// call request() directly for anything else). Textures grow to the levels
+// they asked for and keep what they have beyond that while it fits.
+//
+// update(), called by the runner every frame before rendering, fits them
+// into the budget by dropping top levels one at a time: levels nobody asked
+// for last frame first, then the least recently used texture's, the largest
+// among equally recent ones. Never below TEXTURE_RESIDENCY_MIN_SIZE. Then it
+// applies the changes:
+//
+// - eviction copies the kept levels into a smaller texture on the GPU
+// - loading decodes the file and builds its mip chain on a job system
+//   worker (CPUMipChain), or maps its bake (TextureBakeCache), then uploads
+//   the wanted levels into a larger texture once that is done, a few loads
+//   at a time
+//
+// Either way the new texture and view replace the old ones between frames,
+// the owner's callback runs to rebuild bind groups (e.g.
+// Material::setTexture()) and the old ones are released once frames in
+// flight are done with them. When GPUMemory goes over its budget the next
+// update() shrinks the residency budget by the overshoot.
+//
+// Process wide like the job system, main thread only. Texture::release()
+// unmanages a texture. RGBA8 images via stb_image only.
+
+#define TEXTURE_RESIDENCY_DEFAULT_BUDGET (512ull << 20)
+#define TEXTURE_RESIDENCY_MIN_SIZE 64 // texels, these levels are never evicted
+#define TEXTURE_RESIDENCY_MAX_LOADS 2 // decodes in flight, a 4K one is ~150 MB
+#define TEXTURE_RESIDENCY_PLACEHOLDER 0xFF808080u // RGBA8, little endian
+
+/// @brief The texture and its view were replaced
+typedef void (*TextureResidencyCallback)(GraphicsContext* ctx,
+                                         Texture* texture, void* userdata);
+
+struct TextureResidencyStats {
+    u32 managed;
+    u32 loading;
+    u64 residentBytes; // of managed textures
+    u64 wantedBytes;   // what the last feedback asked for
+    u64 budget;        // after GPUMemory pressure
+    u32 evictions;     // since init
+    u32 loads;         // since init
+};
+
+struct TextureResidency {
+    /// @brief Optional, the first manage() initializes with the defaults
+    static void init(u64 budget = TEXTURE_RESIDENCY_DEFAULT_BUDGET,
+                     MipFilter filter = MIP_FILTER_BOX);
+    static void setBudget(u64 bytes);
+
+    /// @brief Create texture as a 1x1 placeholder and load filename's levels
+    /// down from TEXTURE_RESIDENCY_MIN_SIZE in the background. callback (may
+    /// be NULL) runs from update() whenever the texture is replaced. False
+    /// if the file can't be read (logged), texture is left zeroed
+    static bool manage(GraphicsContext* ctx, Texture* texture,
+                       const char* filename, TextureResidencyCallback callback,
+                       void* userdata);
+
+    /// @brief Stop managing texture, waiting for its decode if running. It
+    /// keeps its current levels. No-op for textures that aren't managed
+    static void unmanage(Texture* texture);
+
+    /// @brief Usage feedback: texture is drawn this frame needing texels
+    /// along its larger axis. No-op for textures that aren't managed
+    static void request(const Texture* texture, f32 texels);
+
+    /// @brief request() for the texture of every draw's material, sized by
+    /// the projected bounding sphere of its entity (see
+    /// Entity::boundingRadius), seen from camera over viewportHeight pixels
+    static void recordDrawList(const DrawList* list, Entity* camera,
+                               u32 viewportHeight);
+
+    /// @brief Collect decodes, fit the budget, replace textures. Called by
+    /// the runner once per frame, before rendering
+    static void update(GraphicsContext* ctx);
+
+    static TextureResidencyStats stats();
+
+    /// @brief Unmanages all textures
+    static void release();
+};
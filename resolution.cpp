@@ -0,0 +1,259 @@
+#include <math.h>
+
+#include "cache.h"
+#include "core/log.h"
+#include "deletion.h"
+#include "gpu_memory.h"
+#include "resolution.h"
+#include "shaders.h"
+
+// ============================================================================
+// Dynamic Resolution
+// ============================================================================
+
+static void createTarget(GraphicsContext* ctx, DynamicResolution* dr)
+{
+    // frames in flight may still sample the old one
+    BindingCache::release(dr->upscaleBindGroup);
+    BindingCache::purge(dr->targetView);
+    DeletionQueue::defer(dr->targetView);
+    DeletionQueue::defer(dr->target);
+
+    dr->targetWidth  = ctx->width;
+    dr->targetHeight = ctx->height;
+
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.label                 = "dynamic resolution target";
+    textureDesc.usage
+      = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding;
+    textureDesc.dimension     = WGPUTextureDimension_2D;
+    textureDesc.size          = { dr->targetWidth, dr->targetHeight, 1 };
+    textureDesc.format        = ctx->swapChainFormat;
+    textureDesc.mipLevelCount = 1;
+    textureDesc.sampleCount   = 1;
+    dr->target = wgpuDeviceCreateTexture(ctx->device, &textureDesc);
+    ASSERT(dr->target != NULL);
+    GPUMemory::track(dr->target, GPU_MEMORY_RENDER_TARGET,
+                     GPUMemory::textureBytes(textureDesc.format,
+                                             dr->targetWidth,
+                                             dr->targetHeight, 1, 1),
+                     textureDesc.label);
+
+    dr->targetView = wgpuTextureCreateView(dr->target, NULL);
+    ASSERT(dr->targetView != NULL);
+
+    WGPUBindGroupEntry entries[3] = {};
+    entries[0].binding            = 0;
+    entries[0].sampler            = dr->sampler;
+    entries[1].binding            = 1;
+    entries[1].textureView        = dr->targetView;
+    entries[2].binding            = 2;
+    entries[2].buffer             = dr->upscaleUniformBuffer;
+    entries[2].size               = sizeof(UpscaleUniforms);
+
+    WGPUBindGroupDescriptor desc = {};
+    desc.label                   = "dynamic resolution upscale";
+    desc.layout                  = dr->upscaleLayout;
+    desc.entries                 = entries;
+    desc.entryCount              = ARRAY_LENGTH(entries);
+    dr->upscaleBindGroup = BindingCache::getBindGroup(ctx, &desc);
+}
+
+static void createUpscalePipeline(GraphicsContext* ctx, DynamicResolution* dr)
+{
+    WGPUBindGroupLayoutEntry entries[3] = {};
+
+    entries[0].binding      = 0;
+    entries[0].visibility   = WGPUShaderStage_Fragment;
+    entries[0].sampler.type = WGPUSamplerBindingType_Filtering;
+
+    entries[1].binding               = 1;
+    entries[1].visibility            = WGPUShaderStage_Fragment;
+    entries[1].texture.sampleType    = WGPUTextureSampleType_Float;
+    entries[1].texture.viewDimension = WGPUTextureViewDimension_2D;
+
+    entries[2].binding    = 2;
+    entries[2].visibility = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
+    entries[2].buffer.type           = WGPUBufferBindingType_Uniform;
+    entries[2].buffer.minBindingSize = sizeof(UpscaleUniforms);
+
+    WGPUBindGroupLayoutDescriptor layoutDesc = {};
+    layoutDesc.label                         = "dynamic resolution upscale";
+    layoutDesc.entryCount                    = ARRAY_LENGTH(entries);
+    layoutDesc.entries                       = entries;
+    dr->upscaleLayout = PipelineCache::getBindGroupLayout(ctx, &layoutDesc);
+
+    WGPUPipelineLayoutDescriptor pipelineLayoutDesc = {};
+    pipelineLayoutDesc.label                = "dynamic resolution upscale";
+    pipelineLayoutDesc.bindGroupLayoutCount = 1;
+    pipelineLayoutDesc.bindGroupLayouts     = &dr->upscaleLayout;
+    WGPUPipelineLayout pipelineLayout
+      = PipelineCache::getPipelineLayout(ctx, &pipelineLayoutDesc);
+
+    WGPUShaderModule shaderModule
+      = PipelineCache::getShaderModule(ctx, upscaleShader, "upscale shader");
+
+    WGPUColorTargetState colorTarget = {};
+    colorTarget.format               = ctx->swapChainFormat;
+    colorTarget.writeMask            = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragmentState = {};
+    fragmentState.module            = shaderModule;
+    fragmentState.entryPoint        = FS_ENTRY_POINT;
+    fragmentState.targetCount       = 1;
+    fragmentState.targets           = &colorTarget;
+
+    WGPURenderPipelineDescriptor desc = {};
+    desc.label                        = "dynamic resolution upscale";
+    desc.layout                       = pipelineLayout;
+    desc.vertex.module                = shaderModule;
+    desc.vertex.entryPoint            = VS_ENTRY_POINT;
+    desc.primitive.topology           = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.cullMode           = WGPUCullMode_None;
+    desc.multisample.count            = 1;
+    desc.multisample.mask             = 0xFFFFFFFF;
+    desc.fragment                     = &fragmentState;
+    dr->upscalePipeline = PipelineCache::getRenderPipeline(ctx, &desc);
+    ASSERT(dr->upscalePipeline != NULL);
+
+    wgpuShaderModuleRelease(shaderModule);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+}
+
+void DynamicResolution::init(GraphicsContext* ctx, DynamicResolution* dr,
+                             f32 targetFrameSeconds, f32 minScale,
+                             f32 maxScale)
+{
+    ASSERT(targetFrameSeconds > 0.0f);
+    ASSERT(minScale > 0.0f && minScale <= maxScale && maxScale <= 1.0f);
+
+    *dr                      = {};
+    dr->enabled              = true;
+    dr->minScale             = minScale;
+    dr->maxScale             = maxScale;
+    dr->targetFrameSeconds   = targetFrameSeconds;
+    dr->scale                = maxScale;
+    dr->smoothedFrameSeconds = targetFrameSeconds;
+
+    WGPUSamplerDescriptor samplerDesc = {};
+    samplerDesc.label                 = "upscale sampler";
+    samplerDesc.addressModeU          = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeV          = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeW          = WGPUAddressMode_ClampToEdge;
+    samplerDesc.minFilter             = WGPUFilterMode_Linear;
+    samplerDesc.magFilter             = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter          = WGPUMipmapFilterMode_Nearest;
+    samplerDesc.lodMinClamp           = 0.0f;
+    samplerDesc.lodMaxClamp           = 1.0f;
+    samplerDesc.maxAnisotropy         = 1;
+    dr->sampler = BindingCache::getSampler(ctx, &samplerDesc);
+
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.label                = "upscale uniforms";
+    bufferDesc.size                 = sizeof(UpscaleUniforms);
+    bufferDesc.usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst;
+    dr->upscaleUniformBuffer = wgpuDeviceCreateBuffer(ctx->device, &bufferDesc);
+    GPUMemory::track(dr->upscaleUniformBuffer, GPU_MEMORY_UNIFORM,
+                     bufferDesc.size, bufferDesc.label);
+
+    createUpscalePipeline(ctx, dr);
+    createTarget(ctx, dr);
+}
+
+void DynamicResolution::update(DynamicResolution* dr, f32 frameSeconds)
+{
+    if (frameSeconds <= 0.0f) return;
+
+    // a single hitch (loading, window drag) should not halve the resolution
+    dr->smoothedFrameSeconds
+      += DYNAMIC_RESOLUTION_SMOOTHING
+         * (frameSeconds - dr->smoothedFrameSeconds);
+
+    f32 budget   = dr->targetFrameSeconds;
+    f32 smoothed = dr->smoothedFrameSeconds;
+    // GPU time roughly follows pixel count, i.e. scale squared
+    f32 ideal = dr->scale * sqrtf(budget / smoothed);
+
+    if (smoothed > budget * (1.0f + DYNAMIC_RESOLUTION_TOLERANCE)) {
+        dr->scale = MAX(ideal, dr->scale - DYNAMIC_RESOLUTION_MAX_DOWN_STEP);
+        dr->cooldown = DYNAMIC_RESOLUTION_COOLDOWN_FRAMES;
+    } else if (smoothed < budget * (1.0f - DYNAMIC_RESOLUTION_TOLERANCE)) {
+        dr->scale = MIN(ideal, dr->scale + DYNAMIC_RESOLUTION_MAX_UP_STEP);
+    } else if (dr->cooldown > 0) {
+        dr->cooldown--;
+    } else {
+        // with vsync frame time sticks to the refresh interval whatever the
+        // headroom, so creep upwards until it no longer does
+        dr->scale += DYNAMIC_RESOLUTION_PROBE_STEP;
+    }
+
+    dr->scale = CLAMP(dr->scale, dr->minScale, dr->maxScale);
+}
+
+void DynamicResolution::beginScene(GraphicsContext* ctx, DynamicResolution* dr)
+{
+    if (!dr->enabled) return;
+
+    if (dr->targetWidth != ctx->width || dr->targetHeight != ctx->height)
+        createTarget(ctx, dr);
+
+    ctx->renderWidth  = MAX(1u, (u32)(dr->targetWidth * dr->scale + 0.5f));
+    ctx->renderHeight = MAX(1u, (u32)(dr->targetHeight * dr->scale + 0.5f));
+    ctx->colorAttachment.view = dr->targetView;
+}
+
+WGPURenderPassEncoder DynamicResolution::endScene(GraphicsContext* ctx,
+                                                  DynamicResolution* dr)
+{
+    if (!dr->enabled) return ctx->renderPassEncoder;
+
+    wgpuRenderPassEncoderEnd(ctx->renderPassEncoder);
+    wgpuRenderPassEncoderRelease(ctx->renderPassEncoder);
+
+    // only the rendered corner, and never bilinear taps across its edge
+    f32 width                = (f32)dr->targetWidth;
+    f32 height               = (f32)dr->targetHeight;
+    UpscaleUniforms uniforms = {};
+    uniforms.uvScale
+      = glm::vec2(ctx->renderWidth / width, ctx->renderHeight / height);
+    uniforms.uvMax = glm::vec2((ctx->renderWidth - 0.5f) / width,
+                               (ctx->renderHeight - 0.5f) / height);
+    GraphicsContext::writeBuffer(ctx, dr->upscaleUniformBuffer, 0, &uniforms,
+                                 sizeof(uniforms));
+
+    WGPURenderPassColorAttachment colorAttachment = ctx->colorAttachment;
+    colorAttachment.view                          = ctx->backbufferView;
+    colorAttachment.loadOp                        = WGPULoadOp_Clear;
+
+    WGPURenderPassDescriptor passDesc = {};
+    passDesc.label                    = "dynamic resolution upscale";
+    passDesc.colorAttachmentCount     = 1;
+    passDesc.colorAttachments         = &colorAttachment;
+
+    WGPURenderPassEncoder pass
+      = wgpuCommandEncoderBeginRenderPass(ctx->commandEncoder, &passDesc);
+    wgpuRenderPassEncoderSetPipeline(pass, dr->upscalePipeline);
+    wgpuRenderPassEncoderSetBindGroup(pass, 0, dr->upscaleBindGroup, 0, NULL);
+    wgpuRenderPassEncoderDraw(pass, 3, 1, 0, 0);
+
+    // UI and presentFrame() continue at full resolution
+    ctx->colorAttachment.view = ctx->backbufferView;
+    ctx->renderWidth          = ctx->width;
+    ctx->renderHeight         = ctx->height;
+    ctx->renderPassEncoder    = pass;
+    return pass;
+}
+
+void DynamicResolution::release(DynamicResolution* dr)
+{
+    BindingCache::release(dr->upscaleBindGroup);
+    BindingCache::release(dr->sampler);
+    BindingCache::purge(dr->targetView);
+    DeletionQueue::defer(dr->targetView);
+    DeletionQueue::defer(dr->target);
+    DeletionQueue::defer(dr->upscaleUniformBuffer);
+    WGPU_RELEASE_RESOURCE(RenderPipeline, dr->upscalePipeline);
+    WGPU_RELEASE_RESOURCE(BindGroupLayout, dr->upscaleLayout);
+
+    *dr = {};
+}
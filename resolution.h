@@ -0,0 +1,91 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+
+// ============================================================================
+// Dynamic Resolution
+// ============================================================================
+
+// Renders the scene into an offscreen color target at a fraction of the
+// window size, then upscales it to the swap chain with a bilinear blit, so
+// GPU bound frames can hold a frame rate target by trading resolution.
+//
+// The target is allocated once at full window size (like the depth
+// texture) and the scene is drawn into its top left renderWidth x
+// renderHeight corner through the viewport, so changing the scale never
+// reallocates. GraphicsContext::renderWidth/renderHeight carry the current
+// size to everything that depends on it (render pass viewports, the depth
+// pre-pass, clustered lighting).
+//
+// The controller follows frame time: scale (per axis) drops quickly when
+// frames run over budget, recovers gradually when they run under, and
+// slowly probes upwards when on target. Frame time is supplied by the
+// caller; with Fifo presentation it is quantized to the refresh interval,
+// which the probing compensates for.
+//
+// Usage, every frame:
+//   DynamicResolution::update(&dr, frameSeconds);
+//   GraphicsContext::beginFrame(ctx);
+//   DynamicResolution::beginScene(ctx, &dr);
+//   (depth pre-pass, lighting, ...)
+//   pass = GraphicsContext::beginRenderPass(ctx);
+//   (draw the scene)
+//   pass = DynamicResolution::endScene(ctx, &dr); // now on the swap chain
+//   (draw UI at full resolution)
+//   GraphicsContext::presentFrame(ctx);
+
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+#define DYNAMIC_RESOLUTION_MAX_SCALE 1.0f
+// frame time smoothing, weight of the newest frame
+#define DYNAMIC_RESOLUTION_SMOOTHING 0.1f
+// +- band around the target that counts as on target
+#define DYNAMIC_RESOLUTION_TOLERANCE 0.05f
+#define DYNAMIC_RESOLUTION_MAX_DOWN_STEP 0.1f // per frame
+#define DYNAMIC_RESOLUTION_MAX_UP_STEP 0.02f
+#define DYNAMIC_RESOLUTION_PROBE_STEP 0.002f
+// no probing for this many frames after dropping
+#define DYNAMIC_RESOLUTION_COOLDOWN_FRAMES 60
+
+struct DynamicResolution {
+    bool enabled;
+
+    // controller
+    f32 minScale; // bounds, per axis. maxScale <= 1
+    f32 maxScale;
+    f32 targetFrameSeconds;
+    f32 scale;
+    f32 smoothedFrameSeconds;
+    u32 cooldown;
+
+    // full window size target
+    WGPUTexture target;
+    WGPUTextureView targetView;
+    u32 targetWidth;
+    u32 targetHeight;
+
+    WGPURenderPipeline upscalePipeline;
+    WGPUBindGroupLayout upscaleLayout;
+    WGPUBuffer upscaleUniformBuffer;
+    WGPUSampler sampler; // borrowed from the BindingCache
+    WGPUBindGroup upscaleBindGroup;
+
+    static void init(GraphicsContext* ctx, DynamicResolution* dr,
+                     f32 targetFrameSeconds,
+                     f32 minScale = DYNAMIC_RESOLUTION_MIN_SCALE,
+                     f32 maxScale = DYNAMIC_RESOLUTION_MAX_SCALE);
+
+    /// @brief Feed the last frame's duration and adjust the scale
+    static void update(DynamicResolution* dr, f32 frameSeconds);
+
+    /// @brief Redirect this frame's scene rendering to the scaled target.
+    /// Call after GraphicsContext::beginFrame(). No-op when disabled
+    static void beginScene(GraphicsContext* ctx, DynamicResolution* dr);
+
+    /// @brief End the scene pass and upscale to the swap chain.
+    /// @return the swap chain pass, ended by GraphicsContext::presentFrame()
+    static WGPURenderPassEncoder endScene(GraphicsContext* ctx,
+                                          DynamicResolution* dr);
+
+    static void release(DynamicResolution* dr);
+};
@@ -1,4 +1,5 @@
 // stdlib includes
+#include <cstring>
 
 // vendor includes
 #include <GLFW/glfw3.h>
@@ -13,8 +14,14 @@
 // project includes
 #include "common.h"
 #include "core/log.h"
+#include "jobs.h"
+#include "latency.h"
 #include "memory.h"
+#include "residency.h"
 #include "runner.h"
+#include "streaming.h"
+#include "texture_bake.h"
+#include "wgsl.h"
 
 // ============================================================================
 // Window
@@ -110,14 +117,32 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action,
 
 void Example_Basic(ExampleCallbacks* callbacks);
 void Example_Obj(ExampleCallbacks* callbacks);
+void Example_Draws(ExampleCallbacks* callbacks);
+void Example_Culling(ExampleCallbacks* callbacks);
+void Example_ShaderBench(ExampleCallbacks* callbacks);
+void Example_Lights(ExampleCallbacks* callbacks);
+void Example_MipBench(ExampleCallbacks* callbacks);
+void Example_BCBench(ExampleCallbacks* callbacks);
+void Example_TexturePacking(ExampleCallbacks* callbacks);
+void Example_Residency(ExampleCallbacks* callbacks);
 
 struct ExampleIndex {
     ExampleEntryPoint entryPoint;
     const char* name;
 };
 
-static ExampleIndex examples[]
-  = { { Example_Basic, "Basic" }, { Example_Obj, "Obj Loader" } };
+static ExampleIndex examples[] = {
+    { Example_Basic, "Basic" },
+    { Example_Obj, "Obj Loader" },
+    { Example_Draws, "Draws" },
+    { Example_Culling, "GPU Culling" },
+    { Example_ShaderBench, "Shader Bench" },
+    { Example_Lights, "Clustered Lights" },
+    { Example_MipBench, "Mip Bench" },
+    { Example_BCBench, "BC Bench" },
+    { Example_TexturePacking, "Texture Packing" },
+    { Example_Residency, "Texture Residency" },
+};
 
 // ============================================================================
 // Example Runner
@@ -152,6 +177,11 @@ bool ExampleRunner::init(ExampleRunner* runner)
         }
     }
 
+    // worker threads for parallel recording, decoding, etc.
+    JobSystem::init(0);
+    // decoded images and their mips, reused across launches
+    TextureBakeCache::init();
+
     { // init graphics context
         if (!GraphicsContext::init(&runner->gctx, runner->window)) {
             log_fatal("Failed to initialize graphics context\n");
@@ -178,8 +208,15 @@ static void mainLoop(ExampleRunner* runner)
     bool render = runner->callbacks.onRender != NULL;
 
     // handle input -------------------
+    // after the frame limiter's wait, so it is as fresh as possible
+    LowLatency::beginFrame();
     glfwPollEvents();
 
+    // finish async work (pipeline compiles, ...) -----
+    GraphicsContext::poll(&runner->gctx);
+    TextureStreaming::update(&runner->gctx);
+    TextureResidency::update(&runner->gctx);
+
     // update --------------------------------
     if (update) runner->callbacks.onUpdate(1.0f / 60.0f);
 
@@ -191,10 +228,20 @@ static void mainLoop(ExampleRunner* runner)
     showFPS(runner->window);
 }
 
-void ExampleRunner::run(ExampleRunner* runner)
+void ExampleRunner::run(ExampleRunner* runner, const char* exampleName)
 {
-    // always run basic for now
+    // default to the obj loader
     ExampleEntryPoint entryPoint = examples[1].entryPoint;
+    if (exampleName) {
+        bool found = false;
+        for (u32 i = 0; i < ARRAY_LENGTH(examples); i++) {
+            if (strcmp(examples[i].name, exampleName) == 0) {
+                entryPoint = examples[i].entryPoint;
+                found      = true;
+            }
+        }
+        if (!found) log_warn("unknown example '%s'", exampleName);
+    }
     entryPoint(&runner->callbacks); // populate callbacks
 
     GraphicsContext* gctx       = &runner->gctx;
@@ -235,7 +282,16 @@ void ExampleRunner::release(ExampleRunner* runner)
     glfwDestroyWindow(runner->window);
     glfwTerminate();
 
+    // before the job system, decodes may still be running
+    TextureStreaming::release();
+    TextureResidency::release();
     GraphicsContext::release(&runner->gctx);
 
+    TextureBakeCache::logStats();
+    TextureBakeCache::release();
+
+    JobSystem::release();
+    ShaderPreprocessor::release();
+
     *runner = {};
 }
@@ -17,8 +17,8 @@ struct ExampleRunner {
     /// @brief Initialize the example runner
     static bool init(ExampleRunner* runner);
 
-    /// @brief Run the example
-    static void run(ExampleRunner* runner);
+    /// @brief Run the example with the given name (NULL for the default)
+    static void run(ExampleRunner* runner, const char* exampleName);
 
     /// @brief resets the example runner, does NOT free the runner struct
     static void release(ExampleRunner* runner);
@@ -7,6 +7,7 @@
 #define PER_FRAME_GROUP 0
 #define PER_MATERIAL_GROUP 1
 #define PER_DRAW_GROUP 2
+#define LIGHTING_GROUP 3 // CLUSTERED_LIGHTING permutations only
 
 #define VS_ENTRY_POINT "vs_main"
 #define FS_ENTRY_POINT "fs_main"
@@ -24,101 +25,384 @@ struct FrameUniforms {
 
 struct MaterialUniforms {
     glm::vec4 color; // at byte offset 0
+    // at byte offset 16: uv = uv * zw + xy, a TextureAtlas rect
+    glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    u32 textureLayer; // at byte offset 32, SHADER_PERMUTATION_TEXTURE_ARRAY
+    u32 _pad[3];
 };
 struct DrawUniforms {
     glm::mat4x4 modelMat; // at byte offset 0
 };
 
-// clang-format off
+// GPU culling -----------------------------------------------------------------
+
+#define CS_ENTRY_POINT "cs_main"
+#define CULL_WORKGROUP_SIZE 64
+// 8x8 threads, each writing 2x2 texels of the first mip level. The compute
+// mip shader's shared memory indexing assumes 8
+#define MIP_COMPUTE_WORKGROUP_SIZE 8
+#define MIP_COMPUTE_TILE_SIZE (MIP_COMPUTE_WORKGROUP_SIZE * 2)
+
+// one per instance, uploaded once (storage buffer)
+struct InstanceData {
+    glm::mat4x4 modelMat;     // at byte offset 0
+    glm::vec4 boundingSphere; // at byte offset 64 (world center, radius)
+    u32 batch;                // at byte offset 80
+    u32 visibleBase;          // at byte offset 84 (batch's visible list)
+    u32 _pad[2];
+};
 
-static const char* shaderCode = CODE(
-    struct FrameUniforms {
-        projectionMat: mat4x4f,
-        viewMat: mat4x4f,
-        projViewMat: mat4x4f,
+struct CullUniforms {
+    glm::vec4 frustumPlanes[6]; // at byte offset 0
+    u32 instanceCount;          // at byte offset 96
+    u32 _pad[3];
+};
 
-        // lighting
-        dirLight: vec3f,
+// Clustered lighting ----------------------------------------------------------
 
-        time: f32,
-    };
+// view frustum split into screen tiles x exponential depth slices
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
 
-    @group(PER_FRAME_GROUP) @binding(0) var<uniform> u_Frame: FrameUniforms;
+// storage buffer, one per light
+struct PointLight {
+    glm::vec3 position; // at byte offset 0 (world)
+    f32 radius;         // at byte offset 12 (no contribution beyond)
+    glm::vec3 color;    // at byte offset 16
+    f32 intensity;      // at byte offset 28
+};
 
-    struct MaterialUniforms {
-        color: vec4f,
-    };
+struct ClusterUniforms {
+    glm::uvec4 gridSize;  // at byte offset 0 (x, y, z, light count)
+    glm::vec2 screenSize; // at byte offset 16 (pixels)
+    f32 sliceScale;       // at byte offset 24
+    f32 sliceBias;        // at byte offset 28 (slice = log(z) * scale + bias)
+};
 
-    @group(PER_MATERIAL_GROUP) @binding(0) var<uniform> u_Material: MaterialUniforms;
-    @group(PER_MATERIAL_GROUP) @binding(1) var u_Texture: texture_2d<f32>;
-    @group(PER_MATERIAL_GROUP) @binding(2) var u_Sampler: sampler;
+// storage buffer, one per cluster: range of the light index list
+struct ClusterLightRange {
+    u32 offset;
+    u32 count;
+};
 
+// Dynamic resolution ----------------------------------------------------------
 
-    struct DrawUniforms {
-        modelMat: mat4x4f,
-    };
+struct UpscaleUniforms {
+    glm::vec2 uvScale; // at byte offset 0
+    glm::vec2 uvMax;   // at byte offset 8
+};
 
-    @group(PER_DRAW_GROUP) @binding(0) var<uniform> u_Draw: DrawUniforms;
+// layout fixed by WebGPU drawIndexedIndirect
+struct DrawIndexedIndirectArgs {
+    u32 indexCount;
+    u32 instanceCount;
+    u32 firstIndex;
+    i32 baseVertex;
+    u32 firstInstance;
+};
 
-    struct VertexInput {
-        @location(0) position : vec3f,
-        @location(1) normal : vec3f,
-        @location(2) uv : vec2f,
-    };
+// clang-format off
 
-    /**
-     * A structure with fields labeled with builtins and locations can also be used
-     * as *output* of the vertex shader, which is also the input of the fragment
-     * shader.
-     */
-    struct VertexOutput {
-        @builtin(position) position : vec4f,
-        // The location here does not refer to a vertex attribute, it
-        // just means that this field must be handled by the
-        // rasterizer. (It can also refer to another field of another
-        // struct that would be used as input to the fragment shader.)
-        @location(0) v_worldPos : vec3f,
-        @location(1) v_normal : vec3f,
-        @location(2) v_uv : vec2f
-    };
+// Shared snippets, pulled in with #include "name" (see wgsl.h). Raw strings
+// rather than CODE(...) so they can carry preprocessor directives.
 
-    @vertex fn vs_main(in : VertexInput) -> VertexOutput
-    {
-        var out : VertexOutput;
+static const char* frameShaderInclude = R"(
+struct FrameUniforms {
+    projectionMat: mat4x4f,
+    viewMat: mat4x4f,
+    projViewMat: mat4x4f,
 
-        var worldPos : vec4f = u_Frame.projViewMat * u_Draw.modelMat * vec4f(in.position, 1.0f);
-        out.v_worldPos = worldPos.xyz;
-        out.v_normal = (u_Draw.modelMat * vec4f(in.normal, 0.0)).xyz;
-        out.v_uv     = in.uv;
+    // lighting
+    dirLight: vec3f,
+
+    time: f32,
+};
 
-        // debug clamp z to range [0, 1]
-        // worldPos.z = worldPos.z * 0.5 + 0.5;
+@group(PER_FRAME_GROUP) @binding(0) var<uniform> u_Frame: FrameUniforms;
+)";
 
-        out.position = worldPos;
-        // out.position = vec4f(in.position, 0.5 + 0.5 * sin(u_Frame.time));
-        return out;
+// the layout always has the texture and sampler bindings, NO_TEXTURE
+// permutations just don't declare them. TEXTURE_ARRAY ones bind a
+// texture_2d_array and pick the material's layer
+static const char* materialShaderInclude = R"(
+struct MaterialUniforms {
+    color: vec4f,
+    uvRect: vec4f,
+    textureLayer: u32,
+};
+
+@group(PER_MATERIAL_GROUP) @binding(0) var<uniform> u_Material: MaterialUniforms;
+#ifndef NO_TEXTURE
+#ifdef TEXTURE_ARRAY
+@group(PER_MATERIAL_GROUP) @binding(1) var u_Texture: texture_2d_array<f32>;
+#else
+@group(PER_MATERIAL_GROUP) @binding(1) var u_Texture: texture_2d<f32>;
+#endif
+@group(PER_MATERIAL_GROUP) @binding(2) var u_Sampler: sampler;
+
+// atlas rects don't repeat, uvs are expected in [0, 1]
+fn materialTexture(uv : vec2f) -> vec4f
+{
+    let rectUV = uv * u_Material.uvRect.zw + u_Material.uvRect.xy;
+#ifdef TEXTURE_ARRAY
+    return textureSample(u_Texture, u_Sampler, rectUV,
+                         u_Material.textureLayer);
+#else
+    return textureSample(u_Texture, u_Sampler, rectUV);
+#endif
+}
+#endif
+)";
+
+// point lights binned into view space clusters on the CPU, see
+// ClusteredLighting. Each fragment only loops over its cluster's lights
+static const char* lightingShaderInclude = R"(
+struct PointLight {
+    position: vec3f,
+    radius: f32,
+    color: vec3f,
+    intensity: f32,
+};
+
+struct ClusterUniforms {
+    gridSize: vec4u,
+    screenSize: vec2f,
+    sliceScale: f32,
+    sliceBias: f32,
+};
+
+@group(LIGHTING_GROUP) @binding(0) var<uniform> u_Clusters: ClusterUniforms;
+@group(LIGHTING_GROUP) @binding(1) var<storage, read> lights: array<PointLight>;
+// (offset, count) into lightIndices
+@group(LIGHTING_GROUP) @binding(2) var<storage, read> clusters: array<vec2u>;
+@group(LIGHTING_GROUP) @binding(3) var<storage, read> lightIndices: array<u32>;
+
+fn clusterIndex(fragCoord : vec4f, viewDepth : f32) -> u32
+{
+    let grid = u_Clusters.gridSize;
+    let tileMax = vec2f(grid.xy) - 1.0;
+    let tileCoord = fragCoord.xy / u_Clusters.screenSize * vec2f(grid.xy);
+    let tile = vec2u(clamp(tileCoord, vec2f(0.0), tileMax));
+    // exponential depth slices
+    let depth = log(max(viewDepth, 1e-4));
+    let slice = depth * u_Clusters.sliceScale + u_Clusters.sliceBias;
+    let z = u32(clamp(slice, 0.0, f32(grid.z - 1u)));
+    return tile.x + grid.x * (tile.y + grid.y * z);
+}
+
+// diffuse from the point lights overlapping the fragment's cluster
+fn pointLighting(fragCoord : vec4f, worldPos : vec3f, normal : vec3f) -> vec3f
+{
+    let viewDepth = -(u_Frame.viewMat * vec4f(worldPos, 1.0)).z;
+    let cluster = clusters[clusterIndex(fragCoord, viewDepth)];
+
+    var result = vec3f(0.0);
+    for (var i = 0u; i < cluster.y; i++) {
+        let light = lights[lightIndices[cluster.x + i]];
+        let toLight = light.position - worldPos;
+        let dist = length(toLight);
+        // fades out to 0 at the radius
+        let falloff = clamp(1.0 - dist / light.radius, 0.0, 1.0);
+        let lambert = max(dot(normal, toLight / max(dist, 1e-4)), 0.0);
+        result += light.color * (light.intensity * lambert * falloff * falloff);
+    }
+    return result;
+}
+)";
+
+static const char* vertexShaderInclude = R"(
+struct VertexInput {
+    @location(0) position : vec3f,
+    @location(1) normal : vec3f,
+    @location(2) uv : vec2f,
+    @builtin(instance_index) instanceIndex : u32,
+};
+
+// output of the vertex shader, input of the fragment shader. position is
+// invariant so the depth pre-pass computes bit-identical depths
+struct VertexOutput {
+    @builtin(position) @invariant position : vec4f,
+    @location(0) v_worldPos : vec3f,
+    @location(1) v_normal : vec3f,
+    @location(2) v_uv : vec2f
+};
+)";
+
+// Material color, optionally textured, alpha tested and lit by the
+// directional light. Permutations strip whatever they don't need.
+static const char* shadingShaderInclude = R"(
+#include "frame.wgsl"
+#include "material.wgsl"
+#include "vertex.wgsl"
+#ifdef CLUSTERED_LIGHTING
+#include "lighting.wgsl"
+#endif
+
+#ifdef ALPHA_TEST
+// set per pipeline via WGPUConstantEntry, no new permutation needed
+override alphaCutoff : f32 = 0.5;
+#endif
+
+fn shade(in : VertexOutput) -> vec4f
+{
+    // base color
+    var color : vec4f = u_Material.color;
+#ifndef NO_TEXTURE
+    color *= materialTexture(in.v_uv);
+#endif
+
+#ifdef ALPHA_TEST
+    if (color.a < alphaCutoff) {
+        discard;
     }
+#endif
+
+#ifdef NO_LIGHTING
+    return color;
+#else
+    // lambertian diffuse plus global ambient
+    let normal = normalize(in.v_normal);
+    var lightContrib : f32 = max(0.0, dot(u_Frame.dirLight, -normal));
+    lightContrib = clamp(lightContrib, 0.2, 1.0);
+#ifdef CLUSTERED_LIGHTING
+    let lit = lightContrib + pointLighting(in.position, in.v_worldPos, normal);
+    return vec4f(color.rgb * lit, color.a);
+#else
+    return vec4f(color.rgb * lightContrib, color.a);
+#endif
+#endif
+}
+)";
+
+static const char* shaderCode = R"(
+#include "shading.wgsl"
+
+struct DrawUniforms {
+    modelMat: mat4x4f,
+};
+
+@group(PER_DRAW_GROUP) @binding(0) var<uniform> u_Draw: DrawUniforms;
+
+@vertex fn vs_main(in : VertexInput) -> VertexOutput
+{
+    var out : VertexOutput;
+
+    // same expression as depthPrepassShaderCode, see VertexOutput
+    out.position = u_Frame.projViewMat * u_Draw.modelMat * vec4f(in.position, 1.0f);
+    out.v_worldPos = (u_Draw.modelMat * vec4f(in.position, 1.0f)).xyz;
+    out.v_normal = (u_Draw.modelMat * vec4f(in.normal, 0.0)).xyz;
+    out.v_uv     = in.uv;
+    return out;
+}
+
+@fragment fn fs_main(in : VertexOutput) -> @location(0) vec4f
+{
+    return shade(in);
+}
+)";
+
+// Depth pre-pass: positions only, same transform as shaderCode, no fragment
+// stage. Uses shaderCode's pipeline layout
+static const char* depthPrepassShaderCode = R"(
+#include "frame.wgsl"
+
+struct DrawUniforms {
+    modelMat: mat4x4f,
+};
+
+@group(PER_DRAW_GROUP) @binding(0) var<uniform> u_Draw: DrawUniforms;
+
+@vertex fn vs_main(@location(0) position : vec3f)
+    -> @builtin(position) @invariant vec4f
+{
+    return u_Frame.projViewMat * u_Draw.modelMat * vec4f(position, 1.0f);
+}
+)";
+
+// Same as shaderCode but the model matrix comes from the instance buffer,
+// indexed through the compacted visible list written by cullShader
+static const char* instancedShaderCode = R"(
+#include "shading.wgsl"
+
+struct InstanceData {
+    modelMat: mat4x4f,
+    boundingSphere: vec4f,
+    batch: u32,
+    visibleBase: u32,
+};
+
+@group(PER_DRAW_GROUP) @binding(0) var<storage, read> instances: array<InstanceData>;
+// bound with a dynamic offset at the start of each batch's list
+@group(PER_DRAW_GROUP) @binding(1) var<storage, read> visibleInstances: array<u32>;
+
+@vertex fn vs_main(in : VertexInput) -> VertexOutput
+{
+    var out : VertexOutput;
+    let modelMat = instances[visibleInstances[in.instanceIndex]].modelMat;
+
+    let worldPos = modelMat * vec4f(in.position, 1.0f);
+    out.v_worldPos = worldPos.xyz;
+    out.v_normal = (modelMat * vec4f(in.normal, 0.0)).xyz;
+    out.v_uv     = in.uv;
+    out.position = u_Frame.projViewMat * worldPos;
+    return out;
+}
+
+@fragment fn fs_main(in : VertexOutput) -> @location(0) vec4f
+{
+    return shade(in);
+}
+)";
+
+// Frustum culls every instance and appends survivors to their batch's
+// visible list, bumping that batch's indirect instanceCount
+static const char* cullShader = CODE(
+    struct InstanceData {
+        modelMat: mat4x4f,
+        boundingSphere: vec4f,
+        batch: u32,
+        visibleBase: u32,
+    };
+
+    struct CullUniforms {
+        frustumPlanes: array<vec4f, 6>,
+        instanceCount: u32,
+    };
+
+    struct DrawIndexedIndirectArgs {
+        indexCount: u32,
+        instanceCount: atomic<u32>,
+        firstIndex: u32,
+        baseVertex: i32,
+        firstInstance: u32,
+    };
 
-    @fragment fn fs_main(in : VertexOutput)->@location(0) vec4f
+    @group(0) @binding(0) var<uniform> u_Cull: CullUniforms;
+    @group(0) @binding(1) var<storage, read> instances: array<InstanceData>;
+    @group(0) @binding(2) var<storage, read_write> visibleInstances: array<u32>;
+    @group(0) @binding(3) var<storage, read_write> drawArgs: array<DrawIndexedIndirectArgs>;
+
+    @compute @workgroup_size(CULL_WORKGROUP_SIZE)
+    fn cs_main(@builtin(global_invocation_id) id : vec3u)
     {
-        // base color
-        var color : vec4f = u_Material.color;
-        // color.g = 0.5 + 0.5 * sin(u_Frame.time);
-        // lambertian diffuse
-        let normal = normalize(in.v_normal);
-        var lightContrib : f32 = max(0.0, dot(u_Frame.dirLight, -normal));
-        // add global ambient
-        lightContrib = clamp(lightContrib, 0.2, 1.0);
-        
-        // texture map
-        // let texelCoords = vec2i(in.v_uv * vec2f(textureDimensions(u_Texture)));
-        // color *= textureLoad(u_Texture, texelCoords, 0);
-        color *= textureSample(u_Texture, u_Sampler, in.v_uv);
-
-
-        return vec4f(color.rgb * lightContrib, color.a);
-        // return vec4f(in.v_normal, 1.0);
-        // return vec4f(in.v_uv, 0.0, 1.0);
+        let index = id.x;
+        if (index >= u_Cull.instanceCount) {
+            return;
+        }
+
+        let sphere = instances[index].boundingSphere;
+        for (var i = 0u; i < 6u; i++) {
+            let plane = u_Cull.frustumPlanes[i];
+            if (dot(plane.xyz, sphere.xyz) + plane.w < -sphere.w) {
+                return;
+            }
+        }
+
+        let batch = instances[index].batch;
+        let slot = atomicAdd(&drawArgs[batch].instanceCount, 1u);
+        visibleInstances[instances[index].visibleBase + slot] = index;
     }
 );
 
@@ -153,4 +437,139 @@ static const char* mipMapShader = CODE(
     }
 );
 
+// Writes up to 4 mip levels below the source level, see MipMapGenerator.
+// MIP_STORAGE_FORMAT is defined per pipeline. Each thread averages a 2x2
+// block of the first level, so the second needs no shared memory
+static const char* mipMapComputeShader = CODE(
+    @group(0) @binding(0) var src : texture_2d_array<f32>;
+    @group(0) @binding(1) var dst1 : texture_storage_2d_array<MIP_STORAGE_FORMAT, write>;
+    @group(0) @binding(2) var dst2 : texture_storage_2d_array<MIP_STORAGE_FORMAT, write>;
+    @group(0) @binding(3) var dst3 : texture_storage_2d_array<MIP_STORAGE_FORMAT, write>;
+    @group(0) @binding(4) var dst4 : texture_storage_2d_array<MIP_STORAGE_FORMAT, write>;
+
+    var<workgroup> level2 : array<vec4f, 64>; // 8x8
+    var<workgroup> level3 : array<vec4f, 16>; // 4x4
+
+    fn average(a : vec4f, b : vec4f, c : vec4f, d : vec4f) -> vec4f {
+        return (a + b + c + d) * 0.25;
+    }
+
+    fn inside(p : vec2u, size : vec2u) -> bool {
+        return p.x < size.x && p.y < size.y;
+    }
+
+    // unused trailing slots repeat the last level, which has the same size
+    fn smaller(a : vec2u, b : vec2u) -> bool {
+        return max(a.x, a.y) < max(b.x, b.y);
+    }
+
+    // odd sizes: clamp to the edge
+    fn loadSrc(p : vec2u, layer : i32) -> vec4f {
+        let q = min(p, textureDimensions(src) - vec2u(1u));
+        return textureLoad(src, vec2i(q), layer, 0);
+    }
+
+    @compute @workgroup_size(MIP_COMPUTE_WORKGROUP_SIZE, MIP_COMPUTE_WORKGROUP_SIZE)
+    fn cs_main(@builtin(workgroup_id) group : vec3u,
+               @builtin(local_invocation_id) local : vec3u)
+    {
+        let layer = i32(group.z);
+        let size1 = textureDimensions(dst1);
+        let size2 = textureDimensions(dst2);
+        let size3 = textureDimensions(dst3);
+        let size4 = textureDimensions(dst4);
+        let write2 = smaller(size2, size1);
+        let write3 = write2 && smaller(size3, size2);
+        let write4 = write3 && smaller(size4, size3);
+
+        // level 1: 2x2 texels per thread
+        let p2 = group.xy * 8u + local.xy;
+        var c1 : array<vec4f, 4>;
+        for (var i = 0u; i < 4u; i++) {
+            let p = p2 * 2u + vec2u(i & 1u, i >> 1u);
+            let s = p * 2u;
+            c1[i] = average(loadSrc(s, layer),
+                            loadSrc(s + vec2u(1u, 0u), layer),
+                            loadSrc(s + vec2u(0u, 1u), layer),
+                            loadSrc(s + vec2u(1u, 1u), layer));
+            if (inside(p, size1)) {
+                textureStore(dst1, vec2i(p), layer, c1[i]);
+            }
+        }
+
+        // level 2: this thread's own block. Children past the edge of the
+        // previous level (non-square and odd sizes) reuse its edge texel,
+        // like loadSrc, instead of averaging clamped reads twice over
+        let dx2 = select(0u, 1u, p2.x * 2u + 1u < size1.x);
+        let dy2 = select(0u, 2u, p2.y * 2u + 1u < size1.y);
+        let c2 = average(c1[0], c1[dx2], c1[dy2], c1[dx2 + dy2]);
+        if (write2 && inside(p2, size2)) {
+            textureStore(dst2, vec2i(p2), layer, c2);
+        }
+        level2[local.y * 8u + local.x] = c2;
+        workgroupBarrier();
+
+        // level 3: 4x4 threads
+        if (local.x < 4u && local.y < 4u) {
+            let p3 = group.xy * 4u + local.xy;
+            let dx3 = select(0u, 1u, p3.x * 2u + 1u < size2.x);
+            let dy3 = select(0u, 8u, p3.y * 2u + 1u < size2.y);
+            let i = local.y * 16u + local.x * 2u;
+            let c3 = average(level2[i], level2[i + dx3], level2[i + dy3],
+                             level2[i + dx3 + dy3]);
+            if (write3 && inside(p3, size3)) {
+                textureStore(dst3, vec2i(p3), layer, c3);
+            }
+            level3[local.y * 4u + local.x] = c3;
+        }
+        workgroupBarrier();
+
+        // level 4: 2x2 threads
+        if (local.x < 2u && local.y < 2u) {
+            let p4 = group.xy * 2u + local.xy;
+            let dx4 = select(0u, 1u, p4.x * 2u + 1u < size3.x);
+            let dy4 = select(0u, 4u, p4.y * 2u + 1u < size3.y);
+            let i = local.y * 8u + local.x * 2u;
+            let c4 = average(level3[i], level3[i + dx4], level3[i + dy4],
+                             level3[i + dx4 + dy4]);
+            if (write4 && inside(p4, size4)) {
+                textureStore(dst4, vec2i(p4), layer, c4);
+            }
+        }
+    }
+);
+
+// Upscales the dynamic resolution target's rendered sub-rect to the whole
+// swap chain. uvMax keeps bilinear taps inside the rendered texels
+static const char* upscaleShader = CODE(
+    struct UpscaleUniforms {
+        uvScale: vec2f, // rendered size / texture size
+        uvMax: vec2f,
+    };
+
+    @group(0) @binding(0) var srcSampler : sampler;
+    @group(0) @binding(1) var src : texture_2d<f32>;
+    @group(0) @binding(2) var<uniform> u_Upscale : UpscaleUniforms;
+
+    struct VertexOutput {
+        @builtin(position) position : vec4f,
+        @location(0) texCoord : vec2f,
+    };
+
+    @vertex
+    fn vs_main(@builtin(vertex_index) vertexIndex : u32) -> VertexOutput {
+        // fullscreen triangle
+        let pos = vec2f(f32((vertexIndex << 1u) & 2u), f32(vertexIndex & 2u));
+        var output : VertexOutput;
+        output.position = vec4f(pos * 2.0 - 1.0, 0.0, 1.0);
+        output.texCoord = vec2f(pos.x, 1.0 - pos.y) * u_Upscale.uvScale;
+        return output;
+    }
+
+    @fragment
+    fn fs_main(@location(0) texCoord : vec2f) -> @location(0) vec4f {
+        return textureSample(src, srcSampler, min(texCoord, u_Upscale.uvMax));
+    }
+);
+
 // clang-format on
\ No newline at end of file
@@ -0,0 +1,361 @@
+#include <string.h>
+
+#include "stb/stb_image.h"
+
+#include "cache.h"
+#include "core/log.h"
+#include "deletion.h"
+#include "gpu_memory.h"
+#include "jobs.h"
+#include "memory.h"
+#include "streaming.h"
+#include "texture_bake.h"
+#include "texture_file.h"
+
+// ============================================================================
+// Texture Streaming
+// ============================================================================
+
+struct TextureStream {
+    Texture* texture;
+    char* filename;
+    u32 filenameBytes;
+    TextureStreamCallback callback;
+    void* userdata;
+
+    // written by the decode job, read once counter is done. The levels come
+    // from the bake cache when it's enabled
+    JobCounter counter;
+    CPUMipChain chain;
+    BakedTexture baked;
+    bool failed;
+
+    // upload progress, main thread
+    bool decoded;
+    bool complete;
+    u32 uploadLevel;   // counts down to 0
+    u32 uploadRow;     // rows of uploadLevel already written
+    u32 residentLevel; // base of the view
+};
+
+struct TextureStreamingState {
+    bool initialized;
+    u64 bytesPerFrame;
+    MipFilter filter;
+
+    TextureStream** streams; // oldest first, they get the budget first
+    u32 count;
+    u32 capacity;
+
+    TextureStreamingStats stats;
+};
+
+static TextureStreamingState streaming = {};
+
+static const CPUMipLevel* streamLevel(const TextureStream* stream, u32 level)
+{
+    return stream->baked.data ? &stream->baked.levels[level]
+                              : &stream->chain.levels[level];
+}
+
+static void decodeStream(void* userData, u32 index)
+{
+    UNUSED_VAR(index);
+    TextureStream* stream = (TextureStream*)userData;
+    Texture* texture      = stream->texture;
+
+    if (TextureBakeCache::enabled()) {
+        TextureBakeSettings bake = {};
+        bake.format              = CPU_MIP_RGBA8_UNORM;
+        bake.filter              = streaming.filter;
+        bake.flipY               = true;
+        // the header read by stream() sized the texture
+        stream->failed
+          = !TextureBakeCache::load(&stream->baked, stream->filename, &bake)
+            || stream->baked.width != texture->width
+            || stream->baked.height != texture->height;
+        return;
+    }
+
+    i32 width = 0, height = 0, comps = 0;
+    stbi_uc* pixels
+      = stbi_load(stream->filename, &width, &height, &comps, STBI_rgb_alpha);
+    if (pixels == NULL) {
+        stream->failed = true;
+        return;
+    }
+
+    // the header read by stream() sized the texture
+    if ((u32)width != texture->width || (u32)height != texture->height) {
+        stream->failed = true;
+    } else {
+        CPUMipChain::generate(&stream->chain, pixels, width, height,
+                              CPU_MIP_RGBA8_UNORM, streaming.filter,
+                              texture->mip_level_count);
+    }
+    stbi_image_free(pixels);
+}
+
+static WGPUTextureView createView(Texture* texture, u32 baseLevel)
+{
+    WGPUTextureViewDescriptor viewDesc = {};
+    viewDesc.format                    = texture->format;
+    viewDesc.dimension                 = WGPUTextureViewDimension_2D;
+    viewDesc.baseMipLevel              = baseLevel;
+    viewDesc.mipLevelCount             = texture->mip_level_count - baseLevel;
+    viewDesc.baseArrayLayer            = 0;
+    viewDesc.arrayLayerCount           = 1;
+    viewDesc.aspect                    = WGPUTextureAspect_All;
+    return wgpuTextureCreateView(texture->texture, &viewDesc);
+}
+
+static void writeRows(GraphicsContext* ctx, WGPUTexture texture, u32 level,
+                      const CPUMipLevel* src, u32 firstRow, u32 rows)
+{
+    u32 rowBytes = 4 * src->width;
+
+    WGPUImageCopyTexture destination = {};
+    destination.texture              = texture;
+    destination.mipLevel             = level;
+    destination.origin               = { 0, firstRow, 0 };
+    destination.aspect               = WGPUTextureAspect_All;
+    WGPUTextureDataLayout layout     = {};
+    layout.bytesPerRow               = rowBytes;
+    layout.rowsPerImage              = rows;
+    WGPUExtent3D extent              = { src->width, rows, 1 };
+    wgpuQueueWriteTexture(ctx->queue, &destination,
+                          src->pixels + (u64)rowBytes * firstRow,
+                          (u64)rowBytes * rows, &layout, &extent);
+}
+
+/// @brief Upload rows up to budget (at least one), move the view down to
+/// the levels that became complete
+/// @return bytes uploaded
+static u64 uploadStream(GraphicsContext* ctx, TextureStream* stream,
+                        u64 budget)
+{
+    Texture* texture = stream->texture;
+    u64 used         = 0;
+    u32 resident     = stream->residentLevel;
+    while (!stream->complete && used < budget) {
+        const CPUMipLevel* level = streamLevel(stream, stream->uploadLevel);
+        u64 rowBytes             = 4 * (u64)level->width;
+        u32 rows = (u32)MIN((u64)(level->height - stream->uploadRow),
+                            MAX((budget - used) / rowBytes, (u64)1));
+
+        writeRows(ctx, texture->texture, stream->uploadLevel, level,
+                  stream->uploadRow, rows);
+        used += rowBytes * rows;
+        stream->uploadRow += rows;
+
+        if (stream->uploadRow == level->height) {
+            resident = stream->uploadLevel;
+            if (stream->uploadLevel == 0) {
+                stream->complete = true;
+            } else {
+                stream->uploadLevel--;
+                stream->uploadRow = 0;
+            }
+        }
+    }
+
+    if (resident != stream->residentLevel) {
+        WGPUTextureView previous = texture->view;
+        texture->view            = createView(texture, resident);
+        stream->residentLevel    = resident;
+
+        // let the owner rebind before the old view's bind groups go
+        if (stream->callback) stream->callback(ctx, texture, stream->userdata);
+        BindingCache::purge(previous);
+        DeletionQueue::defer(previous);
+    }
+    return used;
+}
+
+static void freeStream(TextureStream* stream)
+{
+    CPUMipChain::release(&stream->chain);
+    BakedTexture::release(&stream->baked);
+    FREE_ARRAY(char, stream->filename, stream->filenameBytes);
+    FREE(TextureStream, stream);
+}
+
+static void removeStream(u32 index)
+{
+    freeStream(streaming.streams[index]);
+    memmove(streaming.streams + index, streaming.streams + index + 1,
+            sizeof(TextureStream*) * (streaming.count - index - 1));
+    streaming.count--;
+}
+
+void TextureStreaming::init(u64 bytesPerFrame, MipFilter filter)
+{
+    streaming.initialized   = true;
+    streaming.bytesPerFrame = MAX(bytesPerFrame, (u64)1);
+    streaming.filter        = filter;
+}
+
+bool TextureStreaming::stream(GraphicsContext* ctx, Texture* texture,
+                              const char* filename,
+                              TextureStreamCallback callback, void* userdata)
+{
+    ASSERT(texture->texture == NULL);
+    if (!streaming.initialized) TextureStreaming::init();
+
+    // block compressed files bring their mips, there is no decode to hide
+    if (TextureFile::isTextureFile(filename)) {
+        Texture::initFromFile(ctx, texture, filename, false);
+        return texture->texture != NULL;
+    }
+
+    i32 width = 0, height = 0, comps = 0;
+    if (!stbi_info(filename, &width, &height, &comps)) {
+        log_error("texture streaming: couldn't read '%s': %s", filename,
+                  stbi_failure_reason());
+        return false;
+    }
+
+    u32 levels = 1;
+    for (u32 size = MAX(width, height); size > 1; size >>= 1) levels++;
+
+    texture->width           = width;
+    texture->height          = height;
+    texture->depth           = 1;
+    texture->mip_level_count = levels;
+    texture->format          = WGPUTextureFormat_RGBA8Unorm;
+    texture->dimension       = WGPUTextureDimension_2D;
+
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.usage
+      = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    textureDesc.dimension     = texture->dimension;
+    textureDesc.size          = { (u32)width, (u32)height, 1 };
+    textureDesc.format        = texture->format;
+    textureDesc.mipLevelCount = levels;
+    textureDesc.sampleCount   = 1;
+    textureDesc.label         = filename;
+    texture->texture = wgpuDeviceCreateTexture(ctx->device, &textureDesc);
+    GPUMemory::track(texture->texture, GPU_MEMORY_TEXTURE,
+                     GPUMemory::textureBytes(texture->format, width, height, 1,
+                                             levels),
+                     filename);
+
+    // the 1x1 tail is usable until the real levels arrive
+    u32 placeholder                  = TEXTURE_STREAMING_PLACEHOLDER;
+    WGPUImageCopyTexture destination = {};
+    destination.texture              = texture->texture;
+    destination.mipLevel             = levels - 1;
+    destination.aspect               = WGPUTextureAspect_All;
+    WGPUTextureDataLayout layout     = {};
+    layout.bytesPerRow               = sizeof(placeholder);
+    layout.rowsPerImage              = 1;
+    WGPUExtent3D extent              = { 1, 1, 1 };
+    wgpuQueueWriteTexture(ctx->queue, &destination, &placeholder,
+                          sizeof(placeholder), &layout, &extent);
+
+    texture->view    = createView(texture, levels - 1);
+    texture->sampler = Texture::defaultSampler(ctx);
+
+    TextureStream* stream = ALLOCATE_COUNT(TextureStream, 1);
+    stream->texture       = texture;
+    stream->filenameBytes = (u32)strlen(filename) + 1;
+    stream->filename      = ALLOCATE_COUNT(char, stream->filenameBytes);
+    memcpy(stream->filename, filename, stream->filenameBytes);
+    stream->callback      = callback;
+    stream->userdata      = userdata;
+    stream->uploadLevel   = levels - 1;
+    stream->residentLevel = levels - 1;
+    stream->counter.pending.store(0);
+
+    if (streaming.count == streaming.capacity) {
+        u32 capacity = streaming.capacity < 16 ? 16 : streaming.capacity * 2;
+        streaming.streams
+          = (TextureStream**)reallocate(streaming.streams,
+                                        sizeof(TextureStream*)
+                                          * streaming.capacity,
+                                        sizeof(TextureStream*) * capacity);
+        streaming.capacity = capacity;
+    }
+    streaming.streams[streaming.count++] = stream;
+
+    // global, the same for every worker (see Texture::initFromFiles())
+    stbi_set_flip_vertically_on_load(true);
+    JobSystem::submit(decodeStream, stream, 0, &stream->counter);
+    return true;
+}
+
+void TextureStreaming::update(GraphicsContext* ctx)
+{
+    u64 budget                      = streaming.bytesPerFrame;
+    streaming.stats.lastFrameUpload = 0;
+
+    for (u32 i = 0; i < streaming.count;) {
+        TextureStream* stream = streaming.streams[i];
+        if (!stream->decoded) {
+            if (!JobCounter::done(&stream->counter)) {
+                i++;
+                continue;
+            }
+            if (stream->failed) {
+                // keeps the placeholder
+                log_error("texture streaming: couldn't load '%s'",
+                          stream->filename);
+                removeStream(i);
+                continue;
+            }
+            stream->decoded = true;
+        }
+
+        if (budget > 0) {
+            u64 used = uploadStream(ctx, stream, budget);
+            budget -= MIN(used, budget);
+            streaming.stats.lastFrameUpload += (u32)used;
+            streaming.stats.uploadedBytes += used;
+        }
+
+        if (stream->complete) {
+            log_debug("texture streaming: '%s' resident", stream->filename);
+            streaming.stats.completed++;
+            removeStream(i);
+            continue;
+        }
+        i++;
+    }
+}
+
+bool TextureStreaming::resident(const Texture* texture)
+{
+    for (u32 i = 0; i < streaming.count; i++)
+        if (streaming.streams[i]->texture == texture) return false;
+    return true;
+}
+
+void TextureStreaming::cancel(Texture* texture)
+{
+    for (u32 i = 0; i < streaming.count; i++) {
+        TextureStream* stream = streaming.streams[i];
+        if (stream->texture != texture) continue;
+
+        // the decode job writes into the stream
+        JobSystem::wait(&stream->counter);
+        removeStream(i);
+        return;
+    }
+}
+
+TextureStreamingStats TextureStreaming::stats()
+{
+    TextureStreamingStats stats = streaming.stats;
+    stats.pending               = streaming.count;
+    return stats;
+}
+
+void TextureStreaming::release()
+{
+    while (streaming.count > 0) {
+        JobSystem::wait(&streaming.streams[0]->counter);
+        removeStream(0);
+    }
+    FREE_ARRAY(TextureStream*, streaming.streams, streaming.capacity);
+    streaming = {};
+}
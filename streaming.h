@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+#include "cpu_mips.h"
+
+// ============================================================================
+// Texture Streaming
+// ============================================================================
+
+// Loads images without stalling the caller. stream() only reads the image
+// header, creates the texture at full size with a full mip chain and
+// returns; the texture is usable right away, its view covering just the
+// 1x1 tail level, filled with placeholder grey.
+//
+// A job system worker decodes the image and builds the mip chain on the
+// CPU (CPUMipChain). update(), called by the runner every frame, then
+// uploads levels smallest first under a per frame byte budget, splitting
+// large levels into row ranges across frames. Whenever levels become
+// complete the view is recreated with its base moved down to the largest
+// resident level and the owner's callback runs, so bind groups holding
+// the old view can be rebuilt (e.g. Material::setTexture()). With the view
+// limited to resident levels, sampling never reaches a level still being
+// uploaded and the shared sampler's lodMinClamp can stay 0: in WebGPU
+// sampler LOD clamps are relative to the view's base level.
+//
+// Process wide like the job system, main thread only. Texture::release()
+// cancels a texture's stream. KTX2/DDS files carry their mips and need no
+// decode, stream() loads them directly.
+
+#define TEXTURE_STREAMING_BYTES_PER_FRAME (4u << 20)
+#define TEXTURE_STREAMING_PLACEHOLDER 0xFF808080u // RGBA8, little endian
+
+/// @brief The texture's view changed (more levels resident)
+typedef void (*TextureStreamCallback)(GraphicsContext* ctx, Texture* texture,
+                                      void* userdata);
+
+struct TextureStreamingStats {
+    u32 pending;         // streams not fully resident
+    u64 uploadedBytes;   // since init
+    u32 completed;       // streams fully resident since init
+    u32 lastFrameUpload; // bytes uploaded by the last update()
+};
+
+struct TextureStreaming {
+    /// @brief Optional, the first stream() initializes with the defaults
+    static void init(u64 bytesPerFrame = TEXTURE_STREAMING_BYTES_PER_FRAME,
+                     MipFilter filter  = MIP_FILTER_BOX);
+
+    /// @brief Create texture and start loading filename in the background.
+    /// callback (may be NULL) runs on the main thread, from update(), each
+    /// time more levels are resident. False if the file can't be read
+    /// (logged), texture is left zeroed
+    static bool stream(GraphicsContext* ctx, Texture* texture,
+                       const char* filename, TextureStreamCallback callback,
+                       void* userdata);
+
+    /// @brief Collect decoded images and upload under the budget. Called by
+    /// the runner once per frame, before rendering
+    static void update(GraphicsContext* ctx);
+
+    /// @brief All levels of texture are resident (or it was never streamed)
+    static bool resident(const Texture* texture);
+
+    /// @brief Stop streaming texture, waiting for its decode if running.
+    /// No-op for textures that aren't streaming
+    static void cancel(Texture* texture);
+
+    static TextureStreamingStats stats();
+
+    /// @brief Cancels all streams
+    static void release();
+};
@@ -0,0 +1,363 @@
+#include <math.h>
+#include <string.h>
+
+#include "stb/stb_image.h"
+
+#include "core/log.h"
+#include "cpu_mips.h"
+#include "gpu_memory.h"
+#include "jobs.h"
+#include "memory.h"
+#include "texture_atlas.h"
+
+// ============================================================================
+// Rect Packer
+// ============================================================================
+
+void RectPacker::init(RectPacker* packer, u32 width, u32 height)
+{
+    ASSERT(packer->nodes == NULL);
+    packer->width    = width;
+    packer->height   = height;
+    packer->capacity = 16;
+    packer->nodes    = ALLOCATE_COUNT(SkylineNode, packer->capacity);
+    packer->nodes[0] = { 0, 0, width };
+    packer->count    = 1;
+}
+
+static void insertNode(RectPacker* packer, u32 index, SkylineNode node)
+{
+    if (packer->count == packer->capacity) {
+        u32 capacity  = packer->capacity * 2;
+        packer->nodes = (SkylineNode*)reallocate(
+          packer->nodes, sizeof(SkylineNode) * packer->capacity,
+          sizeof(SkylineNode) * capacity);
+        packer->capacity = capacity;
+    }
+    memmove(packer->nodes + index + 1, packer->nodes + index,
+            sizeof(SkylineNode) * (packer->count - index));
+    packer->nodes[index] = node;
+    packer->count++;
+}
+
+static void removeNode(RectPacker* packer, u32 index)
+{
+    memmove(packer->nodes + index, packer->nodes + index + 1,
+            sizeof(SkylineNode) * (packer->count - index - 1));
+    packer->count--;
+}
+
+/// @brief Lowest y for a rect with its left edge at node index
+static bool fitAt(const RectPacker* packer, u32 index, u32 width, u32 height,
+                  u32* y)
+{
+    if (packer->nodes[index].x + width > packer->width) return false;
+
+    // the nodes cover the whole width, the loop stays inside them
+    u32 top       = 0;
+    u32 remaining = width;
+    for (u32 i = index; remaining > 0; i++) {
+        top = MAX(top, packer->nodes[i].y);
+        if (top + height > packer->height) return false;
+        remaining -= MIN(packer->nodes[i].width, remaining);
+    }
+    *y = top;
+    return true;
+}
+
+bool RectPacker::pack(RectPacker* packer, u32 width, u32 height, u32* x,
+                      u32* y)
+{
+    // bottom-left: lowest resulting top edge, then the narrowest node
+    u32 best = packer->count, bestTop = 0, bestY = 0;
+    for (u32 i = 0; i < packer->count; i++) {
+        u32 fitY = 0;
+        if (!fitAt(packer, i, width, height, &fitY)) continue;
+        u32 top = fitY + height;
+        if (best == packer->count || top < bestTop
+            || (top == bestTop
+                && packer->nodes[i].width < packer->nodes[best].width)) {
+            best    = i;
+            bestTop = top;
+            bestY   = fitY;
+        }
+    }
+    if (best == packer->count) return false;
+
+    SkylineNode node = { packer->nodes[best].x, bestTop, width };
+    insertNode(packer, best, node);
+
+    // cut the nodes now under the rect
+    u32 right = node.x + node.width;
+    for (u32 i = best + 1; i < packer->count;) {
+        SkylineNode* next = &packer->nodes[i];
+        if (next->x >= right) break;
+        u32 overlap = right - next->x;
+        if (overlap < next->width) {
+            next->x += overlap;
+            next->width -= overlap;
+            break;
+        }
+        removeNode(packer, i);
+    }
+
+    // merge neighbours at the same height
+    for (u32 i = 0; i + 1 < packer->count;) {
+        if (packer->nodes[i].y == packer->nodes[i + 1].y) {
+            packer->nodes[i].width += packer->nodes[i + 1].width;
+            removeNode(packer, i + 1);
+        } else {
+            i++;
+        }
+    }
+
+    *x = node.x;
+    *y = bestY;
+    return true;
+}
+
+void RectPacker::release(RectPacker* packer)
+{
+    FREE_ARRAY(SkylineNode, packer->nodes, packer->capacity);
+    *packer = {};
+}
+
+// ============================================================================
+// Texture Atlas
+// ============================================================================
+
+// padded cell of an image, in texels
+struct AtlasCell {
+    u32 x;
+    u32 y;
+    u32 width;
+    u32 height;
+};
+
+struct AtlasCopyJob {
+    const TextureAtlasImage* images;
+    const AtlasCell* cells;
+    u32* pixels; // RGBA8
+    u32 width;
+};
+
+/// @brief Image into its cell, the padding repeating the edge texels
+static void copyImage(void* userData, u32 index)
+{
+    AtlasCopyJob* job              = (AtlasCopyJob*)userData;
+    const TextureAtlasImage* image = &job->images[index];
+    const AtlasCell* cell          = &job->cells[index];
+    const u32* src                 = (const u32*)image->pixels;
+    const i32 padding              = TEXTURE_ATLAS_PADDING;
+
+    for (u32 row = 0; row < cell->height; row++) {
+        i32 srcY = CLAMP((i32)row - padding, 0, (i32)image->height - 1);
+
+        const u32* srcRow = src + (u64)srcY * image->width;
+        u32* dst
+          = job->pixels + (u64)(cell->y + row) * job->width + cell->x;
+        for (u32 col = 0; col < cell->width; col++) {
+            i32 srcX = CLAMP((i32)col - padding, 0, (i32)image->width - 1);
+            dst[col] = srcRow[srcX];
+        }
+    }
+}
+
+/// @brief Texels of an image plus padding on both sides, in whole cells
+static u32 cellSize(u32 texels)
+{
+    const u32 padding = TEXTURE_ATLAS_PADDING;
+    return (texels + 3 * padding - 1) / padding * padding;
+}
+
+static void growSize(u32* width, u32* height)
+{
+    if (*width == *height)
+        *width *= 2;
+    else
+        *height *= 2;
+}
+
+/// @brief Cells of every image placed in a width x height atlas
+static bool packCells(AtlasCell* cells, const u32* order, u32 count,
+                      u32 width, u32 height)
+{
+    const u32 padding = TEXTURE_ATLAS_PADDING;
+    RectPacker packer = {};
+    RectPacker::init(&packer, width / padding, height / padding);
+
+    bool fits = true;
+    for (u32 i = 0; i < count && fits; i++) {
+        AtlasCell* cell = &cells[order[i]];
+
+        u32 x = 0, y = 0;
+        fits  = RectPacker::pack(&packer, cell->width / padding,
+                                 cell->height / padding, &x, &y);
+        cell->x = x * padding;
+        cell->y = y * padding;
+    }
+    RectPacker::release(&packer);
+    return fits;
+}
+
+bool TextureAtlas::init(GraphicsContext* ctx, TextureAtlas* atlas,
+                        const TextureAtlasImage* images, u32 count,
+                        u32 maxSize)
+{
+    ASSERT(atlas->texture.texture == NULL);
+    ASSERT(count > 0);
+    const u32 padding = TEXTURE_ATLAS_PADDING;
+
+    AtlasCell* cells = ALLOCATE_COUNT(AtlasCell, count);
+    u32* order       = ALLOCATE_COUNT(u32, count);
+    u64 area         = 0;
+    u32 widest       = 0, tallest = 0;
+    for (u32 i = 0; i < count; i++) {
+        cells[i].width  = cellSize(images[i].width);
+        cells[i].height = cellSize(images[i].height);
+        area += (u64)cells[i].width * cells[i].height;
+        widest  = MAX(widest, cells[i].width);
+        tallest = MAX(tallest, cells[i].height);
+
+        // tallest first packs tighter, insertion sort as counts are small
+        u32 j = i;
+        for (; j > 0 && cells[order[j - 1]].height < cells[i].height; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    // smallest power of two size that fits, squares and 2:1 rects
+    // alternating, growing on failure
+    u32 width = padding, height = padding;
+    while (width < widest || height < tallest || (u64)width * height < area)
+        growSize(&width, &height);
+    while (width <= maxSize && !packCells(cells, order, count, width, height))
+        growSize(&width, &height);
+    if (width > maxSize) {
+        log_error("texture atlas: %d images don't fit in %dx%d", count,
+                  maxSize, maxSize);
+        FREE_ARRAY(AtlasCell, cells, count);
+        FREE_ARRAY(u32, order, count);
+        return false;
+    }
+
+    // pixels, one image per job
+    u64 pixelCount   = (u64)width * height;
+    AtlasCopyJob job = {};
+    job.images       = images;
+    job.cells        = cells;
+    job.pixels       = ALLOCATE_COUNT(u32, pixelCount);
+    job.width        = width;
+    JobSystem::parallelFor(count, copyImage, &job);
+
+    atlas->count   = count;
+    atlas->uvRects = ALLOCATE_COUNT(glm::vec4, count);
+    for (u32 i = 0; i < count; i++) {
+        atlas->uvRects[i] = glm::vec4(cells[i].x + padding,
+                                      cells[i].y + padding, images[i].width,
+                                      images[i].height)
+                            / glm::vec4(width, height, width, height);
+    }
+
+    // down to the level where the padding is one texel wide
+    u32 levelCount = 1;
+    for (u32 p = padding; p > 1; p >>= 1) levelCount++;
+    CPUMipChain chain = {};
+    CPUMipChain::generate(&chain, job.pixels, width, height,
+                          CPU_MIP_RGBA8_UNORM, MIP_FILTER_BOX, levelCount);
+    FREE_ARRAY(u32, job.pixels, pixelCount);
+
+    Texture* texture         = &atlas->texture;
+    texture->width           = width;
+    texture->height          = height;
+    texture->depth           = 1;
+    texture->mip_level_count = chain.levelCount;
+    texture->format          = WGPUTextureFormat_RGBA8Unorm;
+    texture->dimension       = WGPUTextureDimension_2D;
+
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.usage
+      = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    textureDesc.dimension     = texture->dimension;
+    textureDesc.size          = { width, height, 1 };
+    textureDesc.format        = texture->format;
+    textureDesc.mipLevelCount = texture->mip_level_count;
+    textureDesc.sampleCount   = 1;
+    textureDesc.label         = "texture atlas";
+
+    texture->texture = wgpuDeviceCreateTexture(ctx->device, &textureDesc);
+    ASSERT(texture->texture != NULL);
+    GPUMemory::track(texture->texture, GPU_MEMORY_TEXTURE,
+                     GPUMemory::textureBytes(texture->format, width, height,
+                                             1, texture->mip_level_count),
+                     "texture atlas");
+    CPUMipChain::upload(ctx, &chain, texture->texture);
+    CPUMipChain::release(&chain);
+
+    WGPUTextureViewDescriptor viewDesc = {};
+    viewDesc.format                    = texture->format;
+    viewDesc.dimension                 = WGPUTextureViewDimension_2D;
+    viewDesc.mipLevelCount             = texture->mip_level_count;
+    viewDesc.arrayLayerCount           = 1;
+    viewDesc.aspect                    = WGPUTextureAspect_All;
+
+    texture->view    = wgpuTextureCreateView(texture->texture, &viewDesc);
+    texture->sampler = Texture::defaultSampler(ctx);
+
+    log_debug("texture atlas: %d images in %dx%d, %.0f%% used", count, width,
+              height, 100.0 * area / pixelCount);
+    FREE_ARRAY(AtlasCell, cells, count);
+    FREE_ARRAY(u32, order, count);
+    return true;
+}
+
+struct AtlasDecodeJob {
+    const char* const* filenames;
+    TextureAtlasImage* images;
+};
+
+static void decodeImage(void* userData, u32 index)
+{
+    AtlasDecodeJob* job      = (AtlasDecodeJob*)userData;
+    TextureAtlasImage* image = &job->images[index];
+
+    i32 width = 0, height = 0, comps = 0;
+    image->pixels = stbi_load(job->filenames[index], &width, &height, &comps,
+                              STBI_rgb_alpha);
+    image->width  = width;
+    image->height = height;
+}
+
+bool TextureAtlas::initFromFiles(GraphicsContext* ctx, TextureAtlas* atlas,
+                                 const char* const* filenames, u32 count,
+                                 u32 maxSize)
+{
+    // global, the same for every worker (see Texture::initFromFiles())
+    stbi_set_flip_vertically_on_load(true);
+
+    AtlasDecodeJob job = {};
+    job.filenames      = filenames;
+    job.images         = ALLOCATE_COUNT(TextureAtlasImage, count);
+    JobSystem::parallelFor(count, decodeImage, &job);
+
+    bool ok = true;
+    for (u32 i = 0; i < count; i++) {
+        if (job.images[i].pixels) continue;
+        log_error("texture atlas: couldn't load '%s'", filenames[i]);
+        ok = false;
+    }
+    if (ok) ok = TextureAtlas::init(ctx, atlas, job.images, count, maxSize);
+
+    for (u32 i = 0; i < count; i++)
+        if (job.images[i].pixels)
+            stbi_image_free((void*)job.images[i].pixels);
+    FREE_ARRAY(TextureAtlasImage, job.images, count);
+    return ok;
+}
+
+void TextureAtlas::release(TextureAtlas* atlas)
+{
+    Texture::release(&atlas->texture);
+    FREE_ARRAY(glm::vec4, atlas->uvRects, atlas->count);
+    *atlas = {};
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "common.h"
+#include "context.h"
+
+// ============================================================================
+// Texture Atlas
+// ============================================================================
+
+// Packs many small images into one RGBA8 texture, so materials that only
+// differ by their image can share a texture and, with a MaterialBuffer, one
+// bind group. A material picks its image with MaterialUniforms::uvRect.
+//
+// Images are placed by a skyline bottom-left packer, tallest first, into
+// the smallest power of two size (square or 2:1) they fit. The packer
+// works in cells of TEXTURE_ATLAS_PADDING texels: every image is surrounded
+// by at least that many texels repeating its edge and starts on a cell
+// boundary, so the mip chain (box filtered on the CPU, see CPUMipChain)
+// never mixes two images down to the level where the padding is one texel
+// wide; the chain stops there. Rects don't repeat, uvs must stay in [0, 1].
+//
+// Same sized images of the same format are better off as layers of one
+// array texture, see Texture::initArrayFromFiles().
+
+#define TEXTURE_ATLAS_PADDING 8 // texels, power of two
+#define TEXTURE_ATLAS_MAX_SIZE 4096
+
+struct SkylineNode {
+    u32 x;
+    u32 y; // filled up to
+    u32 width;
+};
+
+/// @brief Skyline bottom-left rectangle packer, in whatever unit the caller
+/// uses
+struct RectPacker {
+    u32 width;
+    u32 height;
+
+    SkylineNode* nodes; // left to right, covering the width
+    u32 count;
+    u32 capacity;
+
+    static void init(RectPacker* packer, u32 width, u32 height);
+    /// @return false if the rect doesn't fit
+    static bool pack(RectPacker* packer, u32 width, u32 height, u32* x,
+                     u32* y);
+    static void release(RectPacker* packer);
+};
+
+struct TextureAtlasImage {
+    const u8* pixels; // RGBA8, tightly packed
+    u32 width;
+    u32 height;
+};
+
+struct TextureAtlas {
+    Texture texture;
+    u32 count;
+    glm::vec4* uvRects; // per image, in order: uv offset xy, scale zw
+
+    /// @brief False if the images don't fit in maxSize (logged)
+    static bool init(GraphicsContext* ctx, TextureAtlas* atlas,
+                     const TextureAtlasImage* images, u32 count,
+                     u32 maxSize = TEXTURE_ATLAS_MAX_SIZE);
+    /// @brief Images via stb_image, decoded on the job system. False if any
+    /// fails to load or they don't fit (logged)
+    static bool initFromFiles(GraphicsContext* ctx, TextureAtlas* atlas,
+                              const char* const* filenames, u32 count,
+                              u32 maxSize = TEXTURE_ATLAS_MAX_SIZE);
+    static void release(TextureAtlas* atlas);
+};
@@ -0,0 +1,425 @@
+#include <atomic>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <direct.h> // _mkdir
+#include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "stb/stb_image.h"
+
+#include "core/log.h"
+#include "hash.h"
+#include "memory.h"
+#include "texture_bake.h"
+
+// ============================================================================
+// Texture Bake Cache
+// ============================================================================
+
+// implementations.cpp, next to stb_image's thread local flip flag
+int stbiFlipThreadState();
+void stbiRestoreFlipThreadState(int state);
+
+struct TextureBakeCacheState {
+    bool enabled;
+    char directory[TEXTURE_BAKE_PATH_LENGTH];
+
+    // bumped by workers
+    std::atomic<u32> hits;
+    std::atomic<u32> bakes;
+    std::atomic<u32> writeFailures;
+    std::atomic<u32> tempFiles; // unique temporary names
+};
+
+static TextureBakeCacheState bakeCache;
+
+static u64 alignUp(u64 value, u64 alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/// @brief A word at a time: FNV-1a per byte is slow for multi megabyte
+/// files. The shift folds high bits back down, which the multiply alone
+/// never does
+static u64 hashSource(const u8* bytes, u64 size)
+{
+    u64 hash  = HASH_SEED;
+    u64 words = size / sizeof(u64);
+    for (u64 i = 0; i < words; i++) {
+        u64 word;
+        memcpy(&word, bytes + i * sizeof(u64), sizeof(u64));
+        hash = (hash ^ word) * HASH_PRIME;
+        hash ^= hash >> 32;
+    }
+    return hashBytes(bytes + words * sizeof(u64), size - words * sizeof(u64),
+                     hash);
+}
+
+static u64 bakeKey(const u8* source, u64 size,
+                   const TextureBakeSettings* settings)
+{
+    u64 key = hashSource(source, size);
+    key     = hashCombine(key, TEXTURE_BAKE_VERSION);
+    key     = hashCombine(key, settings->format);
+    key     = hashCombine(key, settings->filter);
+    key     = hashCombine(key, settings->levelCount);
+    key     = hashCombine(key, settings->flipY);
+    return key;
+}
+
+static bool readFile(const char* filename, u8** data, u64* size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) return false;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (length <= 0) {
+        fclose(f);
+        return false;
+    }
+    *size    = (u64)length;
+    *data    = ALLOCATE_BYTES(u8, *size);
+    u64 read = fread(*data, 1, *size, f);
+    fclose(f);
+    if (read != *size) {
+        FREE_ARRAY(u8, *data, *size);
+        return false;
+    }
+    return true;
+}
+
+/// @brief Check the header against key and the file size, fill in the
+/// levels
+static bool parse(BakedTexture* baked, u64 key)
+{
+    if (baked->size < sizeof(TextureBakeHeader)) return false;
+    TextureBakeHeader header;
+    memcpy(&header, baked->data, sizeof(header));
+    if (header.magic != TEXTURE_BAKE_MAGIC
+        || header.version != TEXTURE_BAKE_VERSION || header.key != key
+        || header.levelCount == 0 || header.levelCount > CPU_MIP_MAX_LEVELS)
+        return false;
+
+    baked->format     = (WGPUTextureFormat)header.format;
+    baked->width      = header.width;
+    baked->height     = header.height;
+    baked->levelCount = header.levelCount;
+    for (u32 level = 0; level < header.levelCount; level++) {
+        CPUMipLevel* dst = &baked->levels[level];
+        dst->width       = MAX(header.width >> level, 1u);
+        dst->height      = MAX(header.height >> level, 1u);
+        dst->bytes       = header.levelBytes[level];
+        if (dst->bytes != 4ull * dst->width * dst->height
+            || header.levelOffsets[level] > baked->size
+            || dst->bytes > baked->size - header.levelOffsets[level])
+            return false;
+        dst->pixels = baked->data + header.levelOffsets[level];
+    }
+    return true;
+}
+
+#if defined(_WIN32)
+
+static bool mapFile(BakedTexture* baked, const char* path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return false;
+
+    // the view keeps the mapping alive
+    baked->data = (u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (baked->data == NULL) return false;
+    baked->size   = (u64)size.QuadPart;
+    baked->mapped = true;
+    return true;
+}
+
+static void unmapFile(BakedTexture* baked)
+{
+    UnmapViewOfFile(baked->data);
+}
+
+static bool makeDirectory(const char* path)
+{
+    return _mkdir(path) == 0 || errno == EEXIST;
+}
+
+static bool replaceFile(const char* from, const char* to)
+{
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#elif !defined(__EMSCRIPTEN__)
+
+static bool mapFile(BakedTexture* baked, const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if (data == MAP_FAILED) return false;
+
+    baked->data   = (u8*)data;
+    baked->size   = (u64)info.st_size;
+    baked->mapped = true;
+    return true;
+}
+
+static void unmapFile(BakedTexture* baked)
+{
+    munmap(baked->data, baked->size);
+}
+
+static bool makeDirectory(const char* path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static bool replaceFile(const char* from, const char* to)
+{
+    return rename(from, to) == 0;
+}
+
+#else
+
+// no persistent file system, init() leaves the cache disabled
+
+static bool mapFile(BakedTexture* baked, const char* path)
+{
+    UNUSED_VAR(baked);
+    UNUSED_VAR(path);
+    return false;
+}
+
+static void unmapFile(BakedTexture* baked)
+{
+    UNUSED_VAR(baked);
+}
+
+static bool makeDirectory(const char* path)
+{
+    UNUSED_VAR(path);
+    return false;
+}
+
+static bool replaceFile(const char* from, const char* to)
+{
+    UNUSED_VAR(from);
+    UNUSED_VAR(to);
+    return false;
+}
+
+#endif
+
+/// @brief mkdir -p
+static bool makeDirectories(const char* directory)
+{
+    char path[TEXTURE_BAKE_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s", directory);
+    for (char* c = path + 1; *c; c++) {
+        if (*c != '/' && *c != '\\') continue;
+        char separator = *c;
+        *c             = '\0';
+        makeDirectory(path);
+        *c = separator;
+    }
+    return makeDirectory(path);
+}
+
+/// @brief Decode source and lay out the whole file in memory
+static bool bake(BakedTexture* baked, const u8* source, u64 sourceBytes,
+                 u64 key, const TextureBakeSettings* settings)
+{
+    // per thread, so bakes with other settings don't race the global flag.
+    // Restored after, workers keep following whatever the caller set
+    int flipState = stbiFlipThreadState();
+    stbi_set_flip_vertically_on_load_thread(settings->flipY);
+    i32 width = 0, height = 0, comps = 0;
+    stbi_uc* pixels = stbi_load_from_memory(source, (int)sourceBytes, &width,
+                                            &height, &comps, STBI_rgb_alpha);
+    stbiRestoreFlipThreadState(flipState);
+    if (pixels == NULL) {
+        baked->error = stbi_failure_reason();
+        return false;
+    }
+
+    CPUMipChain chain = {};
+    CPUMipChain::generate(&chain, pixels, width, height, settings->format,
+                          settings->filter, settings->levelCount);
+    stbi_image_free(pixels);
+
+    TextureBakeHeader header = {};
+    header.magic             = TEXTURE_BAKE_MAGIC;
+    header.version           = TEXTURE_BAKE_VERSION;
+    header.key               = key;
+    header.format            = WGPUTextureFormat_RGBA8Unorm;
+    header.width             = width;
+    header.height            = height;
+    header.levelCount        = chain.levelCount;
+
+    u64 size = alignUp(sizeof(header), TEXTURE_BAKE_ALIGNMENT);
+    for (u32 level = 0; level < chain.levelCount; level++) {
+        header.levelOffsets[level] = size;
+        header.levelBytes[level]   = chain.levels[level].bytes;
+        size = alignUp(size + chain.levels[level].bytes,
+                       TEXTURE_BAKE_ALIGNMENT);
+    }
+
+    baked->size = size;
+    baked->data = ALLOCATE_BYTES(u8, size);
+    memcpy(baked->data, &header, sizeof(header));
+    for (u32 level = 0; level < chain.levelCount; level++) {
+        memcpy(baked->data + header.levelOffsets[level],
+               chain.levels[level].pixels, chain.levels[level].bytes);
+    }
+    CPUMipChain::release(&chain);
+    return true;
+}
+
+/// @brief Write to a temporary name, then rename into place
+static bool writeBake(const BakedTexture* baked, const char* path)
+{
+    char temporary[TEXTURE_BAKE_PATH_LENGTH];
+    snprintf(temporary, sizeof(temporary), "%s.%u.tmp", path,
+             bakeCache.tempFiles.fetch_add(1));
+
+    FILE* f = fopen(temporary, "wb");
+    if (f == NULL) return false;
+    bool written = fwrite(baked->data, 1, baked->size, f) == baked->size;
+    written      = fclose(f) == 0 && written;
+    if (written) written = replaceFile(temporary, path);
+    if (!written) remove(temporary);
+    return written;
+}
+
+void BakedTexture::upload(GraphicsContext* ctx, const BakedTexture* baked,
+                          WGPUTexture texture, u32 firstLevel)
+{
+    for (u32 level = firstLevel; level < baked->levelCount; level++) {
+        const CPUMipLevel* src = &baked->levels[level];
+
+        WGPUImageCopyTexture destination = {};
+        destination.texture              = texture;
+        destination.mipLevel             = level - firstLevel;
+        destination.aspect               = WGPUTextureAspect_All;
+        WGPUTextureDataLayout layout     = {};
+        layout.bytesPerRow               = 4 * src->width;
+        layout.rowsPerImage              = src->height;
+        WGPUExtent3D extent              = { src->width, src->height, 1 };
+        wgpuQueueWriteTexture(ctx->queue, &destination, src->pixels,
+                              src->bytes, &layout, &extent);
+    }
+}
+
+void BakedTexture::release(BakedTexture* baked)
+{
+    if (baked->mapped)
+        unmapFile(baked);
+    else if (baked->data)
+        FREE_ARRAY(u8, baked->data, baked->size);
+    *baked = {};
+}
+
+void TextureBakeCache::init(const char* directory)
+{
+#ifdef __EMSCRIPTEN__
+    UNUSED_VAR(directory);
+    log_info("texture bake cache: no persistent file system, disabled");
+#else
+    if (!makeDirectories(directory)) {
+        log_warn("texture bake cache: couldn't create '%s', disabled",
+                 directory);
+        return;
+    }
+    snprintf(bakeCache.directory, sizeof(bakeCache.directory), "%s",
+             directory);
+    bakeCache.enabled = true;
+    log_debug("texture bake cache: '%s'", directory);
+#endif
+}
+
+bool TextureBakeCache::enabled()
+{
+    return bakeCache.enabled;
+}
+
+bool TextureBakeCache::load(BakedTexture* baked, const char* filename,
+                            const TextureBakeSettings* settings)
+{
+    *baked = {};
+    if (!bakeCache.enabled) {
+        baked->error = "bake cache disabled";
+        return false;
+    }
+
+    u8* source = NULL;
+    u64 size   = 0;
+    if (!readFile(filename, &source, &size)) {
+        baked->error = "can't read file";
+        return false;
+    }
+    u64 key = bakeKey(source, size, settings);
+
+    char path[TEXTURE_BAKE_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%016llx.tbake", bakeCache.directory,
+             (unsigned long long)key);
+
+    if (mapFile(baked, path)) {
+        if (parse(baked, key)) {
+            FREE_ARRAY(u8, source, size);
+            bakeCache.hits++;
+            return true;
+        }
+        // torn by an older version or a full disk, bake over it
+        BakedTexture::release(baked);
+    }
+
+    bool decoded = bake(baked, source, size, key, settings);
+    FREE_ARRAY(u8, source, size);
+    if (!decoded) return false;
+
+    bakeCache.bakes++;
+    if (!writeBake(baked, path)) bakeCache.writeFailures++;
+    bool parsed = parse(baked, key);
+    ASSERT(parsed);
+    UNUSED_VAR(parsed);
+    return true;
+}
+
+void TextureBakeCache::logStats()
+{
+    log_info("texture bake cache: %u hits, %u baked, %u failed writes",
+             bakeCache.hits.load(), bakeCache.bakes.load(),
+             bakeCache.writeFailures.load());
+}
+
+void TextureBakeCache::release()
+{
+    bakeCache.enabled = false;
+    bakeCache.hits.store(0);
+    bakeCache.bakes.store(0);
+    bakeCache.writeFailures.store(0);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+#include "cpu_mips.h"
+
+// ============================================================================
+// Texture Bake Cache
+// ============================================================================
+
+// Decoding a JPEG/PNG, expanding it to RGBA, flipping it and filtering its
+// mips costs tens of milliseconds per 2K image, on every launch. The bake
+// cache does it once and keeps the result on disk: a flat file with a
+// header and the texel data of every mip level, each level aligned to
+// TEXTURE_BAKE_ALIGNMENT, ready for wgpuQueueWriteTexture. Later loads map
+// the file and upload the levels straight from the mapping.
+//
+// Files are content addressed: named by a hash of the source file's bytes
+// and the import settings (and TEXTURE_BAKE_VERSION), so an edited image or
+// different settings simply miss and bake a new file; nothing is ever
+// invalidated in place. A hit still reads and hashes the source, which is
+// much cheaper than decoding it. Stale files are never deleted, clear the
+// directory by hand.
+//
+// A bake is written to a temporary file and renamed into place, so
+// concurrent bakes of the same image (or a crash) never leave a torn file.
+// If the directory isn't writable the bake is used from memory and the
+// next launch tries again.
+//
+// Texture::initFromFiles(), TextureStreaming and TextureResidency go
+// through the cache once init() has been called. Not available on the web
+// (no persistent file system), init() leaves the cache disabled there.
+//
+// Usage:
+//   TextureBakeCache::init(); // ./cache/textures
+//   Texture::initFromFile(ctx, &texture, "albedo.png", true);
+
+#define TEXTURE_BAKE_DIRECTORY "./cache/textures"
+#define TEXTURE_BAKE_MAGIC 0x454B4254u // "TBKE"
+#define TEXTURE_BAKE_VERSION 1         // bump when the layout or mips change
+#define TEXTURE_BAKE_ALIGNMENT 256     // level offsets in the file
+#define TEXTURE_BAKE_PATH_LENGTH 512
+
+/// @brief Everything besides the source bytes that shapes the baked texels
+struct TextureBakeSettings {
+    CPUMipFormat format; // RGBA8 only. sRGB filters in linear space, the
+                         // texels stay sRGB encoded like CPUMipChain's
+    MipFilter filter;
+    u32 levelCount; // 0 for the full chain, 1 for no mips
+    bool flipY;     // bottom row first, like stbi_set_flip_vertically_on_load
+};
+
+/// @brief On disk, at offset 0. Little endian
+struct TextureBakeHeader {
+    u32 magic;
+    u32 version;
+    u64 key; // source and settings hash, also the file name
+    u32 format;
+    u32 width;
+    u32 height;
+    u32 levelCount;
+    u64 levelOffsets[CPU_MIP_MAX_LEVELS]; // from the file start
+    u64 levelBytes[CPU_MIP_MAX_LEVELS];   // tightly packed rows
+};
+
+/// @brief A mapped (or, after a failed write, in memory) bake
+struct BakedTexture {
+    u8* data; // the whole file, read only when mapped
+    u64 size;
+    bool mapped; // else data is owned
+
+    WGPUTextureFormat format;
+    u32 width;
+    u32 height;
+    u32 levelCount;
+    CPUMipLevel levels[CPU_MIP_MAX_LEVELS]; // pixels point into data
+
+    const char* error; // why TextureBakeCache::load() failed, static string
+
+    /// @brief wgpuQueueWriteTexture for levels [firstLevel, levelCount),
+    /// firstLevel going to mip level 0 of texture
+    static void upload(GraphicsContext* ctx, const BakedTexture* baked,
+                       WGPUTexture texture, u32 firstLevel = 0);
+
+    /// @brief Unmap or free. No-op on a zeroed BakedTexture
+    static void release(BakedTexture* baked);
+};
+
+struct TextureBakeCache {
+    /// @brief Enable the cache, creating directory if needed. Main thread,
+    /// before any loads
+    static void init(const char* directory = TEXTURE_BAKE_DIRECTORY);
+    static bool enabled();
+
+    /// @brief Map the bake of filename with settings, decoding and baking
+    /// it first on a miss. False if the cache is disabled or the source
+    /// can't be read or decoded (see baked->error). Thread safe, meant for
+    /// job system workers
+    static bool load(BakedTexture* baked, const char* filename,
+                     const TextureBakeSettings* settings);
+
+    /// @brief Hits, bakes and failed writes since init
+    static void logStats();
+
+    /// @brief Disable the cache
+    static void release();
+};
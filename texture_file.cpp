@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "gpu_memory.h"
+#include "memory.h"
+#include "texture_file.h"
+
+// ============================================================================
+// KTX2
+// ============================================================================
+
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+
+static const u8 ktx2Identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n',
+};
+
+struct KTX2Header {
+    u8 identifier[12];
+    u32 vkFormat;
+    u32 typeSize;
+    u32 pixelWidth;
+    u32 pixelHeight;
+    u32 pixelDepth;
+    u32 layerCount;
+    u32 faceCount;
+    u32 levelCount; // 0: generate at runtime
+    u32 supercompressionScheme;
+
+    // index
+    u32 dfdByteOffset;
+    u32 dfdByteLength;
+    u32 kvdByteOffset;
+    u32 kvdByteLength;
+    u64 sgdByteOffset;
+    u64 sgdByteLength;
+};
+
+struct KTX2Level {
+    u64 byteOffset;
+    u64 byteLength;
+    u64 uncompressedByteLength;
+};
+
+// VkFormat values
+#define VK_FORMAT_R8G8B8A8_UNORM 37
+#define VK_FORMAT_R8G8B8A8_SRGB 43
+#define VK_FORMAT_R16G16B16A16_SFLOAT 97
+#define VK_FORMAT_R32G32B32A32_SFLOAT 109
+#define VK_FORMAT_BC1_RGB_UNORM_BLOCK 131
+#define VK_FORMAT_BC1_RGB_SRGB_BLOCK 132
+#define VK_FORMAT_BC1_RGBA_UNORM_BLOCK 133
+#define VK_FORMAT_BC7_SRGB_BLOCK 146
+#define VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK 147
+#define VK_FORMAT_EAC_R11G11_SNORM_BLOCK 156
+#define VK_FORMAT_ASTC_4x4_UNORM_BLOCK 157
+#define VK_FORMAT_ASTC_12x12_SRGB_BLOCK 184
+
+static WGPUTextureFormat ktx2Format(u32 vkFormat)
+{
+    switch (vkFormat) {
+        case VK_FORMAT_R8G8B8A8_UNORM: return WGPUTextureFormat_RGBA8Unorm;
+        case VK_FORMAT_R8G8B8A8_SRGB: return WGPUTextureFormat_RGBA8UnormSrgb;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return WGPUTextureFormat_RGBA16Float;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return WGPUTextureFormat_RGBA32Float;
+        // WebGPU has no BC1 without alpha, the RGBA variant decodes the same
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            return WGPUTextureFormat_BC1RGBAUnorm;
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            return WGPUTextureFormat_BC1RGBAUnormSrgb;
+        default: break;
+    }
+
+    // the compressed VkFormats are listed in the same order as WebGPU's
+    if (vkFormat >= VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+        && vkFormat <= VK_FORMAT_BC7_SRGB_BLOCK) {
+        return (WGPUTextureFormat)(WGPUTextureFormat_BC1RGBAUnorm + vkFormat
+                                   - VK_FORMAT_BC1_RGBA_UNORM_BLOCK);
+    }
+    if (vkFormat >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+        && vkFormat <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK) {
+        return (WGPUTextureFormat)(WGPUTextureFormat_ETC2RGB8Unorm + vkFormat
+                                   - VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK);
+    }
+    if (vkFormat >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK
+        && vkFormat <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+        return (WGPUTextureFormat)(WGPUTextureFormat_ASTC4x4Unorm + vkFormat
+                                   - VK_FORMAT_ASTC_4x4_UNORM_BLOCK);
+    }
+    return WGPUTextureFormat_Undefined;
+}
+
+/// @brief From the KTXorientation key, one letter per axis: "rd" (the
+/// default, also when the key is missing) is top row first, "ru" bottom row
+/// first
+static bool ktx2TopRowFirst(const TextureFile* file, const KTX2Header* header)
+{
+    static const char key[] = "KTXorientation"; // with its NUL
+
+    u64 offset = header->kvdByteOffset;
+    u64 end    = offset + header->kvdByteLength;
+    if (end > file->size) return true;
+
+    // { u32 length; key\0 value } entries, each padded to 4 bytes
+    while (offset + sizeof(u32) <= end) {
+        u32 length = 0;
+        memcpy(&length, file->data + offset, sizeof(u32));
+        offset += sizeof(u32);
+        if (length > end - offset) break;
+
+        const char* entry = (const char*)file->data + offset;
+        if (length >= sizeof(key) + 2 && memcmp(entry, key, sizeof(key)) == 0)
+            return entry[sizeof(key) + 1] != 'u';
+        offset += (length + 3) & ~3u;
+    }
+    return true;
+}
+
+static bool parseKTX2(TextureFile* file)
+{
+    KTX2Header header = {};
+    if (file->size < sizeof(KTX2Header)) {
+        file->error = "truncated KTX2 header";
+        return false;
+    }
+    memcpy(&header, file->data, sizeof(header));
+
+    if (header.supercompressionScheme != 0) {
+        file->error = "supercompressed KTX2 (Basis, zstd, zlib)";
+        return false;
+    }
+    if (header.pixelDepth > 1) {
+        file->error = "3D textures are not supported";
+        return false;
+    }
+
+    file->format      = ktx2Format(header.vkFormat);
+    file->width       = header.pixelWidth;
+    file->height      = MAX(header.pixelHeight, 1u);
+    file->faces       = MAX(header.faceCount, 1u);
+    file->layers      = MAX(header.layerCount, 1u) * file->faces;
+    file->levelCount  = MAX(header.levelCount, 1u);
+    file->topRowFirst = ktx2TopRowFirst(file, &header);
+    if (file->format == WGPUTextureFormat_Undefined) {
+        file->error = "unsupported KTX2 vkFormat";
+        return false;
+    }
+    if (file->levelCount > TEXTURE_FILE_MAX_LEVELS) {
+        file->error = "too many mip levels";
+        return false;
+    }
+
+    // level index follows the header, largest level first
+    u64 indexBytes = file->levelCount * sizeof(KTX2Level);
+    if (file->size < sizeof(KTX2Header) + indexBytes) {
+        file->error = "truncated KTX2 level index";
+        return false;
+    }
+    for (u32 level = 0; level < file->levelCount; level++) {
+        KTX2Level entry = {};
+        memcpy(&entry,
+               file->data + sizeof(KTX2Header) + level * sizeof(KTX2Level),
+               sizeof(entry));
+
+        // layers and faces of a level are packed back to back
+        u64 imageBytes = TextureFile::imageBytes(file, level);
+        if (entry.byteLength < imageBytes * file->layers
+            || entry.byteOffset + entry.byteLength > file->size) {
+            file->error = "KTX2 level data out of bounds";
+            return false;
+        }
+        file->levelOffsets[level] = entry.byteOffset;
+        file->layerStrides[level] = imageBytes;
+    }
+    return true;
+}
+
+// ============================================================================
+// DDS
+// ============================================================================
+
+// https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-pguide
+
+#define DDS_FOURCC(a, b, c, d)                                                 \
+    ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+#define DDS_MAGIC DDS_FOURCC('D', 'D', 'S', ' ')
+#define DDPF_FOURCC 0x4
+#define DDPF_RGB 0x40
+#define DDSCAPS2_CUBEMAP 0x200
+#define DDSCAPS2_CUBEMAP_ALLFACES 0xFC00
+#define DDSCAPS2_VOLUME 0x200000
+#define DDS_RESOURCE_MISC_TEXTURECUBE 0x4
+#define DDS_DIMENSION_TEXTURE3D 4
+
+struct DDSPixelFormat {
+    u32 size;
+    u32 flags;
+    u32 fourCC;
+    u32 rgbBitCount;
+    u32 rBitMask;
+    u32 gBitMask;
+    u32 bBitMask;
+    u32 aBitMask;
+};
+
+struct DDSHeader {
+    u32 size;
+    u32 flags;
+    u32 height;
+    u32 width;
+    u32 pitchOrLinearSize;
+    u32 depth;
+    u32 mipMapCount;
+    u32 reserved1[11];
+    DDSPixelFormat pixelFormat;
+    u32 caps;
+    u32 caps2;
+    u32 caps3;
+    u32 caps4;
+    u32 reserved2;
+};
+
+struct DDSHeaderDX10 {
+    u32 dxgiFormat;
+    u32 resourceDimension;
+    u32 miscFlag;
+    u32 arraySize;
+    u32 miscFlags2;
+};
+
+static WGPUTextureFormat dxgiFormat(u32 format)
+{
+    switch (format) {
+        case 2: return WGPUTextureFormat_RGBA32Float;
+        case 10: return WGPUTextureFormat_RGBA16Float;
+        case 28: return WGPUTextureFormat_RGBA8Unorm;
+        case 29: return WGPUTextureFormat_RGBA8UnormSrgb;
+        case 71: return WGPUTextureFormat_BC1RGBAUnorm;
+        case 72: return WGPUTextureFormat_BC1RGBAUnormSrgb;
+        case 74: return WGPUTextureFormat_BC2RGBAUnorm;
+        case 75: return WGPUTextureFormat_BC2RGBAUnormSrgb;
+        case 77: return WGPUTextureFormat_BC3RGBAUnorm;
+        case 78: return WGPUTextureFormat_BC3RGBAUnormSrgb;
+        case 80: return WGPUTextureFormat_BC4RUnorm;
+        case 81: return WGPUTextureFormat_BC4RSnorm;
+        case 83: return WGPUTextureFormat_BC5RGUnorm;
+        case 84: return WGPUTextureFormat_BC5RGSnorm;
+        case 87: return WGPUTextureFormat_BGRA8Unorm;
+        case 91: return WGPUTextureFormat_BGRA8UnormSrgb;
+        case 95: return WGPUTextureFormat_BC6HRGBUfloat;
+        case 96: return WGPUTextureFormat_BC6HRGBFloat;
+        case 98: return WGPUTextureFormat_BC7RGBAUnorm;
+        case 99: return WGPUTextureFormat_BC7RGBAUnormSrgb;
+        default: return WGPUTextureFormat_Undefined;
+    }
+}
+
+static WGPUTextureFormat ddsLegacyFormat(const DDSPixelFormat* pf)
+{
+    if (pf->flags & DDPF_FOURCC) {
+        switch (pf->fourCC) {
+            case DDS_FOURCC('D', 'X', 'T', '1'):
+                return WGPUTextureFormat_BC1RGBAUnorm;
+            case DDS_FOURCC('D', 'X', 'T', '2'):
+            case DDS_FOURCC('D', 'X', 'T', '3'):
+                return WGPUTextureFormat_BC2RGBAUnorm;
+            case DDS_FOURCC('D', 'X', 'T', '4'):
+            case DDS_FOURCC('D', 'X', 'T', '5'):
+                return WGPUTextureFormat_BC3RGBAUnorm;
+            case DDS_FOURCC('A', 'T', 'I', '1'):
+            case DDS_FOURCC('B', 'C', '4', 'U'):
+                return WGPUTextureFormat_BC4RUnorm;
+            case DDS_FOURCC('B', 'C', '4', 'S'):
+                return WGPUTextureFormat_BC4RSnorm;
+            case DDS_FOURCC('A', 'T', 'I', '2'):
+            case DDS_FOURCC('B', 'C', '5', 'U'):
+                return WGPUTextureFormat_BC5RGUnorm;
+            case DDS_FOURCC('B', 'C', '5', 'S'):
+                return WGPUTextureFormat_BC5RGSnorm;
+            default: return WGPUTextureFormat_Undefined;
+        }
+    }
+    if ((pf->flags & DDPF_RGB) && pf->rgbBitCount == 32) {
+        if (pf->rBitMask == 0xFF && pf->bBitMask == 0xFF0000)
+            return WGPUTextureFormat_RGBA8Unorm;
+        if (pf->rBitMask == 0xFF0000 && pf->bBitMask == 0xFF)
+            return WGPUTextureFormat_BGRA8Unorm;
+    }
+    return WGPUTextureFormat_Undefined;
+}
+
+static bool parseDDS(TextureFile* file)
+{
+    u64 offset = sizeof(u32) + sizeof(DDSHeader);
+    if (file->size < offset) {
+        file->error = "truncated DDS header";
+        return false;
+    }
+    DDSHeader header = {};
+    memcpy(&header, file->data + sizeof(u32), sizeof(header));
+    if (header.caps2 & DDSCAPS2_VOLUME) {
+        file->error = "3D textures are not supported";
+        return false;
+    }
+
+    file->width       = header.width;
+    file->height      = header.height;
+    file->levelCount  = MAX(header.mipMapCount, 1u);
+    file->faces       = 1;
+    file->layers      = 1;
+    file->topRowFirst = true; // always
+
+    if ((header.pixelFormat.flags & DDPF_FOURCC)
+        && header.pixelFormat.fourCC == DDS_FOURCC('D', 'X', '1', '0')) {
+        DDSHeaderDX10 dx10 = {};
+        if (file->size < offset + sizeof(dx10)) {
+            file->error = "truncated DDS DX10 header";
+            return false;
+        }
+        memcpy(&dx10, file->data + offset, sizeof(dx10));
+        offset += sizeof(dx10);
+
+        if (dx10.resourceDimension == DDS_DIMENSION_TEXTURE3D) {
+            file->error = "3D textures are not supported";
+            return false;
+        }
+        file->format = dxgiFormat(dx10.dxgiFormat);
+        if (dx10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) file->faces = 6;
+        file->layers = MAX(dx10.arraySize, 1u) * file->faces;
+    } else {
+        file->format = ddsLegacyFormat(&header.pixelFormat);
+        if (header.caps2 & DDSCAPS2_CUBEMAP) {
+            if ((header.caps2 & DDSCAPS2_CUBEMAP_ALLFACES)
+                != DDSCAPS2_CUBEMAP_ALLFACES) {
+                file->error = "partial cube maps are not supported";
+                return false;
+            }
+            file->faces  = 6;
+            file->layers = 6;
+        }
+    }
+    if (file->format == WGPUTextureFormat_Undefined) {
+        file->error = "unsupported DDS format";
+        return false;
+    }
+    if (file->levelCount > TEXTURE_FILE_MAX_LEVELS) {
+        file->error = "too many mip levels";
+        return false;
+    }
+
+    // every layer holds its whole mip chain
+    u64 layerBytes = 0;
+    for (u32 level = 0; level < file->levelCount; level++) {
+        file->levelOffsets[level] = offset + layerBytes;
+        layerBytes += TextureFile::imageBytes(file, level);
+    }
+    for (u32 level = 0; level < file->levelCount; level++)
+        file->layerStrides[level] = layerBytes;
+
+    if (offset + layerBytes * file->layers > file->size) {
+        file->error = "DDS data out of bounds";
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Orientation
+// ============================================================================
+
+// Files store the top row first, the renderer expects the bottom row first
+// (stbi_set_flip_vertically_on_load). Uncompressed images swap rows. BC1-5
+// blocks swap block rows, then the rows inside each block: their indices
+// are row by row and the endpoints are shared by the whole block. That
+// only works while whole block rows trade places, so every level has to be
+// a multiple of 4 rows or fit in a single block row (power of two sizes
+// always do). BC6H/BC7 partitions and ETC2/ASTC blocks can't be flipped
+// without re-encoding.
+
+static bool blockFlippable(WGPUTextureFormat format)
+{
+    return format >= WGPUTextureFormat_BC1RGBAUnorm
+           && format <= WGPUTextureFormat_BC5RGSnorm;
+}
+
+/// @brief BC1 color indices, a byte per row after the two endpoints. Also
+/// the color half of BC2/BC3
+static void flipColorRows(u8* block, u32 rows)
+{
+    u8* indices = block + 4;
+    for (u32 i = 0; i < rows / 2; i++) {
+        u8 row                = indices[i];
+        indices[i]            = indices[rows - 1 - i];
+        indices[rows - 1 - i] = row;
+    }
+}
+
+/// @brief BC2 explicit alpha, 16 bits per row
+static void flipExplicitAlphaRows(u8* block, u32 rows)
+{
+    for (u32 i = 0; i < rows / 2; i++) {
+        u8 row[2];
+        memcpy(row, block + 2 * i, 2);
+        memcpy(block + 2 * i, block + 2 * (rows - 1 - i), 2);
+        memcpy(block + 2 * (rows - 1 - i), row, 2);
+    }
+}
+
+/// @brief BC4 (and BC3 alpha, BC5 channels): two endpoints, then 3 bit
+/// indices, 12 bits per row, little endian
+static void flipInterpolatedRows(u8* block, u32 rows)
+{
+    u64 indices = 0;
+    for (u32 i = 0; i < 6; i++) indices |= (u64)block[2 + i] << (8 * i);
+
+    u64 flipped = indices;
+    for (u32 i = 0; i < rows; i++) {
+        u64 row = (indices >> (12 * (rows - 1 - i))) & 0xFFF;
+        flipped = (flipped & ~(0xFFFull << (12 * i))) | (row << (12 * i));
+    }
+    for (u32 i = 0; i < 6; i++) block[2 + i] = (u8)(flipped >> (8 * i));
+}
+
+static void flipBlockRows(WGPUTextureFormat format, u8* block, u32 rows)
+{
+    switch (format) {
+        case WGPUTextureFormat_BC1RGBAUnorm:
+        case WGPUTextureFormat_BC1RGBAUnormSrgb:
+            flipColorRows(block, rows);
+            break;
+        case WGPUTextureFormat_BC2RGBAUnorm:
+        case WGPUTextureFormat_BC2RGBAUnormSrgb:
+            flipExplicitAlphaRows(block, rows);
+            flipColorRows(block + 8, rows);
+            break;
+        case WGPUTextureFormat_BC3RGBAUnorm:
+        case WGPUTextureFormat_BC3RGBAUnormSrgb:
+            flipInterpolatedRows(block, rows);
+            flipColorRows(block + 8, rows);
+            break;
+        case WGPUTextureFormat_BC4RUnorm:
+        case WGPUTextureFormat_BC4RSnorm:
+            flipInterpolatedRows(block, rows);
+            break;
+        case WGPUTextureFormat_BC5RGUnorm:
+        case WGPUTextureFormat_BC5RGSnorm:
+            flipInterpolatedRows(block, rows);
+            flipInterpolatedRows(block + 8, rows);
+            break;
+        default: ASSERT(false);
+    }
+}
+
+static bool flippable(const TextureFile* file)
+{
+    u32 blockWidth = 1, blockHeight = 1;
+    GPUMemory::formatBlock(file->format, &blockWidth, &blockHeight);
+    if (blockHeight == 1) return true;
+    if (!blockFlippable(file->format)) return false;
+
+    for (u32 level = 0; level < file->levelCount; level++) {
+        u32 height = MAX(file->height >> level, 1u);
+        if (height > blockHeight && height % blockHeight != 0) return false;
+    }
+    return true;
+}
+
+/// @brief One image of level, in place. scratch holds a row of blocks
+static void flipImage(const TextureFile* file, u8* image, u32 level,
+                      u8* scratch)
+{
+    u32 blockWidth = 1, blockHeight = 1;
+    u32 blockBytes
+      = GPUMemory::formatBlock(file->format, &blockWidth, &blockHeight);
+    u32 width    = MAX(file->width >> level, 1u);
+    u32 height   = MAX(file->height >> level, 1u);
+    u32 blocksX  = (width + blockWidth - 1) / blockWidth;
+    u32 blocksY  = (height + blockHeight - 1) / blockHeight;
+    u64 rowBytes = (u64)blocksX * blockBytes;
+
+    for (u32 y = 0; y < blocksY / 2; y++) {
+        u8* top    = image + y * rowBytes;
+        u8* bottom = image + (blocksY - 1 - y) * rowBytes;
+        memcpy(scratch, top, rowBytes);
+        memcpy(top, bottom, rowBytes);
+        memcpy(bottom, scratch, rowBytes);
+    }
+
+    if (blockHeight == 1) return;
+    u32 rows = MIN(height, blockHeight); // the rest of a lone block is padding
+    for (u64 i = 0; i < (u64)blocksX * blocksY; i++)
+        flipBlockRows(file->format, image + i * blockBytes, rows);
+}
+
+/// @brief Bottom row first where the format allows, see above
+static void flipToBottomRowFirst(TextureFile* file)
+{
+    // cube faces keep the orientation cube sampling expects
+    if (file->faces > 1) file->topRowFirst = false;
+    if (!file->topRowFirst || !flippable(file)) return;
+
+    u32 blockWidth = 1, blockHeight = 1;
+    u32 blockBytes
+      = GPUMemory::formatBlock(file->format, &blockWidth, &blockHeight);
+    u64 scratchBytes
+      = (u64)(file->width + blockWidth - 1) / blockWidth * blockBytes;
+    u8* scratch = ALLOCATE_BYTES(u8, scratchBytes);
+
+    for (u32 level = 0; level < file->levelCount; level++) {
+        for (u32 layer = 0; layer < file->layers; layer++) {
+            u8* image = file->data + file->levelOffsets[level]
+                        + layer * file->layerStrides[level];
+            flipImage(file, image, level, scratch);
+        }
+    }
+    FREE_ARRAY(u8, scratch, scratchBytes);
+    file->topRowFirst = false;
+}
+
+// ============================================================================
+// Texture Files
+// ============================================================================
+
+static bool hasExtension(const char* filename, const char* extension)
+{
+    const char* dot = strrchr(filename, '.');
+    if (dot == NULL) return false;
+
+    // case insensitive, extensions are short ASCII
+    for (dot++; *dot && *extension; dot++, extension++) {
+        char c = *dot >= 'A' && *dot <= 'Z' ? *dot - 'A' + 'a' : *dot;
+        if (c != *extension) return false;
+    }
+    return *dot == '\0' && *extension == '\0';
+}
+
+bool TextureFile::isTextureFile(const char* filename)
+{
+    return hasExtension(filename, "ktx2") || hasExtension(filename, "dds");
+}
+
+bool TextureFile::load(TextureFile* file, const char* filename)
+{
+    *file = {};
+
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        file->error = "can't open file";
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(f);
+        file->error = "empty file";
+        return false;
+    }
+    file->size = (u64)size;
+    file->data = ALLOCATE_BYTES(u8, file->size);
+    u64 read   = fread(file->data, 1, file->size, f);
+    fclose(f);
+
+    bool parsed = false;
+    if (read != file->size) {
+        file->error = "read failed";
+    } else if (file->size >= sizeof(ktx2Identifier)
+               && memcmp(file->data, ktx2Identifier, sizeof(ktx2Identifier))
+                    == 0) {
+        parsed = parseKTX2(file);
+    } else if (file->size >= sizeof(u32)
+               && memcmp(file->data, "DDS ", sizeof(u32)) == 0) {
+        parsed = parseDDS(file);
+    } else {
+        file->error = "not a KTX2 or DDS file";
+    }
+
+    // WebGPU wants the base level of compressed textures in whole blocks
+    u32 blockWidth = 1, blockHeight = 1;
+    if (parsed) {
+        GPUMemory::formatBlock(file->format, &blockWidth, &blockHeight);
+        if (file->width == 0 || file->width % blockWidth != 0
+            || file->height % blockHeight != 0) {
+            file->error = "size is not a multiple of the block size";
+            parsed      = false;
+        }
+    }
+
+    if (parsed) flipToBottomRowFirst(file);
+
+    if (!parsed) {
+        const char* error = file->error;
+        TextureFile::release(file);
+        file->error = error;
+    }
+    return parsed;
+}
+
+bool TextureFile::formatSupported(GraphicsContext* ctx,
+                                  WGPUTextureFormat format)
+{
+    WGPUFeatureName feature = WGPUFeatureName_Undefined;
+    if (format >= WGPUTextureFormat_BC1RGBAUnorm
+        && format <= WGPUTextureFormat_BC7RGBAUnormSrgb)
+        feature = WGPUFeatureName_TextureCompressionBC;
+    else if (format >= WGPUTextureFormat_ETC2RGB8Unorm
+             && format <= WGPUTextureFormat_EACRG11Snorm)
+        feature = WGPUFeatureName_TextureCompressionETC2;
+    else if (format >= WGPUTextureFormat_ASTC4x4Unorm
+             && format <= WGPUTextureFormat_ASTC12x12UnormSrgb)
+        feature = WGPUFeatureName_TextureCompressionASTC;
+
+    return feature == WGPUFeatureName_Undefined
+           || wgpuDeviceHasFeature(ctx->device, feature);
+}
+
+u64 TextureFile::imageBytes(const TextureFile* file, u32 level)
+{
+    u32 blockWidth = 1, blockHeight = 1;
+    u32 blockBytes
+      = GPUMemory::formatBlock(file->format, &blockWidth, &blockHeight);
+    u32 width   = MAX(file->width >> level, 1u);
+    u32 height  = MAX(file->height >> level, 1u);
+    u64 blocksX = (width + blockWidth - 1) / blockWidth;
+    u64 blocksY = (height + blockHeight - 1) / blockHeight;
+    return blocksX * blocksY * blockBytes;
+}
+
+const u8* TextureFile::image(const TextureFile* file, u32 level, u32 layer)
+{
+    ASSERT(level < file->levelCount && layer < file->layers);
+    return file->data + file->levelOffsets[level]
+           + layer * file->layerStrides[level];
+}
+
+void TextureFile::upload(GraphicsContext* ctx, const TextureFile* file,
+                         WGPUTexture texture)
+{
+    u32 blockWidth = 1, blockHeight = 1;
+    u32 blockBytes
+      = GPUMemory::formatBlock(file->format, &blockWidth, &blockHeight);
+
+    for (u32 level = 0; level < file->levelCount; level++) {
+        u32 width   = MAX(file->width >> level, 1u);
+        u32 height  = MAX(file->height >> level, 1u);
+        u32 blocksX = (width + blockWidth - 1) / blockWidth;
+        u32 blocksY = (height + blockHeight - 1) / blockHeight;
+
+        // small levels are copied as whole blocks (the physical size)
+        WGPUImageCopyTexture destination = {};
+        destination.texture              = texture;
+        destination.mipLevel             = level;
+        destination.aspect               = WGPUTextureAspect_All;
+        WGPUTextureDataLayout layout     = {};
+        layout.bytesPerRow               = blocksX * blockBytes;
+        layout.rowsPerImage              = blocksY;
+        WGPUExtent3D extent
+          = { blocksX * blockWidth, blocksY * blockHeight, 1 };
+
+        for (u32 layer = 0; layer < file->layers; layer++) {
+            destination.origin = { 0, 0, layer };
+            wgpuQueueWriteTexture(ctx->queue, &destination,
+                                  TextureFile::image(file, level, layer),
+                                  TextureFile::imageBytes(file, level),
+                                  &layout, &extent);
+        }
+    }
+}
+
+void TextureFile::release(TextureFile* file)
+{
+    if (file->data) FREE_ARRAY(u8, file->data, file->size);
+    *file = {};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "common.h"
+#include "context.h"
+
+// ============================================================================
+// Texture Files
+// ============================================================================
+
+// KTX2 and DDS containers with pre-built mip chains, loaded as is: block
+// compressed data (BC1-7, ETC2/EAC, ASTC) goes to the GPU without decoding,
+// at 4-8x less memory and bandwidth than RGBA8. RGBA8 and RGBA16/32 float
+// files are accepted too.
+//
+// Supported:
+// - KTX2 without supercompression (no Basis, zstd or zlib)
+// - DDS with a DX10 header, or legacy DXT1-5 / ATI1 / ATI2 / BC4 / BC5
+//   FourCCs and 32 bit RGBA
+// - 2D textures, arrays and cube maps (not 3D)
+//
+// The device enables every compression feature the adapter has; whether a
+// file's format can be used is a per device question, see formatSupported().
+// Browsers usually expose BC on desktop and ETC2/ASTC on mobile, so ship both
+// or keep an uncompressed fallback.
+//
+// Texture::initFromFile() picks this loader by file extension.
+//
+// Like every other loader, images end up bottom row first
+// (stbi_set_flip_vertically_on_load), so a .ktx2 or .dds export of a PNG
+// maps the same on the same mesh. Files store the top row first (DDS
+// always, KTX2 unless KTXorientation says "ru"); load() flips uncompressed
+// and BC1-5 data. BC6H, BC7, ETC2/EAC and ASTC blocks can't be flipped
+// without re-encoding and keep topRowFirst set: export them bottom row
+// first or sample them with V flipped (MaterialUniforms::uvRect =
+// (0, 1, 1, -1)). Cube map faces are left as stored.
+
+#define TEXTURE_FILE_MAX_LEVELS 16
+
+struct TextureFile {
+    u8* data; // the whole file
+    u64 size;
+
+    WGPUTextureFormat format;
+    u32 width;
+    u32 height;
+    u32 layers; // array layers times faces
+    u32 faces;  // 6 for cube maps, else 1
+    u32 levelCount;
+    bool topRowFirst; // after load(): couldn't be flipped, see above
+
+    // image (level, layer) starts at levelOffsets[level] + layer *
+    // layerStrides[level]. KTX2 stores level by level, DDS layer by layer
+    u64 levelOffsets[TEXTURE_FILE_MAX_LEVELS];
+    u64 layerStrides[TEXTURE_FILE_MAX_LEVELS];
+
+    const char* error; // why load() failed, static string
+
+    /// @brief Read and parse a .ktx2 or .dds file. Thread safe
+    static bool load(TextureFile* file, const char* filename);
+    /// @brief By extension
+    static bool isTextureFile(const char* filename);
+
+    /// @brief The device can sample the format (compression feature enabled)
+    static bool formatSupported(GraphicsContext* ctx, WGPUTextureFormat format);
+
+    /// @brief Size of one layer of level, in bytes
+    static u64 imageBytes(const TextureFile* file, u32 level);
+    static const u8* image(const TextureFile* file, u32 level, u32 layer);
+
+    /// @brief wgpuQueueWriteTexture for every level and layer
+    static void upload(GraphicsContext* ctx, const TextureFile* file,
+                       WGPUTexture texture);
+
+    static void release(TextureFile* file);
+};
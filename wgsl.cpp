@@ -0,0 +1,757 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "core/log.h"
+#include "hash.h"
+#include "memory.h"
+#include "shaders.h"
+#include "wgsl.h"
+
+// ============================================================================
+// String builder
+// ============================================================================
+
+struct StringBuilder {
+    char* data;
+    u64 length;
+    u64 capacity;
+};
+
+static void append(StringBuilder* sb, const char* str, u64 length)
+{
+    if (sb->length + length + 1 > sb->capacity) {
+        u64 newCapacity = MAX(sb->capacity * 2, sb->length + length + 1);
+        newCapacity     = MAX(newCapacity, 1024);
+        sb->data = (char*)reallocate(sb->data, sb->capacity, newCapacity);
+        sb->capacity = newCapacity;
+    }
+    memcpy(sb->data + sb->length, str, length);
+    sb->length += length;
+    sb->data[sb->length] = '\0';
+}
+
+// ============================================================================
+// Registry
+// ============================================================================
+
+struct ShaderInclude {
+    const char* name;
+    const char* source;
+};
+
+static ShaderInclude includes[WGSL_MAX_INCLUDES];
+static u32 includeCount = 0;
+
+// permutation key -> char*
+static HashMap permutations = {};
+
+static const ShaderDefine builtinDefines[] = {
+    { "PER_FRAME_GROUP", CODE(PER_FRAME_GROUP) },
+    { "PER_MATERIAL_GROUP", CODE(PER_MATERIAL_GROUP) },
+    { "PER_DRAW_GROUP", CODE(PER_DRAW_GROUP) },
+    { "LIGHTING_GROUP", CODE(LIGHTING_GROUP) },
+};
+
+static void registerBuiltinIncludes()
+{
+    if (includeCount > 0) return;
+    ShaderPreprocessor::addInclude("frame.wgsl", frameShaderInclude);
+    ShaderPreprocessor::addInclude("material.wgsl", materialShaderInclude);
+    ShaderPreprocessor::addInclude("vertex.wgsl", vertexShaderInclude);
+    ShaderPreprocessor::addInclude("lighting.wgsl", lightingShaderInclude);
+    ShaderPreprocessor::addInclude("shading.wgsl", shadingShaderInclude);
+}
+
+void ShaderPreprocessor::addInclude(const char* name, const char* source)
+{
+    for (u32 i = 0; i < includeCount; i++) {
+        if (strcmp(includes[i].name, name) == 0) {
+            includes[i].source = source;
+            return;
+        }
+    }
+    ASSERT(includeCount < WGSL_MAX_INCLUDES);
+    includes[includeCount++] = { name, source };
+}
+
+static const char* findInclude(const char* name, u64 nameLength)
+{
+    for (u32 i = 0; i < includeCount; i++) {
+        if (strlen(includes[i].name) == nameLength
+            && strncmp(includes[i].name, name, nameLength) == 0)
+            return includes[i].source;
+    }
+    return NULL;
+}
+
+// ============================================================================
+// Preprocessor
+// ============================================================================
+
+struct Define {
+    char name[64];
+    char value[64];
+};
+
+struct Preprocessor {
+    Define defines[WGSL_MAX_DEFINES];
+    u32 defineCount;
+
+    // included once per run (implicit include guard)
+    const char* included[WGSL_MAX_INCLUDES];
+    u32 includedCount;
+
+    StringBuilder out;
+    bool failed;
+};
+
+static bool isIdentStart(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isIdent(char c)
+{
+    return isIdentStart(c) || (c >= '0' && c <= '9');
+}
+
+static const char* skipSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+static Define* findDefine(Preprocessor* pp, const char* name, u64 length)
+{
+    for (u32 i = 0; i < pp->defineCount; i++) {
+        Define* d = &pp->defines[i];
+        if (strlen(d->name) == length && strncmp(d->name, name, length) == 0)
+            return d;
+    }
+    return NULL;
+}
+
+static void define(Preprocessor* pp, const char* name, u64 nameLength,
+                   const char* value, u64 valueLength)
+{
+    if (nameLength >= sizeof(Define::name)
+        || valueLength >= sizeof(Define::value)) {
+        log_error("wgsl: define '%.*s' too long", (int)nameLength, name);
+        pp->failed = true;
+        return;
+    }
+
+    Define* d = findDefine(pp, name, nameLength);
+    if (!d) {
+        if (pp->defineCount == WGSL_MAX_DEFINES) {
+            log_error("wgsl: too many defines");
+            pp->failed = true;
+            return;
+        }
+        d = &pp->defines[pp->defineCount++];
+    }
+    memcpy(d->name, name, nameLength);
+    d->name[nameLength] = '\0';
+    memcpy(d->value, value, valueLength);
+    d->value[valueLength] = '\0';
+}
+
+static void undefine(Preprocessor* pp, const char* name, u64 length)
+{
+    Define* d = findDefine(pp, name, length);
+    if (d) *d = pp->defines[--pp->defineCount];
+}
+
+// #if expressions ------------------------------------------------------------
+
+struct ExprParser {
+    Preprocessor* pp;
+    const char* p;
+    const char* end;
+    bool error;
+};
+
+static i64 parseOr(ExprParser* e);
+
+static bool accept(ExprParser* e, const char* token)
+{
+    e->p     = skipSpaces(e->p, e->end);
+    u64 len  = strlen(token);
+    if ((u64)(e->end - e->p) < len || strncmp(e->p, token, len) != 0)
+        return false;
+    e->p += len;
+    return true;
+}
+
+static i64 parsePrimary(ExprParser* e)
+{
+    e->p = skipSpaces(e->p, e->end);
+    if (e->p >= e->end) {
+        e->error = true;
+        return 0;
+    }
+
+    if (accept(e, "(")) {
+        i64 value = parseOr(e);
+        if (!accept(e, ")")) e->error = true;
+        return value;
+    }
+
+    if (accept(e, "!")) return !parsePrimary(e);
+
+    if (*e->p >= '0' && *e->p <= '9') {
+        char* numEnd;
+        i64 value = strtoll(e->p, &numEnd, 0);
+        e->p      = numEnd;
+        return value;
+    }
+
+    if (isIdentStart(*e->p)) {
+        const char* name = e->p;
+        while (e->p < e->end && isIdent(*e->p)) e->p++;
+        u64 length = e->p - name;
+
+        if (length == 7 && strncmp(name, "defined", 7) == 0) {
+            bool paren = accept(e, "(");
+            e->p       = skipSpaces(e->p, e->end);
+            const char* arg = e->p;
+            while (e->p < e->end && isIdent(*e->p)) e->p++;
+            bool isDefined = findDefine(e->pp, arg, e->p - arg) != NULL;
+            if (paren && !accept(e, ")")) e->error = true;
+            return isDefined;
+        }
+
+        // undefined identifiers evaluate to 0, like C
+        Define* d = findDefine(e->pp, name, length);
+        if (!d || d->value[0] == '\0') return d ? 1 : 0;
+        return strtoll(d->value, NULL, 0);
+    }
+
+    e->error = true;
+    return 0;
+}
+
+static i64 parseComparison(ExprParser* e)
+{
+    i64 lhs = parsePrimary(e);
+    for (;;) {
+        if (accept(e, "==")) lhs = lhs == parsePrimary(e);
+        else if (accept(e, "!=")) lhs = lhs != parsePrimary(e);
+        else if (accept(e, "<=")) lhs = lhs <= parsePrimary(e);
+        else if (accept(e, ">=")) lhs = lhs >= parsePrimary(e);
+        else if (accept(e, "<")) lhs = lhs < parsePrimary(e);
+        else if (accept(e, ">")) lhs = lhs > parsePrimary(e);
+        else return lhs;
+    }
+}
+
+static i64 parseAnd(ExprParser* e)
+{
+    i64 lhs = parseComparison(e);
+    while (accept(e, "&&")) {
+        i64 rhs = parseComparison(e);
+        lhs     = lhs && rhs;
+    }
+    return lhs;
+}
+
+static i64 parseOr(ExprParser* e)
+{
+    i64 lhs = parseAnd(e);
+    while (accept(e, "||")) {
+        i64 rhs = parseAnd(e);
+        lhs     = lhs || rhs;
+    }
+    return lhs;
+}
+
+static bool evaluate(Preprocessor* pp, const char* p, const char* end)
+{
+    ExprParser e = { pp, p, end, false };
+    i64 value    = parseOr(&e);
+    if (e.error || skipSpaces(e.p, end) != end) {
+        log_error("wgsl: bad #if expression '%.*s'", (int)(end - p), p);
+        pp->failed = true;
+        return false;
+    }
+    return value != 0;
+}
+
+// lines ----------------------------------------------------------------------
+
+/// @brief Append a code line, substituting defines in identifiers. Comments
+/// are copied verbatim
+static void emitLine(Preprocessor* pp, const char* p, const char* end)
+{
+    const char* run = p; // start of pending verbatim text
+    while (p < end) {
+        if (p + 1 < end && p[0] == '/' && p[1] == '/') break;
+
+        if (!isIdentStart(*p)) {
+            p++;
+            continue;
+        }
+
+        const char* name = p;
+        while (p < end && isIdent(*p)) p++;
+        Define* d = findDefine(pp, name, p - name);
+        if (!d) continue;
+
+        append(&pp->out, run, name - run);
+        append(&pp->out, d->value, strlen(d->value));
+        run = p;
+    }
+    append(&pp->out, run, end - run);
+    append(&pp->out, "\n", 1);
+}
+
+struct IfState {
+    bool active;    // current branch emits
+    bool taken;     // some branch of this #if already matched
+    bool parentActive;
+};
+
+static void processSource(Preprocessor* pp, const char* source, u32 depth);
+
+static void processInclude(Preprocessor* pp, const char* p, const char* end,
+                           u32 depth)
+{
+    p = skipSpaces(p, end);
+    if (p >= end || *p != '"') {
+        log_error("wgsl: expected #include \"name\"");
+        pp->failed = true;
+        return;
+    }
+    const char* name = ++p;
+    while (p < end && *p != '"') p++;
+
+    const char* source = findInclude(name, p - name);
+    if (!source) {
+        log_error("wgsl: unknown include '%.*s'", (int)(p - name), name);
+        pp->failed = true;
+        return;
+    }
+
+    for (u32 i = 0; i < pp->includedCount; i++)
+        if (pp->included[i] == source) return;
+    if (pp->includedCount < WGSL_MAX_INCLUDES)
+        pp->included[pp->includedCount++] = source;
+
+    if (depth + 1 >= WGSL_MAX_INCLUDE_DEPTH) {
+        log_error("wgsl: includes nested too deep");
+        pp->failed = true;
+        return;
+    }
+    processSource(pp, source, depth + 1);
+}
+
+static void processSource(Preprocessor* pp, const char* source, u32 depth)
+{
+    IfState ifStack[WGSL_MAX_IF_DEPTH];
+    u32 ifDepth = 0;
+    bool active = true;
+
+    const char* line = source;
+    while (*line && !pp->failed) {
+        const char* end = strchr(line, '\n');
+        if (!end) end = line + strlen(line);
+        const char* next = *end ? end + 1 : end;
+
+        const char* p = skipSpaces(line, end);
+        if (p == end || *p != '#') {
+            if (active) emitLine(pp, line, end);
+            line = next;
+            continue;
+        }
+
+        // directive
+        p++;
+        const char* keyword = p;
+        while (p < end && isIdent(*p)) p++;
+        u64 keywordLength = p - keyword;
+        p                 = skipSpaces(p, end);
+
+#define IS_DIRECTIVE(str)                                                      \
+    (keywordLength == sizeof(str) - 1                                          \
+     && strncmp(keyword, str, keywordLength) == 0)
+
+        // argument: first identifier after the keyword
+        const char* arg = p;
+        while (p < end && isIdent(*p)) p++;
+        u64 argLength = p - arg;
+
+        if (IS_DIRECTIVE("ifdef") || IS_DIRECTIVE("ifndef")
+            || IS_DIRECTIVE("if")) {
+            if (ifDepth == WGSL_MAX_IF_DEPTH) {
+                log_error("wgsl: #if nested too deep");
+                pp->failed = true;
+                break;
+            }
+            bool cond;
+            if (IS_DIRECTIVE("if")) cond = active && evaluate(pp, arg, end);
+            else cond = (findDefine(pp, arg, argLength) != NULL)
+                        == IS_DIRECTIVE("ifdef");
+
+            IfState* state      = &ifStack[ifDepth++];
+            state->parentActive = active;
+            state->active       = active && cond;
+            state->taken        = state->active;
+            active              = state->active;
+        } else if (IS_DIRECTIVE("elif") || IS_DIRECTIVE("else")) {
+            if (ifDepth == 0) {
+                log_error("wgsl: #%.*s without #if", (int)keywordLength,
+                          keyword);
+                pp->failed = true;
+                break;
+            }
+            IfState* state = &ifStack[ifDepth - 1];
+            bool cond      = !state->taken && state->parentActive;
+            if (cond && IS_DIRECTIVE("elif")) cond = evaluate(pp, arg, end);
+            state->active = cond;
+            state->taken  = state->taken || cond;
+            active        = cond;
+        } else if (IS_DIRECTIVE("endif")) {
+            if (ifDepth == 0) {
+                log_error("wgsl: #endif without #if");
+                pp->failed = true;
+                break;
+            }
+            active = ifStack[--ifDepth].parentActive;
+        } else if (!active) {
+            // other directives in inactive branches are ignored
+        } else if (IS_DIRECTIVE("define")) {
+            const char* value    = skipSpaces(p, end);
+            const char* valueEnd = end;
+            while (valueEnd > value
+                   && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'
+                       || valueEnd[-1] == '\r'))
+                valueEnd--;
+            define(pp, arg, argLength, value, valueEnd - value);
+        } else if (IS_DIRECTIVE("undef")) {
+            undefine(pp, arg, argLength);
+        } else if (IS_DIRECTIVE("include")) {
+            processInclude(pp, arg, end, depth);
+        } else {
+            log_error("wgsl: unknown directive #%.*s", (int)keywordLength,
+                      keyword);
+            pp->failed = true;
+        }
+
+#undef IS_DIRECTIVE
+
+        line = next;
+    }
+
+    if (ifDepth != 0 && !pp->failed) {
+        log_error("wgsl: unterminated #if");
+        pp->failed = true;
+    }
+}
+
+char* ShaderPreprocessor::process(const char* source,
+                                  const ShaderDefine* defines, u32 defineCount)
+{
+    registerBuiltinIncludes();
+
+    // large, keep off the stack
+    Preprocessor* pp = ALLOCATE_COUNT(Preprocessor, 1);
+
+    for (u32 i = 0; i < ARRAY_LENGTH(builtinDefines); i++) {
+        const ShaderDefine* d = &builtinDefines[i];
+        define(pp, d->name, strlen(d->name), d->value, strlen(d->value));
+    }
+    for (u32 i = 0; i < defineCount; i++) {
+        const char* value = defines[i].value ? defines[i].value : "";
+        define(pp, defines[i].name, strlen(defines[i].name), value,
+               strlen(value));
+    }
+
+    processSource(pp, source, 0);
+
+    char* result = pp->out.data;
+    if (pp->failed) {
+        FREE_ARRAY(char, result, pp->out.capacity);
+    } else if (!result) {
+        result = ALLOCATE_COUNT(char, 1); // empty source
+    }
+    FREE(Preprocessor, pp);
+    return result;
+}
+
+void ShaderPreprocessor::freeSource(char* source)
+{
+    // reallocate() ignores the old size when freeing
+    FREE_ARRAY(char, source, 0);
+}
+
+void ShaderPreprocessor::release()
+{
+    for (u32 i = 0; i < permutations.capacity; i++) {
+        if (!HashMap::occupied(&permutations, i)) continue;
+        ShaderPreprocessor::freeSource((char*)permutations.entries[i].value);
+    }
+    HashMap::free(&permutations);
+    includeCount = 0;
+}
+
+// ============================================================================
+// Stripping
+// ============================================================================
+
+static bool isOperator(char c)
+{
+    return c != '\0' && strchr("+-*/%&|^!<>=~", c) != NULL;
+}
+
+/// @brief Drop comments and collapse whitespace. A single space is kept only
+/// where removing it would merge two tokens (identifiers, or operators like
+/// `a - -b`)
+static void minify(StringBuilder* out, const char* p)
+{
+    bool pendingSpace = false;
+    while (*p) {
+        if (p[0] == '/' && p[1] == '/') {
+            while (*p && *p != '\n') p++;
+            pendingSpace = true;
+            continue;
+        }
+        if (p[0] == '/' && p[1] == '*') { // block comments nest in WGSL
+            u32 depth = 0;
+            do {
+                if (p[0] == '/' && p[1] == '*') depth++, p += 2;
+                else if (p[0] == '*' && p[1] == '/') depth--, p += 2;
+                else p++;
+            } while (*p && depth > 0);
+            pendingSpace = true;
+            continue;
+        }
+        if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            pendingSpace = true;
+            p++;
+            continue;
+        }
+
+        if (pendingSpace && out->length > 0) {
+            char last = out->data[out->length - 1];
+            if ((isIdent(last) && isIdent(*p))
+                || (isOperator(last) && isOperator(*p)))
+                append(out, " ", 1);
+        }
+        pendingSpace = false;
+        append(out, p++, 1);
+    }
+}
+
+// one module scope declaration of minified source
+struct Declaration {
+    const char* start;
+    const char* end;
+    const char* name; // NULL for directives (enable, requires, diagnostic)
+    u64 nameLength;
+    bool isEntryPoint;
+    bool keep;
+};
+
+static bool tokenEquals(const char* token, u64 length, const char* str)
+{
+    return strlen(str) == length && strncmp(token, str, length) == 0;
+}
+
+static const char* skipIdent(const char* p, const char* end)
+{
+    while (p < end && isIdent(*p)) p++;
+    return p;
+}
+
+/// @brief Skip a balanced (...) or <...> group starting at p
+static const char* skipGroup(const char* p, const char* end, char open,
+                             char close)
+{
+    i32 depth = 0;
+    do {
+        if (*p == open) depth++;
+        else if (*p == close) depth--;
+        p++;
+    } while (p < end && depth > 0);
+    return p;
+}
+
+static void parseDeclaration(Declaration* decl)
+{
+    const char* p   = decl->start;
+    const char* end = decl->end;
+
+    // attributes
+    while (p < end && *p == '@') {
+        const char* attr = ++p;
+        p                = skipIdent(p, end);
+        u64 attrLength   = p - attr;
+        if (tokenEquals(attr, attrLength, "vertex")
+            || tokenEquals(attr, attrLength, "fragment")
+            || tokenEquals(attr, attrLength, "compute"))
+            decl->isEntryPoint = true;
+        p = skipSpaces(p, end);
+        if (p < end && *p == '(') p = skipGroup(p, end, '(', ')');
+        p = skipSpaces(p, end);
+    }
+
+    const char* keyword = p;
+    p                   = skipIdent(p, end);
+    u64 keywordLength   = p - keyword;
+    if (tokenEquals(keyword, keywordLength, "enable")
+        || tokenEquals(keyword, keywordLength, "requires")
+        || tokenEquals(keyword, keywordLength, "diagnostic")) {
+        decl->keep = true;
+        return;
+    }
+
+    p = skipSpaces(p, end);
+    if (tokenEquals(keyword, keywordLength, "var") && p < end && *p == '<')
+        p = skipSpaces(skipGroup(p, end, '<', '>'), end);
+
+    decl->name       = p;
+    decl->nameLength = skipIdent(p, end) - p;
+}
+
+char* ShaderPreprocessor::strip(const char* source, const char* entryPoint)
+{
+    StringBuilder minified = {};
+    minify(&minified, source);
+    if (!minified.data) return ALLOCATE_COUNT(char, 1); // empty source
+
+    // split into module scope declarations: each ends with a `;` or the `}`
+    // closing its body at brace depth 0
+    Declaration* decls = NULL;
+    u32 declCount = 0, declCapacity = 0;
+
+    const char* p   = minified.data;
+    const char* end = minified.data + minified.length;
+    while (p < end) {
+        const char* start = p;
+        i32 depth         = 0;
+        for (; p < end; p++) {
+            if (*p == '{') depth++;
+            else if (*p == '}' && --depth == 0) break;
+            else if (*p == ';' && depth == 0) break;
+        }
+        if (p < end) p++;
+        const char* declEnd = p;
+        if (p < end && *p == ';') p++; // optional `};` after structs
+        p = skipSpaces(p, end);
+
+        if (start[0] == ';') continue; // stray semicolon
+        if (declCount == declCapacity) {
+            u32 newCapacity = MAX(declCapacity * 2, 32);
+            decls           = (Declaration*)reallocate(
+              decls, declCapacity * sizeof(Declaration),
+              newCapacity * sizeof(Declaration));
+            declCapacity = newCapacity;
+        }
+        Declaration* decl = &decls[declCount++];
+        decl->start       = start;
+        decl->end         = declEnd;
+        parseDeclaration(decl);
+    }
+
+    // roots: the requested entry point (or all of them)
+    bool found = false;
+    for (u32 i = 0; i < declCount; i++) {
+        Declaration* decl = &decls[i];
+        if (!decl->isEntryPoint) continue;
+        if (entryPoint
+            && !tokenEquals(decl->name, decl->nameLength, entryPoint))
+            continue;
+        decl->keep = found = true;
+    }
+
+    char* result = NULL;
+    if (!found) {
+        log_error("wgsl: entry point '%s' not found",
+                  entryPoint ? entryPoint : "(any)");
+    } else {
+        // transitively keep every declaration named by a kept one.
+        // Conservative: a struct member or local shadowing a global name
+        // keeps the global too
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (u32 i = 0; i < declCount; i++) {
+                if (!decls[i].keep) continue;
+                const char* q = decls[i].start;
+                while (q < decls[i].end) {
+                    if (!isIdentStart(*q)) {
+                        // skip numeric literals like 1e3f whole
+                        q = isIdent(*q) ? skipIdent(q, decls[i].end) : q + 1;
+                        continue;
+                    }
+                    const char* ident = q;
+                    q                 = skipIdent(q, decls[i].end);
+                    for (u32 j = 0; j < declCount; j++) {
+                        Declaration* other = &decls[j];
+                        if (other->keep || !other->name
+                            || other->nameLength != (u64)(q - ident)
+                            || strncmp(other->name, ident, q - ident) != 0)
+                            continue;
+                        other->keep = changed = true;
+                    }
+                }
+            }
+        }
+
+        StringBuilder out = {};
+        for (u32 i = 0; i < declCount; i++) {
+            if (!decls[i].keep) continue;
+            append(&out, decls[i].start, decls[i].end - decls[i].start);
+        }
+        result = out.data ? out.data : ALLOCATE_COUNT(char, 1);
+    }
+
+    FREE_ARRAY(Declaration, decls, declCapacity);
+    FREE_ARRAY(char, minified.data, minified.capacity);
+    return result;
+}
+
+// ============================================================================
+// Shader Permutations
+// ============================================================================
+
+const char* shaderPermutation(const char* source, u32 permutation,
+                              const char* entryPoint)
+{
+    ASSERT(permutation < SHADER_PERMUTATION_COUNT);
+
+    u64 key = hashCombine(hashString(source), permutation);
+    if (entryPoint) key = hashString(entryPoint, key);
+    char* result = (char*)HashMap::get(&permutations, key);
+    if (result) return result;
+
+    if (entryPoint) {
+        // stripped from the full permutation, which is cached as well
+        const char* full = shaderPermutation(source, permutation, NULL);
+        if (!full) return NULL;
+        result = ShaderPreprocessor::strip(full, entryPoint);
+        if (!result) return NULL;
+
+        HashMap::put(&permutations, key, result);
+        return result;
+    }
+
+    ShaderDefine defines[5];
+    u32 defineCount = 0;
+    if (permutation & SHADER_PERMUTATION_NO_TEXTURE)
+        defines[defineCount++] = { "NO_TEXTURE", "1" };
+    if (permutation & SHADER_PERMUTATION_NO_LIGHTING)
+        defines[defineCount++] = { "NO_LIGHTING", "1" };
+    if (permutation & SHADER_PERMUTATION_ALPHA_TEST)
+        defines[defineCount++] = { "ALPHA_TEST", "1" };
+    if (permutation & SHADER_PERMUTATION_CLUSTERED_LIGHTING)
+        defines[defineCount++] = { "CLUSTERED_LIGHTING", "1" };
+    if (permutation & SHADER_PERMUTATION_TEXTURE_ARRAY)
+        defines[defineCount++] = { "TEXTURE_ARRAY", "1" };
+
+    result = ShaderPreprocessor::process(source, defines, defineCount);
+    if (!result) return NULL;
+
+    HashMap::put(&permutations, key, result);
+    return result;
+}
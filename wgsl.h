@@ -0,0 +1,84 @@
+#pragma once
+
+#include "common.h"
+
+// ============================================================================
+// WGSL Preprocessor
+// ============================================================================
+
+// A small C-like preprocessor run over WGSL before shader module creation:
+//
+//   #include "name"          registered snippet, each included once
+//   #define NAME [value]     object-like only, substituted in code lines
+//   #undef NAME
+//   #ifdef / #ifndef NAME
+//   #if / #elif EXPR         integers, defined(X), ! && || == != < > <= >=
+//   #else / #endif
+//
+// Shader stage constants that should be tweakable without a new permutation
+// belong in WGSL `override` declarations instead, set per pipeline via
+// WGPUConstantEntry (see RenderPipeline::initPermutation).
+
+#define WGSL_MAX_DEFINES 64
+#define WGSL_MAX_INCLUDES 32
+#define WGSL_MAX_IF_DEPTH 16
+#define WGSL_MAX_INCLUDE_DEPTH 8
+
+struct ShaderDefine {
+    const char* name;
+    const char* value; // NULL or "" for flag style defines
+};
+
+struct ShaderPreprocessor {
+    /// @brief Register a snippet for `#include "name"`. Both strings must
+    /// outlive the preprocessor (string literals). The shaders.h snippets
+    /// are registered automatically.
+    static void addInclude(const char* name, const char* source);
+
+    /// @brief Preprocess source with the given defines on top of the
+    /// built-in ones (PER_FRAME_GROUP, ...).
+    /// @return NUL terminated source, free with freeSource(). NULL on error
+    /// (logged)
+    static char* process(const char* source, const ShaderDefine* defines,
+                         u32 defineCount);
+
+    /// @brief Minify preprocessed source (comments, whitespace) and drop
+    /// every module scope declaration not reachable from entryPoint, so
+    /// each stage gets only its own code. entryPoint NULL keeps all entry
+    /// points. Overrides that become unreachable are dropped too, only pass
+    /// pipeline constants to the stage that uses them.
+    /// @return free with freeSource(). NULL if entryPoint is missing
+    static char* strip(const char* source, const char* entryPoint);
+
+    static void freeSource(char* source);
+
+    /// @brief Drop registered includes and cached permutations
+    static void release();
+};
+
+// ============================================================================
+// Shader Permutations
+// ============================================================================
+
+// Feature switches for the default shaders. Each combination is a separate
+// permutation, preprocessed once and then served from a cache. Since the
+// pipeline cache keys shader modules by source, every permutation is also
+// compiled only once.
+enum ShaderPermutation {
+    SHADER_PERMUTATION_NONE        = 0,
+    SHADER_PERMUTATION_NO_TEXTURE  = 1 << 0, // skip textureSample
+    SHADER_PERMUTATION_NO_LIGHTING = 1 << 1, // unlit, material color only
+    SHADER_PERMUTATION_ALPHA_TEST  = 1 << 2, // discard below alphaCutoff
+    // point lights from ClusteredLighting, adds LIGHTING_GROUP to the layout
+    SHADER_PERMUTATION_CLUSTERED_LIGHTING = 1 << 3,
+    // texture_2d_array material texture (see Texture::initArrayFromFiles)
+    SHADER_PERMUTATION_TEXTURE_ARRAY = 1 << 4,
+    SHADER_PERMUTATION_COUNT         = 1 << 5,
+};
+
+/// @brief Preprocessed source for a permutation (bitmask of
+/// ShaderPermutation) of source, stripped down to entryPoint if given.
+/// Owned by the cache, valid until ShaderPreprocessor::release(). Returns
+/// NULL if preprocessing failed.
+const char* shaderPermutation(const char* source, u32 permutation,
+                              const char* entryPoint = NULL);